@@ -0,0 +1,205 @@
+#include "lib/array.hpp"
+#include "lib/simd.hpp"
+#include "lib/bigint.hpp"
+#include "lib/stats.hpp"
+#include "lib/limits.hpp"
+#include "lib/error.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static ArrayObject* allocate_array(ArrayKinds kind, size_t size) {
+    if (size > (static_cast<size_t>(-1) - sizeof(ArrayObject)) / sizeof(double))
+        fail("BUILTINS", "ARRAY_TOO_LARGE", "size = " + std::to_string(size));
+
+    size_t bytes = sizeof(ArrayObject) + size * sizeof(double);
+    heap_require(bytes);
+    ArrayObject* object = static_cast<ArrayObject*>(std::malloc(bytes));
+    if (object == nullptr)
+        fail("BUILTINS", "ARRAY_TOO_LARGE", "size = " + std::to_string(size));
+    heap_allocated(bytes);
+    BASK_COUNT(count_allocation(bytes));
+    object->refs = 1;
+    object->type = ObjectTypes::ARRAY;
+    object->immortal = false;
+    object->frozen = false;
+    object->kind = kind;
+    object->size = size;
+    return object;
+}
+
+Value new_array(ArrayKinds kind, size_t size) {
+    ArrayObject* object = allocate_array(kind, size);
+    std::memset(object->ints(), 0, size * sizeof(double));
+    return Value::array(object);
+}
+
+Value copy_array(const ArrayObject* array) {
+    ArrayObject* object = allocate_array(array->kind, array->size);
+    std::memcpy(object->ints(), array->ints(), array->size * sizeof(double));
+    return Value::array(object);
+}
+
+static size_t check_index(const ArrayObject* array, long index) {
+    if (index < 0 || static_cast<size_t>(index) >= array->size)
+        fail("BUILTINS", "INDEX_OUT_OF_RANGE",
+            "index = " + std::to_string(index) + ", size = " + std::to_string(array->size));
+    return static_cast<size_t>(index);
+}
+
+Value array_get(ArrayObject* array, long index) {
+    size_t i = check_index(array, index);
+    if (array->kind == ArrayKinds::INT)
+        return Value::integer(array->ints()[i]);
+    return Value::floating(array->floats()[i]);
+}
+
+static bool is_number(const Value& value) {
+    return is_integer(value) || value.type == ValueTypes::FLOAT;
+}
+
+static double to_double(const Value& value) {
+    return value.type == ValueTypes::FLOAT ? value.float_value : big_to_double(value);
+}
+
+void array_set(ArrayObject* array, long index, const Value& value) {
+    size_t i = check_index(array, index);
+    if (array->kind == ArrayKinds::INT) {
+        if (value.type != ValueTypes::INT)
+            fail("BUILTINS", "ARRAY_ELEMENT_TYPE", "an int array only holds ints");
+        array->ints()[i] = value.int_value;
+    } else {
+        if (!is_number(value))
+            fail("BUILTINS", "ARRAY_ELEMENT_TYPE", "a float array only holds numbers");
+        array->floats()[i] = to_double(value);
+    }
+}
+
+static void check_sizes(const ArrayObject* left, const ArrayObject* right) {
+    if (left->size != right->size)
+        fail("BUILTINS", "ARRAY_SIZE_MISMATCH",
+            "sizes = " + std::to_string(left->size) + ", " + std::to_string(right->size));
+}
+
+// the elements as doubles, converted into storage when they are ints
+static const double* floats_of(ArrayObject* array, std::vector<double>& storage) {
+    if (array->kind == ArrayKinds::FLOAT)
+        return array->floats();
+    storage.assign(array->ints(), array->ints() + array->size);
+    return storage.data();
+}
+
+static void divide_ints(const long* a, const long* b, long* out, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (b[i] == 0)
+            fail("BUILTINS", "DIVISION_BY_ZERO", "index = " + std::to_string(i));
+        // LONG_MIN / -1 wraps to LONG_MIN like the other int kernels
+        out[i] = b[i] == -1 ? static_cast<long>(0 - static_cast<unsigned long>(a[i])) : a[i] / b[i];
+    }
+}
+
+Value array_arithmetic(OpCode op, ArrayObject* left, ArrayObject* right) {
+    check_sizes(left, right);
+    const ArrayKernels& kernels = array_kernels();
+    size_t size = left->size;
+
+    if (left->kind == ArrayKinds::INT && right->kind == ArrayKinds::INT) {
+        Value result = new_array(ArrayKinds::INT, size);
+        const long* a = left->ints();
+        const long* b = right->ints();
+        long* out = result.array_value->ints();
+        switch (op) {
+            case OpCode::ADD:
+                kernels.add_ints(a, b, out, size);
+                break;
+            case OpCode::SUB:
+                kernels.sub_ints(a, b, out, size);
+                break;
+            case OpCode::MULT:
+                kernels.mul_ints(a, b, out, size);
+                break;
+            default:
+                // no vector unit divides ints
+                divide_ints(a, b, out, size);
+                break;
+        }
+        return result;
+    }
+
+    std::vector<double> left_storage, right_storage;
+    const double* a = floats_of(left, left_storage);
+    const double* b = floats_of(right, right_storage);
+    Value result = new_array(ArrayKinds::FLOAT, size);
+    double* out = result.array_value->floats();
+    switch (op) {
+        case OpCode::ADD:
+            kernels.add_floats(a, b, out, size);
+            break;
+        case OpCode::SUB:
+            kernels.sub_floats(a, b, out, size);
+            break;
+        case OpCode::MULT:
+            kernels.mul_floats(a, b, out, size);
+            break;
+        default:
+            kernels.div_floats(a, b, out, size);
+            break;
+    }
+    return result;
+}
+
+Value array_sum(ArrayObject* array) {
+    if (array->kind == ArrayKinds::INT)
+        return Value::integer(array_kernels().sum_ints(array->ints(), array->size));
+    return Value::floating(array_kernels().sum_floats(array->floats(), array->size));
+}
+
+Value array_min(ArrayObject* array) {
+    if (array->size == 0)
+        fail("BUILTINS", "EMPTY_ARRAY");
+    if (array->kind == ArrayKinds::INT)
+        return Value::integer(array_kernels().min_ints(array->ints(), array->size));
+    return Value::floating(array_kernels().min_floats(array->floats(), array->size));
+}
+
+Value array_max(ArrayObject* array) {
+    if (array->size == 0)
+        fail("BUILTINS", "EMPTY_ARRAY");
+    if (array->kind == ArrayKinds::INT)
+        return Value::integer(array_kernels().max_ints(array->ints(), array->size));
+    return Value::floating(array_kernels().max_floats(array->floats(), array->size));
+}
+
+Value array_dot(ArrayObject* left, ArrayObject* right) {
+    check_sizes(left, right);
+    if (left->kind == ArrayKinds::INT && right->kind == ArrayKinds::INT)
+        return Value::integer(array_kernels().dot_ints(left->ints(), right->ints(), left->size));
+
+    std::vector<double> left_storage, right_storage;
+    const double* a = floats_of(left, left_storage);
+    const double* b = floats_of(right, right_storage);
+    return Value::floating(array_kernels().dot_floats(a, b, left->size));
+}
+
+Value array_scaled_add(ArrayObject* left, ArrayObject* right, const Value& scale) {
+    check_sizes(left, right);
+    if (!is_number(scale))
+        fail("BUILTINS", "ARGUMENT_TYPE", "function = 'array_scaled_add', argument = 2");
+
+    size_t size = left->size;
+    if (left->kind == ArrayKinds::INT && right->kind == ArrayKinds::INT && scale.type == ValueTypes::INT) {
+        Value result = new_array(ArrayKinds::INT, size);
+        array_kernels().scaled_add_ints(left->ints(), right->ints(), scale.int_value,
+            result.array_value->ints(), size);
+        return result;
+    }
+
+    std::vector<double> left_storage, right_storage;
+    const double* a = floats_of(left, left_storage);
+    const double* b = floats_of(right, right_storage);
+    Value result = new_array(ArrayKinds::FLOAT, size);
+    array_kernels().scaled_add_floats(a, b, to_double(scale), result.array_value->floats(), size);
+    return result;
+}
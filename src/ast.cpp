@@ -1,6 +1,6 @@
 #include "lib/ast.hpp"
+#include "lib/output.hpp"
 
-#include <iostream>
 #include <algorithm>
 
 // NULL
@@ -12,20 +12,23 @@ AstType AstNull::get_type() const {
 }
 
 void AstNull::print() const {
-    std::cout << "null";
+    out() << "null";
 }
 
 // INT
 
-AstInt::AstInt(long value)
-: value(value) {}
+AstInt::AstInt(long value, std::string digits)
+: value(value), digits(std::move(digits)) {}
 
 AstType AstInt::get_type() const {
     return AstType::INT;
 }
 
 void AstInt::print() const {
-    std::cout << "int(" << value << ")";
+    if (digits.empty())
+        out() << "int(" << value << ")";
+    else
+        out() << "int(" << digits << ")";
 }
 
 // FLOAT
@@ -38,7 +41,7 @@ AstType AstFloat::get_type() const {
 }
 
 void AstFloat::print() const {
-    std::cout << "float(" << value << ")";
+    out() << "float(" << value << ")";
 }
 
 // STRING
@@ -51,7 +54,7 @@ AstType AstString::get_type() const {
 }
 
 void AstString::print() const {
-    std::cout << "string(" << value << ")";
+    out() << "string(" << value << ")";
 }
 
 // NAME
@@ -64,7 +67,7 @@ AstType AstName::get_type() const {
 }
 
 void AstName::print() const {
-    std::cout << "name(" << value << ")";
+    out() << "name(" << value << ")";
 }
 
 // UNARY OP
@@ -77,9 +80,9 @@ AstType AstUnaryOp::get_type() const {
 }
 
 void AstUnaryOp::print() const {
-    std::cout << "unary_op(" << static_cast<unsigned short>(type) << ", ";
+    out() << "unary_op(" << static_cast<unsigned short>(type) << ", ";
     value->print();
-    std::cout << ")";
+    out() << ")";
 }
 
 // BINARY OP
@@ -93,11 +96,11 @@ AstType AstBinaryOp::get_type() const {
 }
 
 void AstBinaryOp::print() const {
-    std::cout << "binary_op(" << static_cast<unsigned short>(type) << ", ";
+    out() << "binary_op(" << static_cast<unsigned short>(type) << ", ";
     left->print();
-    std::cout << ", ";
+    out() << ", ";
     right->print();
-    std::cout << ")";
+    out() << ")";
 }
 
 // FUNC CALL
@@ -110,15 +113,70 @@ AstType AstFuncCall::get_type() const {
 }
 
 void AstFuncCall::print() const {
-    std::cout << "func_call(";
+    out() << "func_call(";
     name->print();
-    std::cout << ", [";
+    out() << ", [";
     for (size_t i = 0; i < args.size(); i++) {
         args.at(i)->print();
         if (i != args.size() - 1)
-            std::cout << ", ";
+            out() << ", ";
     }
-    std::cout << "])";
+    out() << "])";
+}
+
+// MAP
+
+AstMap::AstMap(std::vector<std::pair<std::unique_ptr<AstExpr>, std::unique_ptr<AstExpr>>> entries)
+: entries(std::move(entries)) {}
+
+AstType AstMap::get_type() const {
+    return AstType::MAP;
+}
+
+void AstMap::print() const {
+    out() << "map([";
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries.at(i).first->print();
+        out() << ": ";
+        entries.at(i).second->print();
+        if (i != entries.size() - 1)
+            out() << ", ";
+    }
+    out() << "])";
+}
+
+// COMPARISON
+
+AstComparison::AstComparison(ComparisonType type, std::unique_ptr<AstExpr> left, std::unique_ptr<AstExpr> right)
+: type(type), left(std::move(left)), right(std::move(right)) {}
+
+AstType AstComparison::get_type() const {
+    return AstType::COMPARISON;
+}
+
+void AstComparison::print() const {
+    out() << "comparison(" << static_cast<unsigned short>(type) << ", ";
+    left->print();
+    out() << ", ";
+    right->print();
+    out() << ")";
+}
+
+// LOGICAL OP
+
+AstLogicalOp::AstLogicalOp(LogicalOpType type, std::unique_ptr<AstExpr> left, std::unique_ptr<AstExpr> right)
+: type(type), left(std::move(left)), right(std::move(right)) {}
+
+AstType AstLogicalOp::get_type() const {
+    return AstType::LOGICAL_OP;
+}
+
+void AstLogicalOp::print() const {
+    out() << "logical_op(" << static_cast<unsigned short>(type) << ", ";
+    left->print();
+    out() << ", ";
+    right->print();
+    out() << ")";
 }
 
 // CONST DECL
@@ -131,9 +189,9 @@ AstType AstConstDecl::get_type() const {
 }
 
 void AstConstDecl::print() const {
-    std::cout << "const_decl(" << name << ", ";
+    out() << "const_decl(" << name << ", ";
     value->print();
-    std::cout << ")";
+    out() << ")";
 }
 
 // VAR DECL
@@ -146,9 +204,9 @@ AstType AstVarDecl::get_type() const {
 }
 
 void AstVarDecl::print() const {
-    std::cout << "var_decl(" << name << ", ";
+    out() << "var_decl(" << name << ", ";
     value->print();
-    std::cout << ")";
+    out() << ")";
 }
 
 // VAR SET
@@ -161,9 +219,9 @@ AstType AstVarSet::get_type() const {
 }
 
 void AstVarSet::print() const {
-    std::cout << "var_set(" << name << ", ";
+    out() << "var_set(" << name << ", ";
     value->print();
-    std::cout << ")";
+    out() << ")";
 }
 
 // RETURN
@@ -176,9 +234,9 @@ AstType AstReturn::get_type() const {
 }
 
 void AstReturn::print() const {
-    std::cout << "return(";
+    out() << "return(";
     value->print();
-    std::cout << ")";
+    out() << ")";
 }
 
 // NO RETURN EXPR
@@ -191,9 +249,56 @@ AstType AstNoReturnExpr::get_type() const {
 }
 
 void AstNoReturnExpr::print() const {
-    std::cout << "no_return_expr(";
+    out() << "no_return_expr(";
     expr->print();
-    std::cout << ")";
+    out() << ")";
+}
+
+static void print_statements(const std::vector<std::unique_ptr<AstStatement>>& code) {
+    out() << "[";
+    for (size_t i = 0; i < code.size(); i++) {
+        code.at(i)->print();
+        if (i != code.size() - 1)
+            out() << ", ";
+    }
+    out() << "]";
+}
+
+// IF
+
+AstIf::AstIf(std::unique_ptr<AstExpr> condition, std::vector<std::unique_ptr<AstStatement>> code,
+    std::vector<std::unique_ptr<AstStatement>> else_code)
+: condition(std::move(condition)), code(std::move(code)), else_code(std::move(else_code)) {}
+
+AstType AstIf::get_type() const {
+    return AstType::IF;
+}
+
+void AstIf::print() const {
+    out() << "if(";
+    condition->print();
+    out() << ", ";
+    print_statements(code);
+    out() << ", ";
+    print_statements(else_code);
+    out() << ")";
+}
+
+// WHILE
+
+AstWhile::AstWhile(std::unique_ptr<AstExpr> condition, std::vector<std::unique_ptr<AstStatement>> code)
+: condition(std::move(condition)), code(std::move(code)) {}
+
+AstType AstWhile::get_type() const {
+    return AstType::WHILE;
+}
+
+void AstWhile::print() const {
+    out() << "while(";
+    condition->print();
+    out() << ", ";
+    print_statements(code);
+    out() << ")";
 }
 
 // GLOBAL CONST DECL
@@ -206,9 +311,9 @@ AstType AstGlobalConstDecl::get_type() const {
 }
 
 void AstGlobalConstDecl::print() const {
-    std::cout << "global_const_decl(" << name << ", ";
+    out() << "global_const_decl(" << name << ", ";
     value->print();
-    std::cout << ")";
+    out() << ")";
 }
 
 // GLOBAL VAR DECL
@@ -217,45 +322,59 @@ AstGlobalVarDecl::AstGlobalVarDecl(std::string name, std::unique_ptr<AstExpr> va
 : name(std::move(name)), value(std::move(value)) {}
 
 AstType AstGlobalVarDecl::get_type() const {
-    return AstType::GLOBAL_CONST_DECL;
+    return AstType::GLOBAL_VAR_DECL;
 }
 
 void AstGlobalVarDecl::print() const {
-    std::cout << "global_var_decl(" << name << ", ";
+    out() << "global_var_decl(" << name << ", ";
     value->print();
-    std::cout << ")";
+    out() << ")";
 }
 
 // FUNC DECL
 
 AstFuncDecl::AstFuncDecl(std::string name, std::vector<std::unique_ptr<AstVarDecl>> required_args,
-    std::vector<std::unique_ptr<AstVarDecl>> optional_args, std::vector<std::unique_ptr<AstStatement>> code)
-: name(std::move(name)), required_args(std::move(required_args)), optional_args(std::move(optional_args)), code(std::move(code)) {}
+    std::vector<std::unique_ptr<AstVarDecl>> optional_args, std::vector<std::unique_ptr<AstStatement>> code,
+    bool is_async, bool memo)
+: name(std::move(name)), required_args(std::move(required_args)), optional_args(std::move(optional_args)), code(std::move(code)),
+  is_async(is_async), memo(memo) {}
 
 AstType AstFuncDecl::get_type() const {
     return AstType::FUNC_DECL;
 }
 
 void AstFuncDecl::print() const {
-    std::cout << "func_decl(" << name << ", [";
+    out() << (memo ? "memo_" : "") << (is_async ? "async_func_decl(" : "func_decl(") << name << ", [";
     for (size_t i = 0; i < required_args.size(); i++) {
         required_args.at(i)->print();
         if (i != required_args.size() - 1)
-            std::cout << ", ";
+            out() << ", ";
     }
-    std::cout << "], [";
+    out() << "], [";
     for (size_t i = 0; i < optional_args.size(); i++) {
         optional_args.at(i)->print();
         if (i != optional_args.size() - 1)
-            std::cout << ", ";
+            out() << ", ";
     }
-    std::cout << "], [";
+    out() << "], [";
     for (size_t i = 0; i < code.size(); i++) {
         code.at(i)->print();
         if (i != code.size() - 1)
-            std::cout << ", ";
+            out() << ", ";
     }
-    std::cout << "])";
+    out() << "])";
+}
+
+// IMPORT
+
+AstImport::AstImport(std::string path) : path(std::move(path)) {}
+
+AstType AstImport::get_type() const {
+    return AstType::IMPORT;
+}
+
+void AstImport::print() const {
+    out() << "import(" << path << ")";
 }
 
 // PROGRAM
@@ -266,11 +385,11 @@ AstProgram::AstProgram(std::vector<std::unique_ptr<AstDeclaration>> code)
 : code(std::move(code)) {}
 
 void AstProgram::print() const {
-    std::cout << "Program([";
+    out() << "Program([";
     for (size_t i = 0; i < code.size(); i++) {
         code.at(i)->print();
         if (i != code.size() - 1)
-            std::cout << ", ";
+            out() << ", ";
     }
-    std::cout << "])";
+    out() << "])";
 }
\ No newline at end of file
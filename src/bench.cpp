@@ -0,0 +1,337 @@
+#include "lib/lexer.hpp"
+#include "lib/parser.hpp"
+#include "lib/compiler.hpp"
+#include "lib/interpreter.hpp"
+#include "lib/repl.hpp"
+#include "lib/output.hpp"
+#include "lib/simd.hpp"
+#include "lib/error.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Generates bask programs that stress one part of the pipeline each, times
+// every phase on them and writes the results as JSON to stdout.
+//
+// usage: bask_bench [--quick] [--warmup=N] [--repetitions=N] [--filter=name]
+
+class Workload {
+public:
+    std::string name;
+    long size;
+    std::string source;
+
+    Workload(std::string name, long size, std::string source)
+    : name(std::move(name)), size(size), source(std::move(source)) {}
+};
+
+// n global constants and n functions reading them
+static std::string declarations(long n) {
+    std::string source;
+    for (long i = 0; i < n; i++)
+        source += "const c" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+    for (long i = 0; i < n; i++)
+        source += "func f" + std::to_string(i) + "(x) {\n    return x + c" + std::to_string(i) + ";\n}\n";
+    source += "func main() {\n    return f0(1);\n}\n";
+    return source;
+}
+
+// an expression nested depth levels deep, half to the left and half to the
+// right so both the parser and the value stack go deep
+static std::string nesting(long depth) {
+    std::string expr = "1";
+    for (long i = 0; i < depth; i++)
+        expr = (i % 2 == 0) ? "(" + expr + " + x)" : "(x - " + expr + ")";
+    return "func value(x) {\n    return " + expr + ";\n}\nfunc main() {\n    print(value(3), \"\\n\");\n    return 0;\n}\n";
+}
+
+// 2^depth calls through a chain of functions each calling the next twice
+static std::string calls(long depth) {
+    std::string source = "func f0(x) {\n    return x * 3 + 1;\n}\n";
+    for (long i = 1; i <= depth; i++)
+        source += "func f" + std::to_string(i) + "(x) {\n    return f" + std::to_string(i - 1) + "(x) + f"
+            + std::to_string(i - 1) + "(x + 1) / 2;\n}\n";
+    source += "func main() {\n    print(f" + std::to_string(depth) + "(1), \"\\n\");\n    return 0;\n}\n";
+    return source;
+}
+
+// 10^levels lines of output mixing strings, ints and floats
+static std::string strings(long levels) {
+    std::string source = "func s0(n) {\n    print(\"line \", n, \" of the output, at \", n / 3.0, \"\\n\");\n"
+        "    return n + 1;\n}\n";
+    for (long i = 1; i <= levels; i++) {
+        std::string previous = "s" + std::to_string(i - 1);
+        source += "func s" + std::to_string(i) + "(n) {\n";
+        for (int j = 0; j < 10; j++)
+            source += "    n = " + previous + "(n);\n";
+        source += "    return n;\n}\n";
+    }
+    source += "func main() {\n    s" + std::to_string(levels) + "(0);\n    return 0;\n}\n";
+    return source;
+}
+
+// n distinct long strings and n distinct floats in the constant table
+static std::string constants(long n) {
+    std::string source;
+    for (long i = 0; i < n; i++) {
+        source += "const s" + std::to_string(i) + " = \"constant string number " + std::to_string(i)
+            + " long enough not to be stored inline\";\n";
+        source += "const d" + std::to_string(i) + " = " + std::to_string(i) + ".25;\n";
+    }
+    source += "func main() {\n    print(s0, d0, \"\\n\");\n    return 0;\n}\n";
+    return source;
+}
+
+// bulk math over arrays of n ints and n floats
+static std::string arrays(long n) {
+    std::string size = std::to_string(n);
+    return "func main() {\n    const a = array_range(" + size + ");\n"
+        "    const f = array_add(a, array_float(" + size + "));\n"
+        "    const g = array_scaled_add(f, array_mul(f, f), 0.5);\n"
+        "    print(array_sum(g), array_dot(f, g), array_max(array_mul(a, a)), array_min(array_sub(a, a)), \"\\n\");\n"
+        "    return 0;\n}\n";
+}
+
+// 10^levels map inserts through a call tree, then as many lookups
+static std::string maps(long levels) {
+    std::string source = "func insert0(m, n) {\n    map_set(m, n, n);\n    return n + 1;\n}\n"
+        "func lookup0(m, n) {\n    return map_get(m, n) + 1;\n}\n";
+    for (long i = 1; i <= levels; i++)
+        for (const char* name : {"insert", "lookup"}) {
+            std::string previous = name + std::to_string(i - 1);
+            source += "func " + std::string(name) + std::to_string(i) + "(m, n) {\n";
+            for (int j = 0; j < 10; j++)
+                source += "    n = " + previous + "(m, n);\n";
+            source += "    return n;\n}\n";
+        }
+    std::string top = std::to_string(levels);
+    source += "func main() {\n    const m = {};\n    insert" + top + "(m, 0);\n"
+        "    print(map_len(m), \" \", lookup" + top + "(m, 0), \"\\n\");\n    return 0;\n}\n";
+    return source;
+}
+
+// n iterations of a loop with an invariant product and a product of the
+// counter, run by a few calls so compiled code gets a turn
+static std::string loops(long n) {
+    return "func work(n, k) {\n    var i = 0;\n    var total = 0;\n    while (i < n) {\n"
+        "        if (i * 8 > total - k * k || i == 0) {\n            total = total + i * 8;\n        }\n"
+        "        i = i + 1;\n    }\n    return total;\n}\n"
+        "func main() {\n    var calls = 0;\n    var total = 0;\n    while (calls < 4) {\n"
+        "        total = total + work(" + std::to_string(n) + ", calls);\n        calls = calls + 1;\n    }\n"
+        "    print(total, \"\\n\");\n    return 0;\n}\n";
+}
+
+static std::vector<Workload> workloads(bool quick) {
+    std::vector<Workload> result;
+
+    auto add = [&](const char* name, std::string (*generate)(long), std::vector<long> sizes) {
+        if (quick)
+            sizes.resize(2);
+        for (long size : sizes)
+            result.emplace_back(name, size, generate(size));
+    };
+
+    add("declarations", declarations, {100, 1000, 10000});
+    add("nesting", nesting, {50, 200, 800});
+    add("calls", calls, {10, 14, 17});
+    add("strings", strings, {3, 4, 5});
+    add("constants", constants, {100, 1000, 10000});
+    add("arrays", arrays, {10000, 100000, 1000000});
+    add("maps", maps, {3, 4, 5});
+    add("loops", loops, {10000, 100000, 1000000});
+
+    return result;
+}
+
+// nanoseconds taken by each repetition of body, after the warmup runs
+template <typename F>
+static std::vector<long> measure(F body, int warmup, int repetitions) {
+    for (int i = 0; i < warmup; i++)
+        body();
+
+    std::vector<long> samples;
+    for (int i = 0; i < repetitions; i++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        body();
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+
+    return samples;
+}
+
+static void write_phase(Output& output, const char* name, std::vector<long> samples, bool last) {
+    std::sort(samples.begin(), samples.end());
+
+    long total = 0;
+    for (long sample : samples)
+        total += sample;
+
+    output << "        \"" << name << "\": {\"min_ns\": " << samples.front()
+        << ", \"median_ns\": " << samples[samples.size() / 2]
+        << ", \"mean_ns\": " << total / static_cast<long>(samples.size())
+        << ", \"max_ns\": " << samples.back() << "}" << (last ? "\n" : ",\n");
+}
+
+// the ith input of a session, which declares a func and a var and calls
+// an old and a new func every three inputs, or now and then redefines an
+// old func instead of the calls
+static std::string session_input(long i) {
+    std::string n = std::to_string(i / 3);
+    switch (i % 3) {
+        case 0:
+            return "func f" + n + "(x) { return x + " + n + "; }";
+        case 1:
+            return "var v" + n + " = f" + n + "(2)";
+        default:
+            if (i % 30 == 29)
+                return "func f" + std::to_string(i / 9) + "(x) { return x * 2; }";
+            return "f" + n + "(v" + n + ") + f" + std::to_string(i / 6) + "(1)";
+    }
+}
+
+// nanoseconds each of count inputs to one session took
+static std::vector<long> session(long count) {
+    InterpreterOptions options;
+    Session session(options);
+    std::vector<long> samples;
+    for (long i = 0; i < count; i++) {
+        std::string input = session_input(i);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        session.evaluate(input);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+    return samples;
+}
+
+// runs a fresh interpreter over the program, what it prints is thrown away
+static void execute(const Program& program, bool jit) {
+    InterpreterOptions options;
+    options.jit = jit;
+    Interpreter(program, options).run();
+}
+
+// the N of a --name=N option, a decimal count that fits an int
+static bool count_option(const char* option, int& count) {
+    const char* text = std::strchr(option, '=') + 1;
+    char* end;
+    errno = 0;
+    unsigned long long value = std::strtoull(text, &end, 10);
+    if (!std::isdigit(static_cast<unsigned char>(*text)) || *end != '\0' || errno == ERANGE || value > INT_MAX)
+        return false;
+    count = static_cast<int>(value);
+    return true;
+}
+
+int run_bench(int argc, char* argv[]) {
+    bool quick = false;
+    int warmup = 1;
+    int repetitions = 5;
+    std::string filter;
+
+    for (int i = 1; i < argc; i++) {
+        bool valid = true;
+        if (std::strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else if (std::strncmp(argv[i], "--warmup=", 9) == 0)
+            valid = count_option(argv[i], warmup);
+        else if (std::strncmp(argv[i], "--repetitions=", 14) == 0)
+            valid = count_option(argv[i], repetitions);
+        else if (std::strncmp(argv[i], "--filter=", 9) == 0)
+            filter = argv[i] + 9;
+        else
+            valid = false;
+
+        if (!valid) {
+            std::cerr << "usage: bask_bench [--quick] [--warmup=N] [--repetitions=N] [--filter=name]\n";
+            return 1;
+        }
+    }
+
+    if (repetitions < 1) {
+        std::cerr << "ERROR::BENCH::INVALID_REPETITIONS\n";
+        return 1;
+    }
+
+    // programs print into the same buffer the results go to, so stdout is
+    // pointed at /dev/null while they run and the results go out afterwards
+    Output results(dup(STDOUT_FILENO));
+    int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (null < 0 || dup2(null, STDOUT_FILENO) < 0) {
+        std::cerr << "ERROR::BENCH::CANNOT_SILENCE_OUTPUT\n";
+        return 1;
+    }
+
+    results << "{\n  \"warmup\": " << warmup << ",\n  \"repetitions\": " << repetitions
+        << ",\n  \"jit\": " << (BASK_JIT_SUPPORTED ? "true" : "false")
+        << ",\n  \"simd\": \"" << array_kernels().name << "\",\n  \"results\": [";
+
+    bool first = true;
+    for (const Workload& workload : workloads(quick)) {
+        if (!filter.empty() && workload.name != filter)
+            continue;
+
+        std::vector<Token> tokens = tokenize(workload.source);
+        AstProgram ast = parse(tokens);
+        Program program = compile(ast);
+
+        std::vector<long> lexing = measure([&]() { tokenize(workload.source); }, warmup, repetitions);
+        std::vector<long> parsing = measure([&]() { parse(tokens); }, warmup, repetitions);
+        std::vector<long> compiling = measure([&]() { compile(ast); }, warmup, repetitions);
+        std::vector<long> interpreted = measure([&]() { execute(program, false); }, warmup, repetitions);
+        std::vector<long> compiled;
+        if (BASK_JIT_SUPPORTED)
+            compiled = measure([&]() { execute(program, true); }, warmup, repetitions);
+        out().flush();
+
+        results << (first ? "\n" : ",\n");
+        first = false;
+        results << "    {\"workload\": \"" << workload.name << "\", \"size\": " << workload.size
+            << ", \"source_bytes\": " << static_cast<long>(workload.source.size())
+            << ", \"tokens\": " << static_cast<long>(tokens.size()) << ",\n      \"phases\": {\n";
+        write_phase(results, "tokenize", lexing, false);
+        write_phase(results, "parse", parsing, false);
+        write_phase(results, "compile", compiling, false);
+        write_phase(results, "execute_interpreter", interpreted, !BASK_JIT_SUPPORTED);
+        if (BASK_JIT_SUPPORTED)
+            write_phase(results, "execute_jit", compiled, true);
+        results << "      }}";
+    }
+
+    results << "\n  ]";
+
+    // the first and last tenth of the inputs should take about as long
+    if (filter.empty() || filter == "session") {
+        long count = quick ? 1000 : 10000;
+        std::vector<long> samples = session(count);
+        results << ",\n  \"session\": {\"inputs\": " << count << ",\n      \"phases\": {\n";
+        write_phase(results, "first_inputs", std::vector<long>(samples.begin(), samples.begin() + count / 10), false);
+        write_phase(results, "last_inputs", std::vector<long>(samples.end() - count / 10, samples.end()), true);
+        results << "      }}";
+    }
+
+    results << "\n}\n";
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        return run_bench(argc, argv);
+    } catch (const BaskError& error) {
+        out().flush();
+        std::cerr << error.what();
+        return 1;
+    }
+}
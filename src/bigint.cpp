@@ -0,0 +1,359 @@
+#include "lib/bigint.hpp"
+#include "lib/stats.hpp"
+#include "lib/limits.hpp"
+#include "lib/error.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <vector>
+
+typedef std::vector<uint32_t> Limbs;
+
+static const uint32_t DECIMAL_CHUNK = 1000000000;
+static const size_t DECIMAL_CHUNK_DIGITS = 9;
+
+static void trim(Limbs& limbs) {
+    while (!limbs.empty() && limbs.back() == 0)
+        limbs.pop_back();
+}
+
+static Limbs magnitude(const Value& value, bool& negative) {
+    if (value.type == ValueTypes::BIG_INT) {
+        negative = value.big_value->negative;
+        return Limbs(value.big_value->limbs(), value.big_value->limbs() + value.big_value->size);
+    }
+
+    negative = value.int_value < 0;
+    // negated as unsigned so LONG_MIN has a magnitude too
+    unsigned long bits = negative ? 0 - static_cast<unsigned long>(value.int_value)
+        : static_cast<unsigned long>(value.int_value);
+
+    Limbs limbs;
+    for (; bits != 0; bits >>= 32)
+        limbs.push_back(static_cast<uint32_t>(bits));
+    return limbs;
+}
+
+static Value make(bool negative, Limbs limbs) {
+    trim(limbs);
+    return big_int(negative, limbs.data(), limbs.size());
+}
+
+Value big_int(bool negative, const uint32_t* limbs, size_t size) {
+    while (size > 0 && limbs[size - 1] == 0)
+        size--;
+
+    if (size <= 2) {
+        unsigned long bits = 0;
+        for (size_t i = size; i > 0; i--)
+            bits = (bits << 32) | limbs[i - 1];
+        if (!negative && bits <= static_cast<unsigned long>(LONG_MAX))
+            return Value::integer(static_cast<long>(bits));
+        if (negative && bits <= static_cast<unsigned long>(LONG_MAX) + 1)
+            return Value::integer(static_cast<long>(0 - bits));
+    }
+
+    size_t bytes = sizeof(BigIntObject) + size * sizeof(uint32_t);
+    heap_allocated(bytes);
+    BigIntObject* object = static_cast<BigIntObject*>(std::malloc(bytes));
+    BASK_COUNT(count_allocation(bytes));
+    object->refs = 1;
+    object->type = ObjectTypes::BIG_INT;
+    object->immortal = false;
+    object->frozen = false;
+    object->negative = negative;
+    object->size = size;
+    std::copy(limbs, limbs + size, object->limbs());
+    return Value::big(object);
+}
+
+static int compare(const Limbs& a, const Limbs& b) {
+    if (a.size() != b.size())
+        return a.size() < b.size() ? -1 : 1;
+    for (size_t i = a.size(); i > 0; i--)
+        if (a[i - 1] != b[i - 1])
+            return a[i - 1] < b[i - 1] ? -1 : 1;
+    return 0;
+}
+
+// a + b, shifted left by shift limbs, into result which is long enough
+static void add_into(Limbs& result, const uint32_t* b, size_t size, size_t shift) {
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < size; i++) {
+        carry += static_cast<uint64_t>(result[i + shift]) + b[i];
+        result[i + shift] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    for (; carry != 0; i++) {
+        carry += result[i + shift];
+        result[i + shift] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+}
+
+// a -= b where a >= b
+static void subtract_from(Limbs& a, const Limbs& b) {
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        int64_t difference = static_cast<int64_t>(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = difference < 0;
+        a[i] = static_cast<uint32_t>(difference + (borrow << 32));
+    }
+    trim(a);
+}
+
+static Limbs add(const Limbs& a, const Limbs& b) {
+    Limbs result(std::max(a.size(), b.size()) + 1, 0);
+    std::copy(a.begin(), a.end(), result.begin());
+    add_into(result, b.data(), b.size(), 0);
+    trim(result);
+    return result;
+}
+
+static Limbs multiply(const uint32_t* a, size_t n, const uint32_t* b, size_t m);
+
+static Limbs schoolbook(const uint32_t* a, size_t n, const uint32_t* b, size_t m) {
+    Limbs result(n + m, 0);
+    for (size_t i = 0; i < n; i++) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < m; j++) {
+            carry += static_cast<uint64_t>(a[i]) * b[j] + result[i + j];
+            result[i + j] = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        result[i + m] = static_cast<uint32_t>(carry);
+    }
+    trim(result);
+    return result;
+}
+
+// a0 + a1 B^h times b0 + b1 B^h in three half size products
+static Limbs karatsuba(const uint32_t* a, size_t n, const uint32_t* b, size_t m) {
+    size_t h = std::max(n, m) / 2;
+
+    Limbs a0(a, a + h), a1(a + h, a + n), b0(b, b + h), b1(b + h, b + m);
+    trim(a0);
+    trim(b0);
+
+    Limbs z0 = multiply(a0.data(), a0.size(), b0.data(), b0.size());
+    Limbs z2 = multiply(a1.data(), a1.size(), b1.data(), b1.size());
+    Limbs sa = add(a0, a1), sb = add(b0, b1);
+    Limbs z1 = multiply(sa.data(), sa.size(), sb.data(), sb.size());
+    subtract_from(z1, z0);
+    subtract_from(z1, z2);
+
+    Limbs result(n + m + 1, 0);
+    add_into(result, z0.data(), z0.size(), 0);
+    add_into(result, z1.data(), z1.size(), h);
+    add_into(result, z2.data(), z2.size(), 2 * h);
+    trim(result);
+    return result;
+}
+
+static Limbs multiply(const uint32_t* a, size_t n, const uint32_t* b, size_t m) {
+    if (n == 0 || m == 0)
+        return Limbs();
+    // lopsided products would split into mostly empty halves
+    if (n < KARATSUBA_THRESHOLD || m < KARATSUBA_THRESHOLD || n > 2 * m || m > 2 * n)
+        return schoolbook(a, n, b, m);
+    return karatsuba(a, n, b, m);
+}
+
+// a / d for a single limb d, the remainder is returned
+static uint32_t divide_small(Limbs& a, uint32_t d) {
+    uint64_t remainder = 0;
+    for (size_t i = a.size(); i > 0; i--) {
+        uint64_t current = (remainder << 32) | a[i - 1];
+        a[i - 1] = static_cast<uint32_t>(current / d);
+        remainder = current % d;
+    }
+    trim(a);
+    return static_cast<uint32_t>(remainder);
+}
+
+// a shifted left by shift < 32 bits, one limb longer
+static Limbs shift_left(const Limbs& a, int shift) {
+    Limbs result(a.size() + 1, 0);
+    for (size_t i = 0; i < a.size(); i++) {
+        uint64_t bits = static_cast<uint64_t>(a[i]) << shift;
+        result[i] |= static_cast<uint32_t>(bits);
+        result[i + 1] = static_cast<uint32_t>(bits >> 32);
+    }
+    return result;
+}
+
+// Knuth's algorithm D, the quotient of a / b for b of two limbs or more
+static Limbs divide(const Limbs& a, const Limbs& b) {
+    if (compare(a, b) < 0)
+        return Limbs();
+
+    size_t n = b.size();
+    size_t m = a.size() - n;
+
+    // normalized so the top limb of the divisor has its high bit set
+    int shift = __builtin_clz(b.back());
+    Limbs v = shift_left(b, shift);
+    v.pop_back();
+    Limbs u = shift_left(a, shift);
+
+    Limbs q(m + 1, 0);
+    const uint64_t base = 1ULL << 32;
+
+    for (size_t j = m + 1; j > 0; j--) {
+        size_t k = j - 1;
+        uint64_t top = (static_cast<uint64_t>(u[k + n]) << 32) | u[k + n - 1];
+        uint64_t qhat = top / v[n - 1];
+        uint64_t rhat = top % v[n - 1];
+
+        while (qhat >= base || qhat * v[n - 2] > ((rhat << 32) | u[k + n - 2])) {
+            qhat--;
+            rhat += v[n - 1];
+            if (rhat >= base)
+                break;
+        }
+
+        // u[k .. k + n] -= qhat * v
+        int64_t borrow = 0;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t product = qhat * v[i] + carry;
+            carry = product >> 32;
+            int64_t difference = static_cast<int64_t>(u[i + k]) - borrow - static_cast<int64_t>(product & 0xFFFFFFFF);
+            u[i + k] = static_cast<uint32_t>(difference);
+            borrow = difference < 0 ? 1 : 0;
+        }
+        int64_t difference = static_cast<int64_t>(u[k + n]) - borrow - static_cast<int64_t>(carry);
+        u[k + n] = static_cast<uint32_t>(difference);
+
+        // qhat was one too big, add the divisor back
+        if (difference < 0) {
+            qhat--;
+            uint64_t sum = 0;
+            for (size_t i = 0; i < n; i++) {
+                sum += static_cast<uint64_t>(u[i + k]) + v[i];
+                u[i + k] = static_cast<uint32_t>(sum);
+                sum >>= 32;
+            }
+            u[k + n] += static_cast<uint32_t>(sum);
+        }
+
+        q[k] = static_cast<uint32_t>(qhat);
+    }
+
+    trim(q);
+    return q;
+}
+
+Value big_arithmetic(OpCode op, const Value& left, const Value& right) {
+    bool a_negative, b_negative;
+    Limbs a = magnitude(left, a_negative);
+    Limbs b = magnitude(right, b_negative);
+
+    switch (op) {
+        case OpCode::SUB:
+            b_negative = !b_negative;
+            // a - b is a + (-b)
+            // fall through
+        case OpCode::ADD: {
+            if (a_negative == b_negative)
+                return make(a_negative, add(a, b));
+            if (compare(a, b) >= 0) {
+                subtract_from(a, b);
+                return make(a_negative, a);
+            }
+            subtract_from(b, a);
+            return make(b_negative, b);
+        }
+        case OpCode::MULT:
+            return make(a_negative != b_negative, multiply(a.data(), a.size(), b.data(), b.size()));
+        default: {
+            if (b.empty())
+                fail("INTERPRETER", "DIVISION_BY_ZERO");
+            if (b.size() == 1) {
+                divide_small(a, b[0]);
+                return make(a_negative != b_negative, a);
+            }
+            return make(a_negative != b_negative, divide(a, b));
+        }
+    }
+}
+
+int big_compare(const Value& left, const Value& right) {
+    bool left_negative;
+    bool right_negative;
+    Limbs a = magnitude(left, left_negative);
+    Limbs b = magnitude(right, right_negative);
+
+    if (left_negative != right_negative)
+        return left_negative ? -1 : 1;
+    int order = compare(a, b);
+    return left_negative ? -order : order;
+}
+
+Value big_negate(const Value& value) {
+    bool negative;
+    Limbs limbs = magnitude(value, negative);
+    return make(!negative, limbs);
+}
+
+double big_to_double(const Value& value) {
+    if (value.type == ValueTypes::INT)
+        return static_cast<double>(value.int_value);
+
+    const BigIntObject* big = value.big_value;
+    double result = 0;
+    for (size_t i = big->size; i > 0; i--)
+        result = result * 4294967296.0 + big->limbs()[i - 1];
+    return big->negative ? -result : result;
+}
+
+Value parse_integer(const std::string& digits) {
+    Limbs limbs;
+    size_t first = digits.size() % DECIMAL_CHUNK_DIGITS;
+    if (first == 0)
+        first = DECIMAL_CHUNK_DIGITS;
+
+    for (size_t start = 0; start < digits.size(); ) {
+        size_t length = start == 0 ? first : DECIMAL_CHUNK_DIGITS;
+        uint64_t carry = std::stoul(digits.substr(start, length));
+        uint64_t scale = 1;
+        for (size_t i = 0; i < length; i++)
+            scale *= 10;
+
+        for (uint32_t& limb : limbs) {
+            carry += static_cast<uint64_t>(limb) * scale;
+            limb = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        if (carry != 0)
+            limbs.push_back(static_cast<uint32_t>(carry));
+
+        start += length;
+    }
+
+    return make(false, limbs);
+}
+
+std::string big_to_string(const Value& value) {
+    if (value.type == ValueTypes::INT)
+        return std::to_string(value.int_value);
+
+    bool negative;
+    Limbs limbs = magnitude(value, negative);
+
+    // nine digits at a time, least significant first
+    std::vector<uint32_t> chunks;
+    while (!limbs.empty())
+        chunks.push_back(divide_small(limbs, DECIMAL_CHUNK));
+
+    std::string result = negative ? "-" : "";
+    result += std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i > 0; i--) {
+        std::string chunk = std::to_string(chunks[i - 1]);
+        result.append(DECIMAL_CHUNK_DIGITS - chunk.size(), '0');
+        result += chunk;
+    }
+    return result;
+}
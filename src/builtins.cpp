@@ -0,0 +1,244 @@
+#include "lib/builtins.hpp"
+#include "lib/interpreter.hpp"
+#include "lib/output.hpp"
+#include "lib/bigint.hpp"
+#include "lib/array.hpp"
+#include "lib/map.hpp"
+#include "lib/error.hpp"
+
+void print_value(Output& output, const Value& value) {
+    switch (value.type) {
+        case ValueTypes::_NULL:
+            output << "null";
+            break;
+        case ValueTypes::INT:
+            output.write_int(value.int_value);
+            break;
+        case ValueTypes::FLOAT:
+            output.write_double(value.float_value);
+            break;
+        case ValueTypes::STRING:
+            write_string(output, value);
+            break;
+        case ValueTypes::FUNC:
+            output << "<func>";
+            break;
+        case ValueTypes::NATIVE_FUNC:
+            output << "<native func>";
+            break;
+        case ValueTypes::BIG_INT:
+            output << big_to_string(value);
+            break;
+        case ValueTypes::ARRAY: {
+            const ArrayObject* array = value.array_value;
+            output << "[";
+            for (size_t i = 0; i < array->size; i++) {
+                if (i != 0)
+                    output << ", ";
+                if (array->kind == ArrayKinds::INT)
+                    output.write_int(array->ints()[i]);
+                else
+                    output.write_double(array->floats()[i]);
+            }
+            output << "]";
+            break;
+        }
+        case ValueTypes::MAP: {
+            output << "{";
+            bool first = true;
+            map_for_each(value.map_value, [&output, &first](const Value& key, const Value& value) {
+                if (!first)
+                    output << ", ";
+                first = false;
+                print_value(output, key);
+                output << ": ";
+                print_value(output, value);
+            });
+            output << "}";
+            break;
+        }
+    }
+}
+
+namespace build_in_functions {
+    Value print(const Value* args, size_t count) {
+        Output& output = out();
+        std::lock_guard<std::mutex> guard(output.lock);
+        for (size_t i = 0; i < count; i++)
+            print_value(output, args[i]);
+        return Value();
+    }
+
+    void flush() {
+        Output& output = out();
+        std::lock_guard<std::mutex> guard(output.lock);
+        output.flush();
+    }
+
+    long three() {
+        return 3;
+    }
+
+    long exitf(long code) {
+        throw ScriptExit(static_cast<int>(code));
+    }
+
+    Value spawn(const Value* args, size_t count) {
+        return Value::integer(Interpreter::current().tasks().spawn(args[0], args + 1, count - 1));
+    }
+
+    Value join(long handle) {
+        return Interpreter::current().tasks().join(handle);
+    }
+
+    Value parallel_map(const Value& function, long count) {
+        return Interpreter::current().tasks().parallel_map(function, count);
+    }
+
+    long sleep_async(long milliseconds) {
+        return Interpreter::current().events().sleep(milliseconds);
+    }
+
+    long read_file_async(const char* path) {
+        return Interpreter::current().events().read_file(path);
+    }
+
+    static size_t array_size(long size) {
+        if (size < 0)
+            fail("BUILTINS", "INVALID_SIZE", "size = " + std::to_string(size));
+        return static_cast<size_t>(size);
+    }
+
+    Value array_int(long size) {
+        return new_array(ArrayKinds::INT, array_size(size));
+    }
+
+    Value array_float(long size) {
+        return new_array(ArrayKinds::FLOAT, array_size(size));
+    }
+
+    Value array_range(long size) {
+        Value result = new_array(ArrayKinds::INT, array_size(size));
+        for (long i = 0; i < size; i++)
+            result.array_value->ints()[i] = i;
+        return result;
+    }
+
+    long array_len(ArrayObject* array) {
+        return static_cast<long>(array->size);
+    }
+
+    Value array_get(ArrayObject* array, long index) {
+        return ::array_get(array, index);
+    }
+
+    void array_set(ArrayObject* array, long index, const Value& value) {
+        if (array->frozen)
+            fail("BUILTINS", "CONST_GLOBAL_IN_TASK");
+        ::array_set(array, index, value);
+    }
+
+    Value array_add(ArrayObject* left, ArrayObject* right) {
+        return array_arithmetic(OpCode::ADD, left, right);
+    }
+
+    Value array_sub(ArrayObject* left, ArrayObject* right) {
+        return array_arithmetic(OpCode::SUB, left, right);
+    }
+
+    Value array_mul(ArrayObject* left, ArrayObject* right) {
+        return array_arithmetic(OpCode::MULT, left, right);
+    }
+
+    Value array_div(ArrayObject* left, ArrayObject* right) {
+        return array_arithmetic(OpCode::DIV, left, right);
+    }
+
+    Value array_sum(ArrayObject* array) {
+        return ::array_sum(array);
+    }
+
+    Value array_min(ArrayObject* array) {
+        return ::array_min(array);
+    }
+
+    Value array_max(ArrayObject* array) {
+        return ::array_max(array);
+    }
+
+    Value array_dot(ArrayObject* left, ArrayObject* right) {
+        return ::array_dot(left, right);
+    }
+
+    Value array_scaled_add(ArrayObject* left, ArrayObject* right, const Value& scale) {
+        return ::array_scaled_add(left, right, scale);
+    }
+
+    Value map_get(MapObject* map, const Value& key) {
+        const Value* value = map_find(map, key);
+        return value != nullptr ? *value : Value();
+    }
+
+    bool map_has(MapObject* map, const Value& key) {
+        return map_find(map, key) != nullptr;
+    }
+
+    void map_set(MapObject* map, const Value& key, const Value& value) {
+        if (map->frozen)
+            fail("BUILTINS", "CONST_GLOBAL_IN_TASK");
+        ::map_set(map, key, value);
+    }
+
+    bool map_remove(MapObject* map, const Value& key) {
+        if (map->frozen)
+            fail("BUILTINS", "CONST_GLOBAL_IN_TASK");
+        return ::map_remove(map, key);
+    }
+
+    long map_len(MapObject* map) {
+        return static_cast<long>(map->size);
+    }
+}
+
+void native_type_error(const Native& native, size_t index) {
+    fail("BUILTINS", "ARGUMENT_TYPE", "function = '" + native.name + "', argument = " + std::to_string(index));
+}
+
+static NativeTable make_default_natives() {
+    NativeTable natives;
+    natives.bind_raw("print", build_in_functions::print);
+    natives.bind("flush", build_in_functions::flush);
+    natives.bind("three", build_in_functions::three, true);
+    natives.bind("exit", build_in_functions::exitf);
+    natives.bind_raw("spawn", build_in_functions::spawn, 1);
+    natives.bind("join", build_in_functions::join);
+    natives.bind("parallel_map", build_in_functions::parallel_map);
+    natives.bind("sleep_async", build_in_functions::sleep_async);
+    natives.bind("read_file_async", build_in_functions::read_file_async);
+    natives.bind("array_int", build_in_functions::array_int, true);
+    natives.bind("array_float", build_in_functions::array_float, true);
+    natives.bind("array_range", build_in_functions::array_range, true);
+    natives.bind("array_len", build_in_functions::array_len, true);
+    natives.bind("array_get", build_in_functions::array_get, true);
+    natives.bind("array_set", build_in_functions::array_set, true);
+    natives.bind("array_add", build_in_functions::array_add, true);
+    natives.bind("array_sub", build_in_functions::array_sub, true);
+    natives.bind("array_mul", build_in_functions::array_mul, true);
+    natives.bind("array_div", build_in_functions::array_div, true);
+    natives.bind("array_sum", build_in_functions::array_sum, true);
+    natives.bind("array_min", build_in_functions::array_min, true);
+    natives.bind("array_max", build_in_functions::array_max, true);
+    natives.bind("array_dot", build_in_functions::array_dot, true);
+    natives.bind("array_scaled_add", build_in_functions::array_scaled_add, true);
+    natives.bind("map_get", build_in_functions::map_get, true);
+    natives.bind("map_has", build_in_functions::map_has, true);
+    natives.bind("map_set", build_in_functions::map_set, true);
+    natives.bind("map_remove", build_in_functions::map_remove, true);
+    natives.bind("map_len", build_in_functions::map_len, true);
+    return natives;
+}
+
+const NativeTable& default_natives() {
+    static const NativeTable natives = make_default_natives();
+    return natives;
+}
@@ -0,0 +1,378 @@
+#include "lib/c_backend.hpp"
+#include "lib/error.hpp"
+
+#include <sstream>
+
+// the natives src/runtime/bask_runtime.c has a bask_builtin_ for, arrays,
+// maps and the event loop are not there
+static const std::unordered_set<std::string> RUNTIME_NATIVES = {
+    "print", "three", "exit", "spawn", "join", "parallel_map",
+};
+
+CBackend::CBackend(const AstProgram& ast, std::ostream& out)
+: ast(ast), out(out), temps(0) {}
+
+std::string CBackend::temp() {
+    return "t" + std::to_string(temps++);
+}
+
+std::string CBackend::escape(const std::string& value) const {
+    std::stringstream buf;
+    buf << "\"";
+    for (unsigned char c : value) {
+        if (c == '"' || c == '\\') {
+            buf << '\\' << c;
+        } else if (c == '\n') {
+            buf << "\\n";
+        } else if (c < 32 || c > 126) {
+            // three octal digits so a following digit cannot extend it
+            buf << '\\' << static_cast<char>('0' + (c >> 6)) << static_cast<char>('0' + ((c >> 3) & 7))
+                << static_cast<char>('0' + (c & 7));
+        } else {
+            buf << c;
+        }
+    }
+    buf << "\"";
+    return buf.str();
+}
+
+// EXPRESSIONS
+
+std::string CBackend::compile_name(const std::string& name) {
+    if (locals.find(name) != locals.end())
+        return "l_" + name;
+
+    if (functions.find(name) != functions.end())
+        return "bask_func(&fd_" + name + ")";
+
+    if (globals.find(name) != globals.end()) {
+        // globals are read into a temporary, a later call may change them
+        std::string result = temp();
+        out << "    bask_value " << result << " = g_" << name << ";\n";
+        return result;
+    }
+
+    if (RUNTIME_NATIVES.count(name) == 0)
+        fail("C_BACKEND", "NATIVE_NOT_SUPPORTED", "name = '" + name + "'");
+    return "bask_func(&bask_builtin_" + name + ")";
+}
+
+std::string CBackend::compile_func_call(const AstExpr* ast_node) {
+    const AstFuncCall* ptr = static_cast<const AstFuncCall*>(ast_node);
+
+    // a func declaration called with a valid argument count skips bask_call
+    const AstFuncDecl* direct = nullptr;
+    std::string callee;
+    if (ptr->name->get_type() == AstType::NAME) {
+        const std::string& name = static_cast<const AstName*>(ptr->name.get())->value;
+        auto function = functions.find(name);
+        if (locals.find(name) == locals.end() && function != functions.end()
+            && ptr->args.size() >= function->second->required_args.size()
+            && ptr->args.size() <= function->second->required_args.size() + function->second->optional_args.size())
+            direct = function->second;
+    }
+    if (direct == nullptr)
+        callee = compile_expr(ptr->name.get());
+
+    std::vector<std::string> args;
+    for (const auto& arg : ptr->args)
+        args.push_back(compile_expr(arg.get()));
+
+    std::string array = "NULL";
+    if (!args.empty()) {
+        array = temp();
+        out << "    bask_value " << array << "[" << args.size() << "] = {";
+        for (size_t i = 0; i < args.size(); i++)
+            out << (i == 0 ? "" : ", ") << args.at(i);
+        out << "};\n";
+    }
+
+    std::string result = temp();
+    if (direct != nullptr)
+        out << "    bask_value " << result << " = f_" << direct->name << "(" << array << ", " << args.size() << ");\n";
+    else
+        out << "    bask_value " << result << " = bask_call(" << callee << ", " << array << ", " << args.size() << ");\n";
+
+    return result;
+}
+
+std::string CBackend::compile_comparison(const AstExpr* ast_node) {
+    const AstComparison* ptr = static_cast<const AstComparison*>(ast_node);
+    std::string left = compile_expr(ptr->left.get());
+    std::string right = compile_expr(ptr->right.get());
+    const char* op = "BASK_EQUAL";
+    switch (ptr->type) {
+        case ComparisonType::EQUAL:
+            op = "BASK_EQUAL";
+            break;
+        case ComparisonType::NOT_EQUAL:
+            op = "BASK_NOT_EQUAL";
+            break;
+        case ComparisonType::LESS:
+            op = "BASK_LESS";
+            break;
+        case ComparisonType::LESS_EQUAL:
+            op = "BASK_LESS_EQUAL";
+            break;
+        case ComparisonType::GREATER:
+            op = "BASK_GREATER";
+            break;
+        case ComparisonType::GREATER_EQUAL:
+            op = "BASK_GREATER_EQUAL";
+            break;
+    }
+    std::string result = temp();
+    out << "    bask_value " << result << " = bask_compare(" << op << ", " << left << ", " << right << ");\n";
+    return result;
+}
+
+std::string CBackend::compile_logical_op(const AstExpr* ast_node) {
+    const AstLogicalOp* ptr = static_cast<const AstLogicalOp*>(ast_node);
+    std::string result = temp();
+    out << "    bask_value " << result << ";\n";
+
+    // the right side only runs when the left one does not decide
+    std::string left = compile_expr(ptr->left.get());
+    out << "    if (" << (ptr->type == LogicalOpType::AND ? "" : "!") << "bask_truthy(" << left << ")) {\n";
+    std::string right = compile_expr(ptr->right.get());
+    out << "    " << result << " = bask_int(bask_truthy(" << right << "));\n";
+    out << "    } else {\n";
+    out << "    " << result << " = bask_int(" << (ptr->type == LogicalOpType::AND ? 0 : 1) << ");\n";
+    out << "    }\n";
+    return result;
+}
+
+std::string CBackend::compile_expr(const AstExpr* ast_node) {
+    switch (ast_node->get_type()) {
+        case AstType::_NULL:
+            return "bask_null()";
+        case AstType::INT: {
+            const AstInt* literal = static_cast<const AstInt*>(ast_node);
+            if (!literal->digits.empty())
+                fail("C_BACKEND", "BIG_INT_NOT_SUPPORTED", "literal = '" + literal->digits + "'");
+            return "bask_int(" + std::to_string(literal->value) + "L)";
+        }
+        case AstType::FLOAT: {
+            std::stringstream buf;
+            buf.precision(17);
+            buf << static_cast<const AstFloat*>(ast_node)->value;
+            return "bask_float(" + buf.str() + ")";
+        }
+        case AstType::STRING:
+            return "bask_string(" + escape(static_cast<const AstString*>(ast_node)->value) + ")";
+        case AstType::NAME:
+            return compile_name(static_cast<const AstName*>(ast_node)->value);
+        case AstType::UNARY_OP: {
+            const AstUnaryOp* ptr = static_cast<const AstUnaryOp*>(ast_node);
+            std::string value = compile_expr(ptr->value.get());
+            std::string result = temp();
+            if (ptr->type == UnaryOpType::NOT)
+                out << "    bask_value " << result << " = bask_int(!bask_truthy(" << value << "));\n";
+            else
+                out << "    bask_value " << result << " = "
+                    << (ptr->type == UnaryOpType::PLUS_SIGN ? "bask_pos(" : "bask_neg(") << value << ");\n";
+            return result;
+        }
+        case AstType::BINARY_OP: {
+            const AstBinaryOp* ptr = static_cast<const AstBinaryOp*>(ast_node);
+            std::string left = compile_expr(ptr->left.get());
+            std::string right = compile_expr(ptr->right.get());
+            const char* op = "bask_add";
+            switch (ptr->type) {
+                case BinaryOpType::ADD:
+                    op = "bask_add";
+                    break;
+                case BinaryOpType::SUB:
+                    op = "bask_sub";
+                    break;
+                case BinaryOpType::MULT:
+                    op = "bask_mult";
+                    break;
+                case BinaryOpType::DIV:
+                    op = "bask_div";
+                    break;
+            }
+            std::string result = temp();
+            out << "    bask_value " << result << " = " << op << "(" << left << ", " << right << ");\n";
+            return result;
+        }
+        case AstType::COMPARISON:
+            return compile_comparison(ast_node);
+        case AstType::LOGICAL_OP:
+            return compile_logical_op(ast_node);
+        case AstType::MAP:
+            fail("C_BACKEND", "MAP_NOT_SUPPORTED");
+        case AstType::FUNC_CALL:
+            return compile_func_call(ast_node);
+        default:
+            return "bask_null()";
+    }
+}
+
+// STATEMENTS
+
+void CBackend::compile_set(const std::string& name, const std::string& value) {
+    if (locals.find(name) != locals.end())
+        out << "    l_" << name << " = " << value << ";\n";
+    else
+        out << "    g_" << name << " = " << value << ";\n";
+}
+
+void CBackend::compile_statement(const AstStatement* ast_node) {
+    switch (ast_node->get_type()) {
+        case AstType::CONST_DECL: {
+            const AstConstDecl* ptr = static_cast<const AstConstDecl*>(ast_node);
+            std::string value = compile_expr(ptr->value.get());
+            out << "    bask_value l_" << ptr->name << " = " << value << ";\n";
+            locals.insert(ptr->name);
+            break;
+        }
+        case AstType::VAR_DECL: {
+            const AstVarDecl* ptr = static_cast<const AstVarDecl*>(ast_node);
+            std::string value = compile_expr(ptr->value.get());
+            out << "    bask_value l_" << ptr->name << " = " << value << ";\n";
+            locals.insert(ptr->name);
+            break;
+        }
+        case AstType::VAR_SET: {
+            const AstVarSet* ptr = static_cast<const AstVarSet*>(ast_node);
+            compile_set(ptr->name, compile_expr(ptr->value.get()));
+            break;
+        }
+        case AstType::RETURN: {
+            std::string value = compile_expr(static_cast<const AstReturn*>(ast_node)->value.get());
+            out << "    return " << value << ";\n";
+            break;
+        }
+        case AstType::NO_RETURN_EXPR: {
+            std::string value = compile_expr(static_cast<const AstNoReturnExpr*>(ast_node)->expr.get());
+            out << "    (void)" << value << ";\n";
+            break;
+        }
+        case AstType::IF: {
+            const AstIf* ptr = static_cast<const AstIf*>(ast_node);
+            std::string condition = compile_expr(ptr->condition.get());
+            out << "    if (bask_truthy(" << condition << ")) {\n";
+            compile_block(ptr->code);
+            out << "    } else {\n";
+            compile_block(ptr->else_code);
+            out << "    }\n";
+            break;
+        }
+        case AstType::WHILE: {
+            // the condition's temporaries are computed again every iteration
+            const AstWhile* ptr = static_cast<const AstWhile*>(ast_node);
+            out << "    for (;;) {\n";
+            std::string condition = compile_expr(ptr->condition.get());
+            out << "    if (!bask_truthy(" << condition << "))\n";
+            out << "    break;\n";
+            compile_block(ptr->code);
+            out << "    }\n";
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void CBackend::compile_block(const std::vector<std::unique_ptr<AstStatement>>& code) {
+    std::unordered_set<std::string> outer = locals;
+    for (const auto& statement : code)
+        compile_statement(statement.get());
+    locals = std::move(outer);
+}
+
+// DECLARATIONS
+
+void CBackend::compile_func_decl(const AstFuncDecl* ast_node) {
+    locals.clear();
+    temps = 0;
+
+    out << "static bask_value f_" << ast_node->name << "(const bask_value* args, size_t count) {\n";
+    out << "    BASK_CHECK_STACK();\n";
+    out << "    (void)args;\n";
+    out << "    (void)count;\n";
+
+    size_t index = 0;
+    for (const auto& arg : ast_node->required_args) {
+        out << "    bask_value l_" << arg->name << " = args[" << index++ << "];\n";
+        locals.insert(arg->name);
+    }
+
+    for (const auto& arg : ast_node->optional_args) {
+        out << "    bask_value l_" << arg->name << ";\n";
+        out << "    if (count > " << index << ") {\n";
+        out << "    l_" << arg->name << " = args[" << index++ << "];\n";
+        out << "    } else {\n";
+        std::string value = compile_expr(arg->value.get());
+        out << "    l_" << arg->name << " = " << value << ";\n";
+        out << "    }\n";
+        locals.insert(arg->name);
+    }
+
+    for (const auto& statement : ast_node->code)
+        compile_statement(statement.get());
+
+    out << "    return bask_null();\n";
+    out << "}\n\n";
+}
+
+void CBackend::emit() {
+    out << "/* generated by bask --emit-c */\n";
+    out << "#include \"bask_runtime.h\"\n\n";
+
+    for (const auto& declaration : ast.code) {
+        if (declaration->get_type() == AstType::FUNC_DECL) {
+            const AstFuncDecl* ptr = static_cast<const AstFuncDecl*>(declaration.get());
+            // compiled programs have no event loop
+            if (ptr->is_async)
+                fail("C_BACKEND", "ASYNC_NOT_SUPPORTED", "function = '" + ptr->name + "'");
+            functions[ptr->name] = ptr;
+            out << "static bask_value f_" << ptr->name << "(const bask_value* args, size_t count);\n";
+            out << "static const bask_function fd_" << ptr->name << " = {\"" << ptr->name << "\", "
+                << ptr->required_args.size() << ", " << ptr->optional_args.size() << ", f_" << ptr->name << "};\n";
+        } else if (declaration->get_type() == AstType::GLOBAL_CONST_DECL) {
+            const std::string& name = static_cast<const AstGlobalConstDecl*>(declaration.get())->name;
+            globals.insert(name);
+            out << "static bask_value g_" << name << ";\n";
+        } else if (declaration->get_type() == AstType::GLOBAL_VAR_DECL) {
+            const std::string& name = static_cast<const AstGlobalVarDecl*>(declaration.get())->name;
+            globals.insert(name);
+            out << "static bask_value g_" << name << ";\n";
+        } else if (declaration->get_type() == AstType::IMPORT) {
+            fail("C_BACKEND", "IMPORT_NOT_SUPPORTED",
+                "path = '" + static_cast<const AstImport*>(declaration.get())->path + "'");
+        }
+    }
+    out << "\n";
+
+    locals.clear();
+    temps = 0;
+    out << "static void bask_init_globals(void) {\n";
+    for (const auto& declaration : ast.code) {
+        if (declaration->get_type() == AstType::GLOBAL_CONST_DECL) {
+            const AstGlobalConstDecl* ptr = static_cast<const AstGlobalConstDecl*>(declaration.get());
+            compile_set(ptr->name, compile_expr(ptr->value.get()));
+        } else if (declaration->get_type() == AstType::GLOBAL_VAR_DECL) {
+            const AstGlobalVarDecl* ptr = static_cast<const AstGlobalVarDecl*>(declaration.get());
+            compile_set(ptr->name, compile_expr(ptr->value.get()));
+        }
+    }
+    out << "}\n\n";
+
+    for (const auto& declaration : ast.code)
+        if (declaration->get_type() == AstType::FUNC_DECL)
+            compile_func_decl(static_cast<const AstFuncDecl*>(declaration.get()));
+
+    out << "int main(void) {\n";
+    out << "    bask_value result;\n";
+    out << "    bask_init_stack();\n";
+    out << "    bask_init_globals();\n";
+    out << "    result = bask_call(bask_func(&fd_main), NULL, 0);\n";
+    out << "    return result.type == BASK_INT ? (int)result.as.i : 0;\n";
+    out << "}\n";
+}
+
+void emit_c(const AstProgram& ast, std::ostream& out) {
+    CBackend(ast, out).emit();
+}
@@ -0,0 +1,902 @@
+#include "lib/compiler.hpp"
+#include "lib/loops.hpp"
+#include "lib/bigint.hpp"
+#include "lib/map.hpp"
+#include "lib/error.hpp"
+
+#include <algorithm>
+#include <climits>
+
+[[noreturn]] static void compile_error(const char* error, const std::string& name) {
+    fail("COMPILER", error, "name = '" + name + "'");
+}
+
+Compiler::Compiler(const AstProgram& ast, const NativeTable& natives,
+    const std::vector<const CompiledModule*>& imports, LoopPassStats* loop_passes)
+: ast(&ast), natives(natives), imports(imports), native_count(0), input(0), loop_passes(loop_passes),
+  function(nullptr), depth(0), max_depth(0) {}
+
+Compiler::Compiler(const NativeTable& natives)
+: ast(nullptr), natives(natives), native_count(0), input(0), loop_passes(nullptr), function(nullptr), depth(0),
+  max_depth(0) {
+    for (const Native& native : natives)
+        declare_global(native.name, true, Value::native(&native));
+    native_count = program.globals.size();
+
+    program.functions.emplace_back("<init>");
+    begin_function(program.functions[0]);
+    function->entries.push_back(0);
+    end_function();
+
+    input = program.functions.size();
+    program.functions.emplace_back("<input>");
+    program.initialized = true;
+}
+
+void Compiler::emit(OpCode op, long arg, unsigned int count) {
+    function->code.emplace_back(op, arg, count);
+
+    switch (op) {
+        case OpCode::PUSH_NULL:
+        case OpCode::PUSH_INT:
+        case OpCode::PUSH_CONST:
+        case OpCode::GET_LOCAL:
+        case OpCode::GET_GLOBAL:
+            depth++;
+            break;
+        case OpCode::SET_LOCAL:
+        case OpCode::SET_GLOBAL:
+        case OpCode::POP:
+        case OpCode::ADD:
+        case OpCode::SUB:
+        case OpCode::MULT:
+        case OpCode::DIV:
+        case OpCode::RETURN:
+        case OpCode::EQUAL:
+        case OpCode::NOT_EQUAL:
+        case OpCode::LESS:
+        case OpCode::LESS_EQUAL:
+        case OpCode::GREATER:
+        case OpCode::GREATER_EQUAL:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_TRUE:
+            depth--;
+            break;
+        case OpCode::CALL:
+            depth -= arg;
+            break;
+        case OpCode::CALL_NATIVE:
+            depth -= count;
+            depth++;
+            break;
+        case OpCode::TAIL_CALL:
+            depth -= arg + 1;
+            break;
+        case OpCode::MAKE_MAP:
+            depth -= 2 * arg;
+            depth++;
+            break;
+        case OpCode::POS:
+        case OpCode::NEG:
+        case OpCode::AWAIT:
+        case OpCode::NOT:
+        case OpCode::JUMP:
+        case OpCode::ADD_LOCAL:
+            break;
+    }
+
+    if (depth > max_depth)
+        max_depth = depth;
+}
+
+void Compiler::patch(const std::vector<size_t>& jumps, size_t target) {
+    for (size_t jump : jumps)
+        function->code[jump].arg = target;
+}
+
+void Compiler::mark_line(int line) {
+    if (!function->lines.empty() && function->lines.back().second == line)
+        return;
+    if (!function->lines.empty() && function->lines.back().first == function->code.size())
+        function->lines.back().second = line;
+    else
+        function->lines.emplace_back(function->code.size(), line);
+}
+
+size_t Compiler::add_constant(Value value) {
+    program.constants.push_back(value);
+    return program.constants.size() - 1;
+}
+
+size_t Compiler::intern(const std::string& value) {
+    auto constant = interned.find(value);
+    if (constant != interned.end())
+        return constant->second;
+
+    Value string = Value::string(value.data(), value.size());
+    if (!string.is_small_string()) {
+        // hashed now, as map keys they are never hashed again
+        hash_value(string);
+        // the program keeps the only reference, values just borrow it
+        string.string_value->immortal = true;
+        string.counted = false;
+        program.objects.push_back(string.string_value);
+    }
+
+    size_t index = add_constant(string);
+    interned[value] = index;
+    return index;
+}
+
+void Compiler::declare_global(const std::string& name, bool constant, Value value) {
+    if (global_index.find(name) != global_index.end())
+        compile_error("REDECLARATION", name);
+    global_index[name] = program.globals.size();
+    program.globals.emplace_back(name, constant, value);
+}
+
+size_t Compiler::declare_local(const std::string& name, bool constant) {
+    if (locals.find(name) != locals.end())
+        compile_error("REDECLARATION", name);
+    size_t slot = function->locals++;
+    locals[name] = Local(slot, constant);
+    return slot;
+}
+
+void Compiler::declare_imports() {
+    for (size_t import = 0; import < imports.size(); import++) {
+        const CompiledModule* module = imports[import];
+        // importing a module twice brings in nothing new
+        if (std::find(imports.begin(), imports.begin() + import, module) != imports.begin() + import)
+            continue;
+
+        for (size_t i = module->natives; i < module->natives + module->declared; i++) {
+            declare_global(module->program.globals[i].name, module->program.globals[i].constant);
+            externs.emplace_back(import, i);
+        }
+    }
+}
+
+void Compiler::redeclare_global(const std::string& name, bool constant) {
+    auto global = global_index.find(name);
+    if (global == global_index.end())
+        return declare_global(name, constant);
+
+    const Global& existing = program.globals[global->second];
+    if (global->second < native_count || existing.constant != constant || existing.value.type == ValueTypes::FUNC)
+        compile_error("REDECLARATION", name);
+}
+
+void Compiler::roll_back(size_t globals, size_t functions, size_t constants, size_t objects) {
+    for (size_t i = globals; i < program.globals.size(); i++)
+        global_index.erase(program.globals[i].name);
+    program.globals.erase(program.globals.begin() + globals, program.globals.end());
+    program.functions.erase(program.functions.begin() + functions, program.functions.end());
+    program.constants.erase(program.constants.begin() + constants, program.constants.end());
+
+    for (auto literal = interned.begin(); literal != interned.end();)
+        literal = literal->second >= constants ? interned.erase(literal) : std::next(literal);
+    for (size_t i = objects; i < program.objects.size(); i++)
+        std::free(program.objects[i]);
+    program.objects.resize(objects);
+}
+
+GlobalKind Compiler::global_kind(const std::string& name) const {
+    auto global = global_index.find(name);
+    if (global == global_index.end())
+        return GlobalKind::OTHER;
+
+    const Value& value = program.globals[global->second].value;
+    if (value.type == ValueTypes::NATIVE_FUNC)
+        return value.native_value->pure ? GlobalKind::PURE_FUNCTION : GlobalKind::FUNCTION;
+    if (value.type == ValueTypes::FUNC)
+        return program.functions[value.func_value].pure ? GlobalKind::PURE_FUNCTION : GlobalKind::FUNCTION;
+    return immutable_constants.count(name) != 0 ? GlobalKind::CONSTANT : GlobalKind::OTHER;
+}
+
+void Compiler::mark_pure(const std::vector<std::pair<const AstFuncDecl*, Function*>>& funcs) {
+    std::vector<const AstFuncDecl*> decls;
+    for (const auto& func : funcs)
+        decls.push_back(func.first);
+
+    std::unordered_set<const AstFuncDecl*> pure = pure_functions(decls,
+        [this](const std::string& name) { return global_kind(name); });
+
+    for (const auto& func : funcs) {
+        if (func.first->memo && pure.count(func.first) == 0)
+            fail("COMPILER", "IMPURE_MEMO", "function = '" + func.first->name + "'");
+        func.second->pure = pure.count(func.first) != 0;
+        func.second->memo = func.first->memo;
+    }
+}
+
+void Compiler::begin_function(Function& target) {
+    function = &target;
+    locals.clear();
+    integers.clear();
+    computed.clear();
+    steps.clear();
+    depth = 0;
+    max_depth = 0;
+}
+
+void Compiler::end_function() {
+    emit(OpCode::PUSH_NULL);
+    emit(OpCode::RETURN);
+    function->max_stack = function->locals + max_depth;
+}
+
+// EXPRESSIONS
+
+void Compiler::compile_name(const AstExpr* ast_node) {
+    const std::string& name = static_cast<const AstName*>(ast_node)->value;
+
+    auto local = locals.find(name);
+    if (local != locals.end())
+        return emit(OpCode::GET_LOCAL, local->second.slot);
+
+    auto global = global_index.find(name);
+    if (global != global_index.end())
+        return emit(OpCode::GET_GLOBAL, global->second);
+
+    compile_error("UNDEFINED_NAME", name);
+}
+
+void Compiler::compile_unary_op(const AstExpr* ast_node) {
+    const AstUnaryOp* ptr = static_cast<const AstUnaryOp*>(ast_node);
+    compile_expr(ptr->value.get());
+    switch (ptr->type) {
+        case UnaryOpType::PLUS_SIGN:
+            return emit(OpCode::POS);
+        case UnaryOpType::MINUS_SIGN:
+            return emit(OpCode::NEG);
+        case UnaryOpType::AWAIT:
+            if (!function->is_async)
+                compile_error("AWAIT_OUTSIDE_ASYNC", function->name);
+            return emit(OpCode::AWAIT);
+        case UnaryOpType::NOT:
+            return emit(OpCode::NOT);
+    }
+}
+
+void Compiler::compile_binary_op(const AstExpr* ast_node) {
+    const AstBinaryOp* ptr = static_cast<const AstBinaryOp*>(ast_node);
+    compile_expr(ptr->left.get());
+    compile_expr(ptr->right.get());
+    switch (ptr->type) {
+        case BinaryOpType::ADD:
+            return emit(OpCode::ADD);
+        case BinaryOpType::SUB:
+            return emit(OpCode::SUB);
+        case BinaryOpType::MULT:
+            return emit(OpCode::MULT);
+        case BinaryOpType::DIV:
+            return emit(OpCode::DIV);
+    }
+}
+
+void Compiler::compile_comparison(const AstExpr* ast_node) {
+    const AstComparison* ptr = static_cast<const AstComparison*>(ast_node);
+    compile_expr(ptr->left.get());
+    compile_expr(ptr->right.get());
+    switch (ptr->type) {
+        case ComparisonType::EQUAL:
+            return emit(OpCode::EQUAL);
+        case ComparisonType::NOT_EQUAL:
+            return emit(OpCode::NOT_EQUAL);
+        case ComparisonType::LESS:
+            return emit(OpCode::LESS);
+        case ComparisonType::LESS_EQUAL:
+            return emit(OpCode::LESS_EQUAL);
+        case ComparisonType::GREATER:
+            return emit(OpCode::GREATER);
+        case ComparisonType::GREATER_EQUAL:
+            return emit(OpCode::GREATER_EQUAL);
+    }
+}
+
+void Compiler::compile_logical_op(const AstExpr* ast_node) {
+    std::vector<size_t> falses;
+    compile_branch(ast_node, false, falses);
+    emit(OpCode::PUSH_INT, 1);
+    size_t end = function->code.size();
+    emit(OpCode::JUMP);
+    // the 1 is not there on the way to the 0
+    depth--;
+    patch(falses, function->code.size());
+    emit(OpCode::PUSH_INT, 0);
+    patch({end}, function->code.size());
+}
+
+void Compiler::compile_branch(const AstExpr* ast_node, bool when, std::vector<size_t>& jumps) {
+    if (computed.count(ast_node) == 0) {
+        if (ast_node->get_type() == AstType::UNARY_OP
+            && static_cast<const AstUnaryOp*>(ast_node)->type == UnaryOpType::NOT)
+            return compile_branch(static_cast<const AstUnaryOp*>(ast_node)->value.get(), !when, jumps);
+
+        if (ast_node->get_type() == AstType::LOGICAL_OP) {
+            const AstLogicalOp* ptr = static_cast<const AstLogicalOp*>(ast_node);
+            // the left side decides it when it is false for and, true for or
+            bool decides = ptr->type == LogicalOpType::OR;
+            if (decides == when) {
+                compile_branch(ptr->left.get(), when, jumps);
+                return compile_branch(ptr->right.get(), when, jumps);
+            }
+            std::vector<size_t> decided;
+            compile_branch(ptr->left.get(), decides, decided);
+            compile_branch(ptr->right.get(), when, jumps);
+            return patch(decided, function->code.size());
+        }
+
+        if (ast_node->get_type() == AstType::INT && static_cast<const AstInt*>(ast_node)->digits.empty()) {
+            if ((static_cast<const AstInt*>(ast_node)->value != 0) == when) {
+                jumps.push_back(function->code.size());
+                emit(OpCode::JUMP);
+            }
+            return;
+        }
+    }
+
+    compile_expr(ast_node);
+    jumps.push_back(function->code.size());
+    emit(when ? OpCode::JUMP_IF_TRUE : OpCode::JUMP_IF_FALSE);
+}
+
+long Compiler::static_native(const AstExpr* callee) const {
+    if (callee->get_type() != AstType::NAME)
+        return -1;
+
+    const std::string& name = static_cast<const AstName*>(callee)->value;
+    if (locals.find(name) != locals.end())
+        return -1;
+
+    auto global = global_index.find(name);
+    if (global == global_index.end())
+        return -1;
+
+    const Global& target = program.globals.at(global->second);
+    if (!target.constant || target.value.type != ValueTypes::NATIVE_FUNC)
+        return -1;
+
+    return global->second;
+}
+
+void Compiler::compile_func_call(const AstExpr* ast_node, OpCode op) {
+    const AstFuncCall* ptr = static_cast<const AstFuncCall*>(ast_node);
+
+    long native = static_native(ptr->name.get());
+    if (native >= 0) {
+        const Native* target = program.globals.at(native).value.native_value;
+        if (!target->accepts(ptr->args.size()))
+            compile_error("WRONG_ARGUMENT_COUNT", target->name);
+
+        for (const auto& arg : ptr->args)
+            compile_expr(arg.get());
+        emit(OpCode::CALL_NATIVE, native, ptr->args.size());
+
+        // natives never need a frame, a tail call is just call and return
+        if (op == OpCode::TAIL_CALL)
+            emit(OpCode::RETURN);
+        return;
+    }
+
+    compile_expr(ptr->name.get());
+    for (const auto& arg : ptr->args)
+        compile_expr(arg.get());
+    emit(op, ptr->args.size());
+}
+
+void Compiler::compile_int(const AstExpr* ast_node) {
+    const AstInt* ptr = static_cast<const AstInt*>(ast_node);
+    if (ptr->digits.empty())
+        return emit(OpCode::PUSH_INT, ptr->value);
+
+    Value value = parse_integer(ptr->digits);
+    if (value.type == ValueTypes::INT)
+        return emit(OpCode::PUSH_INT, value.int_value);
+
+    // owned by the program like the long string literals
+    value.big_value->immortal = true;
+    value.counted = false;
+    program.objects.push_back(value.big_value);
+    emit(OpCode::PUSH_CONST, add_constant(value));
+}
+
+void Compiler::compile_map(const AstExpr* ast_node) {
+    const AstMap* ptr = static_cast<const AstMap*>(ast_node);
+    for (const auto& entry : ptr->entries) {
+        compile_expr(entry.first.get());
+        compile_expr(entry.second.get());
+    }
+    emit(OpCode::MAKE_MAP, ptr->entries.size());
+}
+
+void Compiler::compile_expr(const AstExpr* ast_node) {
+    if (!computed.empty()) {
+        auto local = computed.find(ast_node);
+        if (local != computed.end())
+            return emit(OpCode::GET_LOCAL, local->second);
+    }
+
+    switch (ast_node->get_type()) {
+        case AstType::_NULL:
+            return emit(OpCode::PUSH_NULL);
+        case AstType::INT:
+            return compile_int(ast_node);
+        case AstType::FLOAT:
+            return emit(OpCode::PUSH_CONST,
+                add_constant(Value::floating(static_cast<const AstFloat*>(ast_node)->value)));
+        case AstType::STRING:
+            return emit(OpCode::PUSH_CONST, intern(static_cast<const AstString*>(ast_node)->value));
+        case AstType::NAME:
+            return compile_name(ast_node);
+        case AstType::UNARY_OP:
+            return compile_unary_op(ast_node);
+        case AstType::BINARY_OP:
+            return compile_binary_op(ast_node);
+        case AstType::FUNC_CALL:
+            return compile_func_call(ast_node);
+        case AstType::MAP:
+            return compile_map(ast_node);
+        case AstType::COMPARISON:
+            return compile_comparison(ast_node);
+        case AstType::LOGICAL_OP:
+            return compile_logical_op(ast_node);
+        default:
+            fail("COMPILER", "UNKNOWN_EXPRESSION");
+    }
+}
+
+// STATEMENTS
+
+void Compiler::compile_set(const std::string& name) {
+    auto local = locals.find(name);
+    if (local != locals.end()) {
+        if (local->second.constant)
+            compile_error("ASSIGNMENT_TO_CONST", name);
+        return emit(OpCode::SET_LOCAL, local->second.slot);
+    }
+
+    auto global = global_index.find(name);
+    if (global != global_index.end()) {
+        if (program.globals.at(global->second).constant)
+            compile_error("ASSIGNMENT_TO_CONST", name);
+        return emit(OpCode::SET_GLOBAL, global->second);
+    }
+
+    compile_error("UNDEFINED_NAME", name);
+}
+
+void Compiler::compile_const_decl(const AstStatement* ast_node) {
+    const AstConstDecl* ptr = static_cast<const AstConstDecl*>(ast_node);
+    compile_expr(ptr->value.get());
+    emit(OpCode::SET_LOCAL, declare_local(ptr->name, true));
+}
+
+void Compiler::compile_var_decl(const AstStatement* ast_node) {
+    const AstVarDecl* ptr = static_cast<const AstVarDecl*>(ast_node);
+    compile_expr(ptr->value.get());
+    emit(OpCode::SET_LOCAL, declare_local(ptr->name, false));
+}
+
+// the int step when set is name = name + step or name = name - step
+static bool is_local_step(const AstVarSet* set, long& step) {
+    if (set->value->get_type() != AstType::BINARY_OP)
+        return false;
+
+    const AstBinaryOp* op = static_cast<const AstBinaryOp*>(set->value.get());
+    if (op->type != BinaryOpType::ADD && op->type != BinaryOpType::SUB)
+        return false;
+    auto is_name = [set](const AstExpr* expr) {
+        return expr->get_type() == AstType::NAME && static_cast<const AstName*>(expr)->value == set->name;
+    };
+    auto is_int = [](const AstExpr* expr) {
+        return expr->get_type() == AstType::INT && static_cast<const AstInt*>(expr)->digits.empty();
+    };
+
+    const AstExpr* literal = nullptr;
+    if (is_name(op->left.get()) && is_int(op->right.get()))
+        literal = op->right.get();
+    else if (op->type == BinaryOpType::ADD && is_int(op->left.get()) && is_name(op->right.get()))
+        literal = op->left.get();
+    if (literal == nullptr)
+        return false;
+
+    step = static_cast<const AstInt*>(literal)->value;
+    if (op->type == BinaryOpType::SUB) {
+        if (step == LONG_MIN)
+            return false;
+        step = -step;
+    }
+    return true;
+}
+
+void Compiler::compile_var_set(const AstStatement* ast_node) {
+    const AstVarSet* ptr = static_cast<const AstVarSet*>(ast_node);
+
+    auto local = locals.find(ptr->name);
+    long step;
+    if (local != locals.end() && !local->second.constant && is_local_step(ptr, step)) {
+        emit(OpCode::ADD_LOCAL, step, static_cast<unsigned int>(local->second.slot));
+    } else {
+        compile_expr(ptr->value.get());
+        compile_set(ptr->name);
+    }
+
+    auto following = steps.find(ast_node);
+    if (following != steps.end())
+        for (const Instruction& instruction : following->second)
+            emit(instruction.op, instruction.arg, instruction.count);
+}
+
+void Compiler::compile_return(const AstStatement* ast_node) {
+    const AstExpr* value = static_cast<const AstReturn*>(ast_node)->value.get();
+
+    if (value->get_type() == AstType::FUNC_CALL)
+        return compile_func_call(value, OpCode::TAIL_CALL);
+
+    compile_expr(value);
+    emit(OpCode::RETURN);
+}
+
+void Compiler::compile_no_return_expr(const AstStatement* ast_node) {
+    compile_expr(static_cast<const AstNoReturnExpr*>(ast_node)->expr.get());
+    emit(OpCode::POP);
+}
+
+void Compiler::compile_block(const std::vector<std::unique_ptr<AstStatement>>& code) {
+    // their slots stay taken, only the names go
+    std::unordered_map<std::string, Local> outer = locals;
+    for (const auto& statement : code)
+        compile_statement(statement.get());
+    locals = std::move(outer);
+}
+
+void Compiler::compile_if(const AstStatement* ast_node) {
+    const AstIf* ptr = static_cast<const AstIf*>(ast_node);
+
+    std::vector<size_t> skips;
+    compile_branch(ptr->condition.get(), false, skips);
+    compile_block(ptr->code);
+
+    if (!ptr->else_code.empty()) {
+        size_t end = function->code.size();
+        emit(OpCode::JUMP);
+        patch(skips, function->code.size());
+        compile_block(ptr->else_code);
+        skips = {end};
+    }
+    patch(skips, function->code.size());
+}
+
+void Compiler::compile_while(const AstStatement* ast_node) {
+    const AstWhile* ptr = static_cast<const AstWhile*>(ast_node);
+
+    // rotated, see loops.hpp
+    std::vector<size_t> exits;
+    compile_branch(ptr->condition.get(), false, exits);
+
+    auto resolve = [this](const std::string& name) {
+        if (locals.find(name) != locals.end())
+            return NameKind::LOCAL;
+        auto global = global_index.find(name);
+        if (global == global_index.end())
+            return NameKind::UNDEFINED;
+        return program.globals[global->second].constant ? NameKind::CONST_GLOBAL : NameKind::VAR_GLOBAL;
+    };
+    LoopPlan plan = plan_loop(*ptr, resolve, integers, computed, loop_passes);
+    std::vector<const AstExpr*> planned;
+
+    for (const auto& uses : plan.hoisted) {
+        size_t slot = function->locals++;
+        compile_expr(uses.front());
+        emit(OpCode::SET_LOCAL, slot);
+        for (const AstExpr* use : uses)
+            computed[use] = slot;
+        planned.insert(planned.end(), uses.begin(), uses.end());
+    }
+
+    for (const Reduction& reduction : plan.reductions) {
+        size_t product = function->locals++;
+        emit(OpCode::GET_LOCAL, locals.at(reduction.variable).slot);
+        compile_expr(reduction.factor);
+        emit(OpCode::MULT);
+        emit(OpCode::SET_LOCAL, product);
+
+        std::vector<Instruction>& step = steps[reduction.update];
+        if (reduction.folded) {
+            step.emplace_back(OpCode::ADD_LOCAL, reduction.folded_step, product);
+        } else {
+            size_t increment = function->locals++;
+            compile_expr(reduction.step);
+            compile_expr(reduction.factor);
+            emit(OpCode::MULT);
+            emit(OpCode::SET_LOCAL, increment);
+            step.emplace_back(OpCode::GET_LOCAL, product);
+            step.emplace_back(OpCode::GET_LOCAL, increment);
+            step.emplace_back(reduction.subtract ? OpCode::SUB : OpCode::ADD);
+            step.emplace_back(OpCode::SET_LOCAL, product);
+        }
+
+        for (const AstExpr* use : reduction.uses)
+            computed[use] = product;
+        planned.insert(planned.end(), reduction.uses.begin(), reduction.uses.end());
+    }
+
+    size_t top = function->code.size();
+    compile_block(ptr->code);
+
+    mark_line(ptr->line);
+    std::vector<size_t> repeats;
+    compile_branch(ptr->condition.get(), true, repeats);
+    patch(repeats, top);
+    patch(exits, function->code.size());
+
+    for (const AstExpr* use : planned)
+        computed.erase(use);
+    for (const Reduction& reduction : plan.reductions)
+        steps.erase(reduction.update);
+}
+
+void Compiler::compile_statement(const AstStatement* ast_node) {
+    mark_line(ast_node->line);
+
+    switch (ast_node->get_type()) {
+        case AstType::CONST_DECL:
+            return compile_const_decl(ast_node);
+        case AstType::VAR_DECL:
+            return compile_var_decl(ast_node);
+        case AstType::VAR_SET:
+            return compile_var_set(ast_node);
+        case AstType::RETURN:
+            return compile_return(ast_node);
+        case AstType::NO_RETURN_EXPR:
+            return compile_no_return_expr(ast_node);
+        case AstType::IF:
+            return compile_if(ast_node);
+        case AstType::WHILE:
+            return compile_while(ast_node);
+        default:
+            fail("COMPILER", "UNKNOWN_STATEMENT");
+    }
+}
+
+// DECLARATIONS
+
+void Compiler::compile_func_decl(const AstFuncDecl* ast_node, Function& target) {
+    begin_function(target);
+    function->is_async = ast_node->is_async;
+    mark_line(ast_node->line);
+
+    std::vector<std::string> arguments;
+    for (const auto& arg : ast_node->required_args)
+        arguments.push_back(arg->name);
+    for (const auto& arg : ast_node->optional_args)
+        arguments.push_back(arg->name);
+    integers = integer_locals(ast_node->code, arguments);
+
+    for (const auto& arg : ast_node->required_args)
+        declare_local(arg->name, false);
+
+    // an optional argument is only visible to the defaults after it
+    for (const auto& arg : ast_node->optional_args) {
+        function->entries.push_back(function->code.size());
+        compile_expr(arg->value.get());
+        emit(OpCode::SET_LOCAL, declare_local(arg->name, false));
+    }
+    function->entries.push_back(function->code.size());
+
+    for (const auto& statement : ast_node->code)
+        compile_statement(statement.get());
+
+    end_function();
+}
+
+void Compiler::compile_global_values(const AstProgram& ast) {
+    for (const auto& declaration : ast.code) {
+        if (declaration->get_type() == AstType::GLOBAL_CONST_DECL) {
+            const AstGlobalConstDecl* ptr = static_cast<const AstGlobalConstDecl*>(declaration.get());
+            mark_line(ptr->line);
+            compile_expr(ptr->value.get());
+            emit(OpCode::SET_GLOBAL, global_index.at(ptr->name));
+        } else if (declaration->get_type() == AstType::GLOBAL_VAR_DECL) {
+            const AstGlobalVarDecl* ptr = static_cast<const AstGlobalVarDecl*>(declaration.get());
+            mark_line(ptr->line);
+            compile_expr(ptr->value.get());
+            emit(OpCode::SET_GLOBAL, global_index.at(ptr->name));
+        }
+    }
+}
+
+CompiledModule Compiler::compile_module() {
+    for (const Native& native : natives)
+        declare_global(native.name, true, Value::native(&native));
+    native_count = program.globals.size();
+
+    program.functions.emplace_back("<init>");
+
+    for (const auto& declaration : ast->code) {
+        if (declaration->get_type() != AstType::FUNC_DECL)
+            continue;
+        const AstFuncDecl* ptr = static_cast<const AstFuncDecl*>(declaration.get());
+        declare_global(ptr->name, true, Value::function(program.functions.size()));
+        program.functions.emplace_back(ptr->name, ptr->required_args.size(), ptr->optional_args.size());
+    }
+
+    for (const auto& declaration : ast->code) {
+        if (declaration->get_type() == AstType::GLOBAL_CONST_DECL) {
+            const AstGlobalConstDecl* ptr = static_cast<const AstGlobalConstDecl*>(declaration.get());
+            declare_global(ptr->name, true);
+            if (immutable_value(ptr->value.get()))
+                immutable_constants.insert(ptr->name);
+        } else if (declaration->get_type() == AstType::GLOBAL_VAR_DECL) {
+            declare_global(static_cast<const AstGlobalVarDecl*>(declaration.get())->name, false);
+        }
+    }
+    size_t declared = program.globals.size() - native_count;
+
+    declare_imports();
+
+    begin_function(program.functions[0]);
+    function->entries.push_back(0);
+    compile_global_values(*ast);
+    end_function();
+
+    size_t index = 1;
+    std::vector<std::pair<const AstFuncDecl*, Function*>> funcs;
+    for (const auto& declaration : ast->code) {
+        if (declaration->get_type() != AstType::FUNC_DECL)
+            continue;
+        const AstFuncDecl* ptr = static_cast<const AstFuncDecl*>(declaration.get());
+        compile_func_decl(ptr, program.functions[index]);
+        funcs.emplace_back(ptr, &program.functions[index++]);
+    }
+    mark_pure(funcs);
+
+    auto main = global_index.find("main");
+    if (main != global_index.end() && program.globals.at(main->second).value.type == ValueTypes::FUNC)
+        program.main = program.globals.at(main->second).value.func_value;
+
+    return CompiledModule(std::move(program), native_count, declared, std::move(externs));
+}
+
+Program Compiler::compile() {
+    for (const auto& declaration : ast->code)
+        if (declaration->get_type() == AstType::IMPORT)
+            fail("COMPILER", "UNRESOLVED_IMPORT",
+                "path = '" + static_cast<const AstImport*>(declaration.get())->path + "'");
+
+    CompiledModule module = compile_module();
+    if (module.program.main < 0)
+        compile_error("NO_MAIN", "main");
+    return std::move(module.program);
+}
+
+// SESSIONS
+
+std::vector<size_t> Compiler::add_declarations(const AstProgram& ast) {
+    size_t globals = program.globals.size();
+    size_t functions = program.functions.size();
+    size_t constants = program.constants.size();
+    size_t objects = program.objects.size();
+    std::vector<size_t> replaced;
+    std::unordered_set<std::string> immutable = immutable_constants;
+    // a func or const declared again may change what earlier funcs do
+    bool redeclared = false;
+
+    try {
+        // declared before anything compiles, so funcs can call each other
+        std::vector<std::pair<const AstFuncDecl*, size_t>> funcs;
+        for (const auto& declaration : ast.code) {
+            switch (declaration->get_type()) {
+                case AstType::FUNC_DECL: {
+                    const AstFuncDecl* ptr = static_cast<const AstFuncDecl*>(declaration.get());
+                    auto global = global_index.find(ptr->name);
+                    if (global == global_index.end()) {
+                        declare_global(ptr->name, true, Value::function(program.functions.size()));
+                        funcs.emplace_back(ptr, program.functions.size());
+                        program.functions.emplace_back(ptr->name);
+                    } else if (global->second >= native_count
+                            && program.globals[global->second].value.type == ValueTypes::FUNC) {
+                        funcs.emplace_back(ptr, program.globals[global->second].value.func_value);
+                        redeclared = true;
+                    } else {
+                        compile_error("REDECLARATION", ptr->name);
+                    }
+                    break;
+                }
+                case AstType::GLOBAL_CONST_DECL: {
+                    const AstGlobalConstDecl* ptr = static_cast<const AstGlobalConstDecl*>(declaration.get());
+                    redeclared = redeclared || global_index.count(ptr->name) != 0;
+                    redeclare_global(ptr->name, true);
+                    break;
+                }
+                case AstType::GLOBAL_VAR_DECL:
+                    redeclare_global(static_cast<const AstGlobalVarDecl*>(declaration.get())->name, false);
+                    break;
+                default:
+                    fail("COMPILER", "UNRESOLVED_IMPORT",
+                        "path = '" + static_cast<const AstImport*>(declaration.get())->path + "'");
+            }
+        }
+
+        program.functions[input] = Function("<input>");
+        begin_function(program.functions[input]);
+        function->entries.push_back(0);
+        compile_global_values(ast);
+        end_function();
+
+        // the old code stays until all of the new compiles
+        std::vector<Function> code;
+        for (const auto& func : funcs) {
+            code.emplace_back(func.first->name, func.first->required_args.size(), func.first->optional_args.size());
+            compile_func_decl(func.first, code.back());
+        }
+
+        // earlier funcs are only still pure if all they reach stays the same
+        if (redeclared)
+            for (Function& old : program.functions)
+                old.pure = old.memo = false;
+        for (const auto& declaration : ast.code) {
+            if (declaration->get_type() != AstType::GLOBAL_CONST_DECL)
+                continue;
+            const AstGlobalConstDecl* ptr = static_cast<const AstGlobalConstDecl*>(declaration.get());
+            if (immutable_value(ptr->value.get()))
+                immutable_constants.insert(ptr->name);
+            else
+                immutable_constants.erase(ptr->name);
+        }
+        std::vector<std::pair<const AstFuncDecl*, Function*>> compiled;
+        for (size_t i = 0; i < funcs.size(); i++)
+            compiled.emplace_back(funcs[i].first, &code[i]);
+        mark_pure(compiled);
+
+        for (size_t i = 0; i < funcs.size(); i++) {
+            if (funcs[i].second < functions)
+                replaced.push_back(funcs[i].second);
+            program.functions[funcs[i].second] = std::move(code[i]);
+        }
+    } catch (...) {
+        immutable_constants = std::move(immutable);
+        roll_back(globals, functions, constants, objects);
+        throw;
+    }
+
+    return replaced;
+}
+
+void Compiler::add_statements(const std::vector<std::unique_ptr<AstStatement>>& statements) {
+    size_t constants = program.constants.size();
+    size_t objects = program.objects.size();
+
+    try {
+        program.functions[input] = Function("<input>");
+        begin_function(program.functions[input]);
+        function->entries.push_back(0);
+        integers = integer_locals(statements, {});
+
+        for (size_t i = 0; i < statements.size(); i++) {
+            const AstStatement* statement = statements[i].get();
+            if (i + 1 == statements.size() && statement->get_type() == AstType::NO_RETURN_EXPR) {
+                mark_line(statement->line);
+                compile_expr(static_cast<const AstNoReturnExpr*>(statement)->expr.get());
+                emit(OpCode::RETURN);
+            } else {
+                compile_statement(statement);
+            }
+        }
+        end_function();
+    } catch (...) {
+        roll_back(program.globals.size(), program.functions.size(), constants, objects);
+        throw;
+    }
+}
+
+Program compile(const AstProgram& ast, const NativeTable& natives, LoopPassStats* loop_passes) {
+    return Compiler(ast, natives, {}, loop_passes).compile();
+}
+
+CompiledModule compile_module(const AstProgram& ast, const std::vector<const CompiledModule*>& imports,
+        const NativeTable& natives) {
+    return Compiler(ast, natives, imports).compile_module();
+}
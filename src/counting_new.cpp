@@ -0,0 +1,26 @@
+#include "lib/stats.hpp"
+
+#include <cstdlib>
+#include <new>
+
+// Only the bask executable replaces operator new, so --stats can report
+// what lexing, parsing and compiling allocate. Programs embedding bask_core
+// keep their own.
+
+#if BASK_STATS
+void* operator new(size_t size) {
+    count_allocation(size);
+    void* pointer = std::malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+#endif
@@ -0,0 +1,76 @@
+#include "lib/embed.hpp"
+#include "lib/lexer.hpp"
+#include "lib/parser.hpp"
+#include "lib/compiler.hpp"
+#include "lib/snapshot.hpp"
+#include "lib/error.hpp"
+
+Script Script::compile(const std::string& source, const NativeTable& natives, Stats* stats) {
+    PhaseTimer lex(stats, "lex");
+    std::vector<Token> tokens = tokenize(source);
+    lex.stop();
+
+    PhaseTimer parsing(stats, "parse");
+    AstProgram ast = parse(tokens);
+    parsing.stop();
+
+    PhaseTimer compiling(stats, "compile");
+    Script script;
+    script.program = std::make_shared<const Program>(::compile(ast, natives));
+    compiling.stop();
+
+    if (stats != nullptr) {
+        stats->count_tokens(tokens);
+        stats->count_nodes(ast);
+    }
+
+    return script;
+}
+
+Script Script::load(const std::string& path, const NativeTable& natives) {
+    Script script;
+    script.program = std::make_shared<const Program>(read_snapshot(path, natives));
+    return script;
+}
+
+Context::Context(const Script& script, const InterpreterOptions& options)
+: program(script.program), interpreter(*program, options) {}
+
+template <typename F>
+RunResult Context::guard(F body) {
+    try {
+        return RunResult(RunStatus::OK, body());
+    } catch (const ScriptExit& exit) {
+        interpreter.reset();
+        return RunResult(RunStatus::EXIT, Value(), exit.code);
+    } catch (const LimitError& error) {
+        interpreter.reset();
+        return RunResult(RunStatus::LIMIT, Value(), 1, error.what(), error.limit);
+    } catch (const BaskError& error) {
+        interpreter.reset();
+        return RunResult(RunStatus::ERROR, Value(), 1, error.what());
+    }
+}
+
+RunResult Context::run() {
+    return guard([this]() {
+        interpreter.initialize();
+        return interpreter.call(*interpreter.global("main"), nullptr, 0);
+    });
+}
+
+RunResult Context::call(const std::string& name, const Value* args, size_t count) {
+    return guard([&]() {
+        interpreter.initialize();
+
+        const Value* callee = interpreter.global(name);
+        if (callee == nullptr)
+            fail("EMBED", "UNKNOWN_GLOBAL", "name = '" + name + "'");
+
+        return interpreter.call(*callee, args, count);
+    });
+}
+
+ExecutionStats Context::stats() const {
+    return interpreter.execution_stats();
+}
@@ -0,0 +1,231 @@
+#include "lib/event_loop.hpp"
+#include "lib/error.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+const size_t FILE_READERS = 2;
+
+static int64_t now_milliseconds() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+EventLoop::EventLoop()
+: next_handle(1), epoll_fd(-1), wake_fd(-1), pending_reads(0), stopping(false) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epoll_fd < 0 || wake_fd < 0)
+        fail("INTERPRETER", "CANNOT_CREATE_EVENT_LOOP");
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = wake_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) != 0)
+        fail("INTERPRETER", "CANNOT_CREATE_EVENT_LOOP");
+}
+
+EventLoop::~EventLoop() {
+    {
+        std::lock_guard<std::mutex> guard(reads_lock);
+        stopping = true;
+    }
+    reads_wake.notify_all();
+    for (auto& reader : readers)
+        reader.join();
+
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+    if (wake_fd >= 0)
+        close(wake_fd);
+}
+
+long EventLoop::create() {
+    long handle = next_handle++;
+    promises[handle];
+    return handle;
+}
+
+long EventLoop::start(std::unique_ptr<Coroutine> coroutine) {
+    long handle = create();
+    promises[handle].coroutine = std::move(coroutine);
+    ready.push_back(handle);
+    return handle;
+}
+
+long EventLoop::sleep(long milliseconds) {
+    long handle = create();
+    timers.emplace(now_milliseconds() + (milliseconds > 0 ? milliseconds : 0), handle);
+    return handle;
+}
+
+long EventLoop::read_file(const std::string& path) {
+    long handle = create();
+
+    {
+        std::lock_guard<std::mutex> guard(reads_lock);
+        queued_reads.emplace_back(handle, path);
+        pending_reads++;
+        if (readers.size() < FILE_READERS)
+            readers.emplace_back(&EventLoop::read_files, this);
+    }
+    reads_wake.notify_one();
+
+    return handle;
+}
+
+void EventLoop::read_files() {
+    std::unique_lock<std::mutex> lock(reads_lock);
+
+    while (true) {
+        reads_wake.wait(lock, [this]() { return stopping || !queued_reads.empty(); });
+        if (stopping)
+            return;
+
+        FinishedRead read;
+        read.handle = queued_reads.front().first;
+        read.path = std::move(queued_reads.front().second);
+        queued_reads.pop_front();
+        lock.unlock();
+
+        std::ifstream file(read.path, std::ios::binary);
+        read.ok = file.is_open();
+        if (read.ok) {
+            std::stringstream buf;
+            buf << file.rdbuf();
+            read.data = buf.str();
+        }
+
+        lock.lock();
+        finished_reads.push_back(std::move(read));
+
+        uint64_t one = 1;
+        ssize_t written = write(wake_fd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+bool EventLoop::await(long handle, long waiter, Value& value) {
+    auto found = promises.find(handle);
+    if (found == promises.end())
+        fail("INTERPRETER", "UNKNOWN_TASK", "handle = " + std::to_string(handle));
+
+    Promise& promise = found->second;
+
+    if (promise.done) {
+        std::string error = std::move(promise.error);
+        value = std::move(promise.result);
+        promises.erase(found);
+        if (!error.empty())
+            throw BaskError(error);
+        return true;
+    }
+
+    if (promise.waiter != 0)
+        fail("INTERPRETER", "AWAITED_TWICE", "handle = " + std::to_string(handle));
+
+    promise.waiter = waiter;
+    return false;
+}
+
+Coroutine& EventLoop::coroutine(long handle) {
+    return *promises.at(handle).coroutine;
+}
+
+void EventLoop::finish(long handle, Value result) {
+    Promise& promise = promises.at(handle);
+    promise.coroutine.reset();
+
+    if (promise.waiter == 0) {
+        promise.done = true;
+        promise.result = std::move(result);
+        return;
+    }
+
+    // the waiter finds the result where its await left the handle
+    long waiter = promise.waiter;
+    promises.erase(handle);
+    promises.at(waiter).coroutine->frame.push_back(std::move(result));
+    ready.push_back(waiter);
+}
+
+void EventLoop::reject(long handle, std::string error) {
+    Promise& promise = promises.at(handle);
+
+    if (promise.waiter == 0) {
+        promise.done = true;
+        promise.error = std::move(error);
+        return;
+    }
+
+    // the waiter finds a null where its await left the handle and raises
+    // the error as it resumes
+    long waiter = promise.waiter;
+    promises.erase(handle);
+    Coroutine& coroutine = *promises.at(waiter).coroutine;
+    coroutine.frame.push_back(Value());
+    coroutine.error = std::move(error);
+    ready.push_back(waiter);
+}
+
+bool EventLoop::done(long handle) const {
+    return promises.at(handle).done;
+}
+
+bool EventLoop::idle() const {
+    return ready.empty() && timers.empty() && pending_reads == 0;
+}
+
+long EventLoop::next_ready() {
+    if (ready.empty())
+        return 0;
+
+    long handle = ready.front();
+    ready.pop_front();
+    return handle;
+}
+
+void EventLoop::poll() {
+    if (timers.empty() && pending_reads == 0)
+        fail("INTERPRETER", "DEADLOCK");
+
+    int timeout = -1;
+    if (!timers.empty()) {
+        int64_t wait = timers.top().first - now_milliseconds();
+        timeout = wait < 0 ? 0 : static_cast<int>(wait);
+    }
+
+    epoll_event events[4];
+    if (epoll_wait(epoll_fd, events, 4, timeout) > 0) {
+        uint64_t count;
+        ssize_t drained = ::read(wake_fd, &count, sizeof(count));
+        (void)drained;
+
+        std::vector<FinishedRead> reads;
+        {
+            std::lock_guard<std::mutex> guard(reads_lock);
+            reads.swap(finished_reads);
+            pending_reads -= reads.size();
+        }
+
+        // a failed read only fails whoever awaits it, the rest of the
+        // batch still finishes
+        for (auto& read : reads) {
+            if (read.ok)
+                finish(read.handle, Value::string(read.data.data(), read.data.size()));
+            else
+                reject(read.handle, error_message("BUILTINS", "CANNOT_READ_FILE", "path = '" + read.path + "'"));
+        }
+    }
+
+    int64_t now = now_milliseconds();
+    while (!timers.empty() && timers.top().first <= now) {
+        long handle = timers.top().second;
+        timers.pop();
+        finish(handle, Value());
+    }
+}
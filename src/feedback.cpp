@@ -0,0 +1,621 @@
+#include "lib/feedback.hpp"
+#include "lib/error.hpp"
+#include "lib/map.hpp"
+#include "lib/module.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+const int PROFILE_VERSION = 1;
+
+static uint64_t hash_number(uint64_t hash, uint64_t value) {
+    return content_hash(&value, sizeof(value), hash);
+}
+
+static uint64_t hash_string(uint64_t hash, const std::string& value) {
+    return content_hash(value.c_str(), value.size() + 1, hash);
+}
+
+uint64_t function_hash(const Program& program, const Function& function) {
+    uint64_t hash = hash_string(0, function.name);
+    hash = hash_number(hash, function.required_args);
+    hash = hash_number(hash, function.optional_args);
+    hash = hash_number(hash, function.locals);
+    hash = hash_number(hash, function.is_async);
+    for (const Instruction& instruction : function.code) {
+        hash = hash_number(hash, static_cast<uint64_t>(instruction.op));
+        hash = hash_number(hash, instruction.count);
+        switch (instruction.op) {
+            // constants and globals by what they are, not where they are kept
+            case OpCode::PUSH_CONST: {
+                const Value& constant = program.constants[instruction.arg];
+                hash = hash_number(hash, static_cast<uint64_t>(constant.type));
+                hash = hash_number(hash, hash_value(constant));
+                break;
+            }
+            case OpCode::GET_GLOBAL:
+            case OpCode::SET_GLOBAL:
+            case OpCode::CALL_NATIVE:
+                hash = hash_string(hash, program.globals[instruction.arg].name);
+                break;
+            default:
+                hash = hash_number(hash, instruction.arg);
+                break;
+        }
+    }
+    // 0 stands for no function in a call site
+    return hash == 0 ? 1 : hash;
+}
+
+static std::string hex(uint64_t value) {
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+    return buffer;
+}
+
+// FILE FORMAT
+
+// A text file starting with "bask-profile <version>", then for each function
+//   function <hash> <name> <calls> <loop turns>
+//   args <type mask>...
+//   branch <ip> <taken> <not taken>
+//   site <ip> <calls> <callee hash> <type mask>...
+// with only the branches and sites that were reached.
+
+void Profile::write(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file)
+        fail("PROFILE", "CANNOT_WRITE_PROFILE", "path = '" + path + "'");
+
+    // by name so profiles of the same program compare line by line
+    std::vector<std::pair<std::string, uint64_t>> order;
+    for (const auto& entry : functions)
+        order.emplace_back(entry.second.name, entry.first);
+    std::sort(order.begin(), order.end());
+
+    file << "bask-profile " << PROFILE_VERSION << "\n";
+    for (const auto& entry : order) {
+        const FunctionProfile& function = functions.at(entry.second);
+        file << "function " << hex(entry.second) << " " << function.name << " " << function.calls << " "
+             << function.loop_turns << "\n";
+        if (!function.arg_types.empty()) {
+            file << "args";
+            for (TypeMask types : function.arg_types)
+                file << " " << types;
+            file << "\n";
+        }
+        for (size_t ip = 0; ip < function.branches.size(); ip++) {
+            const BranchCounts& branch = function.branches[ip];
+            if (branch.taken != 0 || branch.not_taken != 0)
+                file << "branch " << ip << " " << branch.taken << " " << branch.not_taken << "\n";
+        }
+        for (size_t ip = 0; ip < function.sites.size(); ip++) {
+            const CallSite& site = function.sites[ip];
+            if (site.calls == 0)
+                continue;
+            file << "site " << ip << " " << site.calls << " " << hex(site.callee);
+            for (TypeMask types : site.types)
+                file << " " << types;
+            file << "\n";
+        }
+    }
+
+    file.close();
+    if (!file)
+        fail("PROFILE", "CANNOT_WRITE_PROFILE", "path = '" + path + "'");
+}
+
+[[noreturn]] static void corrupt(const std::string& path) {
+    fail("PROFILE", "CORRUPT_PROFILE", "path = '" + path + "'");
+}
+
+static uint64_t read_hash(std::istream& line, const std::string& path) {
+    std::string text;
+    line >> text;
+    if (text.size() != 16 || text.find_first_not_of("0123456789abcdef") != std::string::npos)
+        corrupt(path);
+    return std::stoull(text, nullptr, 16);
+}
+
+// grows entries so that index is in it
+template <typename T>
+static T& at(std::vector<T>& entries, size_t index) {
+    if (index >= entries.size())
+        entries.resize(index + 1);
+    return entries[index];
+}
+
+Profile Profile::read(const std::string& path, const Program& program) {
+    std::ifstream file(path);
+    if (!file)
+        fail("PROFILE", "CANNOT_READ_PROFILE", "path = '" + path + "'");
+
+    std::string text;
+    int version = 0;
+    if (!std::getline(file, text) || std::sscanf(text.c_str(), "bask-profile %d", &version) != 1)
+        corrupt(path);
+    if (version != PROFILE_VERSION)
+        fail("PROFILE", "UNSUPPORTED_VERSION", "path = '" + path + "', version = " + std::to_string(version));
+
+    std::unordered_map<uint64_t, size_t> code_sizes;
+    for (const Function& function : program.functions)
+        code_sizes[function_hash(program, function)] = function.code.size();
+
+    Profile profile;
+    FunctionProfile* function = nullptr;
+    // ips of the current function are below this, none are kept for one the
+    // program does not have
+    size_t code_size = 0;
+    bool stale = false;
+    while (std::getline(file, text)) {
+        if (text.empty())
+            continue;
+        std::istringstream line(text);
+        std::string kind;
+        line >> kind;
+        if (kind == "function") {
+            uint64_t hash = read_hash(line, path);
+            function = &profile.functions[hash];
+            if (!(line >> function->name >> function->calls >> function->loop_turns))
+                corrupt(path);
+            auto found = code_sizes.find(hash);
+            stale = found == code_sizes.end();
+            code_size = stale ? 0 : found->second;
+        } else if (function == nullptr) {
+            corrupt(path);
+        } else if (kind == "args") {
+            TypeMask types;
+            while (line >> types)
+                function->arg_types.push_back(types);
+            if (!line.eof())
+                corrupt(path);
+        } else if (kind == "branch") {
+            size_t ip = 0;
+            BranchCounts counts;
+            if (!(line >> ip >> counts.taken >> counts.not_taken))
+                corrupt(path);
+            if (ip < code_size)
+                at(function->branches, ip) = counts;
+            else if (!stale)
+                corrupt(path);
+        } else if (kind == "site") {
+            size_t ip = 0;
+            CallSite site;
+            if (!(line >> ip >> site.calls))
+                corrupt(path);
+            site.callee = read_hash(line, path);
+            TypeMask types;
+            while (line >> types)
+                site.types.push_back(types);
+            if (!line.eof())
+                corrupt(path);
+            if (ip < code_size)
+                at(function->sites, ip) = std::move(site);
+            else if (!stale)
+                corrupt(path);
+        } else {
+            corrupt(path);
+        }
+    }
+    return profile;
+}
+
+// RECORDING
+
+ProfileRecorder::ProfileRecorder(const Program& program) : program(program), functions(program.functions.size()) {
+    for (const Function& function : program.functions)
+        hashes.push_back(function_hash(program, function));
+}
+
+FunctionProfile& ProfileRecorder::function(size_t index) {
+    FunctionProfile& profile = functions[index];
+    size_t size = program.functions[index].code.size();
+    if (profile.sites.size() != size) {
+        profile.name = program.functions[index].name;
+        profile.branches.resize(size);
+        profile.sites.resize(size);
+    }
+    return profile;
+}
+
+void ProfileRecorder::arguments(FunctionProfile& profile, const Value* args, size_t argc) {
+    if (profile.arg_types.size() < argc)
+        profile.arg_types.resize(argc);
+    for (size_t i = 0; i < argc; i++)
+        profile.arg_types[i] |= type_bit(args[i]);
+}
+
+void ProfileRecorder::call(size_t index, const Value* args, size_t argc) {
+    FunctionProfile& profile = function(index);
+    profile.calls++;
+    arguments(profile, args, argc);
+}
+
+void ProfileRecorder::site(size_t index, size_t ip, const Value* callee, size_t argc) {
+    CallSite& site = function(index).sites[ip];
+    uint64_t hash = callee->type == ValueTypes::FUNC ? hashes[callee->func_value] : 0;
+    site.callee = site.calls == 0 || site.callee == hash ? hash : 0;
+    site.calls++;
+    if (site.types.size() < argc)
+        site.types.resize(argc);
+    for (size_t i = 0; i < argc; i++)
+        site.types[i] |= type_bit(callee[1 + i]);
+
+    // the callee may still fail on the argument count, it was called anyway
+    if (callee->type == ValueTypes::FUNC)
+        call(callee->func_value, callee + 1, argc);
+}
+
+void ProfileRecorder::branch(size_t index, size_t ip, size_t target, bool taken) {
+    FunctionProfile& profile = function(index);
+    BranchCounts& counts = profile.branches[ip];
+    if (taken) {
+        counts.taken++;
+        if (target <= ip)
+            profile.loop_turns++;
+    } else {
+        counts.not_taken++;
+    }
+}
+
+Profile ProfileRecorder::profile() const {
+    Profile result;
+    for (size_t i = 0; i < functions.size(); i++)
+        if (!functions[i].sites.empty())
+            result.functions[hashes[i]] = functions[i];
+    return result;
+}
+
+// INLINING
+
+// what instruction pops off the stack and pushes on it
+static void stack_effect(const Instruction& instruction, size_t& pops, size_t& pushes) {
+    pops = 0;
+    pushes = 0;
+    switch (instruction.op) {
+        case OpCode::PUSH_NULL:
+        case OpCode::PUSH_INT:
+        case OpCode::PUSH_CONST:
+        case OpCode::GET_LOCAL:
+        case OpCode::GET_GLOBAL:
+            pushes = 1;
+            break;
+        case OpCode::SET_LOCAL:
+        case OpCode::SET_GLOBAL:
+        case OpCode::POP:
+        case OpCode::RETURN:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_TRUE:
+            pops = 1;
+            break;
+        case OpCode::POS:
+        case OpCode::NEG:
+        case OpCode::NOT:
+        case OpCode::AWAIT:
+            pops = 1;
+            pushes = 1;
+            break;
+        case OpCode::ADD:
+        case OpCode::SUB:
+        case OpCode::MULT:
+        case OpCode::DIV:
+        case OpCode::EQUAL:
+        case OpCode::NOT_EQUAL:
+        case OpCode::LESS:
+        case OpCode::LESS_EQUAL:
+        case OpCode::GREATER:
+        case OpCode::GREATER_EQUAL:
+            pops = 2;
+            pushes = 1;
+            break;
+        case OpCode::CALL:
+            pops = instruction.arg + 1;
+            pushes = 1;
+            break;
+        case OpCode::TAIL_CALL:
+            pops = instruction.arg + 1;
+            break;
+        case OpCode::CALL_NATIVE:
+            pops = instruction.count;
+            pushes = 1;
+            break;
+        case OpCode::MAKE_MAP:
+            pops = 2 * instruction.arg;
+            pushes = 1;
+            break;
+        case OpCode::JUMP:
+        case OpCode::ADD_LOCAL:
+            break;
+    }
+}
+
+static bool is_jump(OpCode op) {
+    return op == OpCode::JUMP || op == OpCode::JUMP_IF_FALSE || op == OpCode::JUMP_IF_TRUE;
+}
+
+// For each CALL, the instruction that pushed its callee, or -1 when that is
+// not a single one whose value goes nowhere else. Follows which instruction
+// pushed each stack slot along every path, a slot pushed by different ones
+// on paths that meet being -1 from there on.
+static std::vector<long> callee_pushes(const Function& function) {
+    const std::vector<Instruction>& code = function.code;
+    std::vector<long> result(code.size(), -1);
+    std::vector<std::vector<long>> stacks(code.size());
+    std::vector<bool> seen(code.size(), false);
+    // pushed values that reach more than one instruction
+    std::vector<bool> escaped(code.size(), false);
+    std::vector<size_t> work;
+    bool consistent = true;
+
+    auto flow = [&](size_t target, const std::vector<long>& stack) {
+        if (target >= code.size())
+            return;
+        if (!seen[target]) {
+            seen[target] = true;
+            stacks[target] = stack;
+            work.push_back(target);
+            return;
+        }
+        std::vector<long>& known = stacks[target];
+        if (known.size() != stack.size()) {
+            consistent = false;
+            return;
+        }
+        bool changed = false;
+        for (size_t i = 0; i < stack.size(); i++) {
+            if (known[i] == stack[i])
+                continue;
+            if (known[i] >= 0)
+                escaped[known[i]] = true;
+            if (stack[i] >= 0)
+                escaped[stack[i]] = true;
+            if (known[i] != -1) {
+                known[i] = -1;
+                changed = true;
+            }
+        }
+        if (changed)
+            work.push_back(target);
+    };
+
+    for (size_t entry : function.entries)
+        flow(entry, {});
+    while (!work.empty() && consistent) {
+        size_t ip = work.back();
+        work.pop_back();
+        const Instruction& instruction = code[ip];
+        std::vector<long> stack = stacks[ip];
+        size_t pops, pushes;
+        stack_effect(instruction, pops, pushes);
+        if (stack.size() < pops) {
+            consistent = false;
+            break;
+        }
+        stack.resize(stack.size() - pops);
+        if (pushes != 0)
+            stack.push_back(ip);
+
+        switch (instruction.op) {
+            case OpCode::RETURN:
+            case OpCode::TAIL_CALL:
+                break;
+            case OpCode::JUMP:
+                flow(instruction.arg, stack);
+                break;
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::JUMP_IF_TRUE:
+                flow(instruction.arg, stack);
+                flow(ip + 1, stack);
+                break;
+            default:
+                flow(ip + 1, stack);
+                break;
+        }
+    }
+    if (!consistent)
+        return result;
+
+    // each pushed value must be popped by one instruction only
+    std::vector<long> consumer(code.size(), -1);
+    for (size_t ip = 0; ip < code.size(); ip++) {
+        if (!seen[ip])
+            continue;
+        size_t pops, pushes;
+        stack_effect(code[ip], pops, pushes);
+        const std::vector<long>& stack = stacks[ip];
+        for (size_t i = stack.size() - pops; i < stack.size(); i++) {
+            long pusher = stack[i];
+            if (pusher < 0)
+                continue;
+            if (consumer[pusher] == -1)
+                consumer[pusher] = ip;
+            else if (consumer[pusher] != static_cast<long>(ip))
+                escaped[pusher] = true;
+        }
+    }
+
+    for (size_t ip = 0; ip < code.size(); ip++) {
+        if (!seen[ip] || code[ip].op != OpCode::CALL)
+            continue;
+        const std::vector<long>& stack = stacks[ip];
+        long pusher = stack[stack.size() - code[ip].arg - 1];
+        if (pusher >= 0 && !escaped[pusher])
+            result[ip] = pusher;
+    }
+    return result;
+}
+
+static bool inlinable(const Function& callee, size_t argc) {
+    if (callee.is_async || callee.memo || callee.code.size() > INLINE_MAX_SIZE)
+        return false;
+    if (argc < callee.required_args || argc > callee.required_args + callee.optional_args)
+        return false;
+    for (const Instruction& instruction : callee.code)
+        if (instruction.op == OpCode::TAIL_CALL || instruction.op == OpCode::AWAIT)
+            return false;
+    return true;
+}
+
+// Replaces the call at call, whose callee was pushed by the GET_GLOBAL at
+// get, with the code of callee. Its arguments are stored into new locals of
+// caller, its returns jump past it with the result on the stack.
+static void splice(Function& caller, size_t get, size_t call, const Function& callee, std::vector<long>& recorded) {
+    size_t argc = caller.code[call].arg;
+    size_t base = caller.locals;
+    // the GET_GLOBAL goes, so the block starts one earlier
+    size_t start = call - 1;
+
+    std::vector<Instruction> block;
+    for (size_t i = argc; i > 0; i--)
+        block.emplace_back(OpCode::SET_LOCAL, base + i - 1);
+    size_t entry = callee.entries[argc - callee.required_args];
+    if (entry != 0)
+        block.emplace_back(OpCode::JUMP, entry);
+    size_t body = block.size();
+    for (Instruction instruction : callee.code) {
+        switch (instruction.op) {
+            case OpCode::GET_LOCAL:
+            case OpCode::SET_LOCAL:
+                instruction.arg += base;
+                break;
+            case OpCode::ADD_LOCAL:
+                instruction.count += base;
+                break;
+            case OpCode::RETURN:
+                instruction = Instruction(OpCode::JUMP, callee.code.size());
+                break;
+            default:
+                break;
+        }
+        block.push_back(instruction);
+    }
+    for (size_t i = argc; i < block.size(); i++)
+        if (is_jump(block[i].op))
+            block[i].arg += start + body;
+
+    auto moved = [&](size_t ip) -> size_t {
+        if (ip <= get)
+            return ip;
+        if (ip < call)
+            return ip - 1;
+        if (ip == call)
+            return start;
+        return ip + block.size() - 2;
+    };
+
+    std::vector<Instruction> code;
+    std::vector<long> positions;
+    for (size_t ip = 0; ip < caller.code.size(); ip++) {
+        if (ip == get)
+            continue;
+        if (ip == call) {
+            code.insert(code.end(), block.begin(), block.end());
+            positions.resize(code.size(), -1);
+            continue;
+        }
+        Instruction instruction = caller.code[ip];
+        if (is_jump(instruction.op))
+            instruction.arg = moved(instruction.arg);
+        code.push_back(instruction);
+        positions.push_back(recorded[ip]);
+    }
+
+    caller.code = std::move(code);
+    recorded = std::move(positions);
+    for (size_t& entry : caller.entries)
+        entry = moved(entry);
+    for (auto& line : caller.lines)
+        line.first = moved(line.first);
+    caller.locals += callee.locals;
+    caller.max_stack += callee.max_stack;
+}
+
+// inlines the hot calls of program.functions[index] to small functions,
+// from originals so that what was inlined into those is not copied again
+static size_t inline_calls(Program& program, size_t index, const FunctionProfile& profile,
+        const std::vector<Function>& originals, const std::unordered_map<uint64_t, size_t>& by_hash) {
+    Function& caller = program.functions[index];
+    // the ip each instruction had when the profile was recorded, -1 for
+    // inlined code
+    std::vector<long> recorded(caller.code.size());
+    for (size_t ip = 0; ip < recorded.size(); ip++)
+        recorded[ip] = ip;
+
+    size_t inlined = 0;
+    while (caller.code.size() <= INLINE_MAX_CALLER_SIZE) {
+        std::vector<long> pushes = callee_pushes(caller);
+        long call = -1;
+        size_t target = 0;
+        for (size_t ip = 0; ip < caller.code.size() && call == -1; ip++) {
+            const Instruction& instruction = caller.code[ip];
+            if (instruction.op != OpCode::CALL || recorded[ip] < 0 || pushes[ip] < 0)
+                continue;
+            size_t original = recorded[ip];
+            if (original >= profile.sites.size())
+                continue;
+            const CallSite& site = profile.sites[original];
+            auto callee = by_hash.find(site.callee);
+            if (site.calls < INLINE_MIN_CALLS || callee == by_hash.end() || callee->second == index)
+                continue;
+            // the function called must be the one the site always called
+            const Instruction& get = caller.code[pushes[ip]];
+            if (get.op != OpCode::GET_GLOBAL)
+                continue;
+            const Global& global = program.globals[get.arg];
+            if (!global.constant || global.value.type != ValueTypes::FUNC ||
+                    global.value.func_value != callee->second)
+                continue;
+            if (!inlinable(originals[callee->second], instruction.arg))
+                continue;
+            call = ip;
+            target = callee->second;
+        }
+        if (call == -1)
+            break;
+        splice(caller, pushes[call], call, originals[target], recorded);
+        inlined++;
+    }
+    return inlined;
+}
+
+ProfileUse apply_profile(Program& program, const Profile& profile) {
+    ProfileUse use;
+    size_t count = program.functions.size();
+    std::unordered_map<uint64_t, size_t> by_hash;
+    std::vector<const FunctionProfile*> found(count, nullptr);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t hash = function_hash(program, program.functions[i]);
+        by_hash[hash] = i;
+        auto entry = profile.functions.find(hash);
+        if (entry != profile.functions.end()) {
+            found[i] = &entry->second;
+            use.matched++;
+        }
+    }
+    for (const auto& entry : profile.functions)
+        if (by_hash.count(entry.first) == 0)
+            use.stale++;
+
+    std::vector<Function> originals = program.functions;
+    for (size_t i = 0; i < count; i++)
+        if (found[i] != nullptr)
+            use.inlined += inline_calls(program, i, *found[i], originals, by_hash);
+
+    // the types the JIT compiles for were the only ones seen, so it can have
+    // them ready before the first call
+    TypeMask int_only = 1u << static_cast<unsigned>(ValueTypes::INT);
+    for (size_t i = 1; i < count; i++) {
+        const FunctionProfile* function = found[i];
+        if (function == nullptr || !function->hot())
+            continue;
+        bool ints = std::all_of(function->arg_types.begin(), function->arg_types.end(),
+            [&](TypeMask types) { return types == int_only; });
+        if (ints && function->arg_types.size() >= program.functions[i].required_args) {
+            program.functions[i].precompile = true;
+            use.precompiled++;
+        }
+    }
+    return use;
+}
@@ -1,129 +1,846 @@
 #include "lib/interpreter.hpp"
+#include "lib/native.hpp"
+#include "lib/profiler.hpp"
+#include "lib/bigint.hpp"
+#include "lib/map.hpp"
+#include "lib/error.hpp"
 
-namespace build_in_functions {
-    long three(const std::vector<long>& args) {
-        return 3;
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+[[noreturn]] static void runtime_error(const char* error) {
+    fail("INTERPRETER", error);
+}
+
+static thread_local Interpreter* current_interpreter = nullptr;
+
+// makes an interpreter current for the duration of a call, and its budget
+// the one allocations count against
+class CurrentInterpreter {
+private:
+    Interpreter* outer;
+    Budget* outer_budget;
+public:
+    CurrentInterpreter(Interpreter* interpreter, Budget* budget)
+    : outer(current_interpreter), outer_budget(swap_budget(budget)) {
+        current_interpreter = interpreter;
     }
 
-    long exitf(const std::vector<long>& args) {
-        if (args.size() != 1)
-            exit(1);
-        exit(args.at(0));
+    ~CurrentInterpreter() {
+        current_interpreter = outer;
+        swap_budget(outer_budget);
     }
-}
+};
 
-Interpreter::Interpreter(const std::vector<std::unique_ptr<AstStatement>>& ast_tree)
-: ast_tree(ast_tree), functions(default_functions) {}
+Value arithmetic(OpCode op, const Value& left, const Value& right) {
+    if (left.type == ValueTypes::INT && right.type == ValueTypes::INT) {
+        long result;
+        switch (op) {
+            case OpCode::ADD:
+                if (!__builtin_add_overflow(left.int_value, right.int_value, &result))
+                    return Value::integer(result);
+                break;
+            case OpCode::SUB:
+                if (!__builtin_sub_overflow(left.int_value, right.int_value, &result))
+                    return Value::integer(result);
+                break;
+            case OpCode::MULT:
+                if (!__builtin_mul_overflow(left.int_value, right.int_value, &result))
+                    return Value::integer(result);
+                break;
+            default:
+                if (right.int_value == 0)
+                    runtime_error("DIVISION_BY_ZERO");
+                if (right.int_value != -1 || left.int_value != LONG_MIN)
+                    return Value::integer(left.int_value / right.int_value);
+                break;
+        }
+        return big_arithmetic(op, left, right);
+    }
 
-long Interpreter::interprite_int(const std::unique_ptr<AstExpr>& ast_node) {
-    return static_cast<AstInt*>(ast_node.get())->value;
-}
-    
-long Interpreter::interprite_var_get(const std::unique_ptr<AstExpr>& ast_node) {
-    const AstVarGet* ptr = static_cast<AstVarGet*>(ast_node.get());
-    std::string name = ptr->name;
-    if (variables.find(name) == variables.end())
-        exit(1);
-    return variables.at(name);
+    if (op == OpCode::ADD && left.type == ValueTypes::STRING && right.type == ValueTypes::STRING)
+        return concat(left, right);
+
+    if (is_integer(left) && is_integer(right))
+        return big_arithmetic(op, left, right);
+
+    if ((!is_integer(left) && left.type != ValueTypes::FLOAT)
+        || (!is_integer(right) && right.type != ValueTypes::FLOAT))
+        runtime_error("TYPE_ERROR");
+
+    double a = (left.type == ValueTypes::FLOAT) ? left.float_value : big_to_double(left);
+    double b = (right.type == ValueTypes::FLOAT) ? right.float_value : big_to_double(right);
+
+    switch (op) {
+        case OpCode::ADD:
+            return Value::floating(a + b);
+        case OpCode::SUB:
+            return Value::floating(a - b);
+        case OpCode::MULT:
+            return Value::floating(a * b);
+        default:
+            return Value::floating(a / b);
+    }
 }
 
-long Interpreter::interprite_unary_op(const std::unique_ptr<AstExpr>& ast_node) {
-    const AstUnaryOp* ptr = static_cast<AstUnaryOp*>(ast_node.get());
-    switch (ptr->type) {
-        case UnaryOpType::PLUS_SIGN:
-            return interprite_expr(ptr->value);
-        case UnaryOpType::MINUS_SIGN:
-            return -interprite_expr(ptr->value);
+// whether order, as big_compare gives it, satisfies the comparison op
+static bool holds(OpCode op, int order) {
+    switch (op) {
+        case OpCode::EQUAL:
+            return order == 0;
+        case OpCode::NOT_EQUAL:
+            return order != 0;
+        case OpCode::LESS:
+            return order < 0;
+        case OpCode::LESS_EQUAL:
+            return order <= 0;
+        case OpCode::GREATER:
+            return order > 0;
         default:
-            exit(1);
+            return order >= 0;
     }
 }
 
-long Interpreter::interprite_binary_op(const std::unique_ptr<AstExpr>& ast_node) {
-    const AstBinaryOp* ptr = static_cast<AstBinaryOp*>(ast_node.get());
-    switch (ptr->type) {
-        case BinaryOpType::ADD:
-            return interprite_expr(ptr->left) + interprite_expr(ptr->right);
-        case BinaryOpType::SUB:
-            return interprite_expr(ptr->left) - interprite_expr(ptr->right);
-        case BinaryOpType::MULT:
-            return interprite_expr(ptr->left) * interprite_expr(ptr->right);
-        case BinaryOpType::DIV:
-            return interprite_expr(ptr->left) / interprite_expr(ptr->right);
+// the same value, for those that are not numbers
+static bool same(const Value& left, const Value& right) {
+    if (left.type != right.type)
+        return false;
+
+    switch (left.type) {
+        case ValueTypes::_NULL:
+            return true;
+        case ValueTypes::STRING: {
+            size_t size = string_size(left);
+            return size == string_size(right) && std::memcmp(string_data(left), string_data(right), size) == 0;
+        }
+        case ValueTypes::FUNC:
+            return left.func_value == right.func_value;
+        case ValueTypes::NATIVE_FUNC:
+            return left.native_value == right.native_value;
         default:
-            exit(1);
+            return left.object_value == right.object_value;
     }
 }
 
-long Interpreter::interprite_func_call(const std::unique_ptr<AstExpr>& ast_node) {
-    const AstFuncCall* ptr = static_cast<AstFuncCall*>(ast_node.get());
+Value compare(OpCode op, const Value& left, const Value& right) {
+    if (left.type == ValueTypes::INT && right.type == ValueTypes::INT) {
+        long a = left.int_value;
+        long b = right.int_value;
+        return Value::integer(holds(op, (a > b) - (a < b)));
+    }
+
+    bool numbers = (is_integer(left) || left.type == ValueTypes::FLOAT)
+        && (is_integer(right) || right.type == ValueTypes::FLOAT);
+
+    if (numbers && is_integer(left) && is_integer(right))
+        return Value::integer(holds(op, big_compare(left, right)));
+
+    if (numbers) {
+        // compared as IEEE does, so nan is unequal to everything
+        double a = (left.type == ValueTypes::FLOAT) ? left.float_value : big_to_double(left);
+        double b = (right.type == ValueTypes::FLOAT) ? right.float_value : big_to_double(right);
+        switch (op) {
+            case OpCode::EQUAL:
+                return Value::integer(a == b);
+            case OpCode::NOT_EQUAL:
+                return Value::integer(a != b);
+            case OpCode::LESS:
+                return Value::integer(a < b);
+            case OpCode::LESS_EQUAL:
+                return Value::integer(a <= b);
+            case OpCode::GREATER:
+                return Value::integer(a > b);
+            default:
+                return Value::integer(a >= b);
+        }
+    }
 
-    std::string name = ptr->name;
-    if (functions.find(name) == functions.end())
-        exit(1);
+    if (op == OpCode::EQUAL || op == OpCode::NOT_EQUAL)
+        return Value::integer(same(left, right) == (op == OpCode::EQUAL));
 
-    std::vector<long> args;
-    for (const auto& arg : ptr->args)
-        args.push_back(interprite_expr(arg));
-    
-    return functions.at(name)(args);
+    if (left.type != ValueTypes::STRING || right.type != ValueTypes::STRING)
+        runtime_error("TYPE_ERROR");
+
+    size_t left_size = string_size(left);
+    size_t right_size = string_size(right);
+    int order = std::memcmp(string_data(left), string_data(right), std::min(left_size, right_size));
+    if (order == 0)
+        order = (left_size > right_size) - (left_size < right_size);
+    return Value::integer(holds(op, order));
 }
 
-long Interpreter::interprite_expr(const std::unique_ptr<AstExpr>& ast_node) {
-    switch (ast_node->get_type()) {
-        case AstType::INT:
-            return interprite_int(ast_node);
-        case AstType::VAR_GET:
-            return interprite_var_get(ast_node);
-        case AstType::UNARY_OP:
-            return interprite_unary_op(ast_node);
-        case AstType::BINARY_OP:
-            return interprite_binary_op(ast_node);
-        case AstType::FUNC_CALL:
-            return interprite_func_call(ast_node);
-        default:
-            exit(1);
+static void count_memo(const MemoTable& table, ExecutionStats& stats) {
+    if (table.lookups == 0)
+        return;
+    stats.memo_functions++;
+    stats.memo_lookups += table.lookups;
+    stats.memo_hits += table.hits;
+}
+
+static void count_memos(const std::vector<MemoTable>& memos, ExecutionStats& stats) {
+    for (const MemoTable& table : memos)
+        count_memo(table, stats);
+}
+
+// arrays and maps in the globals of a loaded snapshot are templates shared
+// by every interpreter of the program, each changes a copy of its own
+static Value own_global(const Value& value) {
+    if (value.type == ValueTypes::ARRAY || value.type == ValueTypes::MAP)
+        return isolate(value);
+    return value;
+}
+
+Interpreter::Interpreter(const Program& program, const InterpreterOptions& options)
+: program(program), options(options), stack(nullptr), stack_size(options.stack_size), high_water(0),
+  max_frames(options.stack_size), sp(0), initialized(program.initialized),
+  task_depth(0), scheduler(nullptr), running_coroutine(0), suspended(false), budget(options.limits), recorder(nullptr) {
+    stack = static_cast<Value*>(std::malloc(stack_size * sizeof(Value)));
+    if (stack == nullptr && stack_size != 0)
+        throw std::bad_alloc();
+
+    if (options.jit)
+        jit.reset(new Jit(program, options.jit_threshold, options.stack_size * sizeof(Value), jit_budget()));
+    if (jit)
+        for (size_t i = 0; i < program.functions.size(); i++)
+            if (program.functions[i].precompile)
+                jit->precompile(i);
+
+    globals.reserve(program.globals.size());
+    for (const auto& global : program.globals)
+        globals.push_back(own_global(global.value));
+    frames.reserve(max_frames);
+    memos.resize(program.functions.size());
+}
+
+Interpreter::~Interpreter() {
+    own_scheduler.reset();
+    loop.reset();
+    for (size_t i = 0; i < high_water; i++)
+        stack[i].~Value();
+    std::free(stack);
+}
+
+void Interpreter::reach(size_t depth) {
+    for (; high_water < depth; high_water++)
+        new (&stack[high_water]) Value();
+}
+
+size_t Interpreter::push_frame(size_t argc, size_t return_ip) {
+    const Function& function = program.functions[stack[sp - argc - 1].func_value];
+
+    if (argc < function.required_args || argc > function.required_args + function.optional_args)
+        runtime_error("WRONG_ARGUMENT_COUNT");
+
+    budget.take(static_cast<long>(function.code.size()));
+
+    size_t base = sp - argc;
+
+    if (frames.size() == max_frames || base + function.max_stack > stack_size)
+        fail_limit(Limit::STACK, "STACK_OVERFLOW");
+
+    if (base + function.max_stack > high_water)
+        reach(base + function.max_stack);
+
+    frames.emplace_back(base, return_ip, &function);
+    sp = base + function.locals;
+
+#if BASK_STATS
+    counters.calls++;
+    if (frames.size() > counters.peak_frames)
+        counters.peak_frames = frames.size();
+    if (base + function.max_stack > counters.peak_stack)
+        counters.peak_stack = base + function.max_stack;
+#endif
+
+    return function.entries[argc - function.required_args];
+}
+
+bool Interpreter::call_native(JitCode native, size_t argc) {
+    const Function& function = program.functions[stack[sp - argc - 1].func_value];
+    const Value* args = &stack[sp - argc];
+
+    if (argc < function.required_args || argc > function.required_args + function.optional_args)
+        return false;
+    for (size_t i = 0; i < argc; i++)
+        if (args[i].type != ValueTypes::INT)
+            return false;
+
+    long result;
+    if (!jit->invoke(native, args, argc, result)) {
+        jit->discard(stack[sp - argc - 1].func_value);
+        return false;
+    }
+    sp -= argc;
+    stack[sp - 1] = Value::integer(result);
+
+    return true;
+}
+
+bool Interpreter::lookup_memo(size_t argc, size_t depth) {
+    size_t index = stack[sp - argc - 1].func_value;
+    const Function& function = program.functions[index];
+    MemoTable& table = memos[index];
+
+    if (!function.memo) {
+        // pure funcs called often are cached until they show few hits
+        if (table.abandoned || options.memo_threshold == 0 || ++table.calls < options.memo_threshold)
+            return false;
+        if (table.lookups >= MEMO_TRIAL && table.hits * MEMO_MIN_HIT_RATE < table.lookups) {
+            table.abandon();
+            return false;
+        }
+    }
+
+    // push_frame reports it
+    if (argc < function.required_args || argc > function.required_args + function.optional_args)
+        return false;
+
+    const Value* args = &stack[sp - argc];
+    size_t hash = memo_key(args, argc);
+    if (hash == 0)
+        return false;
+
+    const Value* result = table.find(hash, args, argc);
+    if (result != nullptr) {
+        sp -= argc;
+        stack[sp - 1] = *result;
+        return true;
     }
+    pending_memos.emplace_back(depth, index, hash, table.reserve(hash, args, argc));
+    return false;
 }
 
-void Interpreter::interprite_var_decl(const std::unique_ptr<AstStatement>& ast_node) {
-    const AstVarDecl* ptr = static_cast<AstVarDecl*>(ast_node.get());
-    std::string name = ptr->name;
-    if (variables.find(name) != variables.end())
-        exit(1);
-    variables[name] = interprite_expr(ptr->value);
+void Interpreter::store_memos(size_t depth, const Value& result) {
+    while (!pending_memos.empty() && pending_memos.back().depth >= depth) {
+        const PendingMemo& call = pending_memos.back();
+        if (call.depth == depth)
+            memos[call.function].store(call.hash, call.generation, result);
+        pending_memos.pop_back();
+    }
 }
 
-void Interpreter::interprite_var_set(const std::unique_ptr<AstStatement>& ast_node) {
-    const AstVarSet* ptr = static_cast<AstVarSet*>(ast_node.get());
-    std::string name = ptr->name;
-    if (variables.find(name) == variables.end())
-        exit(1);
-    variables[name] = interprite_expr(ptr->value);
+void Interpreter::drop_memos(size_t depth) {
+    while (!pending_memos.empty() && pending_memos.back().depth > depth)
+        pending_memos.pop_back();
 }
 
-void Interpreter::interprite_no_return_expr(const std::unique_ptr<AstStatement>& ast_node) {
-    interprite_expr(static_cast<AstNoReturnExpr*>(ast_node.get())->expr);
+bool Interpreter::call_in_place(size_t argc, size_t ip, size_t depth) {
+    const Value& callee = stack[sp - argc - 1];
+
+    if (callee.type == ValueTypes::NATIVE_FUNC) {
+        const Native& native = *callee.native_value;
+        if (!native.accepts(argc))
+            runtime_error("WRONG_ARGUMENT_COUNT");
+
+        BASK_COUNT(counters.native_calls++);
+        Value result = native.invoke(native, &stack[sp - argc], argc);
+        if (profile_ticks.load(std::memory_order_relaxed) != 0)
+            sample(ip, &native.name);
+        sp -= argc;
+        stack[sp - 1] = std::move(result);
+        return true;
+    }
+
+    if (callee.type != ValueTypes::FUNC)
+        runtime_error("NOT_CALLABLE");
+
+    if (program.functions[callee.func_value].is_async) {
+        long handle = start_coroutine(&stack[sp - argc], argc);
+        sp -= argc;
+        stack[sp - 1] = Value::integer(handle);
+        return true;
+    }
+
+    const Function& function = program.functions[callee.func_value];
+    if (function.pure && lookup_memo(argc, depth))
+        return true;
+
+    if (jit) {
+        JitCode native = jit->lookup(callee.func_value);
+        if (native != nullptr && call_native(native, argc)) {
+            BASK_COUNT(counters.calls++);
+            if (function.pure)
+                store_memos(depth, stack[sp - 1]);
+            if (profile_ticks.load(std::memory_order_relaxed) != 0)
+                sample(ip, &function.name);
+            return true;
+        }
+    }
+
+    return false;
 }
 
-void Interpreter::interprite_statement(const std::unique_ptr<AstStatement>& ast_node) {
-    switch (ast_node->get_type()) {
-        case AstType::VAR_DECL:
-            return interprite_var_decl(ast_node);
-        case AstType::VAR_SET:
-            return interprite_var_set(ast_node);
-        case AstType::NO_RETURN_EXPR:
-            return interprite_no_return_expr(ast_node);
-        default:
-            exit(1);
+void Interpreter::sample(size_t ip, const std::string* leaf) {
+    long ticks = profile_ticks.exchange(0, std::memory_order_relaxed);
+    Profiler* profiler = Profiler::active();
+    if (ticks == 0 || profiler == nullptr)
+        return;
+
+    // every frame but the top one stands at the call that made the next
+    std::string stack;
+    for (size_t i = 0; i < frames.size(); i++) {
+        size_t at = (i + 1 < frames.size()) ? frames[i + 1].return_ip : ip;
+        const Function& function = *frames[i].function;
+        if (i != 0)
+            stack += ';';
+        stack += function.name;
+        stack += ':';
+        stack += std::to_string(function.line_at(at == 0 ? 0 : at - 1));
+    }
+    if (leaf != nullptr) {
+        stack += ';';
+        stack += *leaf;
+    }
+
+    profiler->record(stack, ticks);
+}
+
+Value Interpreter::execute(size_t ip, size_t exit_depth) {
+    const Frame* frame = &frames.back();
+    const Instruction* code = frame->function->code.data();
+    Value* base = &stack[frame->base];
+
+    while (true) {
+        const Instruction& instruction = code[ip++];
+        BASK_COUNT(counters.ops[static_cast<size_t>(instruction.op)]++);
+
+        switch (instruction.op) {
+            case OpCode::PUSH_NULL:
+                stack[sp++] = Value();
+                break;
+            case OpCode::PUSH_INT:
+                stack[sp++] = Value::integer(instruction.arg);
+                break;
+            case OpCode::PUSH_CONST:
+                stack[sp++] = program.constants[instruction.arg];
+                break;
+            case OpCode::GET_LOCAL:
+                stack[sp++] = base[instruction.arg];
+                break;
+            case OpCode::SET_LOCAL:
+                base[instruction.arg] = stack[--sp];
+                break;
+            case OpCode::GET_GLOBAL:
+                if (task_depth != 0 && !program.globals[instruction.arg].constant)
+                    runtime_error("GLOBAL_VAR_IN_TASK");
+                stack[sp++] = globals[instruction.arg];
+                break;
+            case OpCode::SET_GLOBAL:
+                if (task_depth != 0)
+                    runtime_error("GLOBAL_VAR_IN_TASK");
+                globals[instruction.arg] = stack[--sp];
+                break;
+            case OpCode::POP:
+                sp--;
+                break;
+            case OpCode::POS: {
+                const Value& value = stack[sp - 1];
+                if (!is_integer(value) && value.type != ValueTypes::FLOAT)
+                    runtime_error("TYPE_ERROR");
+                break;
+            }
+            case OpCode::NEG: {
+                Value& value = stack[sp - 1];
+                if (value.type == ValueTypes::INT && value.int_value != LONG_MIN)
+                    value.int_value = -value.int_value;
+                else if (is_integer(value))
+                    value = big_negate(value);
+                else if (value.type == ValueTypes::FLOAT)
+                    value.float_value = -value.float_value;
+                else
+                    runtime_error("TYPE_ERROR");
+                break;
+            }
+            case OpCode::ADD:
+            case OpCode::SUB:
+            case OpCode::MULT:
+            case OpCode::DIV:
+                stack[sp - 2] = arithmetic(instruction.op, stack[sp - 2], stack[sp - 1]);
+                sp--;
+                break;
+            case OpCode::EQUAL:
+            case OpCode::NOT_EQUAL:
+            case OpCode::LESS:
+            case OpCode::LESS_EQUAL:
+            case OpCode::GREATER:
+            case OpCode::GREATER_EQUAL:
+                stack[sp - 2] = compare(instruction.op, stack[sp - 2], stack[sp - 1]);
+                sp--;
+                break;
+            case OpCode::NOT:
+                stack[sp - 1] = Value::integer(!is_true(stack[sp - 1]));
+                break;
+            // backward branches close loops, each turn spends its length
+            case OpCode::JUMP:
+                if (static_cast<size_t>(instruction.arg) < ip) {
+                    budget.take(static_cast<long>(ip) - instruction.arg);
+                    if (recorder != nullptr)
+                        recorder->branch(frame->function - program.functions.data(), ip - 1, instruction.arg, true);
+                }
+                ip = instruction.arg;
+                break;
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::JUMP_IF_TRUE: {
+                bool taken = is_true(stack[--sp]) == (instruction.op == OpCode::JUMP_IF_TRUE);
+                if (recorder != nullptr)
+                    recorder->branch(frame->function - program.functions.data(), ip - 1, instruction.arg, taken);
+                if (taken) {
+                    if (static_cast<size_t>(instruction.arg) < ip)
+                        budget.take(static_cast<long>(ip) - instruction.arg);
+                    ip = instruction.arg;
+                }
+                break;
+            }
+            case OpCode::ADD_LOCAL: {
+                Value& local = base[instruction.count];
+                long result;
+                if (local.type == ValueTypes::INT && !__builtin_add_overflow(local.int_value, instruction.arg, &result))
+                    local.int_value = result;
+                else
+                    local = arithmetic(OpCode::ADD, local, Value::integer(instruction.arg));
+                break;
+            }
+            case OpCode::CALL_NATIVE: {
+                const Native& native = *program.globals[instruction.arg].value.native_value;
+                BASK_COUNT(counters.native_calls++);
+                Value result = native.invoke(native, &stack[sp - instruction.count], instruction.count);
+                if (profile_ticks.load(std::memory_order_relaxed) != 0)
+                    sample(ip, &native.name);
+                sp -= instruction.count;
+                stack[sp++] = std::move(result);
+                break;
+            }
+            case OpCode::CALL:
+                if (profile_ticks.load(std::memory_order_relaxed) != 0)
+                    sample(ip);
+                if (recorder != nullptr)
+                    recorder->site(frame->function - program.functions.data(), ip - 1, &stack[sp - instruction.arg - 1],
+                        instruction.arg);
+                if (call_in_place(instruction.arg, ip, frames.size() + 1))
+                    break;
+
+                ip = push_frame(instruction.arg, ip);
+                frame = &frames.back();
+                code = frame->function->code.data();
+                base = &stack[frame->base];
+                break;
+            case OpCode::TAIL_CALL:
+                if (profile_ticks.load(std::memory_order_relaxed) != 0)
+                    sample(ip);
+                if (recorder != nullptr)
+                    recorder->site(frame->function - program.functions.data(), ip - 1, &stack[sp - instruction.arg - 1],
+                        instruction.arg);
+                // the callee takes over this frame
+                if (!call_in_place(instruction.arg, ip, frames.size())) {
+                    // slide the callee and its arguments down over this frame
+                    size_t argc = instruction.arg;
+                    size_t return_ip = frame->return_ip;
+                    Value* target = base - 1;
+                    const Value* source = &stack[sp - argc - 1];
+
+                    for (size_t i = 0; i <= argc; i++)
+                        target[i] = source[i];
+                    sp = frame->base + argc;
+                    frames.pop_back();
+
+                    ip = push_frame(argc, return_ip);
+                    frame = &frames.back();
+                    code = frame->function->code.data();
+                    base = &stack[frame->base];
+                    break;
+                }
+                // the call already finished, so return its result
+                // fall through
+            case OpCode::RETURN: {
+                if (profile_ticks.load(std::memory_order_relaxed) != 0)
+                    sample(ip);
+                Value result = stack[sp - 1];
+                sp = frame->base;
+                stack[sp - 1] = result;
+                ip = frame->return_ip;
+                if (!pending_memos.empty())
+                    store_memos(frames.size(), result);
+                frames.pop_back();
+
+                if (frames.size() == exit_depth)
+                    return result;
+
+                frame = &frames.back();
+                code = frame->function->code.data();
+                base = &stack[frame->base];
+                break;
+            }
+            case OpCode::MAKE_MAP: {
+                size_t count = instruction.arg;
+                Value map = new_map(count);
+                Value* entries = &stack[sp - 2 * count];
+                for (size_t i = 0; i < count; i++) {
+                    if (!is_hashable(entries[2 * i]))
+                        runtime_error("UNHASHABLE_KEY");
+                    map_set(map.map_value, entries[2 * i], entries[2 * i + 1]);
+                }
+                sp -= 2 * count;
+                stack[sp++] = std::move(map);
+                break;
+            }
+            case OpCode::AWAIT: {
+                Value& awaited = stack[sp - 1];
+                if (awaited.type != ValueTypes::INT)
+                    runtime_error("NOT_AWAITABLE");
+                if (events().await(awaited.int_value, running_coroutine, awaited))
+                    break;
+
+                // only an async func awaits and it is always the bottom
+                // frame of a resume, so keeping this frame is enough
+                sp--;
+                Coroutine& coroutine = loop->coroutine(running_coroutine);
+                for (size_t i = frame->base - 1; i < sp; i++)
+                    coroutine.frame.push_back(std::move(stack[i]));
+                coroutine.ip = ip;
+                frames.pop_back();
+                suspended = true;
+                return Value();
+            }
+        }
     }
 }
 
-void Interpreter::run() {
-    for (const auto& ast_node : ast_tree)
-        interprite_statement(ast_node);
+Value Interpreter::call(const Value& callee, const Value* args, size_t count) {
+    CurrentInterpreter guard(this, &budget);
+
+    if (callee.type == ValueTypes::NATIVE_FUNC) {
+        const Native& native = *callee.native_value;
+        if (!native.accepts(count))
+            runtime_error("WRONG_ARGUMENT_COUNT");
+        BASK_COUNT(counters.native_calls++);
+        return native.invoke(native, args, count);
+    }
+
+    if (callee.type != ValueTypes::FUNC)
+        runtime_error("NOT_CALLABLE");
+
+    // a call from the host, or a task, is an execution of its own
+    if (frames.empty())
+        budget.start();
+    if (recorder != nullptr)
+        recorder->call(callee.func_value, args, count);
+
+    // the host waits for async funcs, running the event loop meanwhile
+    if (program.functions[callee.func_value].is_async) {
+        std::vector<Value> frame(args, args + count);
+        frame.insert(frame.begin(), callee);
+        return drive(start_coroutine(frame.data() + 1, count));
+    }
+
+    if (sp + count + 1 > stack_size)
+        fail_limit(Limit::STACK, "STACK_OVERFLOW");
+
+    if (sp + count + 1 > high_water)
+        reach(sp + count + 1);
+
+    stack[sp++] = callee;
+    for (size_t i = 0; i < count; i++)
+        stack[sp++] = args[i];
+
+    size_t depth = frames.size();
+    size_t start = sp - count - 1;
+    Value result;
+    try {
+        result = execute(push_frame(count, 0), depth);
+    } catch (...) {
+        // leave the stacks as they were so the caller can go on
+        frames.erase(frames.begin() + depth, frames.end());
+        drop_memos(depth);
+        sp = start;
+        throw;
+    }
+    sp--;
+
+    return result;
+}
+
+void Interpreter::initialize() {
+    if (initialized)
+        return;
+
+    call(Value::function(0), nullptr, 0);
+    initialized = true;
+}
+
+void Interpreter::reset() {
+    frames.clear();
+    pending_memos.clear();
+    sp = 0;
+}
+
+void Interpreter::update(const std::vector<size_t>& replaced) {
+    bool grown = globals.size() != program.globals.size();
+    for (size_t i = globals.size(); i < program.globals.size(); i++)
+        globals.push_back(own_global(program.globals[i].value));
+
+    if (jit && !replaced.empty()) {
+        // calls between compiled functions skip the program, any of them
+        // may hold the old code
+        counters.jit_functions += jit->compiled;
+        counters.jit_seconds += jit->compile_seconds;
+        jit.reset(new Jit(program, options.jit_threshold, options.stack_size * sizeof(Value), jit_budget()));
+    } else if (jit) {
+        jit->grow();
+    }
+
+    // replaced funcs start over, the compiler already stopped calling the
+    // others pure when a const changed what they reach
+    memos.resize(program.functions.size());
+    for (size_t index : replaced) {
+        count_memo(memos[index], counters);
+        memos[index] = MemoTable();
+    }
+
+    // tasks see the globals as they were when the scheduler started
+    if (own_scheduler && (grown || !replaced.empty())) {
+        own_scheduler->add_stats(counters);
+        own_scheduler.reset();
+        scheduler = nullptr;
+    }
+}
+
+void Interpreter::settle() {
+    if (loop)
+        drive(0);
 }
 
-void run(const std::vector<std::unique_ptr<AstStatement>>& ast_tree) {
-    Interpreter(ast_tree).run();
-}
\ No newline at end of file
+const Value* Interpreter::global(const std::string& name) const {
+    for (size_t i = 0; i < program.globals.size(); i++)
+        if (program.globals[i].name == name)
+            return &globals[i];
+    return nullptr;
+}
+
+long Interpreter::start_coroutine(const Value* args, size_t argc) {
+    const Function& function = program.functions[args[-1].func_value];
+
+    if (argc < function.required_args || argc > function.required_args + function.optional_args)
+        runtime_error("WRONG_ARGUMENT_COUNT");
+
+    BASK_COUNT(counters.calls++);
+    std::unique_ptr<Coroutine> coroutine(new Coroutine(&function, function.entries[argc - function.required_args]));
+    coroutine->frame.assign(args - 1, args + argc);
+
+    return events().start(std::move(coroutine));
+}
+
+void Interpreter::resume(long handle) {
+    CurrentInterpreter guard(this, &budget);
+    Coroutine& coroutine = loop->coroutine(handle);
+    const Function& function = *coroutine.function;
+    size_t start = sp;
+    size_t base = start + 1;
+
+    if (frames.size() == max_frames || base + function.max_stack > stack_size)
+        fail_limit(Limit::STACK, "STACK_OVERFLOW");
+    if (base + function.max_stack > high_water)
+        reach(base + function.max_stack);
+
+    for (size_t i = 0; i < coroutine.frame.size(); i++)
+        stack[start + i] = std::move(coroutine.frame[i]);
+    sp = coroutine.started ? start + coroutine.frame.size() : base + function.locals;
+    coroutine.frame.clear();
+    coroutine.started = true;
+
+    long outer = running_coroutine;
+    running_coroutine = handle;
+    suspended = false;
+
+    size_t depth = frames.size();
+    frames.emplace_back(base, 0, &function);
+
+    Value result;
+    try {
+        // the handle it awaited failed, the error is raised at the await
+        if (!coroutine.error.empty()) {
+            std::string error = std::move(coroutine.error);
+            coroutine.error.clear();
+            throw BaskError(error);
+        }
+        result = execute(coroutine.ip, depth);
+    } catch (...) {
+        frames.erase(frames.begin() + depth, frames.end());
+        drop_memos(depth);
+        sp = start;
+        running_coroutine = outer;
+        throw;
+    }
+
+    sp = start;
+    running_coroutine = outer;
+
+    if (suspended)
+        suspended = false;
+    else
+        loop->finish(handle, std::move(result));
+}
+
+Value Interpreter::drive(long handle) {
+    EventLoop& events = this->events();
+
+    while (handle != 0 ? !events.done(handle) : !events.idle()) {
+        long next = events.next_ready();
+        if (next != 0)
+            resume(next);
+        else
+            events.poll();
+    }
+
+    Value result;
+    if (handle != 0)
+        events.await(handle, 0, result);
+    return result;
+}
+
+EventLoop& Interpreter::events() {
+    if (!loop)
+        loop.reset(new EventLoop());
+    return *loop;
+}
+
+ExecutionStats Interpreter::execution_stats() const {
+    ExecutionStats stats = counters;
+    if (jit) {
+        stats.jit_functions += jit->compiled;
+        stats.jit_seconds += jit->compile_seconds;
+    }
+    count_memos(memos, stats);
+    if (own_scheduler)
+        own_scheduler->add_stats(stats);
+    return stats;
+}
+
+Interpreter& Interpreter::current() {
+    return *current_interpreter;
+}
+
+Scheduler& Interpreter::tasks() {
+    if (scheduler == nullptr) {
+        if (!initialized)
+            runtime_error("SPAWN_DURING_INIT");
+        own_scheduler.reset(new Scheduler(program, globals, options));
+        scheduler = own_scheduler.get();
+    }
+    return *scheduler;
+}
+
+int Interpreter::run() {
+    initialize();
+
+    Value result = call(Value::function(program.main), nullptr, 0);
+    settle();
+
+    return (result.type == ValueTypes::INT) ? static_cast<int>(result.int_value) : 0;
+}
+
+int run(const Program& program, const InterpreterOptions& options) {
+    return Interpreter(program, options).run();
+}
@@ -0,0 +1,762 @@
+#include "lib/jit.hpp"
+#include "lib/error.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#if BASK_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+// Abstract value of an operand during analysis: an int, or the statically
+// known function a call is about to go to.
+static const long JIT_INT = -1;
+
+void jit_escape(Jit* jit, long reason) {
+    std::longjmp(jit->escape, static_cast<int>(reason));
+}
+
+// called by compiled code whose budget ran out, returns with a new slice
+void jit_refill(Jit* jit) {
+    if (!jit->budget->refill())
+        jit_escape(jit, JIT_LIMIT);
+}
+
+class Assembler {
+public:
+    std::vector<uint8_t> code;
+
+    void emit(std::initializer_list<uint8_t> bytes) {
+        code.insert(code.end(), bytes);
+    }
+
+    void imm32(int32_t value) {
+        uint8_t bytes[4];
+        std::memcpy(bytes, &value, 4);
+        code.insert(code.end(), bytes, bytes + 4);
+    }
+
+    void imm64(uint64_t value) {
+        uint8_t bytes[8];
+        std::memcpy(bytes, &value, 8);
+        code.insert(code.end(), bytes, bytes + 8);
+    }
+
+    // emits a rel32 placeholder and returns its offset for patch()
+    size_t label() {
+        imm32(0);
+        return code.size() - 4;
+    }
+
+    void patch(size_t at, size_t target) {
+        int32_t rel = static_cast<int32_t>(target) - static_cast<int32_t>(at + 4);
+        std::memcpy(&code[at], &rel, 4);
+    }
+
+    void call_absolute(const void* target) {
+        emit({0x48, 0xB8}); // mov rax, imm64
+        imm64(reinterpret_cast<uint64_t>(target));
+        emit({0xFF, 0xD0}); // call rax
+    }
+};
+
+// takes fuel from the budget at left, calling the refill stub once it is
+// used up; only rax and the flags change on the way
+static void emit_take(Assembler& a, long* left, long fuel, std::vector<size_t>& refill_fixups) {
+    a.emit({0x48, 0xB8});       // mov rax, &left
+    a.imm64(reinterpret_cast<uint64_t>(left));
+    a.emit({0x48, 0x81, 0x28}); // sub qword [rax], imm32
+    a.imm32(static_cast<int32_t>(fuel));
+    a.emit({0x7F, 0x05});       // jg past the call
+    a.emit({0xE8});             // call refill
+    refill_fixups.push_back(a.label());
+}
+
+static int32_t local_offset(size_t slot) {
+    return -8 * static_cast<int32_t>(slot + 1);
+}
+
+// bytes the prologue reserves below rbp for the locals, keeping rsp aligned
+static int32_t frame_size(const Function& function) {
+    return static_cast<int32_t>((function.locals * 8 + 15) & ~15);
+}
+
+// Operand stacks where jumps land. Code runs in order apart from jumps, so
+// after an instruction that never goes on to the next one, that one only
+// runs when a jump lands on it, with the stack the jump had.
+class Flow {
+public:
+    std::vector<std::vector<long>> stacks;
+    std::vector<bool> known;
+    // whether the instruction before went on to the next one
+    bool running;
+    // every jump agreed with the stack where it lands
+    bool consistent;
+
+    Flow(const Function& function)
+    : stacks(function.code.size() + 1), known(function.code.size() + 1, false), running(true), consistent(true) {
+        // optional arguments start at their entries with nothing pushed
+        for (size_t entry : function.entries)
+            known[entry] = true;
+    }
+
+    // whether ip runs, stack becoming what it starts with
+    bool reach(size_t ip, std::vector<long>& stack) {
+        if (!running) {
+            if (!known[ip])
+                return false;
+            stack = stacks[ip];
+            running = true;
+        }
+        land(ip, stack);
+        return true;
+    }
+
+    void jump(size_t from, size_t target, const std::vector<long>& stack) {
+        // a loop has to come back with what it started with
+        if (target <= from && !known[target])
+            consistent = false;
+        land(target, stack);
+    }
+
+    void stop() {
+        running = false;
+    }
+private:
+    void land(size_t ip, const std::vector<long>& stack) {
+        if (!known[ip]) {
+            known[ip] = true;
+            stacks[ip] = stack;
+        } else if (stacks[ip] != stack) {
+            consistent = false;
+        }
+    }
+};
+
+// condition codes of jcc and setcc
+static const uint8_t CC_EQUAL = 0x4;
+static const uint8_t CC_NOT_EQUAL = 0x5;
+static const uint8_t CC_LESS = 0xC;
+static const uint8_t CC_GREATER_EQUAL = 0xD;
+static const uint8_t CC_LESS_EQUAL = 0xE;
+static const uint8_t CC_GREATER = 0xF;
+
+static uint8_t condition_code(OpCode op) {
+    switch (op) {
+        case OpCode::EQUAL:
+            return CC_EQUAL;
+        case OpCode::NOT_EQUAL:
+            return CC_NOT_EQUAL;
+        case OpCode::LESS:
+            return CC_LESS;
+        case OpCode::LESS_EQUAL:
+            return CC_LESS_EQUAL;
+        case OpCode::GREATER:
+            return CC_GREATER;
+        default:
+            return CC_GREATER_EQUAL;
+    }
+}
+
+static bool is_jump(OpCode op) {
+    return op == OpCode::JUMP || op == OpCode::JUMP_IF_FALSE || op == OpCode::JUMP_IF_TRUE;
+}
+
+Jit::Jit(const Program& program, size_t threshold, size_t stack_bytes, Budget* budget)
+: program(program), threshold(threshold), stack_bytes(stack_bytes + JIT_STACK_MARGIN), stack(nullptr),
+  stack_limit(0), trampoline(nullptr), budget(budget), functions(program.functions.size()), compiled(0),
+  compile_seconds(0) {}
+
+Jit::~Jit() {
+#if BASK_JIT_SUPPORTED
+    for (const auto& region : regions)
+        munmap(region.first, region.second);
+    if (stack != nullptr)
+        munmap(stack, stack_bytes);
+#endif
+}
+
+void* Jit::install(const std::vector<uint8_t>& code) {
+#if BASK_JIT_SUPPORTED
+    void* region = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (region == MAP_FAILED)
+        return nullptr;
+
+    std::memcpy(region, code.data(), code.size());
+    mprotect(region, code.size(), PROT_READ | PROT_EXEC);
+    regions.emplace_back(region, code.size());
+
+    return region;
+#else
+    return nullptr;
+#endif
+}
+
+bool Jit::analyze(size_t index, std::vector<size_t>& cluster) {
+    JitFunction& jit_function = functions[index];
+
+    if (jit_function.state == JitState::COMPILED || jit_function.state == JitState::ANALYZING)
+        return true;
+    if (jit_function.state == JitState::FAILED)
+        return false;
+
+    const Function& function = program.functions[index];
+
+    jit_function.state = JitState::FAILED;
+    // calls to @memo funcs go through their cache, which compiled code skips
+    if (index == 0 || function.is_async || function.memo || function.required_args + function.optional_args > JIT_MAX_ARGS)
+        return false;
+
+    jit_function.state = JitState::ANALYZING;
+    cluster.push_back(index);
+
+    std::vector<bool> int_locals(function.locals, false);
+    for (size_t i = 0; i < function.required_args + function.optional_args; i++)
+        int_locals[i] = true;
+
+    Flow flow(function);
+    std::vector<long> stack;
+    auto pop_int = [&stack]() {
+        if (stack.empty() || stack.back() != JIT_INT)
+            return false;
+        stack.pop_back();
+        return true;
+    };
+
+    for (size_t ip = 0; ip < function.code.size(); ip++) {
+        const Instruction& instruction = function.code[ip];
+        bool ok = true;
+
+        if (!flow.reach(ip, stack))
+            continue;
+
+        switch (instruction.op) {
+            case OpCode::PUSH_INT:
+                stack.push_back(JIT_INT);
+                break;
+            case OpCode::GET_LOCAL:
+                ok = int_locals[instruction.arg];
+                stack.push_back(JIT_INT);
+                break;
+            case OpCode::SET_LOCAL:
+                ok = pop_int();
+                int_locals[instruction.arg] = true;
+                break;
+            case OpCode::GET_GLOBAL: {
+                const Global& global = program.globals[instruction.arg];
+                ok = global.constant && global.value.type == ValueTypes::FUNC;
+                stack.push_back(global.value.func_value);
+                break;
+            }
+            case OpCode::POP:
+                ok = pop_int();
+                break;
+            case OpCode::RETURN:
+                ok = pop_int();
+                flow.stop();
+                break;
+            case OpCode::POS:
+            case OpCode::NEG:
+            case OpCode::NOT:
+                ok = pop_int();
+                stack.push_back(JIT_INT);
+                break;
+            case OpCode::ADD:
+            case OpCode::SUB:
+            case OpCode::MULT:
+            case OpCode::DIV:
+            case OpCode::EQUAL:
+            case OpCode::NOT_EQUAL:
+            case OpCode::LESS:
+            case OpCode::LESS_EQUAL:
+            case OpCode::GREATER:
+            case OpCode::GREATER_EQUAL:
+                ok = pop_int() && pop_int();
+                stack.push_back(JIT_INT);
+                break;
+            case OpCode::ADD_LOCAL:
+                ok = int_locals[instruction.count];
+                break;
+            case OpCode::JUMP:
+                flow.jump(ip, instruction.arg, stack);
+                flow.stop();
+                break;
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::JUMP_IF_TRUE:
+                ok = pop_int();
+                flow.jump(ip, instruction.arg, stack);
+                break;
+            case OpCode::CALL:
+            case OpCode::TAIL_CALL: {
+                for (long i = 0; i < instruction.arg && ok; i++)
+                    ok = pop_int();
+                if (!ok || stack.empty() || stack.back() == JIT_INT) {
+                    ok = false;
+                    break;
+                }
+
+                size_t callee = stack.back();
+                const Function& target = program.functions[callee];
+                size_t argc = instruction.arg;
+                stack.back() = JIT_INT;
+
+                ok = argc >= target.required_args && argc <= target.required_args + target.optional_args
+                    && analyze(callee, cluster);
+                if (instruction.op == OpCode::TAIL_CALL) {
+                    stack.pop_back();
+                    flow.stop();
+                }
+                break;
+            }
+            default:
+                ok = false;
+                break;
+        }
+
+        if (!ok || !flow.consistent) {
+            jit_function.state = JitState::FAILED;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Jit::compile(size_t index) {
+    std::vector<size_t> cluster;
+
+    if (!BASK_JIT_SUPPORTED || !analyze(index, cluster)) {
+        // the rest were only accepted on the assumption this one would be
+        for (size_t member : cluster)
+            if (functions[member].state == JitState::ANALYZING)
+                functions[member].state = JitState::PENDING;
+        functions[index].state = JitState::FAILED;
+        return;
+    }
+
+#if BASK_JIT_SUPPORTED
+    Assembler a;
+    std::vector<size_t> starts(program.functions.size(), 0);
+    std::vector<size_t> bodies(program.functions.size(), 0);
+    std::vector<std::pair<size_t, size_t>> call_fixups;
+    std::vector<std::pair<size_t, size_t>> tail_fixups;
+    std::vector<size_t> overflow_fixups;
+    std::vector<size_t> division_fixups;
+    std::vector<size_t> int_overflow_fixups;
+    std::vector<size_t> refill_fixups;
+
+    for (size_t member : cluster) {
+        const Function& function = program.functions[member];
+        Flow flow(function);
+        std::vector<size_t> labels(function.code.size() + 1, 0);
+        std::vector<std::pair<size_t, size_t>> jump_fixups;
+
+        std::vector<bool> targets(function.code.size() + 1, false);
+        // fuel a turn of the loop starting there spends
+        std::vector<long> loop_fuel(function.code.size() + 1, 0);
+        for (size_t ip = 0; ip < function.code.size(); ip++) {
+            const Instruction& instruction = function.code[ip];
+            if (!is_jump(instruction.op))
+                continue;
+            targets[instruction.arg] = true;
+            if (instruction.arg <= static_cast<long>(ip))
+                loop_fuel[instruction.arg] = std::max(loop_fuel[instruction.arg], static_cast<long>(ip + 1) - instruction.arg);
+        }
+
+        starts[member] = a.code.size();
+
+        a.emit({0x55});             // push rbp
+        a.emit({0x48, 0x89, 0xE5}); // mov rbp, rsp
+        a.emit({0x48, 0x81, 0xEC}); // sub rsp, imm32
+        a.imm32(frame_size(function));
+        bodies[member] = a.code.size();
+
+        a.emit({0x48, 0x8D, 0x8C, 0x24}); // lea rcx, [rsp + disp32]
+        a.imm32(-8 * static_cast<int32_t>(function.max_stack));
+        a.emit({0x48, 0xB8});             // mov rax, &stack_limit
+        a.imm64(reinterpret_cast<uint64_t>(&stack_limit));
+        a.emit({0x48, 0x3B, 0x08});       // cmp rcx, [rax]
+        a.emit({0x0F, 0x82});             // jb overflow
+        overflow_fixups.push_back(a.label());
+
+        if (budget != nullptr)
+            emit_take(a, &budget->left, static_cast<long>(function.code.size()), refill_fixups);
+
+        for (size_t i = 0; i < function.required_args + function.optional_args; i++) {
+            if (i >= function.required_args) {
+                size_t missing = i - function.required_args;
+                a.emit({0x48, 0x81, 0xFE}); // cmp rsi, imm32
+                a.imm32(static_cast<int32_t>(i));
+                a.emit({0x0F, 0x8E});       // jle entry
+                jump_fixups.emplace_back(a.label(), function.entries[missing]);
+            }
+            a.emit({0x48, 0x8B, 0x87}); // mov rax, [rdi + disp32]
+            a.imm32(-8 * static_cast<int32_t>(i));
+            a.emit({0x48, 0x89, 0x85}); // mov [rbp + disp32], rax
+            a.imm32(local_offset(i));
+        }
+        a.emit({0xE9});                 // jmp body
+        jump_fixups.emplace_back(a.label(), function.entries[function.optional_args]);
+
+        std::vector<long> stack;
+        // condition of a comparison left in the flags for the branch after it
+        uint8_t pending = 0;
+
+        for (size_t ip = 0; ip < function.code.size(); ip++) {
+            const Instruction& instruction = function.code[ip];
+            labels[ip] = a.code.size();
+
+            if (!flow.reach(ip, stack))
+                continue;
+
+            if (budget != nullptr && loop_fuel[ip] != 0)
+                emit_take(a, &budget->left, loop_fuel[ip], refill_fixups);
+
+            switch (instruction.op) {
+                case OpCode::PUSH_INT:
+                    a.emit({0x48, 0xB8}); // mov rax, imm64
+                    a.imm64(static_cast<uint64_t>(instruction.arg));
+                    a.emit({0x50});       // push rax
+                    stack.push_back(JIT_INT);
+                    break;
+                case OpCode::GET_LOCAL:
+                    a.emit({0xFF, 0xB5}); // push [rbp + disp32]
+                    a.imm32(local_offset(instruction.arg));
+                    stack.push_back(JIT_INT);
+                    break;
+                case OpCode::SET_LOCAL:
+                    a.emit({0x58});             // pop rax
+                    a.emit({0x48, 0x89, 0x85}); // mov [rbp + disp32], rax
+                    a.imm32(local_offset(instruction.arg));
+                    stack.pop_back();
+                    break;
+                case OpCode::GET_GLOBAL:
+                    // callee of a direct call, nothing to materialize
+                    stack.push_back(program.globals[instruction.arg].value.func_value);
+                    break;
+                case OpCode::POP:
+                    a.emit({0x58}); // pop rax
+                    stack.pop_back();
+                    break;
+                case OpCode::POS:
+                    break;
+                case OpCode::NEG:
+                    a.emit({0x48, 0xF7, 0x1C, 0x24}); // neg qword [rsp]
+                    a.emit({0x0F, 0x80});             // jo int_overflow
+                    int_overflow_fixups.push_back(a.label());
+                    break;
+                case OpCode::ADD:
+                case OpCode::SUB:
+                case OpCode::MULT:
+                case OpCode::DIV:
+                    a.emit({0x59}); // pop rcx
+                    a.emit({0x58}); // pop rax
+                    if (instruction.op == OpCode::ADD) {
+                        a.emit({0x48, 0x01, 0xC8});       // add rax, rcx
+                    } else if (instruction.op == OpCode::SUB) {
+                        a.emit({0x48, 0x29, 0xC8});       // sub rax, rcx
+                    } else if (instruction.op == OpCode::MULT) {
+                        a.emit({0x48, 0x0F, 0xAF, 0xC1}); // imul rax, rcx
+                    } else {
+                        a.emit({0x48, 0x85, 0xC9});       // test rcx, rcx
+                        a.emit({0x0F, 0x84});             // jz division_by_zero
+                        division_fixups.push_back(a.label());
+                        // LONG_MIN / -1 traps instead of overflowing
+                        a.emit({0x48, 0x83, 0xF9, 0xFF}); // cmp rcx, -1
+                        a.emit({0x75, 0x13});             // jne divide
+                        a.emit({0x48, 0xBA});             // mov rdx, LONG_MIN
+                        a.imm64(static_cast<uint64_t>(1) << 63);
+                        a.emit({0x48, 0x39, 0xD0});       // cmp rax, rdx
+                        a.emit({0x0F, 0x84});             // je int_overflow
+                        int_overflow_fixups.push_back(a.label());
+                        a.emit({0x48, 0x99});             // divide: cqo
+                        a.emit({0x48, 0xF7, 0xF9});       // idiv rcx
+                    }
+                    if (instruction.op != OpCode::DIV) {
+                        a.emit({0x0F, 0x80});             // jo int_overflow
+                        int_overflow_fixups.push_back(a.label());
+                    }
+                    a.emit({0x50}); // push rax
+                    stack.pop_back();
+                    break;
+                case OpCode::EQUAL:
+                case OpCode::NOT_EQUAL:
+                case OpCode::LESS:
+                case OpCode::LESS_EQUAL:
+                case OpCode::GREATER:
+                case OpCode::GREATER_EQUAL: {
+                    uint8_t cc = condition_code(instruction.op);
+                    a.emit({0x59});             // pop rcx
+                    a.emit({0x58});             // pop rax
+                    a.emit({0x48, 0x39, 0xC8}); // cmp rax, rcx
+                    stack.pop_back();
+
+                    const Instruction* next = ip + 1 < function.code.size() ? &function.code[ip + 1] : nullptr;
+                    if (next != nullptr && !targets[ip + 1]
+                        && (next->op == OpCode::JUMP_IF_FALSE || next->op == OpCode::JUMP_IF_TRUE)) {
+                        pending = cc;
+                        break;
+                    }
+                    a.emit({0x0F, static_cast<uint8_t>(0x90 | cc), 0xC0}); // setcc al
+                    a.emit({0x0F, 0xB6, 0xC0});                             // movzx eax, al
+                    a.emit({0x50});                                         // push rax
+                    break;
+                }
+                case OpCode::NOT:
+                    a.emit({0x58});             // pop rax
+                    a.emit({0x48, 0x85, 0xC0}); // test rax, rax
+                    a.emit({0x0F, 0x94, 0xC0}); // sete al
+                    a.emit({0x0F, 0xB6, 0xC0}); // movzx eax, al
+                    a.emit({0x50});             // push rax
+                    break;
+                case OpCode::ADD_LOCAL:
+                    a.emit({0x48, 0xB8});       // mov rax, imm64
+                    a.imm64(static_cast<uint64_t>(instruction.arg));
+                    a.emit({0x48, 0x01, 0x85}); // add [rbp + disp32], rax
+                    a.imm32(local_offset(instruction.count));
+                    a.emit({0x0F, 0x80});       // jo int_overflow
+                    int_overflow_fixups.push_back(a.label());
+                    break;
+                case OpCode::JUMP:
+                    a.emit({0xE9}); // jmp rel32
+                    jump_fixups.emplace_back(a.label(), instruction.arg);
+                    flow.jump(ip, instruction.arg, stack);
+                    flow.stop();
+                    break;
+                case OpCode::JUMP_IF_FALSE:
+                case OpCode::JUMP_IF_TRUE: {
+                    bool when = instruction.op == OpCode::JUMP_IF_TRUE;
+                    uint8_t cc = CC_NOT_EQUAL;
+                    if (pending != 0) {
+                        cc = pending;
+                        pending = 0;
+                    } else {
+                        a.emit({0x58});             // pop rax
+                        a.emit({0x48, 0x85, 0xC0}); // test rax, rax
+                    }
+                    if (!when)
+                        cc ^= 1;
+                    a.emit({0x0F, static_cast<uint8_t>(0x80 | cc)}); // jcc rel32
+                    jump_fixups.emplace_back(a.label(), instruction.arg);
+                    stack.pop_back();
+                    flow.jump(ip, instruction.arg, stack);
+                    break;
+                }
+                case OpCode::TAIL_CALL:
+                    // arguments go into this frame's first slots and the
+                    // callee's frame takes the place of this one, entered
+                    // past its prologue so the slots never go below rsp.
+                    // With nothing else on the operand stack each argument
+                    // only moves up, so copying from the first one never
+                    // clobbers a later one.
+                    if (stack.size() == static_cast<size_t>(instruction.arg) + 1) {
+                        size_t argc = instruction.arg;
+                        size_t callee = stack[stack.size() - argc - 1];
+
+                        for (size_t i = 0; i < argc; i++) {
+                            a.emit({0x48, 0x8B, 0x84, 0x24}); // mov rax, [rsp + disp32]
+                            a.imm32(8 * static_cast<int32_t>(argc - 1 - i));
+                            a.emit({0x48, 0x89, 0x85});       // mov [rbp + disp32], rax
+                            a.imm32(local_offset(i));
+                        }
+                        a.emit({0x48, 0x8D, 0xBD});           // lea rdi, [rbp - 8]
+                        a.imm32(local_offset(0));
+                        a.emit({0x48, 0xC7, 0xC6});           // mov rsi, imm32
+                        a.imm32(static_cast<int32_t>(argc));
+                        a.emit({0x48, 0x8D, 0xA5});           // lea rsp, [rbp + disp32]
+                        a.imm32(-frame_size(program.functions[callee]));
+
+                        if (functions[callee].state == JitState::COMPILED) {
+                            a.emit({0x48, 0xB8});             // mov rax, imm64
+                            a.imm64(reinterpret_cast<uint64_t>(functions[callee].body));
+                            a.emit({0xFF, 0xE0});             // jmp rax
+                        } else {
+                            a.emit({0xE9});                   // jmp rel32
+                            tail_fixups.emplace_back(a.label(), callee);
+                        }
+
+                        stack.resize(stack.size() - argc - 1);
+                        flow.stop();
+                        break;
+                    }
+                    // other temporaries are in the way, so call and return
+                    // fall through
+                case OpCode::CALL: {
+                    size_t argc = instruction.arg;
+                    size_t callee = stack[stack.size() - argc - 1];
+
+                    a.emit({0x48, 0x8D, 0xBC, 0x24}); // lea rdi, [rsp + disp32]
+                    a.imm32(8 * static_cast<int32_t>(argc) - 8);
+                    a.emit({0x48, 0xC7, 0xC6});       // mov rsi, imm32
+                    a.imm32(static_cast<int32_t>(argc));
+
+                    if (functions[callee].state == JitState::COMPILED) {
+                        a.call_absolute(reinterpret_cast<const void*>(functions[callee].code));
+                    } else {
+                        a.emit({0xE8});               // call rel32
+                        call_fixups.emplace_back(a.label(), callee);
+                    }
+
+                    if (argc > 0) {
+                        a.emit({0x48, 0x81, 0xC4});   // add rsp, imm32
+                        a.imm32(8 * static_cast<int32_t>(argc));
+                    }
+                    a.emit({0x50});                   // push rax
+
+                    stack.resize(stack.size() - argc);
+                    stack.back() = JIT_INT;
+
+                    if (instruction.op == OpCode::CALL)
+                        break;
+
+                    a.emit({0x58}); // pop rax
+                    a.emit({0xC9}); // leave
+                    a.emit({0xC3}); // ret
+                    stack.pop_back();
+                    flow.stop();
+                    break;
+                }
+                case OpCode::RETURN:
+                    a.emit({0x58}); // pop rax
+                    a.emit({0xC9}); // leave
+                    a.emit({0xC3}); // ret
+                    stack.pop_back();
+                    flow.stop();
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        for (const auto& fixup : jump_fixups)
+            a.patch(fixup.first, labels[fixup.second]);
+    }
+
+    // error paths never return, they only need to be on the reserved part of
+    // the stack with the ABI alignment
+    size_t overflow = a.code.size();
+    a.emit({0x48, 0xB8});             // mov rax, &stack_limit
+    a.imm64(reinterpret_cast<uint64_t>(&stack_limit));
+    a.emit({0x48, 0x8B, 0x20});       // mov rsp, [rax]
+    a.emit({0x48, 0x83, 0xE4, 0xF0}); // and rsp, -16
+    a.emit({0x48, 0xBF});             // mov rdi, this
+    a.imm64(reinterpret_cast<uint64_t>(this));
+    a.emit({0xBE});                   // mov esi, imm32
+    a.imm32(JIT_STACK_OVERFLOW);
+    a.call_absolute(reinterpret_cast<const void*>(jit_escape));
+
+    size_t division = a.code.size();
+    a.emit({0x48, 0x83, 0xE4, 0xF0}); // and rsp, -16
+    a.emit({0x48, 0xBF});             // mov rdi, this
+    a.imm64(reinterpret_cast<uint64_t>(this));
+    a.emit({0xBE});                   // mov esi, imm32
+    a.imm32(JIT_DIVISION_BY_ZERO);
+    a.call_absolute(reinterpret_cast<const void*>(jit_escape));
+
+    for (size_t fixup : overflow_fixups)
+        a.patch(fixup, overflow);
+    size_t int_overflow = a.code.size();
+    a.emit({0x48, 0x83, 0xE4, 0xF0}); // and rsp, -16
+    a.emit({0x48, 0xBF});             // mov rdi, this
+    a.imm64(reinterpret_cast<uint64_t>(this));
+    a.emit({0xBE});                   // mov esi, imm32
+    a.imm32(JIT_INT_OVERFLOW);
+    a.call_absolute(reinterpret_cast<const void*>(jit_escape));
+
+    // called with the arguments of a prologue still in rdi and rsi
+    size_t refill = a.code.size();
+    a.emit({0x57});                   // push rdi
+    a.emit({0x56});                   // push rsi
+    a.emit({0x55});                   // push rbp
+    a.emit({0x48, 0x89, 0xE5});       // mov rbp, rsp
+    a.emit({0x48, 0x83, 0xE4, 0xF0}); // and rsp, -16
+    a.emit({0x48, 0xBF});             // mov rdi, this
+    a.imm64(reinterpret_cast<uint64_t>(this));
+    a.call_absolute(reinterpret_cast<const void*>(jit_refill));
+    a.emit({0x48, 0x89, 0xEC});       // mov rsp, rbp
+    a.emit({0x5D});                   // pop rbp
+    a.emit({0x5E});                   // pop rsi
+    a.emit({0x5F});                   // pop rdi
+    a.emit({0xC3});                   // ret
+
+    for (size_t fixup : division_fixups)
+        a.patch(fixup, division);
+    for (size_t fixup : refill_fixups)
+        a.patch(fixup, refill);
+    for (size_t fixup : int_overflow_fixups)
+        a.patch(fixup, int_overflow);
+    for (const auto& fixup : call_fixups)
+        a.patch(fixup.first, starts[fixup.second]);
+    for (const auto& fixup : tail_fixups)
+        a.patch(fixup.first, bodies[fixup.second]);
+
+    void* region = install(a.code);
+
+    if (region == nullptr) {
+        for (size_t member : cluster)
+            functions[member].state = JitState::FAILED;
+        return;
+    }
+
+    for (size_t member : cluster) {
+        functions[member].state = JitState::COMPILED;
+        functions[member].code = reinterpret_cast<JitCode>(static_cast<uint8_t*>(region) + starts[member]);
+        functions[member].body = static_cast<uint8_t*>(region) + bodies[member];
+        compiled++;
+    }
+#endif
+}
+
+void Jit::compile_counted(size_t index) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    compile(index);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    compile_seconds += elapsed.count();
+}
+
+bool Jit::invoke(JitCode code, const Value* args, size_t count, long& result) {
+    long buffer[JIT_MAX_ARGS];
+
+    for (size_t i = 0; i < count; i++)
+        buffer[JIT_MAX_ARGS - 1 - i] = args[i].int_value;
+
+#if BASK_JIT_SUPPORTED
+    if (trampoline == nullptr) {
+        Assembler a;
+        a.emit({0x55});             // push rbp
+        a.emit({0x48, 0x89, 0xE5}); // mov rbp, rsp
+        a.emit({0x48, 0x89, 0xCC}); // mov rsp, rcx
+        a.emit({0xFF, 0xD2});       // call rdx
+        a.emit({0x48, 0x89, 0xEC}); // mov rsp, rbp
+        a.emit({0x5D});             // pop rbp
+        a.emit({0xC3});             // ret
+        trampoline = reinterpret_cast<JitTrampoline>(install(a.code));
+
+        stack = mmap(nullptr, stack_bytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        if (trampoline == nullptr || stack == MAP_FAILED)
+            fail("JIT", "CANNOT_ALLOCATE");
+        stack_limit = reinterpret_cast<uintptr_t>(stack) + JIT_STACK_MARGIN;
+    }
+
+    void* top = static_cast<uint8_t*>(stack) + (stack_bytes & ~static_cast<size_t>(15));
+
+    int reason = setjmp(escape);
+    if (reason == JIT_STACK_OVERFLOW)
+        fail_limit(Limit::STACK, "STACK_OVERFLOW");
+    if (reason == JIT_LIMIT)
+        budget->fail();
+    if (reason == JIT_DIVISION_BY_ZERO)
+        fail("INTERPRETER", "DIVISION_BY_ZERO");
+    if (reason == JIT_INT_OVERFLOW)
+        return false;
+
+    result = trampoline(&buffer[JIT_MAX_ARGS - 1], count, code, top);
+#else
+    result = code(&buffer[JIT_MAX_ARGS - 1], count);
+#endif
+    return true;
+}
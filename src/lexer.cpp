@@ -1,17 +1,31 @@
 #include "lib/lexer.hpp"
+#include "lib/error.hpp"
 
 #include <sstream>
-#include <iostream>
 
 Lexer::Lexer(const std::string& source)
-: source(source), current('\0'), index(-1) {
+: source(source), current('\0'), index(-1), line(1), start_line(1) {
     advance();
 }
 
 void Lexer::advance() {
+    // the source, not current, which an escape in a string may have changed
+    if (index < source.size() && source[index] == '\n')
+        line++;
     current = (++index < source.size()) ? source.at(index) : '\0';
 }
 
+char Lexer::peek() const {
+    return (index + 1 < source.size()) ? source[index + 1] : '\0';
+}
+
+TokenType Lexer::pair(char second, TokenType paired, TokenType single) {
+    if (peek() != second)
+        return single;
+    advance();
+    return paired;
+}
+
 void Lexer::skip() {
     if (current == '\0')
         return;
@@ -32,7 +46,7 @@ void Lexer::skip() {
         advance();
         while (current != '\'') {
             if (current == '\0')
-                exit(1);
+                fail("LEXER", "UNTERMINATED_COMMENT");
             advance();
         }
         advance();
@@ -42,6 +56,7 @@ void Lexer::skip() {
 
 Token Lexer::next() {
     skip();
+    start_line = line;
     
     if (std::isalpha(current) || current == '_')
         return word();
@@ -58,7 +73,27 @@ Token Lexer::next() {
             type = TokenType::END;
             break;
         case '=':
-            type = TokenType::EQUAL;
+            type = pair('=', TokenType::DOUBLE_EQUAL, TokenType::EQUAL);
+            break;
+        case '!':
+            type = pair('=', TokenType::NOT_EQUAL, TokenType::NOT);
+            break;
+        case '<':
+            type = pair('=', TokenType::LESS_EQUAL, TokenType::LESS);
+            break;
+        case '>':
+            type = pair('=', TokenType::GREATER_EQUAL, TokenType::GREATER);
+            break;
+        case '&':
+        case '|':
+            // only doubled
+            if (peek() != current)
+                fail("LEXER", "UNEXPECTED_CHAR", std::string("character = '") + current + "'");
+            type = (current == '&') ? TokenType::AND : TokenType::OR;
+            advance();
+            break;
+        case '@':
+            type = TokenType::AT;
             break;
         case ';':
             type = TokenType::SEMI;
@@ -90,10 +125,11 @@ Token Lexer::next() {
         case '}':
             type = TokenType::RCURLY;
             break;
+        case ':':
+            type = TokenType::COLON;
+            break;
         default:
-            std::cerr << "ERROR::LEXER::UNEXPECTED_CHAR\n";
-            std::cerr << "character = '" << current << "'\n";
-            exit(1);
+            fail("LEXER", "UNEXPECTED_CHAR", std::string("character = '") + current + "'");
     }
 
     advance();
@@ -123,13 +159,13 @@ Token Lexer::string() {
 
     while (current != '"') {
         if (current == '\0')
-            exit(1);
+            fail("LEXER", "UNTERMINATED_STRING");
 
         if (current == '\\') {
             advance();
             switch (current) {
                 case '\0':
-                    exit(1);
+                    fail("LEXER", "UNTERMINATED_STRING");
                 case 'n':
                     current = '\n';
                     break;
@@ -152,11 +188,11 @@ Token Lexer::num() {
     bool dot = false;
 
     while (std::isdigit(current) || current == '.') {
-        if (current == '.')
+        if (current == '.') {
             if (dot)
-                exit(1);
-            else
-                dot = true;
+                fail("LEXER", "INVALID_NUMBER");
+            dot = true;
+        }
         buf << current;
         advance();
     }
@@ -170,10 +206,12 @@ Token Lexer::num() {
 std::vector<Token> Lexer::tokenize() {
     std::vector<Token> tokens;
     Token token = next();
+    token.line = start_line;
 
     while (token.type != TokenType::END) {
         tokens.push_back(token);
         token = next();
+        token.line = start_line;
     }
 
     tokens.push_back(token);
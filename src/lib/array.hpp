@@ -0,0 +1,33 @@
+#ifndef ARRAY_HPP
+#define ARRAY_HPP
+
+#include "bytecode.hpp"
+
+// Arrays of ints or floats, worked on in bulk by the kernels in simd.hpp.
+// Ints in an array are 64 bit and wrap around instead of growing into big
+// ints. An operation with a float array on either side gives floats.
+
+// zero filled
+Value new_array(ArrayKinds kind, size_t size);
+
+Value copy_array(const ArrayObject* array);
+
+Value array_get(ArrayObject* array, long index);
+
+void array_set(ArrayObject* array, long index, const Value& value);
+
+// ADD, SUB, MULT or DIV element by element on arrays of the same size
+Value array_arithmetic(OpCode op, ArrayObject* left, ArrayObject* right);
+
+Value array_sum(ArrayObject* array);
+
+Value array_min(ArrayObject* array);
+
+Value array_max(ArrayObject* array);
+
+Value array_dot(ArrayObject* left, ArrayObject* right);
+
+// left + scale * right
+Value array_scaled_add(ArrayObject* left, ArrayObject* right, const Value& scale);
+
+#endif
@@ -14,14 +14,20 @@ enum class AstType {
     UNARY_OP,
     BINARY_OP,
     FUNC_CALL,
+    MAP,
+    COMPARISON,
+    LOGICAL_OP,
     CONST_DECL,
     VAR_DECL,
     VAR_SET,
     RETURN,
     NO_RETURN_EXPR,
+    IF,
+    WHILE,
     GLOBAL_CONST_DECL,
     GLOBAL_VAR_DECL,
     FUNC_DECL,
+    IMPORT,
 };
 
 class AstNode {
@@ -45,8 +51,10 @@ public:
 class AstInt : public AstExpr {
 public:
     long value;
+    // the literal when it does not fit in value, empty otherwise
+    std::string digits;
 
-    AstInt(long value);
+    AstInt(long value, std::string digits = "");
     AstType get_type() const;
     void print() const;
 };
@@ -81,6 +89,8 @@ public:
 enum class UnaryOpType {
     PLUS_SIGN,
     MINUS_SIGN,
+    AWAIT,
+    NOT,
 };
 
 class AstUnaryOp : public AstExpr {
@@ -122,9 +132,59 @@ public:
     void print() const;
 };
 
+class AstMap : public AstExpr {
+public:
+    // keys and values in source order
+    std::vector<std::pair<std::unique_ptr<AstExpr>, std::unique_ptr<AstExpr>>> entries;
+
+    AstMap(std::vector<std::pair<std::unique_ptr<AstExpr>, std::unique_ptr<AstExpr>>> entries);
+    AstType get_type() const;
+    void print() const;
+};
+
+enum class ComparisonType {
+    EQUAL,
+    NOT_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+};
+
+class AstComparison : public AstExpr {
+public:
+    ComparisonType type;
+    std::unique_ptr<AstExpr> left;
+    std::unique_ptr<AstExpr> right;
+
+    AstComparison(ComparisonType type, std::unique_ptr<AstExpr> left, std::unique_ptr<AstExpr> right);
+    AstType get_type() const;
+    void print() const;
+};
+
+enum class LogicalOpType {
+    AND,
+    OR,
+};
+
+// right is only evaluated when left does not decide the result
+class AstLogicalOp : public AstExpr {
+public:
+    LogicalOpType type;
+    std::unique_ptr<AstExpr> left;
+    std::unique_ptr<AstExpr> right;
+
+    AstLogicalOp(LogicalOpType type, std::unique_ptr<AstExpr> left, std::unique_ptr<AstExpr> right);
+    AstType get_type() const;
+    void print() const;
+};
+
 // STATEMENTS
 
-class AstStatement : public AstNode {};
+class AstStatement : public AstNode {
+public:
+    int line = 0;
+};
 
 class AstConstDecl : public AstStatement {
 public:
@@ -174,9 +234,35 @@ public:
     void print() const;
 };
 
+// else if is an else holding just another if
+class AstIf : public AstStatement {
+public:
+    std::unique_ptr<AstExpr> condition;
+    std::vector<std::unique_ptr<AstStatement>> code;
+    std::vector<std::unique_ptr<AstStatement>> else_code;
+
+    AstIf(std::unique_ptr<AstExpr> condition, std::vector<std::unique_ptr<AstStatement>> code,
+        std::vector<std::unique_ptr<AstStatement>> else_code);
+    AstType get_type() const;
+    void print() const;
+};
+
+class AstWhile : public AstStatement {
+public:
+    std::unique_ptr<AstExpr> condition;
+    std::vector<std::unique_ptr<AstStatement>> code;
+
+    AstWhile(std::unique_ptr<AstExpr> condition, std::vector<std::unique_ptr<AstStatement>> code);
+    AstType get_type() const;
+    void print() const;
+};
+
 // DECLARATIONS
 
-class AstDeclaration : public AstNode {};
+class AstDeclaration : public AstNode {
+public:
+    int line = 0;
+};
 
 class AstGlobalConstDecl : public AstDeclaration {
 public:
@@ -204,9 +290,23 @@ public:
     std::vector<std::unique_ptr<AstVarDecl>> required_args;
     std::vector<std::unique_ptr<AstVarDecl>> optional_args;
     std::vector<std::unique_ptr<AstStatement>> code;
+    bool is_async;
+    // annotated @memo, its calls are always memoized
+    bool memo;
 
     AstFuncDecl(std::string name, std::vector<std::unique_ptr<AstVarDecl>> required_args,
-        std::vector<std::unique_ptr<AstVarDecl>> optional_args, std::vector<std::unique_ptr<AstStatement>> code);
+        std::vector<std::unique_ptr<AstVarDecl>> optional_args, std::vector<std::unique_ptr<AstStatement>> code,
+        bool is_async = false, bool memo = false);
+    AstType get_type() const;
+    void print() const;
+};
+
+class AstImport : public AstDeclaration {
+public:
+    // as written, relative to the directory of the importing file
+    std::string path;
+
+    AstImport(std::string path);
     AstType get_type() const;
     void print() const;
 };
@@ -222,4 +322,43 @@ public:
     void print() const;
 };
 
+// calls visit on each operand of expr in the order they are evaluated
+template <typename Visit>
+void visit_operands(const AstExpr* expr, Visit visit) {
+    switch (expr->get_type()) {
+        case AstType::UNARY_OP:
+            return visit(static_cast<const AstUnaryOp*>(expr)->value.get());
+        case AstType::BINARY_OP: {
+            const AstBinaryOp* op = static_cast<const AstBinaryOp*>(expr);
+            visit(op->left.get());
+            return visit(op->right.get());
+        }
+        case AstType::COMPARISON: {
+            const AstComparison* comparison = static_cast<const AstComparison*>(expr);
+            visit(comparison->left.get());
+            return visit(comparison->right.get());
+        }
+        case AstType::LOGICAL_OP: {
+            const AstLogicalOp* op = static_cast<const AstLogicalOp*>(expr);
+            visit(op->left.get());
+            return visit(op->right.get());
+        }
+        case AstType::FUNC_CALL: {
+            const AstFuncCall* call = static_cast<const AstFuncCall*>(expr);
+            visit(call->name.get());
+            for (const auto& arg : call->args)
+                visit(arg.get());
+            return;
+        }
+        case AstType::MAP:
+            for (const auto& entry : static_cast<const AstMap*>(expr)->entries) {
+                visit(entry.first.get());
+                visit(entry.second.get());
+            }
+            return;
+        default:
+            return;
+    }
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef BIGINT_HPP
+#define BIGINT_HPP
+
+#include "bytecode.hpp"
+
+#include <cstdint>
+#include <string>
+
+// Integers are plain INT values while they fit in a long. Operations check
+// for overflow with the compiler builtins and only then come here, where
+// results that fit in a long again are given back as INT.
+
+// multiplications with both sides at least this many limbs use Karatsuba
+const size_t KARATSUBA_THRESHOLD = 32;
+
+inline bool is_integer(const Value& value) {
+    return value.type == ValueTypes::INT || value.type == ValueTypes::BIG_INT;
+}
+
+// ADD, SUB, MULT or DIV on two integers without overflow, division truncates
+// toward zero like it does for ints
+Value big_arithmetic(OpCode op, const Value& left, const Value& right);
+
+Value big_negate(const Value& value);
+
+// -1, 0 or 1 as the integer left is less than, equal to or greater than right
+int big_compare(const Value& left, const Value& right);
+
+double big_to_double(const Value& value);
+
+// an integer from limbs as BigIntObject keeps them, INT when it fits
+Value big_int(bool negative, const uint32_t* limbs, size_t size);
+
+// decimal digits without a sign
+Value parse_integer(const std::string& digits);
+
+std::string big_to_string(const Value& value);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef BUILTINS_HPP
+#define BUILTINS_HPP
+
+#include "native.hpp"
+
+namespace build_in_functions {
+    Value print(const Value* args, size_t count);
+    void flush();
+    long three();
+    long exitf(long code);
+    Value spawn(const Value* args, size_t count);
+    Value join(long handle);
+    Value parallel_map(const Value& function, long count);
+    long sleep_async(long milliseconds);
+    long read_file_async(const char* path);
+    Value array_int(long size);
+    Value array_float(long size);
+    Value array_range(long size);
+    long array_len(ArrayObject* array);
+    Value array_get(ArrayObject* array, long index);
+    void array_set(ArrayObject* array, long index, const Value& value);
+    Value array_add(ArrayObject* left, ArrayObject* right);
+    Value array_sub(ArrayObject* left, ArrayObject* right);
+    Value array_mul(ArrayObject* left, ArrayObject* right);
+    Value array_div(ArrayObject* left, ArrayObject* right);
+    Value array_sum(ArrayObject* array);
+    Value array_min(ArrayObject* array);
+    Value array_max(ArrayObject* array);
+    Value array_dot(ArrayObject* left, ArrayObject* right);
+    Value array_scaled_add(ArrayObject* left, ArrayObject* right, const Value& scale);
+    Value map_get(MapObject* map, const Value& key);
+    bool map_has(MapObject* map, const Value& key);
+    void map_set(MapObject* map, const Value& key, const Value& value);
+    bool map_remove(MapObject* map, const Value& key);
+    long map_len(MapObject* map);
+}
+
+// natives every program starts with
+const NativeTable& default_natives();
+
+class Output;
+
+void print_value(Output& output, const Value& value);
+
+#endif
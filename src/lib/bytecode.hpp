@@ -0,0 +1,147 @@
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+#include "value.hpp"
+
+#include <cstdlib>
+#include <utility>
+#include <string>
+#include <vector>
+
+enum class OpCode {
+    PUSH_NULL,
+    PUSH_INT,
+    PUSH_CONST,
+    GET_LOCAL,
+    SET_LOCAL,
+    GET_GLOBAL,
+    SET_GLOBAL,
+    POP,
+    POS,
+    NEG,
+    ADD,
+    SUB,
+    MULT,
+    DIV,
+    CALL,
+    // call to the native in a constant global, arity checked when compiling
+    CALL_NATIVE,
+    // call whose result is returned right away, replaces the current frame
+    TAIL_CALL,
+    RETURN,
+    // replaces the handle on top with its result, suspending the coroutine
+    // until there is one
+    AWAIT,
+    // replaces arg keys and values on top, pushed in pairs, with a map
+    MAKE_MAP,
+    // replace the two values on top with 1 if the comparison holds, 0 if not
+    EQUAL,
+    NOT_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    // replaces the value on top with 1 if it is false, 0 if it is true
+    NOT,
+    // jumps go to the instruction at arg in the same function
+    JUMP,
+    // pop the value on top and jump if it is false or true
+    JUMP_IF_FALSE,
+    JUMP_IF_TRUE,
+    // local = local + arg for the local in count, without the stack
+    ADD_LOCAL,
+};
+
+class Instruction {
+public:
+    OpCode op;
+    // argument count of CALL_NATIVE, whose arg is the global, and the local
+    // of ADD_LOCAL, whose arg is the int added
+    unsigned int count;
+    long arg;
+
+    Instruction(OpCode op, long arg = 0, unsigned int count = 0) : op(op), count(count), arg(arg) {}
+};
+
+// Frame layout on the value stack, relative to the frame base:
+//   [-1]              the callee itself
+//   [0, args)         arguments, required first, then optional
+//   [args, locals)    local variables and constants
+//   [locals, ...)     temporaries, never more than max_stack in total
+class Function {
+public:
+    std::string name;
+    size_t required_args;
+    size_t optional_args;
+    size_t locals;
+    size_t max_stack;
+    // calls run as coroutines on the event loop and return a handle
+    bool is_async;
+    // calls may be answered from earlier ones with the same arguments, see
+    // purity.hpp, and always are when memo
+    bool pure;
+    bool memo;
+    // a profile saw it hot and only ever given ints, see feedback.hpp, so
+    // the JIT compiles it before its first call
+    bool precompile;
+    // entries[k] is where execution starts when k optional arguments were
+    // passed, so the defaults of the missing ones are stored straight into
+    // their slots before the body runs.
+    std::vector<size_t> entries;
+    std::vector<Instruction> code;
+    // (first instruction, source line) wherever the line changes, in code order
+    std::vector<std::pair<size_t, int>> lines;
+
+    Function(std::string name, size_t required_args = 0, size_t optional_args = 0)
+    : name(std::move(name)), required_args(required_args), optional_args(optional_args),
+      locals(0), max_stack(0), is_async(false), pure(false), memo(false), precompile(false) {}
+
+    // source line of the instruction at ip, 0 if unknown
+    int line_at(size_t ip) const {
+        int line = 0;
+        for (const auto& entry : lines) {
+            if (entry.first > ip)
+                break;
+            line = entry.second;
+        }
+        return line;
+    }
+};
+
+class Global {
+public:
+    std::string name;
+    bool constant;
+    Value value;
+
+    Global(std::string name, bool constant, Value value = Value())
+    : name(std::move(name)), constant(constant), value(value) {}
+};
+
+class Program {
+public:
+    // immortal objects behind the long string and big int literals in
+    // constants
+    std::vector<Object*> objects;
+    std::vector<Value> constants;
+    std::vector<Global> globals;
+    // functions[0] runs the global initializers
+    std::vector<Function> functions;
+    long main;
+    // globals already hold what the initializers would give them, as in a
+    // program loaded from a snapshot
+    bool initialized;
+
+    Program() : main(-1), initialized(false) {}
+
+    Program(Program&&) = default;
+
+    Program(const Program&) = delete;
+
+    ~Program() {
+        for (Object* object : objects)
+            std::free(object);
+    }
+};
+
+#endif
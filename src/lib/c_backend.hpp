@@ -0,0 +1,53 @@
+#ifndef C_BACKEND_HPP
+#define C_BACKEND_HPP
+
+#include "ast.hpp"
+
+#include <ostream>
+#include <unordered_map>
+#include <unordered_set>
+
+// Translates a program into C against src/runtime/bask_runtime.h. The
+// program is expected to have passed compile() already, so names resolve
+// and argument lists are well formed.
+class CBackend {
+private:
+    const AstProgram& ast;
+    std::ostream& out;
+    std::unordered_map<std::string, const AstFuncDecl*> functions;
+    std::unordered_set<std::string> globals;
+    std::unordered_set<std::string> locals;
+    size_t temps;
+
+    std::string temp();
+
+    std::string escape(const std::string& value) const;
+
+    std::string compile_name(const std::string& name);
+
+    std::string compile_func_call(const AstExpr* ast_node);
+
+    std::string compile_comparison(const AstExpr* ast_node);
+
+    std::string compile_logical_op(const AstExpr* ast_node);
+
+    std::string compile_expr(const AstExpr* ast_node);
+
+    void compile_set(const std::string& name, const std::string& value);
+
+    void compile_statement(const AstStatement* ast_node);
+
+    // the statements in a C block of their own, locals declared in it end
+    // with it
+    void compile_block(const std::vector<std::unique_ptr<AstStatement>>& code);
+
+    void compile_func_decl(const AstFuncDecl* ast_node);
+public:
+    CBackend(const AstProgram& ast, std::ostream& out);
+
+    void emit();
+};
+
+void emit_c(const AstProgram& ast, std::ostream& out);
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef COMPILER_HPP
+#define COMPILER_HPP
+
+#include "ast.hpp"
+#include "bytecode.hpp"
+#include "builtins.hpp"
+#include "purity.hpp"
+
+#include <unordered_map>
+#include <unordered_set>
+
+class LoopPassStats;
+
+class Local {
+public:
+    size_t slot;
+    bool constant;
+
+    Local(size_t slot = 0, bool constant = false) : slot(slot), constant(constant) {}
+};
+
+// A module compiled on its own, linked into a program by module.hpp. Its
+// globals are the natives, then the ones it declares, then a stand-in for
+// each global its imports declare, which its code uses like any other.
+class CompiledModule {
+public:
+    Program program;
+    size_t natives;
+    // what importing the module brings in
+    size_t declared;
+    // (import, global of that import) for each stand-in, imports counted in
+    // source order
+    std::vector<std::pair<size_t, size_t>> externs;
+
+    CompiledModule() : natives(0), declared(0) {}
+
+    CompiledModule(Program program, size_t natives, size_t declared, std::vector<std::pair<size_t, size_t>> externs)
+    : program(std::move(program)), natives(natives), declared(declared), externs(std::move(externs)) {}
+};
+
+class Compiler {
+private:
+    // nullptr for a session, which gets its declarations an input at a time
+    const AstProgram* ast;
+    const NativeTable& natives;
+    // one for each import of ast, in source order
+    std::vector<const CompiledModule*> imports;
+    Program program;
+    size_t native_count;
+    std::vector<std::pair<size_t, size_t>> externs;
+    // function a session compiles each input into, replaced every time
+    size_t input;
+    std::unordered_map<std::string, size_t> global_index;
+    // literal contents to their constant, so each is stored only once
+    std::unordered_map<std::string, size_t> interned;
+    // const globals whose value can never change
+    std::unordered_set<std::string> immutable_constants;
+    std::unordered_map<std::string, Local> locals;
+    // locals of the function that only ever hold integers
+    std::unordered_set<std::string> integers;
+    // expressions the loops being compiled keep in locals, to those locals
+    std::unordered_map<const AstExpr*, size_t> computed;
+    // code following an induction variable update, stepping the products of
+    // the variable kept in locals
+    std::unordered_map<const AstStatement*, std::vector<Instruction>> steps;
+    LoopPassStats* loop_passes;
+    Function* function;
+    size_t depth;
+    size_t max_depth;
+
+    void emit(OpCode op, long arg = 0, unsigned int count = 0);
+
+    // points the jumps at target
+    void patch(const std::vector<size_t>& jumps, size_t target);
+
+    // what is emitted from here on comes from line
+    void mark_line(int line);
+
+    size_t add_constant(Value value);
+
+    size_t intern(const std::string& value);
+
+    void declare_global(const std::string& name, bool constant, Value value = Value());
+
+    size_t declare_local(const std::string& name, bool constant);
+
+    void declare_imports();
+
+    // an existing var or const global keeps its slot when declared again
+    void redeclare_global(const std::string& name, bool constant);
+
+    // drops what a failed input added, the sizes are those from before it
+    void roll_back(size_t globals, size_t functions, size_t constants, size_t objects);
+
+    // what a global name is to the purity analysis
+    GlobalKind global_kind(const std::string& name) const;
+
+    // sets pure and memo of each function from its declaration, the
+    // declarations being those compiled together
+    void mark_pure(const std::vector<std::pair<const AstFuncDecl*, Function*>>& funcs);
+
+    void begin_function(Function& target);
+
+    void end_function();
+
+    void compile_int(const AstExpr* ast_node);
+
+    void compile_name(const AstExpr* ast_node);
+
+    void compile_unary_op(const AstExpr* ast_node);
+
+    void compile_binary_op(const AstExpr* ast_node);
+
+    void compile_comparison(const AstExpr* ast_node);
+
+    // 1 or 0, through compile_branch
+    void compile_logical_op(const AstExpr* ast_node);
+
+    // Emits jumps taken when the truth of ast_node is when and adds them to
+    // jumps, falling through otherwise. Nothing is left on the stack either
+    // way.
+    void compile_branch(const AstExpr* ast_node, bool when, std::vector<size_t>& jumps);
+
+    // the global holding the native a call always reaches, or -1
+    long static_native(const AstExpr* callee) const;
+
+    void compile_func_call(const AstExpr* ast_node, OpCode op = OpCode::CALL);
+
+    void compile_map(const AstExpr* ast_node);
+
+    void compile_expr(const AstExpr* ast_node);
+
+    void compile_set(const std::string& name);
+
+    void compile_const_decl(const AstStatement* ast_node);
+
+    void compile_var_decl(const AstStatement* ast_node);
+
+    void compile_var_set(const AstStatement* ast_node);
+
+    void compile_return(const AstStatement* ast_node);
+
+    void compile_no_return_expr(const AstStatement* ast_node);
+
+    // names declared in a block go out of scope at its end
+    void compile_block(const std::vector<std::unique_ptr<AstStatement>>& code);
+
+    void compile_if(const AstStatement* ast_node);
+
+    void compile_while(const AstStatement* ast_node);
+
+    void compile_statement(const AstStatement* ast_node);
+
+    void compile_func_decl(const AstFuncDecl* ast_node, Function& target);
+
+    // stores the values of the var and const declarations of ast
+    void compile_global_values(const AstProgram& ast);
+public:
+    // loop_passes, unless nullptr, gets what the loop passes took
+    Compiler(const AstProgram& ast, const NativeTable& natives,
+        const std::vector<const CompiledModule*>& imports = {}, LoopPassStats* loop_passes = nullptr);
+
+    // a session, an empty program that only declares the natives
+    Compiler(const NativeTable& natives);
+
+    // main is left at -1 when the module declares none
+    CompiledModule compile_module();
+
+    Program compile();
+
+    // SESSIONS
+
+    const Program& target() const {
+        return program;
+    }
+
+    // Adds the declarations of ast, whose var and const values are stored by
+    // running the input function. A func declared again keeps its index and
+    // gets the new code, the indexes of such funcs are returned. Nothing is
+    // added when it fails.
+    std::vector<size_t> add_declarations(const AstProgram& ast);
+
+    // Compiles statements into the input function, which returns the value
+    // of the last one if that is an expression.
+    void add_statements(const std::vector<std::unique_ptr<AstStatement>>& statements);
+
+    size_t input_function() const {
+        return input;
+    }
+};
+
+// ast may not import anything, programs with imports are loaded by module.hpp
+Program compile(const AstProgram& ast, const NativeTable& natives = default_natives(),
+    LoopPassStats* loop_passes = nullptr);
+
+CompiledModule compile_module(const AstProgram& ast, const std::vector<const CompiledModule*>& imports,
+    const NativeTable& natives = default_natives());
+
+#endif
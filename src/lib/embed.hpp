@@ -0,0 +1,72 @@
+#ifndef EMBED_HPP
+#define EMBED_HPP
+
+#include "bytecode.hpp"
+#include "builtins.hpp"
+#include "interpreter.hpp"
+#include "native.hpp"
+#include "stats.hpp"
+
+#include <memory>
+#include <string>
+
+// A compiled script. It is immutable once built, so any number of contexts
+// on any number of threads can share one. The natives it was compiled
+// against must outlive it.
+class Script {
+public:
+    std::shared_ptr<const Program> program;
+
+    // throws BaskError when the source does not compile, the lex, parse and
+    // compile phases are added to stats unless it is nullptr
+    static Script compile(const std::string& source, const NativeTable& natives = default_natives(),
+        Stats* stats = nullptr);
+
+    // an image written by bask --snapshot, globals come already initialized
+    static Script load(const std::string& path, const NativeTable& natives = default_natives());
+};
+
+enum class RunStatus {
+    OK,
+    EXIT,
+    ERROR,
+    // went past one of InterpreterOptions::limits or the stack size
+    LIMIT,
+};
+
+class RunResult {
+public:
+    RunStatus status;
+    Value value;
+    int exit_code;
+    std::string error;
+    Limit limit;
+
+    RunResult(RunStatus status = RunStatus::OK, Value value = Value(), int exit_code = 0, std::string error = "",
+        Limit limit = Limit::NONE)
+    : status(status), value(value), exit_code(exit_code), error(std::move(error)), limit(limit) {}
+};
+
+// Globals and stacks for running one script on one thread. Errors, limits
+// and exit calls end only the current call, the context stays usable.
+class Context {
+private:
+    std::shared_ptr<const Program> program;
+    Interpreter interpreter;
+
+    template <typename F>
+    RunResult guard(F body);
+public:
+    Context(const Script& script, const InterpreterOptions& options = InterpreterOptions());
+
+    // runs main, value is its result
+    RunResult run();
+
+    // calls a global function by name
+    RunResult call(const std::string& name, const Value* args = nullptr, size_t count = 0);
+
+    // everything run in this context so far
+    ExecutionStats stats() const;
+};
+
+#endif
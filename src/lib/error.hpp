@@ -0,0 +1,55 @@
+#ifndef ERROR_HPP
+#define ERROR_HPP
+
+#include <stdexcept>
+#include <string>
+
+// Any failure while loading or running a script. what() is the report the
+// command line prints, "ERROR::<STAGE>::<ERROR>" followed by detail lines.
+class BaskError : public std::runtime_error {
+public:
+    BaskError(const std::string& message) : std::runtime_error(message) {}
+};
+
+// the limits a host can put on an execution, see limits.hpp
+enum class Limit {
+    NONE,
+    FUEL,
+    TIME,
+    STACK,
+    HEAP,
+};
+
+// A script that went past one of its limits, which hosts may want to tell
+// apart from a script that failed on its own.
+class LimitError : public BaskError {
+public:
+    Limit limit;
+
+    LimitError(Limit limit, const std::string& message) : BaskError(message), limit(limit) {}
+};
+
+// Thrown by the exit builtin so the host decides what ending a script means.
+class ScriptExit {
+public:
+    int code;
+
+    ScriptExit(int code) : code(code) {}
+};
+
+inline std::string error_message(const char* stage, const char* error, const std::string& detail) {
+    std::string message = std::string("ERROR::") + stage + "::" + error + "\n";
+    if (!detail.empty())
+        message += detail + "\n";
+    return message;
+}
+
+[[noreturn]] inline void fail(const char* stage, const char* error, const std::string& detail = "") {
+    throw BaskError(error_message(stage, error, detail));
+}
+
+[[noreturn]] inline void fail_limit(Limit limit, const char* error, const std::string& detail = "") {
+    throw LimitError(limit, error_message("INTERPRETER", error, detail));
+}
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include "bytecode.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The suspended frame of a call to an async func. await is only allowed in
+// the body of the async func itself, so a single frame is all there is to
+// keep between resumes.
+class Coroutine {
+public:
+    const Function* function;
+    size_t ip;
+    bool started;
+    // callee, arguments, locals and temporaries, laid out as on the stack
+    std::vector<Value> frame;
+    // report of the error the handle it awaits failed with, raised where
+    // the await left off when it resumes, empty if none
+    std::string error;
+
+    Coroutine(const Function* function, size_t ip) : function(function), ip(ip), started(false) {}
+};
+
+// The result of a coroutine, timer or file read, awaited through an int
+// handle. A result is handed out once, the promise is gone after that.
+class Promise {
+public:
+    bool done;
+    Value result;
+    // report of the error it failed with instead of a result, empty if none
+    std::string error;
+    // coroutine resumed with the result, 0 while nobody awaits it
+    long waiter;
+    std::unique_ptr<Coroutine> coroutine;
+
+    Promise() : done(false), waiter(0) {}
+};
+
+// Promises of one interpreter and the ready queue of coroutines. Timers
+// are the epoll_wait timeout, file reads run on helper threads because
+// regular files never poll as unready, and wake the loop through an
+// eventfd.
+class EventLoop {
+private:
+    class FinishedRead {
+    public:
+        long handle;
+        bool ok;
+        std::string path;
+        std::string data;
+    };
+
+    std::unordered_map<long, Promise> promises;
+    long next_handle;
+    std::deque<long> ready;
+    // deadline in milliseconds and the promise it finishes
+    std::priority_queue<std::pair<int64_t, long>, std::vector<std::pair<int64_t, long>>,
+        std::greater<std::pair<int64_t, long>>> timers;
+
+    int epoll_fd;
+    int wake_fd;
+
+    std::mutex reads_lock;
+    std::condition_variable reads_wake;
+    std::deque<std::pair<long, std::string>> queued_reads;
+    std::vector<FinishedRead> finished_reads;
+    std::vector<std::thread> readers;
+    size_t pending_reads;
+    bool stopping;
+
+    long create();
+
+    void read_files();
+public:
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    long start(std::unique_ptr<Coroutine> coroutine);
+
+    long sleep(long milliseconds);
+
+    long read_file(const std::string& path);
+
+    // true with the result in value if handle is done, otherwise waiter is
+    // resumed once it is; throws the error of a handle that failed
+    bool await(long handle, long waiter, Value& value);
+
+    Coroutine& coroutine(long handle);
+
+    // a coroutine has returned
+    void finish(long handle, Value result);
+
+    // a timer or file read failed with the error report, which goes to
+    // whoever awaits handle
+    void reject(long handle, std::string error);
+
+    bool done(long handle) const;
+
+    // nothing left that could ever become ready
+    bool idle() const;
+
+    // next coroutine to resume, 0 if none is ready
+    long next_ready();
+
+    // blocks until a timer or file read finishes
+    void poll();
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef FEEDBACK_HPP
+#define FEEDBACK_HPP
+
+#include "bytecode.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Profile-guided optimization across runs. A run with --profile-out records
+// how often each function is called and with what types of arguments, which
+// way each conditional branch goes and what each call site calls; a later
+// run with --profile-in optimizes the program with it before it starts. Hot
+// call sites of small functions are inlined, and hot functions only ever
+// given ints are compiled to native code up front instead of after
+// --jit-threshold calls.
+//
+// Everything recorded about a function is filed under a hash of its
+// bytecode, so what was recorded for a function that changed since is
+// ignored.
+
+// calls, or turns of its loops, that make a function hot
+const size_t HOT_CALLS = 1000;
+const size_t HOT_LOOP_TURNS = 10000;
+// calls a site needs to be inlined
+const size_t INLINE_MIN_CALLS = 1000;
+// instructions of the largest function inlined, and of the largest caller
+// it is inlined into
+const size_t INLINE_MAX_SIZE = 40;
+const size_t INLINE_MAX_CALLER_SIZE = 2000;
+
+// bit 1 << type for each ValueTypes seen
+typedef unsigned TypeMask;
+
+inline TypeMask type_bit(const Value& value) {
+    return 1u << static_cast<unsigned>(value.type);
+}
+
+class BranchCounts {
+public:
+    size_t taken;
+    size_t not_taken;
+
+    BranchCounts() : taken(0), not_taken(0) {}
+};
+
+class CallSite {
+public:
+    size_t calls;
+    // hash of the one function called there, 0 when a native or more than
+    // one function was
+    uint64_t callee;
+    // of each argument
+    std::vector<TypeMask> types;
+
+    CallSite() : calls(0), callee(0) {}
+};
+
+class FunctionProfile {
+public:
+    std::string name;
+    size_t calls;
+    // backward branches taken
+    size_t loop_turns;
+    // of each argument it was called with
+    std::vector<TypeMask> arg_types;
+    // by ip, of conditional and backward jumps
+    std::vector<BranchCounts> branches;
+    // by ip, of calls
+    std::vector<CallSite> sites;
+
+    FunctionProfile() : calls(0), loop_turns(0) {}
+
+    bool hot() const {
+        return calls >= HOT_CALLS || loop_turns >= HOT_LOOP_TURNS;
+    }
+};
+
+class Profile {
+public:
+    // by function hash
+    std::unordered_map<uint64_t, FunctionProfile> functions;
+
+    void write(const std::string& path) const;
+
+    // keeps only the branches and sites of functions program still has,
+    // whose ips must be inside their code
+    static Profile read(const std::string& path, const Program& program);
+};
+
+// of the code and signature of a function, stable across runs and builds
+uint64_t function_hash(const Program& program, const Function& function);
+
+// Collects a profile while an interpreter runs the program, which must not
+// change meanwhile.
+class ProfileRecorder {
+private:
+    const Program& program;
+    std::vector<uint64_t> hashes;
+    std::vector<FunctionProfile> functions;
+
+    FunctionProfile& function(size_t index);
+
+    void arguments(FunctionProfile& profile, const Value* args, size_t argc);
+public:
+    ProfileRecorder(const Program& program);
+
+    // a call from the host
+    void call(size_t index, const Value* args, size_t argc);
+
+    // a call at ip of function, callee followed by its arguments
+    void site(size_t index, size_t ip, const Value* callee, size_t argc);
+
+    void branch(size_t index, size_t ip, size_t target, bool taken);
+
+    Profile profile() const;
+};
+
+// what apply_profile made of a profile
+class ProfileUse {
+public:
+    // functions with data and data for functions that are gone or changed
+    size_t matched;
+    size_t stale;
+    size_t inlined;
+    size_t precompiled;
+
+    ProfileUse() : matched(0), stale(0), inlined(0), precompiled(0) {}
+};
+
+// optimizes the program for what the profile saw before it runs
+ProfileUse apply_profile(Program& program, const Profile& profile);
+
+#endif
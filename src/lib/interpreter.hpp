@@ -1,56 +1,193 @@
 #ifndef INTERPRETER_HPP
 #define INTERPRETER_HPP
 
-#include "ast.hpp"
+#include "bytecode.hpp"
+#include "event_loop.hpp"
+#include "feedback.hpp"
+#include "jit.hpp"
+#include "limits.hpp"
+#include "memo.hpp"
+#include "scheduler.hpp"
+#include "stats.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+const size_t DEFAULT_STACK_SIZE = 1 << 18;
+
+class InterpreterOptions {
+public:
+    size_t stack_size = DEFAULT_STACK_SIZE;
+    bool jit = BASK_JIT_SUPPORTED;
+    size_t jit_threshold = DEFAULT_JIT_THRESHOLD;
+    size_t memo_threshold = DEFAULT_MEMO_THRESHOLD;
+    // threads running spawned tasks, counting the one that joins them, 0
+    // means one per core
+    size_t threads = 0;
+    // for every call from the host, and every spawned task
+    ExecutionLimits limits;
+};
+
+class Frame {
+public:
+    size_t base;
+    size_t return_ip;
+    const Function* function;
 
-#include <stack>
-#include <unordered_map>
-#include <functional>
+    Frame(size_t base = 0, size_t return_ip = 0, const Function* function = nullptr)
+    : base(base), return_ip(return_ip), function(function) {}
+};
 
-namespace build_in_functions {
-    long three(const std::vector<long>& args);
-    long exitf(const std::vector<long>& args);
-}
+// a memoized call whose result is stored once the frame at depth returns
+class PendingMemo {
+public:
+    size_t depth;
+    size_t function;
+    size_t hash;
+    size_t generation;
 
-const std::unordered_map<std::string,
-    std::function<long(const std::vector<long>&)>> default_functions = {
-    {"three", build_in_functions::three},
-    {"exit", build_in_functions::exitf},
+    PendingMemo(size_t depth, size_t function, size_t hash, size_t generation)
+    : depth(depth), function(function), hash(hash), generation(generation) {}
 };
 
+Value arithmetic(OpCode op, const Value& left, const Value& right);
+
+// EQUAL to GREATER_EQUAL. Numbers compare by value whatever their types and
+// strings by their bytes, other values are only equal to themselves and
+// have no order.
+Value compare(OpCode op, const Value& left, const Value& right);
+
 class Interpreter {
 private:
-    const std::vector<std::unique_ptr<AstStatement>>& ast_tree;
-    std::stack<long> op_stack;
-    std::unordered_map<std::string, long> variables;
-    std::unordered_map<std::string,
-        std::function<long(const std::vector<long>&)>> functions;
+    const Program& program;
+    InterpreterOptions options;
+    std::vector<Value> globals;
+    // both stacks are allocated once up front and never grow, value slots are
+    // constructed only as deep as calls reach so a fresh context stays cheap
+    Value* stack;
+    size_t stack_size;
+    // slots below this are constructed
+    size_t high_water;
+    std::vector<Frame> frames;
+    size_t max_frames;
+    size_t sp;
+    bool initialized;
+    // nonzero while running a spawned task, which may not use var globals
+    size_t task_depth;
+    // shared with every interpreter running tasks for the same program,
+    // created by the first spawn and owned by the interpreter that made it
+    Scheduler* scheduler;
+    std::unique_ptr<Scheduler> own_scheduler;
+    std::unique_ptr<EventLoop> loop;
+    // handle of the coroutine whose frame is at the bottom of execute, 0
+    // outside of coroutines
+    long running_coroutine;
+    // set by an await that left execute without finishing the frame
+    bool suspended;
+    Budget budget;
+    std::unique_ptr<Jit> jit;
+    // one per func, results are only ever cached for pure ones
+    std::vector<MemoTable> memos;
+    std::vector<PendingMemo> pending_memos;
+    // sees the calls and branches of this interpreter, not of its tasks
+    ProfileRecorder* recorder;
+    ExecutionStats counters;
+
+    void reach(size_t depth);
+
+    size_t push_frame(size_t argc, size_t return_ip);
+
+    // makes a coroutine out of a call to an async func with the callee and
+    // args at args[-1], args[0], ...
+    long start_coroutine(const Value* args, size_t argc);
+
+    // runs a ready coroutine until it awaits something unfinished or returns
+    void resume(long handle);
+
+    // runs the event loop until handle is done and returns its result, or
+    // until nothing is left to run when handle is 0
+    Value drive(long handle);
+
+    // nullptr when there are no limits for compiled code to check
+    Budget* jit_budget() {
+        return options.limits.any() ? &budget : nullptr;
+    }
+
+    // runs a call through compiled code if its arguments allow it
+    bool call_native(JitCode native, size_t argc);
+
+    // answers a call to a pure func from its cache, or has its result cached
+    // when the frame at depth returns
+    bool lookup_memo(size_t argc, size_t depth);
+
+    // caches the results of the calls whose frame at depth returns result
+    void store_memos(size_t depth, const Value& result);
+
+    // forgets the calls deeper than depth, which an error unwound
+    void drop_memos(size_t depth);
+
+    // finishes calls to builtins, compiled code and cached results where
+    // they stand, false when the callee needs a bytecode frame; ip is that
+    // of the caller and depth that of the frame the callee would get
+    bool call_in_place(size_t argc, size_t ip, size_t depth);
+
+    // hands the stack to the profiler for the ticks since the last sample,
+    // with leaf on top if a builtin or compiled call just ran
+    void sample(size_t ip, const std::string* leaf = nullptr);
+
+    Value execute(size_t ip, size_t exit_depth);
+public:
+    Interpreter(const Program& program, const InterpreterOptions& options = InterpreterOptions());
+    ~Interpreter();
 
-    long interprite_int(const std::unique_ptr<AstExpr>& ast_node);
-    
-    long interprite_var_get(const std::unique_ptr<AstExpr>& ast_node);
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
 
-    long interprite_unary_op(const std::unique_ptr<AstExpr>& ast_node);
+    Value call(const Value& callee, const Value* args, size_t count);
 
-    long interprite_binary_op(const std::unique_ptr<AstExpr>& ast_node);
+    // runs the global initializers once
+    void initialize();
 
-    long interprite_func_call(const std::unique_ptr<AstExpr>& ast_node);
+    // drops whatever calls an error left on the stacks
+    void reset();
 
-    long interprite_expr(const std::unique_ptr<AstExpr>& ast_node);
+    // Takes in the globals and functions the program gained since, with no
+    // call running. Compiled code goes when any of replaced, functions whose
+    // code changed, could have reached them.
+    void update(const std::vector<size_t>& replaced);
 
-    void interprite_var_decl(const std::unique_ptr<AstStatement>& ast_node);
+    // runs the coroutines nobody awaited to the end
+    void settle();
 
-    void interprite_var_set(const std::unique_ptr<AstStatement>& ast_node);
+    // nullptr when the program has no global with that name
+    const Value* global(const std::string& name) const;
 
-    void interprite_no_return_expr(const std::unique_ptr<AstStatement>& ast_node);
+    const std::vector<Value>& global_values() const {
+        return globals;
+    }
 
-    void interprite_statement(const std::unique_ptr<AstStatement>& ast_node);
-public:
-    Interpreter(const std::vector<std::unique_ptr<AstStatement>>& ast_tree);
+    // has recorder see every call and branch from now on, nullptr to stop;
+    // compiled code is not seen, the JIT should be off
+    void record(ProfileRecorder* recorder) {
+        this->recorder = recorder;
+    }
+
+    // what this interpreter and those running its tasks have run so far
+    ExecutionStats execution_stats() const;
+
+    int run();
+
+    // the interpreter whose call is running on this thread
+    static Interpreter& current();
+
+    Scheduler& tasks();
+
+    EventLoop& events();
 
-    void run();
+    friend class Scheduler;
 };
 
-void run(const std::vector<std::unique_ptr<AstStatement>>& ast_tree);
+int run(const Program& program, const InterpreterOptions& options = InterpreterOptions());
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,126 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "bytecode.hpp"
+#include "limits.hpp"
+
+#include <csetjmp>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define BASK_JIT_SUPPORTED 1
+#else
+#define BASK_JIT_SUPPORTED 0
+#endif
+
+const size_t DEFAULT_JIT_THRESHOLD = 100;
+const size_t JIT_MAX_ARGS = 64;
+// room kept below the stack limit for the error paths
+const size_t JIT_STACK_MARGIN = 1 << 16;
+
+// Compiled code takes a pointer to its first argument, the rest following at
+// decreasing addresses (the order a caller's pushes leave them in), and the
+// number of arguments passed.
+typedef long (*JitCode)(const long* args, long argc);
+
+// Switches to the stack top, runs the code there and switches back.
+typedef long (*JitTrampoline)(const long* args, long argc, JitCode code, void* stack_top);
+
+enum class JitState {
+    PENDING,
+    ANALYZING,
+    COMPILED,
+    FAILED,
+};
+
+class JitFunction {
+public:
+    JitState state;
+    size_t calls;
+    JitCode code;
+    // past the prologue, where tail calls land with the frame already set up
+    const void* body;
+
+    JitFunction() : state(JitState::PENDING), calls(0), code(nullptr), body(nullptr) {}
+};
+
+// what sent compiled code back to invoke()
+enum JitEscape {
+    JIT_STACK_OVERFLOW = 1,
+    JIT_DIVISION_BY_ZERO,
+    // an int result did not fit, the call has to be redone with big ints
+    JIT_INT_OVERFLOW,
+    JIT_LIMIT,
+};
+
+class Jit {
+private:
+    const Program& program;
+    size_t threshold;
+    // compiled code runs on its own heap allocated stack, not the C++ one
+    size_t stack_bytes;
+    void* stack;
+    uintptr_t stack_limit;
+    JitTrampoline trampoline;
+    // compiled code has no unwind info, errors longjmp past it to invoke()
+    std::jmp_buf escape;
+    // what the interpreter has left, compiled code takes from it at calls
+    // and loop heads when there is one
+    Budget* budget;
+    std::vector<JitFunction> functions;
+    std::vector<std::pair<void*, size_t>> regions;
+
+    bool analyze(size_t index, std::vector<size_t>& cluster);
+
+    void compile(size_t index);
+
+    // compile() adding to compile_seconds
+    void compile_counted(size_t index);
+
+    void* install(const std::vector<uint8_t>& code);
+public:
+    Jit(const Program& program, size_t threshold, size_t stack_bytes, Budget* budget = nullptr);
+
+    ~Jit();
+
+    // Counts a call and returns native code for the function once it is hot
+    // and compilable, nullptr while it should stay in the interpreter.
+    JitCode lookup(size_t index) {
+        JitFunction& function = functions[index];
+        if (function.state == JitState::PENDING && ++function.calls >= threshold)
+            compile_counted(index);
+        return function.code;
+    }
+
+    // compiles the function now rather than once it is hot
+    void precompile(size_t index) {
+        if (functions[index].state == JitState::PENDING)
+            compile_counted(index);
+    }
+
+    // false when an int overflowed, compiled code only ever touches its own
+    // locals so the call can simply be run again in the interpreter
+    bool invoke(JitCode code, const Value* args, size_t count, long& result);
+
+    // sends every later call of the function to the interpreter
+    void discard(size_t index) {
+        functions[index].state = JitState::FAILED;
+        functions[index].code = nullptr;
+        functions[index].body = nullptr;
+    }
+
+    // takes in functions added to the program since
+    void grow() {
+        functions.resize(program.functions.size());
+    }
+
+    // functions compiled so far and the time it took
+    size_t compiled;
+    double compile_seconds;
+
+    friend void jit_escape(Jit* jit, long reason);
+    friend void jit_refill(Jit* jit);
+};
+
+#endif
@@ -8,9 +8,19 @@ private:
     const std::string& source;
     char current;
     unsigned long index;
+    int line;
+    // line of the token next() is reading
+    int start_line;
 
     void advance();
 
+    // the character after current
+    char peek() const;
+
+    // paired if current is followed by second, which is then consumed, and
+    // single otherwise
+    TokenType pair(char second, TokenType paired, TokenType single);
+
     void skip();
 
     Token next();
@@ -0,0 +1,86 @@
+#ifndef LIMITS_HPP
+#define LIMITS_HPP
+
+#include "error.hpp"
+
+#include <chrono>
+#include <climits>
+#include <cstddef>
+
+// fuel spent between two looks at the clock
+const long LIMIT_SLICE = 1 << 14;
+
+// What one execution, a call from the host, may use, 0 leaving a limit off.
+// The value stack is capped by InterpreterOptions::stack_size.
+class ExecutionLimits {
+public:
+    // about the instructions run: a call spends the length of the callee's
+    // code and a backward branch the length of the loop it closes
+    size_t fuel = 0;
+    double seconds = 0;
+    // how much the strings, arrays, maps and big ints made on the thread may
+    // grow the heap by, net of those freed
+    size_t heap_bytes = 0;
+
+    bool any() const {
+        return fuel != 0 || seconds != 0 || heap_bytes != 0;
+    }
+};
+
+// What is left to an execution. Checkpoints, at calls and backward
+// branches, take fuel from left and call refill once it runs out, which
+// counts what went and hands out the next slice, so the clock is only read
+// once a slice. Going over the heap limit empties left to have the next
+// checkpoint report it.
+class Budget {
+private:
+    ExecutionLimits limits;
+    long slice;
+    size_t spent;
+    long heap;
+    std::chrono::steady_clock::time_point deadline;
+    Limit exceeded;
+
+    void hand_out();
+public:
+    long left;
+
+    Budget(const ExecutionLimits& limits);
+
+    // for a new execution
+    void start();
+
+    // false once a limit has been passed
+    bool refill();
+
+    // throws for the limit refill found passed
+    [[noreturn]] void fail() const;
+
+    void take(long fuel) {
+        if ((left -= fuel) <= 0 && !refill())
+            fail();
+    }
+
+    void allocated(size_t bytes);
+
+    void freed(size_t bytes) {
+        heap -= static_cast<long>(bytes);
+    }
+
+    // throws if bytes more would already be over the heap limit
+    void require(size_t bytes) const;
+};
+
+// makes budget the one allocations on this thread count against, giving
+// back the one before
+Budget* swap_budget(Budget* budget);
+
+// called by the allocations of script objects
+void heap_allocated(size_t bytes);
+
+void heap_freed(size_t bytes);
+
+// for allocations whose size a script picks, before making them
+void heap_require(size_t bytes);
+
+#endif
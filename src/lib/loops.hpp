@@ -0,0 +1,83 @@
+#ifndef LOOPS_HPP
+#define LOOPS_HPP
+
+#include "ast.hpp"
+#include "stats.hpp"
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Optimizations of while loops, worked out on the AST for the compiler to
+// carry out. A loop compiles rotated:
+//
+//     condition, jump past the loop when false
+//     preheader, what the plan computes ahead
+//     top: body
+//     condition, jump back to top when true
+//
+// so the preheader only runs when the loop is entered, after the condition
+// was evaluated once with the values the preheader sees, and right before
+// the first iteration. An expression the condition always evaluates, or the
+// body does before anything that could fail or be seen, can therefore be
+// computed there whatever it does, anything else only when it cannot fail.
+
+enum class NameKind {
+    LOCAL,
+    CONST_GLOBAL,
+    VAR_GLOBAL,
+    UNDEFINED,
+};
+
+// A product i * c of an induction variable i, stepped once an iteration by
+// i = i + k or i = i - k, and a loop invariant int c. The product is kept in
+// a local stepped by k * c right after i instead of multiplied every time.
+class Reduction {
+public:
+    std::string variable;
+    const AstExpr* factor;
+    const AstExpr* step;
+    bool subtract;
+    // the assignment stepping the variable
+    const AstStatement* update;
+    // every occurrence of the product
+    std::vector<const AstExpr*> uses;
+    // k * c, negated when subtracting, when both are int literals
+    bool folded;
+    long folded_step;
+};
+
+class LoopPlan {
+public:
+    // Loop invariant expressions to compute in the preheader, each with its
+    // occurrences in the loop, the first of them being the one to compile.
+    // None of them contains another.
+    std::vector<std::vector<const AstExpr*>> hoisted;
+    std::vector<Reduction> reductions;
+};
+
+// what each pass took over every plan_loop call, for --stats
+class LoopPassStats {
+public:
+    // hoisting loop invariant code into the preheader
+    PhaseStats licm;
+    PhaseStats strength;
+
+    LoopPassStats() : licm("licm", 0, 0), strength("strength", 0, 0) {}
+};
+
+// the locals declared in code that only ever hold integers, arguments are
+// the names that are locals before it
+std::unordered_set<std::string> integer_locals(const std::vector<std::unique_ptr<AstStatement>>& code,
+    const std::vector<std::string>& arguments);
+
+// resolve tells what a name is where the loop starts and computed maps the
+// expressions enclosing loops already keep in locals, to those locals; the
+// passes add their time to stats unless it is nullptr
+LoopPlan plan_loop(const AstWhile& loop, const std::function<NameKind(const std::string&)>& resolve,
+    const std::unordered_set<std::string>& integers, const std::unordered_map<const AstExpr*, size_t>& computed,
+    LoopPassStats* stats = nullptr);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef MAP_HPP
+#define MAP_HPP
+
+#include "value.hpp"
+
+// Hash maps from values to values. Keys compare by type and content, ints
+// and floats are never equal to each other and floats compare bit for bit.
+// Arrays and maps cannot be keys.
+
+bool is_hashable(const Value& value);
+
+// the same for equal keys and stable across runs, long strings keep theirs
+size_t hash_value(const Value& value);
+
+// both hashed already when they are long strings
+bool keys_equal(const Value& a, const Value& b);
+
+Value new_map(size_t reserve = 0);
+
+// the value under key, nullptr when there is none
+const Value* map_find(const MapObject* map, const Value& key);
+
+void map_set(MapObject* map, const Value& key, const Value& value);
+
+// false when key was not there
+bool map_remove(MapObject* map, const Value& key);
+
+// calls visit(key, value) for every entry, in table order
+template <typename Visit>
+void map_for_each(const MapObject* map, Visit visit) {
+    for (size_t i = 0; i < map->capacity; i++)
+        if (map->control[i] >= 0)
+            visit(map->entries[i].key, map->entries[i].value);
+}
+
+Value copy_map(const MapObject* map, Value (*copy)(const Value&));
+
+void destroy_map(MapObject* map);
+
+#endif
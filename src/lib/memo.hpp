@@ -0,0 +1,67 @@
+#ifndef MEMO_HPP
+#define MEMO_HPP
+
+#include "value.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// calls a pure func gets before its results are cached, 0 leaves caching to
+// funcs annotated @memo
+const size_t DEFAULT_MEMO_THRESHOLD = 1000;
+// results kept per func
+const size_t MEMO_SLOTS = 1024;
+// lookups an automatic cache gets before it has to show a hit rate of at
+// least 1 in MEMO_MIN_HIT_RATE, or be dropped
+const size_t MEMO_TRIAL = 4096;
+const size_t MEMO_MIN_HIT_RATE = 16;
+
+class MemoEntry {
+public:
+    size_t hash;
+    // bumped whenever the slot is taken for another key
+    size_t generation;
+    std::vector<Value> args;
+    Value result;
+    // false while the call the key was taken for runs
+    bool ready;
+
+    MemoEntry() : hash(0), generation(0), ready(false) {}
+};
+
+// The results of one func by argument values. A key has a single slot and
+// takes it over from whatever was there, so the cache never holds more than
+// MEMO_SLOTS results.
+class MemoTable {
+public:
+    size_t calls;
+    size_t lookups;
+    size_t hits;
+    // set once an automatic cache missed too often to pay for itself
+    bool abandoned;
+    std::vector<MemoEntry> slots;
+
+    MemoTable() : calls(0), lookups(0), hits(0), abandoned(false) {}
+
+    // the result of an earlier call with these args, nullptr when there is
+    // none; hash is that of memo_key
+    const Value* find(size_t hash, const Value* args, size_t count);
+
+    // takes the slot of a call about to run, whose result store fills in
+    // unless another key took the slot meanwhile; gives the generation
+    size_t reserve(size_t hash, const Value* args, size_t count);
+
+    void store(size_t hash, size_t generation, const Value& result);
+
+    // stops caching, keeping the counts
+    void abandon();
+};
+
+// nonzero when every argument can be part of a key, which arrays and maps
+// cannot as the func may change them
+size_t memo_key(const Value* args, size_t count);
+
+// whether a result can be handed out to every caller
+bool memoizable(const Value& result);
+
+#endif
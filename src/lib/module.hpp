@@ -0,0 +1,50 @@
+#ifndef MODULE_HPP
+#define MODULE_HPP
+
+#include "compiler.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Programs spread over several files. `import "path";` brings in every
+// global the imported file declares, though not what that file imports in
+// turn. A module is compiled once however many others import it and its
+// globals are initialized before those of the modules importing it. Import
+// cycles are an error.
+//
+// Files are read and modules compiled on a pool of threads, each module as
+// soon as its imports are. Compiled modules are kept under a key hashed from
+// their source and the keys of their imports, so a changed file recompiles
+// that module and whatever imports it, directly or not, and nothing else.
+class ModuleLoader {
+private:
+    const NativeTable& natives;
+    // keeps compiled modules between runs too when not empty
+    std::string cache_dir;
+    size_t threads;
+    std::mutex cache_lock;
+    std::unordered_map<uint64_t, std::shared_ptr<const CompiledModule>> cache;
+
+    // the module cached under key, nullptr when it has to be compiled
+    std::shared_ptr<const CompiledModule> find(uint64_t key);
+
+    void store(uint64_t key, const std::shared_ptr<const CompiledModule>& module);
+public:
+    // modules compiled and modules taken from the cache by the last load
+    size_t compiled;
+    size_t cached;
+
+    // threads 0 uses one for each core
+    ModuleLoader(std::string cache_dir = "", size_t threads = 0, const NativeTable& natives = default_natives());
+
+    // the program whose main is in the file at path
+    Program load(const std::string& path);
+};
+
+// 64 bit FNV-1a, stable across runs and builds
+uint64_t content_hash(const void* data, size_t size, uint64_t seed = 0);
+
+#endif
@@ -0,0 +1,240 @@
+#ifndef NATIVE_HPP
+#define NATIVE_HPP
+
+#include "value.hpp"
+#include "bigint.hpp"
+
+#include <deque>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+const size_t VARIADIC = static_cast<size_t>(-1);
+
+class Native;
+
+typedef Value (*NativeInvoker)(const Native& native, const Value* args, size_t count);
+
+typedef Value (*RawNativeFunction)(const Value* args, size_t count);
+
+// A host function callable from scripts. invoke unpacks the arguments for
+// the signature function was bound with, arity has already been checked.
+class Native {
+public:
+    std::string name;
+    size_t min_args;
+    size_t max_args;
+    NativeInvoker invoke;
+    void (*function)();
+    // its result only depends on its arguments and it has no other effect
+    // than on arrays and maps it is passed, see purity.hpp
+    bool pure;
+
+    Native(std::string name, size_t min_args, size_t max_args, NativeInvoker invoke, void (*function)(), bool pure)
+    : name(std::move(name)), min_args(min_args), max_args(max_args), invoke(invoke), function(function), pure(pure) {}
+
+    bool accepts(size_t count) const {
+        return count >= min_args && count <= max_args;
+    }
+};
+
+[[noreturn]] void native_type_error(const Native& native, size_t index);
+
+// CONVERSIONS
+
+template <typename T>
+class NativeArg;
+
+template <>
+class NativeArg<long> {
+public:
+    static bool accepts(const Value& value) {
+        return value.type == ValueTypes::INT;
+    }
+
+    static long get(const Value& value) {
+        return value.int_value;
+    }
+};
+
+template <>
+class NativeArg<int> {
+public:
+    static bool accepts(const Value& value) {
+        return value.type == ValueTypes::INT;
+    }
+
+    static int get(const Value& value) {
+        return static_cast<int>(value.int_value);
+    }
+};
+
+template <>
+class NativeArg<double> {
+public:
+    static bool accepts(const Value& value) {
+        return is_integer(value) || value.type == ValueTypes::FLOAT;
+    }
+
+    static double get(const Value& value) {
+        return value.type == ValueTypes::FLOAT ? value.float_value : big_to_double(value);
+    }
+};
+
+template <>
+class NativeArg<const char*> {
+public:
+    static bool accepts(const Value& value) {
+        return value.type == ValueTypes::STRING;
+    }
+
+    static const char* get(const Value& value) {
+        return string_data(value);
+    }
+};
+
+template <>
+class NativeArg<ArrayObject*> {
+public:
+    static bool accepts(const Value& value) {
+        return value.type == ValueTypes::ARRAY;
+    }
+
+    static ArrayObject* get(const Value& value) {
+        return value.array_value;
+    }
+};
+
+template <>
+class NativeArg<MapObject*> {
+public:
+    static bool accepts(const Value& value) {
+        return value.type == ValueTypes::MAP;
+    }
+
+    static MapObject* get(const Value& value) {
+        return value.map_value;
+    }
+};
+
+template <>
+class NativeArg<Value> {
+public:
+    static bool accepts(const Value&) {
+        return true;
+    }
+
+    static const Value& get(const Value& value) {
+        return value;
+    }
+};
+
+template <typename T>
+class NativeResult;
+
+template <>
+class NativeResult<long> {
+public:
+    static Value make(long value) {
+        return Value::integer(value);
+    }
+};
+
+template <>
+class NativeResult<int> {
+public:
+    static Value make(int value) {
+        return Value::integer(value);
+    }
+};
+
+template <>
+class NativeResult<bool> {
+public:
+    static Value make(bool value) {
+        return Value::integer(value ? 1 : 0);
+    }
+};
+
+template <>
+class NativeResult<double> {
+public:
+    static Value make(double value) {
+        return Value::floating(value);
+    }
+};
+
+template <>
+class NativeResult<Value> {
+public:
+    static Value make(Value value) {
+        return value;
+    }
+};
+
+// INVOKERS
+
+template <typename Arg>
+using NativeArgOf = NativeArg<typename std::decay<Arg>::type>;
+
+template <typename... Args, size_t... I>
+void check_native_args(const Native& native, const Value* args, std::index_sequence<I...>) {
+    bool accepted[] = {true, NativeArgOf<Args>::accepts(args[I])...};
+    for (size_t i = 0; i < sizeof...(Args); i++)
+        if (!accepted[i + 1])
+            native_type_error(native, i);
+}
+
+template <typename R, typename... Args, size_t... I>
+Value apply_native(R (*function)(Args...), const Value* args, std::index_sequence<I...>, std::false_type) {
+    return NativeResult<typename std::decay<R>::type>::make(function(NativeArgOf<Args>::get(args[I])...));
+}
+
+template <typename R, typename... Args, size_t... I>
+Value apply_native(R (*function)(Args...), const Value* args, std::index_sequence<I...>, std::true_type) {
+    function(NativeArgOf<Args>::get(args[I])...);
+    return Value();
+}
+
+template <typename R, typename... Args>
+Value invoke_typed(const Native& native, const Value* args, size_t) {
+    check_native_args<Args...>(native, args, std::index_sequence_for<Args...>());
+    return apply_native(reinterpret_cast<R (*)(Args...)>(native.function), args,
+        std::index_sequence_for<Args...>(), std::is_void<R>());
+}
+
+inline Value invoke_raw(const Native& native, const Value* args, size_t count) {
+    return reinterpret_cast<RawNativeFunction>(native.function)(args, count);
+}
+
+// Natives available to a program, bound by name. Entries never move, so
+// values can point straight at them.
+class NativeTable {
+private:
+    std::deque<Native> natives;
+public:
+    // the signature is deduced from function, arguments are converted with
+    // NativeArg and the result with NativeResult
+    template <typename R, typename... Args>
+    void bind(std::string name, R (*function)(Args...), bool pure = false) {
+        natives.emplace_back(std::move(name), sizeof...(Args), sizeof...(Args),
+            invoke_typed<R, Args...>, reinterpret_cast<void (*)()>(function), pure);
+    }
+
+    // for functions that take any values, max_args may be VARIADIC
+    void bind_raw(std::string name, RawNativeFunction function, size_t min_args = 0, size_t max_args = VARIADIC,
+        bool pure = false) {
+        natives.emplace_back(std::move(name), min_args, max_args, invoke_raw,
+            reinterpret_cast<void (*)()>(function), pure);
+    }
+
+    std::deque<Native>::const_iterator begin() const {
+        return natives.begin();
+    }
+
+    std::deque<Native>::const_iterator end() const {
+        return natives.end();
+    }
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+const size_t OUTPUT_BUFFER_SIZE = 1 << 16;
+
+// A buffered writer straight to a file descriptor. It flushes when the
+// buffer fills, on flush() and when destroyed. Writers themselves are not
+// synchronized, threads that share one take lock around what they write.
+class Output {
+private:
+    int fd;
+    size_t used;
+    char buffer[OUTPUT_BUFFER_SIZE];
+public:
+    std::mutex lock;
+
+    Output(int fd);
+    ~Output();
+
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    void write(const char* data, size_t size);
+
+    void put(char c) {
+        if (used == OUTPUT_BUFFER_SIZE)
+            flush();
+        buffer[used++] = c;
+    }
+
+    void write_int(long value);
+
+    void write_double(double value);
+
+    void flush();
+
+    Output& operator<<(const char* value);
+    Output& operator<<(const std::string& value);
+
+    Output& operator<<(char value) {
+        put(value);
+        return *this;
+    }
+
+    Output& operator<<(long value) {
+        write_int(value);
+        return *this;
+    }
+
+    Output& operator<<(int value) {
+        write_int(value);
+        return *this;
+    }
+
+    Output& operator<<(unsigned short value) {
+        write_int(value);
+        return *this;
+    }
+
+    Output& operator<<(double value) {
+        write_double(value);
+        return *this;
+    }
+};
+
+// standard output of the process
+Output& out();
+
+#endif
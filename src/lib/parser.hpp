@@ -7,7 +7,7 @@
 class Parser {
 private:
     std::vector<Token>& tokens;
-    Token& current;
+    Token* current;
     unsigned long index;
 
     void advance();
@@ -16,10 +16,20 @@ private:
 
     void check(TokenType type);
 
+    // {key: value, ...}, current is the {
+    std::unique_ptr<AstExpr> parse_map();
+
     std::unique_ptr<AstExpr> parse_factor();
 
     std::unique_ptr<AstExpr> parse_term();
 
+    std::unique_ptr<AstExpr> parse_sum();
+
+    // a single comparison, they do not chain
+    std::unique_ptr<AstExpr> parse_comparison();
+
+    std::unique_ptr<AstExpr> parse_conjunction();
+
     std::unique_ptr<AstExpr> parse_expr();
 
     std::unique_ptr<AstStatement> parse_const_decl();
@@ -30,6 +40,16 @@ private:
 
     std::unique_ptr<AstStatement> parse_return();
 
+    // { statement* }
+    std::vector<std::unique_ptr<AstStatement>> parse_block();
+
+    // ( expression )
+    std::unique_ptr<AstExpr> parse_condition();
+
+    std::unique_ptr<AstStatement> parse_if();
+
+    std::unique_ptr<AstStatement> parse_while();
+
     std::unique_ptr<AstStatement> parse_statement();
 
     std::unique_ptr<AstDeclaration> parse_global_const_decl();
@@ -38,13 +58,24 @@ private:
 
     std::unique_ptr<AstDeclaration> parse_func_decl();
 
+    // @memo func ...
+    std::unique_ptr<AstDeclaration> parse_annotated();
+
+    // import "path";
+    std::unique_ptr<AstDeclaration> parse_import();
+
     std::unique_ptr<AstDeclaration> parse_declaration();
 public:
     Parser(std::vector<Token>& tokens);
 
     AstProgram parse();
+
+    // statements up to the end, as a session takes them
+    std::vector<std::unique_ptr<AstStatement>> parse_statements();
 };
 
 AstProgram parse(std::vector<Token>& tokens);
 
+std::vector<std::unique_ptr<AstStatement>> parse_statements(std::vector<Token>& tokens);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <atomic>
+#include <csignal>
+#include <cstddef>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+const long DEFAULT_PROFILE_INTERVAL = 1000;
+
+// timer ticks no interpreter has taken a sample for yet, always 0 when no
+// profiler is running
+extern std::atomic<long> profile_ticks;
+
+// Samples the bask call stacks of a running program on a timer counting CPU
+// time. The signal handler only counts ticks, interpreters take the samples
+// at their next call or return, where their frames are in a consistent state,
+// and weigh them by the ticks they cover.
+//
+// Stacks are folded into "func:line;func:line count" lines as flamegraph
+// tools read them.
+class Profiler {
+private:
+    std::mutex lock;
+    std::unordered_map<std::string, size_t> stacks;
+    size_t samples;
+    long interval;
+    struct sigaction previous;
+    timer_t timer;
+public:
+    // interval in microseconds of CPU time
+    Profiler(long interval = DEFAULT_PROFILE_INTERVAL);
+    ~Profiler();
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    void record(const std::string& stack, size_t weight);
+
+    // stops sampling, writes the folded stacks to path and a summary of the
+    // time spent in and under each function to stderr
+    void finish(const std::string& path);
+
+    // the running profiler, nullptr when there is none
+    static Profiler* active();
+};
+
+#endif
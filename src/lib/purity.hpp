@@ -0,0 +1,39 @@
+#ifndef PURITY_HPP
+#define PURITY_HPP
+
+#include "ast.hpp"
+
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// A pure func gives the same result whenever it gets the same arguments and
+// does nothing else on the way, so its calls can be answered from a cache.
+// It writes no global, reads no var global and only calls pure funcs and
+// natives, which may change arrays and maps they are passed but nothing
+// else. Calls passing arrays or maps are never cached, nor results that are
+// arrays or maps, so the ones a cached call sees are all its own.
+
+// what a global name the analysis runs into is
+enum class GlobalKind {
+    // a func or native that is pure, it can be read and called
+    PURE_FUNCTION,
+    // any other func or native, it can only be read
+    FUNCTION,
+    // a const whose value can never change
+    CONSTANT,
+    // var globals, imports, names that do not exist
+    OTHER,
+};
+
+// the funcs that are pure, those of funcs being taken as pure until shown
+// not to be, so they may call each other; global tells about any other name
+// that is not a local
+std::unordered_set<const AstFuncDecl*> pure_functions(const std::vector<const AstFuncDecl*>& funcs,
+    const std::function<GlobalKind(const std::string&)>& global);
+
+// whether a const initialized with expr holds a value that can never change
+bool immutable_value(const AstExpr* expr);
+
+#endif
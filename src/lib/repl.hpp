@@ -0,0 +1,31 @@
+#ifndef REPL_HPP
+#define REPL_HPP
+
+#include "compiler.hpp"
+#include "interpreter.hpp"
+
+#include <string>
+
+// A program built up one input at a time. Each input is lexed, parsed and
+// compiled alone against what the ones before it left: globals keep their
+// slots and values, literals stay interned and a func declared again gets
+// its new code at the same index, so callers compiled earlier reach it.
+// Nothing entered before is compiled or run again.
+class Session {
+private:
+    Compiler compiler;
+    Interpreter interpreter;
+public:
+    Session(const InterpreterOptions& options = InterpreterOptions(), const NativeTable& natives = default_natives());
+
+    // Runs declarations or statements, a missing final ; is fine. Returns
+    // the value of a final expression, null for anything else. Errors leave
+    // the session as it was before the input, apart from what already ran.
+    Value evaluate(const std::string& input);
+};
+
+// reads inputs from stdin until it ends, an input goes on over several lines
+// while brackets are open in it
+int repl(const InterpreterOptions& options);
+
+#endif
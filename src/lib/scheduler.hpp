@@ -0,0 +1,116 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include "bytecode.hpp"
+#include "error.hpp"
+#include "stats.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class Interpreter;
+class InterpreterOptions;
+
+enum class TaskState {
+    OK,
+    ERROR,
+    EXIT,
+};
+
+// A call waiting to run on some thread. Everything in it is isolated, no
+// counted object is shared with the thread that spawned it.
+class Task {
+public:
+    Value callee;
+    std::vector<Value> args;
+    // a parallel_map chunk calls callee on each index in [begin, end)
+    bool map;
+    long begin;
+    long end;
+
+    std::atomic<bool> done;
+    TaskState state;
+    Value result;
+    std::string error;
+    // which one an ERROR went past, if it was a limit
+    Limit limit;
+    int exit_code;
+
+    Task() : map(false), begin(0), end(0), done(false), state(TaskState::OK), limit(Limit::NONE), exit_code(0) {}
+};
+
+// Runs tasks for one program on a fixed set of threads. Each worker owns a
+// deque, pushes and pops at its back and steals from the front of others.
+// Queue 0 belongs to the thread that created the scheduler, which runs
+// tasks itself while it waits in join.
+//
+// Tasks run on their own interpreters, one per queue, never on the one that
+// created the scheduler. They see every constant global as it was when the
+// first task was spawned, frozen so array_set, map_set and map_remove refuse
+// to change it, and may not touch var globals at all. Arguments and results
+// are copied across.
+class Scheduler {
+private:
+    class Queue {
+    public:
+        std::mutex lock;
+        std::deque<std::shared_ptr<Task>> tasks;
+    };
+
+    const Program& program;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::unique_ptr<Interpreter>> interpreters;
+    std::vector<std::thread> threads;
+
+    std::mutex idle_lock;
+    std::condition_variable wake;
+    std::atomic<size_t> queued;
+    bool stopping;
+
+    std::mutex handles_lock;
+    std::unordered_map<long, std::shared_ptr<Task>> handles;
+    long next_handle;
+
+    // queue of the calling thread, 0 unless it is one of the workers
+    size_t own_queue() const;
+
+    void push(std::shared_ptr<Task> task);
+    std::shared_ptr<Task> take();
+
+    void run_task(Interpreter& interpreter, Task& task);
+
+    // runs other tasks on the interpreter of the calling thread's queue until
+    // task is done
+    void wait_for(Task& task);
+
+    // the result of a finished task, or its error thrown again
+    Value finish(Task& task);
+
+    void work(size_t index);
+public:
+    // globals are those of the creating interpreter, which must be initialized
+    Scheduler(const Program& program, const std::vector<Value>& globals, const InterpreterOptions& options);
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    long spawn(const Value& callee, const Value* args, size_t count);
+
+    Value join(long handle);
+
+    // callee(0) + callee(1) + ... + callee(count - 1), added in index order
+    Value parallel_map(const Value& callee, long count);
+
+    // adds what the task interpreters have run, best read while no task is
+    void add_stats(ExecutionStats& stats) const;
+};
+
+#endif
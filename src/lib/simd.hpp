@@ -0,0 +1,40 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <cstddef>
+
+// Bulk kernels over contiguous 64 bit ints and doubles. Int kernels wrap
+// around on overflow. Float sums add their terms in the same order in
+// every kernel set, so results are the same on any CPU.
+//
+// min and max need at least one element. scaled_add computes a + scale * b.
+class ArrayKernels {
+public:
+    const char* name;
+
+    void (*add_floats)(const double* a, const double* b, double* out, size_t size);
+    void (*sub_floats)(const double* a, const double* b, double* out, size_t size);
+    void (*mul_floats)(const double* a, const double* b, double* out, size_t size);
+    void (*div_floats)(const double* a, const double* b, double* out, size_t size);
+    double (*sum_floats)(const double* a, size_t size);
+    double (*min_floats)(const double* a, size_t size);
+    double (*max_floats)(const double* a, size_t size);
+    double (*dot_floats)(const double* a, const double* b, size_t size);
+    void (*scaled_add_floats)(const double* a, const double* b, double scale, double* out, size_t size);
+
+    void (*add_ints)(const long* a, const long* b, long* out, size_t size);
+    void (*sub_ints)(const long* a, const long* b, long* out, size_t size);
+    void (*mul_ints)(const long* a, const long* b, long* out, size_t size);
+    long (*sum_ints)(const long* a, size_t size);
+    long (*min_ints)(const long* a, size_t size);
+    long (*max_ints)(const long* a, size_t size);
+    long (*dot_ints)(const long* a, const long* b, size_t size);
+    void (*scaled_add_ints)(const long* a, const long* b, long scale, long* out, size_t size);
+};
+
+// The widest kernels the CPU supports, "avx2", "sse2" or "scalar", picked
+// on first use. BASK_SIMD set to one of those names in the environment
+// caps the choice, to compare them.
+const ArrayKernels& array_kernels();
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include "bytecode.hpp"
+#include "builtins.hpp"
+#include "compiler.hpp"
+
+#include <string>
+#include <vector>
+
+// Writes the compiled program with globals as they are after initialization.
+// Natives are stored by name and bound again when the image is loaded, the
+// image only suits the bask build that wrote it.
+void write_snapshot(const std::string& path, const Program& program, const std::vector<Value>& globals);
+
+// Maps an image written by write_snapshot. The program comes back already
+// initialized, running it goes straight to main.
+Program read_snapshot(const std::string& path, const NativeTable& natives = default_natives());
+
+// A module as compiled, for the module cache. Same format caveats as above.
+void write_module_image(const std::string& path, const CompiledModule& module);
+
+CompiledModule read_module_image(const std::string& path, const NativeTable& natives = default_natives());
+
+#endif
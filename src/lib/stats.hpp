@@ -0,0 +1,131 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include "ast.hpp"
+#include "bytecode.hpp"
+#include "output.hpp"
+#include "token.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// builds configured with -DBASK_STATS=OFF leave every counter out
+#ifndef BASK_STATS
+#define BASK_STATS 1
+#endif
+
+#if BASK_STATS
+#define BASK_COUNT(...) __VA_ARGS__
+#else
+#define BASK_COUNT(...)
+#endif
+
+const size_t TOKEN_TYPE_COUNT = static_cast<size_t>(TokenType::AT) + 1;
+const size_t AST_TYPE_COUNT = static_cast<size_t>(AstType::IMPORT) + 1;
+const size_t OP_CODE_COUNT = static_cast<size_t>(OpCode::ADD_LOCAL) + 1;
+
+// bytes allocated for runtime objects since the start, and through operator
+// new in the bask executable, which replaces it; always 0 without BASK_STATS
+size_t allocated_bytes();
+
+void count_allocation(size_t bytes);
+
+class PhaseStats {
+public:
+    std::string name;
+    double seconds;
+    size_t bytes;
+
+    PhaseStats(std::string name, double seconds, size_t bytes)
+    : name(std::move(name)), seconds(seconds), bytes(bytes) {}
+};
+
+// What one interpreter ran. Compiled code counts as a call but its
+// operations are not counted.
+class ExecutionStats {
+public:
+    size_t ops[OP_CODE_COUNT];
+    size_t calls;
+    size_t native_calls;
+    size_t peak_frames;
+    size_t peak_stack;
+    size_t jit_functions;
+    double jit_seconds;
+    // calls to pure funcs looked up in their caches
+    size_t memo_functions;
+    size_t memo_lookups;
+    size_t memo_hits;
+
+    ExecutionStats();
+
+    // totals of two interpreters that ran side by side
+    void add(const ExecutionStats& other);
+};
+
+class Stats {
+public:
+    std::vector<PhaseStats> phases;
+    // of the main file alone
+    size_t tokens[TOKEN_TYPE_COUNT];
+    size_t nodes[AST_TYPE_COUNT];
+    // modules of a program with imports, the main file among them
+    size_t modules_compiled;
+    size_t modules_cached;
+    // what --profile-in did with its profile
+    size_t profiled_functions;
+    size_t stale_profiles;
+    size_t inlined_calls;
+    size_t precompiled_functions;
+    ExecutionStats execution;
+
+    Stats();
+
+    void count_tokens(const std::vector<Token>& tokens);
+
+    void count_nodes(const AstProgram& ast);
+
+    // takes parts, run in pieces inside the last phase, out of it into
+    // phases of their own
+    void split_last(const std::vector<PhaseStats>& parts);
+
+    void print(Output& output) const;
+};
+
+// Adds a phase with the wall time and bytes allocated from construction to
+// stop(), or to destruction if stop() was never called.
+class PhaseTimer {
+private:
+    Stats* stats;
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+    size_t start_bytes;
+public:
+    // nullptr stats makes a timer that records nothing
+    PhaseTimer(Stats* stats, std::string name);
+    ~PhaseTimer();
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    void stop();
+};
+
+// Adds the wall time and bytes allocated from construction to destruction
+// to phase, for one that runs in many short pieces. nullptr phase records
+// nothing.
+class PhaseSpan {
+private:
+    PhaseStats* phase;
+    std::chrono::steady_clock::time_point start;
+    size_t start_bytes;
+public:
+    PhaseSpan(PhaseStats* phase);
+    ~PhaseSpan();
+
+    PhaseSpan(const PhaseSpan&) = delete;
+    PhaseSpan& operator=(const PhaseSpan&) = delete;
+};
+
+#endif
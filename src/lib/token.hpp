@@ -13,6 +13,12 @@ enum class TokenType {
     CONST,
     FUNC,
     RETURN,
+    ASYNC,
+    AWAIT,
+    IMPORT,
+    IF,
+    ELSE,
+    WHILE,
     // values
     _NULL,
     INT,
@@ -30,6 +36,17 @@ enum class TokenType {
     RPAREN,
     LCURLY,
     RCURLY,
+    COLON,
+    DOUBLE_EQUAL,
+    NOT_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    AND,
+    OR,
+    NOT,
+    AT,
 };
 
 const std::unordered_map<std::string, TokenType> Keywords = {
@@ -37,15 +54,23 @@ const std::unordered_map<std::string, TokenType> Keywords = {
     {"var", TokenType::VAR},
     {"const", TokenType::CONST},
     {"func", TokenType::FUNC},
-    {"return", TokenType::RETURN}
+    {"return", TokenType::RETURN},
+    {"async", TokenType::ASYNC},
+    {"await", TokenType::AWAIT},
+    {"import", TokenType::IMPORT},
+    {"if", TokenType::IF},
+    {"else", TokenType::ELSE},
+    {"while", TokenType::WHILE}
 };
 
 class Token {
 public:
     TokenType type;
     std::string value;
+    // source line the token starts on, counting from 1
+    int line;
 
-    Token(TokenType type, std::string value = "");
+    Token(TokenType type, std::string value = "", int line = 0);
 
     void print() const;
 };
@@ -1,10 +1,315 @@
 #ifndef VALUE_HPP
 #define VALUE_HPP
 
-enum class ValueTypes {
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+enum class ValueTypes : unsigned char {
+    _NULL,
     INT,
+    FLOAT,
+    STRING,
+    FUNC,
+    NATIVE_FUNC,
+    // an integer too big for int_value, see bigint.hpp
+    BIG_INT,
+    ARRAY,
+    MAP,
+};
+
+enum class ObjectTypes : unsigned char {
+    STRING,
+    BIG_INT,
+    ARRAY,
+    MAP,
+};
+
+class Object {
+public:
+    size_t refs;
+    ObjectTypes type;
+    // owned by the program (literals), never counted or freed at runtime
+    bool immortal;
+    // a task's copy of a constant global, builtins refuse to change it
+    bool frozen;
+};
+
+// Immutable string. A flat string keeps its characters right after the
+// header. A rope node joins left and right without copying them until
+// something needs contiguous characters, then it flattens into a single
+// flat string kept in left, with right set to nullptr.
+class StringObject : public Object {
+public:
+    size_t size;
+    StringObject* left;
+    StringObject* right;
+    // 0 until hash_value() needs it, set up front for literals
+    size_t hash;
+
+    bool is_flat() const {
+        return left == nullptr;
+    }
+
+    char* data() {
+        return reinterpret_cast<char*>(this + 1);
+    }
+};
+
+// Sign and magnitude in 32 bit limbs, least significant first, with no
+// leading zero limbs. Only integers that do not fit in a long are kept in
+// one, so a value is never both a big and a plain int.
+class BigIntObject : public Object {
+public:
+    bool negative;
+    size_t size;
+
+    uint32_t* limbs() {
+        return reinterpret_cast<uint32_t*>(this + 1);
+    }
+
+    const uint32_t* limbs() const {
+        return reinterpret_cast<const uint32_t*>(this + 1);
+    }
+};
+
+enum class ArrayKinds : unsigned char {
+    INT,
+    FLOAT,
+};
+
+// A fixed size array of 64 bit ints or doubles, kept right after the
+// header. Arrays are shared by reference and changed in place.
+class ArrayObject : public Object {
+public:
+    ArrayKinds kind;
+    size_t size;
+
+    long* ints() {
+        return reinterpret_cast<long*>(this + 1);
+    }
+
+    double* floats() {
+        return reinterpret_cast<double*>(this + 1);
+    }
+
+    const long* ints() const {
+        return reinterpret_cast<const long*>(this + 1);
+    }
+
+    const double* floats() const {
+        return reinterpret_cast<const double*>(this + 1);
+    }
+};
+
+void destroy_object(Object* object);
+
+inline void retain(Object* object) {
+    if (!object->immortal)
+        object->refs++;
+}
+
+inline void release(Object* object) {
+    if (!object->immortal && --object->refs == 0)
+        destroy_object(object);
+}
+
+class Native;
+class MapObject;
+
+// Strings of up to SMALL_STRING_SIZE bytes live inside the value itself,
+// from byte 3 up to the end of the payload.
+const size_t SMALL_STRING_SIZE = 13;
+const unsigned char NOT_SMALL = 0xFF;
+
+class Value {
+public:
+    ValueTypes type;
+    // the payload is a counted reference to object_value
+    bool counted;
+    unsigned char small_size;
+    char small_head[5];
+    union {
+        long int_value;
+        double float_value;
+        Object* object_value;
+        StringObject* string_value;
+        BigIntObject* big_value;
+        ArrayObject* array_value;
+        MapObject* map_value;
+        size_t func_value;
+        const Native* native_value;
+    };
+
+    Value() : type(ValueTypes::_NULL), counted(false), small_size(NOT_SMALL), int_value(0) {}
+
+    Value(const Value& other) {
+        copy_from(other);
+        if (counted)
+            object_value->refs++;
+    }
+
+    Value(Value&& other) noexcept {
+        copy_from(other);
+        other.counted = false;
+    }
+
+    Value& operator=(const Value& other) {
+        if (other.counted)
+            other.object_value->refs++;
+        if (counted)
+            release(object_value);
+        copy_from(other);
+        return *this;
+    }
+
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            if (counted)
+                release(object_value);
+            copy_from(other);
+            other.counted = false;
+        }
+        return *this;
+    }
+
+    ~Value() {
+        if (counted)
+            release(object_value);
+    }
+
+    bool is_small_string() const {
+        return small_size != NOT_SMALL;
+    }
+
+    const char* small_data() const {
+        return reinterpret_cast<const char*>(this) + 3;
+    }
+
+    static Value integer(long value) {
+        Value result;
+        result.type = ValueTypes::INT;
+        result.int_value = value;
+        return result;
+    }
+
+    static Value floating(double value) {
+        Value result;
+        result.type = ValueTypes::FLOAT;
+        result.float_value = value;
+        return result;
+    }
+
+    // copies the characters, inline when they fit
+    static Value string(const char* data, size_t size);
+
+    // takes over a reference to object
+    static Value string(StringObject* object) {
+        Value result;
+        result.type = ValueTypes::STRING;
+        result.counted = !object->immortal;
+        result.string_value = object;
+        return result;
+    }
+
+    // takes over a reference to object
+    static Value big(BigIntObject* object) {
+        Value result;
+        result.type = ValueTypes::BIG_INT;
+        result.counted = !object->immortal;
+        result.big_value = object;
+        return result;
+    }
+
+    // takes over a reference to object
+    static Value array(ArrayObject* object) {
+        Value result;
+        result.type = ValueTypes::ARRAY;
+        result.counted = true;
+        result.array_value = object;
+        return result;
+    }
+
+    // takes over a reference to object
+    static Value map(MapObject* object) {
+        Value result;
+        result.type = ValueTypes::MAP;
+        result.counted = true;
+        result.map_value = object;
+        return result;
+    }
+
+    static Value function(size_t index) {
+        Value result;
+        result.type = ValueTypes::FUNC;
+        result.func_value = index;
+        return result;
+    }
+
+    static Value native(const Native* native) {
+        Value result;
+        result.type = ValueTypes::NATIVE_FUNC;
+        result.native_value = native;
+        return result;
+    }
+private:
+    void copy_from(const Value& other) {
+        std::memcpy(static_cast<void*>(this), &other, sizeof(Value));
+    }
+};
+
+static_assert(sizeof(Value) == 16, "values are two words");
+
+class MapEntry {
+public:
+    Value key;
+    Value value;
+};
+
+// Open addressing laid out as a Swiss table: a control byte per slot holds
+// the low 7 bits of the hash of a full slot or marks it EMPTY or DELETED,
+// and lookups compare 16 control bytes at once. See map.cpp.
+class MapObject : public Object {
+public:
+    size_t size;
+    size_t tombstones;
+    // a power of two, at least 16 once anything was stored
+    size_t capacity;
+    signed char* control;
+    MapEntry* entries;
 };
 
+// null, the int 0 and the float 0.0 are false, every other value is true
+inline bool is_true(const Value& value) {
+    switch (value.type) {
+        case ValueTypes::_NULL:
+            return false;
+        case ValueTypes::INT:
+            return value.int_value != 0;
+        case ValueTypes::FLOAT:
+            return value.float_value != 0;
+        default:
+            return true;
+    }
+}
+
+StringObject* new_string_object(const char* data, size_t size);
+
+size_t string_size(const Value& value);
+
+// contiguous characters of a string value, flattening a rope if needed
+const char* string_data(const Value& value);
+
+Value concat(const Value& left, const Value& right);
+
+// a copy sharing no counted object with value, safe to hand to another thread
+Value isolate(const Value& value);
+
+// marks value and every container inside it frozen
+void freeze(const Value& value);
+
+class Output;
 
+void write_string(Output& out, const Value& value);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,95 @@
+#include "lib/limits.hpp"
+
+#include <algorithm>
+#include <string>
+
+static thread_local Budget* current_budget = nullptr;
+
+Budget::Budget(const ExecutionLimits& limits)
+: limits(limits), slice(0), spent(0), heap(0), exceeded(Limit::NONE), left(0) {
+    start();
+}
+
+void Budget::start() {
+    spent = 0;
+    heap = 0;
+    exceeded = Limit::NONE;
+    if (limits.seconds != 0)
+        deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(limits.seconds));
+    hand_out();
+}
+
+void Budget::hand_out() {
+    // without limits a slice never runs out
+    slice = limits.seconds != 0 ? LIMIT_SLICE : LONG_MAX / 2;
+    if (limits.fuel != 0)
+        slice = std::min(slice, static_cast<long>(std::min<size_t>(limits.fuel - spent, LONG_MAX / 2)));
+    left = slice;
+}
+
+bool Budget::refill() {
+    // left is at or below 0 by what the last checkpoint overdrew
+    spent += static_cast<size_t>(slice - left);
+    slice = 0;
+    left = 0;
+
+    if (exceeded != Limit::NONE)
+        return false;
+    if (limits.fuel != 0 && spent > limits.fuel) {
+        exceeded = Limit::FUEL;
+        return false;
+    }
+    if (limits.seconds != 0 && std::chrono::steady_clock::now() >= deadline) {
+        exceeded = Limit::TIME;
+        return false;
+    }
+    hand_out();
+    return true;
+}
+
+void Budget::fail() const {
+    switch (exceeded) {
+        case Limit::FUEL:
+            fail_limit(Limit::FUEL, "OUT_OF_FUEL", "fuel = " + std::to_string(limits.fuel));
+        case Limit::HEAP:
+            fail_limit(Limit::HEAP, "HEAP_LIMIT", "bytes = " + std::to_string(limits.heap_bytes));
+        default:
+            fail_limit(Limit::TIME, "TIME_LIMIT", "seconds = " + std::to_string(limits.seconds));
+    }
+}
+
+void Budget::allocated(size_t bytes) {
+    heap += static_cast<long>(bytes);
+    if (limits.heap_bytes != 0 && heap > static_cast<long>(limits.heap_bytes) && exceeded == Limit::NONE) {
+        exceeded = Limit::HEAP;
+        // counted as spent by the refill that reports it
+        left = 0;
+    }
+}
+
+void Budget::require(size_t bytes) const {
+    if (limits.heap_bytes != 0 && (bytes > limits.heap_bytes || heap > static_cast<long>(limits.heap_bytes - bytes)))
+        fail_limit(Limit::HEAP, "HEAP_LIMIT", "bytes = " + std::to_string(limits.heap_bytes));
+}
+
+Budget* swap_budget(Budget* budget) {
+    Budget* outer = current_budget;
+    current_budget = budget;
+    return outer;
+}
+
+void heap_allocated(size_t bytes) {
+    if (current_budget != nullptr)
+        current_budget->allocated(bytes);
+}
+
+void heap_freed(size_t bytes) {
+    if (current_budget != nullptr)
+        current_budget->freed(bytes);
+}
+
+void heap_require(size_t bytes) {
+    if (current_budget != nullptr)
+        current_budget->require(bytes);
+}
@@ -0,0 +1,629 @@
+#include "lib/loops.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+// calls visit on each expression code holds outside of expressions, nested
+// blocks included
+template <typename Visit>
+static void visit_expressions(const std::vector<std::unique_ptr<AstStatement>>& code, Visit visit) {
+    for (const auto& statement : code) {
+        switch (statement->get_type()) {
+            case AstType::CONST_DECL:
+                visit(static_cast<const AstConstDecl*>(statement.get())->value.get());
+                break;
+            case AstType::VAR_DECL:
+                visit(static_cast<const AstVarDecl*>(statement.get())->value.get());
+                break;
+            case AstType::VAR_SET:
+                visit(static_cast<const AstVarSet*>(statement.get())->value.get());
+                break;
+            case AstType::RETURN:
+                visit(static_cast<const AstReturn*>(statement.get())->value.get());
+                break;
+            case AstType::NO_RETURN_EXPR:
+                visit(static_cast<const AstNoReturnExpr*>(statement.get())->expr.get());
+                break;
+            case AstType::IF: {
+                const AstIf* branch = static_cast<const AstIf*>(statement.get());
+                visit(branch->condition.get());
+                visit_expressions(branch->code, visit);
+                visit_expressions(branch->else_code, visit);
+                break;
+            }
+            case AstType::WHILE: {
+                const AstWhile* loop = static_cast<const AstWhile*>(statement.get());
+                visit(loop->condition.get());
+                visit_expressions(loop->code, visit);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+static bool is_leaf(const AstExpr* expr) {
+    switch (expr->get_type()) {
+        case AstType::_NULL:
+        case AstType::INT:
+        case AstType::FLOAT:
+        case AstType::STRING:
+        case AstType::NAME:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool is_int_literal(const AstExpr* expr) {
+    return expr->get_type() == AstType::INT && static_cast<const AstInt*>(expr)->digits.empty();
+}
+
+// INTEGER LOCALS
+
+class Assignments {
+public:
+    std::unordered_set<std::string> declared;
+    // every value each name is given
+    std::unordered_map<std::string, std::vector<const AstExpr*>> values;
+    // the names read in those values that refer to locals, not globals
+    std::unordered_set<const AstExpr*> local_reads;
+};
+
+static void find_local_reads(const AstExpr* expr, const std::unordered_set<std::string>& scope, Assignments& found) {
+    if (expr->get_type() == AstType::NAME && scope.count(static_cast<const AstName*>(expr)->value) != 0)
+        found.local_reads.insert(expr);
+    visit_operands(expr, [&](const AstExpr* operand) { find_local_reads(operand, scope, found); });
+}
+
+// scope holds the locals at the start of code, a block keeps its own
+static void collect(const std::vector<std::unique_ptr<AstStatement>>& code, std::unordered_set<std::string> scope,
+        Assignments& found) {
+    auto assign = [&](const std::string& name, const AstExpr* value) {
+        find_local_reads(value, scope, found);
+        found.values[name].push_back(value);
+    };
+
+    for (const auto& statement : code) {
+        switch (statement->get_type()) {
+            case AstType::CONST_DECL: {
+                const AstConstDecl* ptr = static_cast<const AstConstDecl*>(statement.get());
+                assign(ptr->name, ptr->value.get());
+                scope.insert(ptr->name);
+                found.declared.insert(ptr->name);
+                break;
+            }
+            case AstType::VAR_DECL: {
+                const AstVarDecl* ptr = static_cast<const AstVarDecl*>(statement.get());
+                assign(ptr->name, ptr->value.get());
+                scope.insert(ptr->name);
+                found.declared.insert(ptr->name);
+                break;
+            }
+            case AstType::VAR_SET: {
+                const AstVarSet* ptr = static_cast<const AstVarSet*>(statement.get());
+                assign(ptr->name, ptr->value.get());
+                break;
+            }
+            case AstType::IF: {
+                const AstIf* branch = static_cast<const AstIf*>(statement.get());
+                collect(branch->code, scope, found);
+                collect(branch->else_code, scope, found);
+                break;
+            }
+            case AstType::WHILE:
+                collect(static_cast<const AstWhile*>(statement.get())->code, scope, found);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// an integer whenever it gives a value, given the integer locals
+static bool gives_integer(const AstExpr* expr, const std::unordered_set<std::string>& integers,
+        const std::unordered_set<const AstExpr*>& local_reads) {
+    switch (expr->get_type()) {
+        case AstType::INT:
+        case AstType::COMPARISON:
+        case AstType::LOGICAL_OP:
+            return true;
+        case AstType::NAME:
+            return local_reads.count(expr) != 0 && integers.count(static_cast<const AstName*>(expr)->value) != 0;
+        case AstType::UNARY_OP: {
+            const AstUnaryOp* op = static_cast<const AstUnaryOp*>(expr);
+            return op->type == UnaryOpType::NOT
+                || (op->type != UnaryOpType::AWAIT && gives_integer(op->value.get(), integers, local_reads));
+        }
+        case AstType::BINARY_OP: {
+            const AstBinaryOp* op = static_cast<const AstBinaryOp*>(expr);
+            return gives_integer(op->left.get(), integers, local_reads)
+                && gives_integer(op->right.get(), integers, local_reads);
+        }
+        default:
+            return false;
+    }
+}
+
+std::unordered_set<std::string> integer_locals(const std::vector<std::unique_ptr<AstStatement>>& code,
+        const std::vector<std::string>& arguments) {
+    Assignments found;
+    collect(code, std::unordered_set<std::string>(arguments.begin(), arguments.end()), found);
+
+    // a name given anything but integers drops out, which can drop names
+    // given values computed from it
+    std::unordered_set<std::string> integers = found.declared;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto name = integers.begin(); name != integers.end();) {
+            bool integer = true;
+            for (const AstExpr* value : found.values[*name])
+                integer = integer && gives_integer(value, integers, found.local_reads);
+            if (integer) {
+                name++;
+            } else {
+                name = integers.erase(name);
+                changed = true;
+            }
+        }
+    }
+
+    return integers;
+}
+
+// LOOP PLANS
+
+class LoopPlanner {
+private:
+    const AstWhile& loop;
+    const std::function<NameKind(const std::string&)>& resolve;
+    const std::unordered_set<std::string>& integers;
+    const std::unordered_map<const AstExpr*, size_t>& computed;
+    LoopPassStats* stats;
+    // names declared or assigned anywhere in the loop, and how often
+    std::unordered_map<std::string, size_t> assigned;
+    // calls and awaits, which can change var globals
+    bool effects;
+    std::unordered_map<std::string, size_t> hoisted_keys;
+    std::unordered_map<std::string, size_t> product_keys;
+    std::unordered_set<const AstExpr*> hoisted;
+    // induction variables, each with a reduction still lacking the factor
+    std::unordered_map<std::string, Reduction> inductions;
+
+    void scan_expr(const AstExpr* expr);
+
+    void scan(const std::vector<std::unique_ptr<AstStatement>>& code);
+
+    bool invariant(const AstExpr* expr) const;
+
+    bool integer(const AstExpr* expr) const;
+
+    bool number(const AstExpr* expr) const;
+
+    // evaluating it cannot fail
+    bool safe(const AstExpr* expr) const;
+
+    // the same for equal expressions
+    std::string key(const AstExpr* expr) const;
+
+    // walking the condition rather than the body
+    bool proven;
+
+    // Evaluated tells whether expr is sure to be evaluated without failing
+    // when the preheader runs: in the condition because it just was, in the
+    // body because nothing before it in the first iteration could fail or be
+    // seen. Returns the same for what comes after expr.
+    bool hoist(const AstExpr* expr, bool evaluated);
+
+    void hoist_body(const std::vector<std::unique_ptr<AstStatement>>& code);
+
+    void find_inductions();
+
+    void find_products(const AstExpr* expr);
+public:
+    LoopPlan plan;
+
+    LoopPlanner(const AstWhile& loop, const std::function<NameKind(const std::string&)>& resolve,
+        const std::unordered_set<std::string>& integers, const std::unordered_map<const AstExpr*, size_t>& computed,
+        LoopPassStats* stats)
+    : loop(loop), resolve(resolve), integers(integers), computed(computed), stats(stats), effects(false),
+      proven(false) {}
+
+    void run();
+};
+
+void LoopPlanner::scan_expr(const AstExpr* expr) {
+    if (expr->get_type() == AstType::FUNC_CALL
+        || (expr->get_type() == AstType::UNARY_OP
+            && static_cast<const AstUnaryOp*>(expr)->type == UnaryOpType::AWAIT))
+        effects = true;
+    visit_operands(expr, [this](const AstExpr* operand) { scan_expr(operand); });
+}
+
+void LoopPlanner::scan(const std::vector<std::unique_ptr<AstStatement>>& code) {
+    for (const auto& statement : code) {
+        switch (statement->get_type()) {
+            case AstType::CONST_DECL:
+                assigned[static_cast<const AstConstDecl*>(statement.get())->name]++;
+                break;
+            case AstType::VAR_DECL:
+                assigned[static_cast<const AstVarDecl*>(statement.get())->name]++;
+                break;
+            case AstType::VAR_SET:
+                assigned[static_cast<const AstVarSet*>(statement.get())->name]++;
+                break;
+            case AstType::IF: {
+                const AstIf* branch = static_cast<const AstIf*>(statement.get());
+                scan(branch->code);
+                scan(branch->else_code);
+                break;
+            }
+            case AstType::WHILE:
+                scan(static_cast<const AstWhile*>(statement.get())->code);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+bool LoopPlanner::invariant(const AstExpr* expr) const {
+    if (computed.count(expr) != 0)
+        return true;
+
+    switch (expr->get_type()) {
+        case AstType::_NULL:
+        case AstType::INT:
+        case AstType::FLOAT:
+        case AstType::STRING:
+            return true;
+        case AstType::NAME: {
+            const std::string& name = static_cast<const AstName*>(expr)->value;
+            if (assigned.count(name) != 0)
+                return false;
+            switch (resolve(name)) {
+                case NameKind::LOCAL:
+                case NameKind::CONST_GLOBAL:
+                    return true;
+                case NameKind::VAR_GLOBAL:
+                    return !effects;
+                default:
+                    return false;
+            }
+        }
+        case AstType::UNARY_OP: {
+            const AstUnaryOp* op = static_cast<const AstUnaryOp*>(expr);
+            return op->type != UnaryOpType::AWAIT && invariant(op->value.get());
+        }
+        case AstType::BINARY_OP:
+        case AstType::COMPARISON:
+        case AstType::LOGICAL_OP: {
+            bool result = true;
+            visit_operands(expr, [&](const AstExpr* operand) { result = result && invariant(operand); });
+            return result;
+        }
+        default:
+            // calls do anything and every map is a new one
+            return false;
+    }
+}
+
+bool LoopPlanner::integer(const AstExpr* expr) const {
+    switch (expr->get_type()) {
+        case AstType::INT:
+        case AstType::COMPARISON:
+        case AstType::LOGICAL_OP:
+            return true;
+        case AstType::NAME: {
+            const std::string& name = static_cast<const AstName*>(expr)->value;
+            return resolve(name) == NameKind::LOCAL && integers.count(name) != 0;
+        }
+        case AstType::UNARY_OP: {
+            const AstUnaryOp* op = static_cast<const AstUnaryOp*>(expr);
+            return op->type == UnaryOpType::NOT || (op->type != UnaryOpType::AWAIT && integer(op->value.get()));
+        }
+        case AstType::BINARY_OP: {
+            const AstBinaryOp* op = static_cast<const AstBinaryOp*>(expr);
+            return integer(op->left.get()) && integer(op->right.get());
+        }
+        default:
+            return false;
+    }
+}
+
+bool LoopPlanner::number(const AstExpr* expr) const {
+    switch (expr->get_type()) {
+        case AstType::FLOAT:
+            return true;
+        case AstType::UNARY_OP: {
+            const AstUnaryOp* op = static_cast<const AstUnaryOp*>(expr);
+            return integer(expr) || (op->type != UnaryOpType::AWAIT && number(op->value.get()));
+        }
+        case AstType::BINARY_OP: {
+            const AstBinaryOp* op = static_cast<const AstBinaryOp*>(expr);
+            return number(op->left.get()) && number(op->right.get());
+        }
+        default:
+            return integer(expr);
+    }
+}
+
+bool LoopPlanner::safe(const AstExpr* expr) const {
+    switch (expr->get_type()) {
+        case AstType::_NULL:
+        case AstType::INT:
+        case AstType::FLOAT:
+        case AstType::STRING:
+        case AstType::NAME:
+            return true;
+        case AstType::UNARY_OP: {
+            const AstUnaryOp* op = static_cast<const AstUnaryOp*>(expr);
+            if (op->type == UnaryOpType::NOT)
+                return safe(op->value.get());
+            return op->type != UnaryOpType::AWAIT && number(op->value.get()) && safe(op->value.get());
+        }
+        case AstType::BINARY_OP: {
+            // numbers only fail an int division by zero
+            const AstBinaryOp* op = static_cast<const AstBinaryOp*>(expr);
+            const AstExpr* right = op->right.get();
+            bool divisor = op->type != BinaryOpType::DIV || right->get_type() == AstType::FLOAT
+                || (right->get_type() == AstType::INT
+                    && (static_cast<const AstInt*>(right)->value != 0 || !static_cast<const AstInt*>(right)->digits.empty()));
+            return divisor && number(op->left.get()) && number(right) && safe(op->left.get()) && safe(right);
+        }
+        case AstType::COMPARISON: {
+            // only orderings of what has no order fail
+            const AstComparison* comparison = static_cast<const AstComparison*>(expr);
+            bool ordered = comparison->type != ComparisonType::EQUAL && comparison->type != ComparisonType::NOT_EQUAL;
+            return (!ordered || (number(comparison->left.get()) && number(comparison->right.get())))
+                && safe(comparison->left.get()) && safe(comparison->right.get());
+        }
+        case AstType::LOGICAL_OP: {
+            const AstLogicalOp* op = static_cast<const AstLogicalOp*>(expr);
+            return safe(op->left.get()) && safe(op->right.get());
+        }
+        default:
+            return false;
+    }
+}
+
+std::string LoopPlanner::key(const AstExpr* expr) const {
+    auto local = computed.find(expr);
+    if (local != computed.end())
+        return "#" + std::to_string(local->second);
+
+    std::string result;
+    switch (expr->get_type()) {
+        case AstType::_NULL:
+            return "null";
+        case AstType::INT: {
+            const AstInt* literal = static_cast<const AstInt*>(expr);
+            return "int " + (literal->digits.empty() ? std::to_string(literal->value) : literal->digits);
+        }
+        case AstType::FLOAT: {
+            // the bits, printing rounds
+            double value = static_cast<const AstFloat*>(expr)->value;
+            unsigned long bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return "float " + std::to_string(bits);
+        }
+        case AstType::STRING: {
+            const std::string& value = static_cast<const AstString*>(expr)->value;
+            return "string " + std::to_string(value.size()) + " " + value;
+        }
+        case AstType::NAME:
+            return "name " + static_cast<const AstName*>(expr)->value;
+        case AstType::UNARY_OP:
+            result = "unary " + std::to_string(static_cast<int>(static_cast<const AstUnaryOp*>(expr)->type));
+            break;
+        case AstType::BINARY_OP:
+            result = "binary " + std::to_string(static_cast<int>(static_cast<const AstBinaryOp*>(expr)->type));
+            break;
+        case AstType::COMPARISON:
+            result = "comparison " + std::to_string(static_cast<int>(static_cast<const AstComparison*>(expr)->type));
+            break;
+        case AstType::LOGICAL_OP:
+            result = "logical " + std::to_string(static_cast<int>(static_cast<const AstLogicalOp*>(expr)->type));
+            break;
+        default:
+            // never equal to anything, these are not hoisted
+            return "node " + std::to_string(reinterpret_cast<uintptr_t>(expr));
+    }
+
+    result += " (";
+    visit_operands(expr, [&](const AstExpr* operand) { result += key(operand) + ", "; });
+    return result + ")";
+}
+
+bool LoopPlanner::hoist(const AstExpr* expr, bool evaluated) {
+    if (computed.count(expr) != 0)
+        return evaluated;
+
+    if (!is_leaf(expr) && invariant(expr) && (evaluated || safe(expr))) {
+        std::string found = key(expr);
+        auto group = hoisted_keys.find(found);
+        if (group == hoisted_keys.end()) {
+            hoisted_keys[found] = plan.hoisted.size();
+            plan.hoisted.push_back({expr});
+        } else {
+            plan.hoisted[group->second].push_back(expr);
+        }
+        hoisted.insert(expr);
+        // the preheader keeps the order, so it fails where the loop would
+        return evaluated;
+    }
+
+    if (expr->get_type() == AstType::LOGICAL_OP) {
+        // the right side only sometimes runs
+        const AstLogicalOp* op = static_cast<const AstLogicalOp*>(expr);
+        evaluated = hoist(op->left.get(), evaluated);
+        hoist(op->right.get(), false);
+        return evaluated && (proven || safe(op->right.get()));
+    }
+    visit_operands(expr, [&](const AstExpr* operand) { evaluated = hoist(operand, evaluated); });
+    return evaluated && (proven || safe(expr));
+}
+
+void LoopPlanner::hoist_body(const std::vector<std::unique_ptr<AstStatement>>& code) {
+    auto nested = [this](const AstExpr* expr) { hoist(expr, false); };
+    bool evaluated = true;
+    for (const auto& statement : code) {
+        switch (statement->get_type()) {
+            case AstType::CONST_DECL:
+                evaluated = hoist(static_cast<const AstConstDecl*>(statement.get())->value.get(), evaluated);
+                break;
+            case AstType::VAR_DECL:
+                evaluated = hoist(static_cast<const AstVarDecl*>(statement.get())->value.get(), evaluated);
+                break;
+            case AstType::VAR_SET: {
+                const AstVarSet* set = static_cast<const AstVarSet*>(statement.get());
+                evaluated = hoist(set->value.get(), evaluated) && resolve(set->name) == NameKind::LOCAL;
+                break;
+            }
+            case AstType::NO_RETURN_EXPR:
+                evaluated = hoist(static_cast<const AstNoReturnExpr*>(statement.get())->expr.get(), evaluated);
+                break;
+            case AstType::IF: {
+                const AstIf* branch = static_cast<const AstIf*>(statement.get());
+                hoist(branch->condition.get(), evaluated);
+                visit_expressions(branch->code, nested);
+                visit_expressions(branch->else_code, nested);
+                evaluated = false;
+                break;
+            }
+            case AstType::WHILE: {
+                const AstWhile* inner = static_cast<const AstWhile*>(statement.get());
+                hoist(inner->condition.get(), evaluated);
+                visit_expressions(inner->code, nested);
+                evaluated = false;
+                break;
+            }
+            case AstType::RETURN:
+                hoist(static_cast<const AstReturn*>(statement.get())->value.get(), evaluated);
+                evaluated = false;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void LoopPlanner::find_inductions() {
+    for (const auto& statement : loop.code) {
+        if (statement->get_type() != AstType::VAR_SET)
+            continue;
+
+        const AstVarSet* set = static_cast<const AstVarSet*>(statement.get());
+        if (assigned[set->name] != 1 || resolve(set->name) != NameKind::LOCAL || integers.count(set->name) == 0
+            || set->value->get_type() != AstType::BINARY_OP)
+            continue;
+
+        const AstBinaryOp* op = static_cast<const AstBinaryOp*>(set->value.get());
+        auto is_variable = [set](const AstExpr* expr) {
+            return expr->get_type() == AstType::NAME && static_cast<const AstName*>(expr)->value == set->name;
+        };
+
+        const AstExpr* step = nullptr;
+        if (op->type == BinaryOpType::ADD && is_variable(op->left.get()))
+            step = op->right.get();
+        else if (op->type == BinaryOpType::ADD && is_variable(op->right.get()))
+            step = op->left.get();
+        else if (op->type == BinaryOpType::SUB && is_variable(op->left.get()))
+            step = op->right.get();
+
+        if (step == nullptr || !invariant(step) || !integer(step) || !safe(step))
+            continue;
+
+        Reduction& reduction = inductions[set->name];
+        reduction.variable = set->name;
+        reduction.factor = nullptr;
+        reduction.step = step;
+        reduction.subtract = op->type == BinaryOpType::SUB;
+        reduction.update = set;
+        reduction.folded = false;
+        reduction.folded_step = 0;
+    }
+}
+
+void LoopPlanner::find_products(const AstExpr* expr) {
+    if (computed.count(expr) != 0 || hoisted.count(expr) != 0)
+        return;
+
+    if (expr->get_type() == AstType::BINARY_OP && static_cast<const AstBinaryOp*>(expr)->type == BinaryOpType::MULT) {
+        const AstBinaryOp* op = static_cast<const AstBinaryOp*>(expr);
+        auto find = [this](const AstExpr* variable) {
+            return variable->get_type() == AstType::NAME
+                ? inductions.find(static_cast<const AstName*>(variable)->value) : inductions.end();
+        };
+
+        auto induction = find(op->left.get());
+        const AstExpr* factor = op->right.get();
+        if (induction == inductions.end()) {
+            induction = find(op->right.get());
+            factor = op->left.get();
+        }
+        if (induction != inductions.end() && invariant(factor) && integer(factor) && safe(factor)) {
+            std::string found = induction->first + " * " + key(factor);
+            auto group = product_keys.find(found);
+            if (group == product_keys.end()) {
+                product_keys[found] = plan.reductions.size();
+                plan.reductions.push_back(induction->second);
+                plan.reductions.back().factor = factor;
+                plan.reductions.back().uses.push_back(expr);
+            } else {
+                plan.reductions[group->second].uses.push_back(expr);
+            }
+            return;
+        }
+    }
+
+    visit_operands(expr, [this](const AstExpr* operand) { find_products(operand); });
+}
+
+void LoopPlanner::run() {
+    {
+        PhaseSpan licm(stats != nullptr ? &stats->licm : nullptr);
+        scan(loop.code);
+        scan_expr(loop.condition.get());
+        visit_expressions(loop.code, [this](const AstExpr* expr) { scan_expr(expr); });
+
+        proven = true;
+        hoist(loop.condition.get(), true);
+        proven = false;
+        hoist_body(loop.code);
+    }
+
+    PhaseSpan strength(stats != nullptr ? &stats->strength : nullptr);
+    find_inductions();
+    if (inductions.empty())
+        return;
+    find_products(loop.condition.get());
+    visit_expressions(loop.code, [this](const AstExpr* expr) { find_products(expr); });
+
+    // stepping the product costs about what one multiplication does, unless
+    // the step is a constant it can be added as
+    std::vector<Reduction> reductions;
+    for (Reduction& reduction : plan.reductions) {
+        long step = 0;
+        if (is_int_literal(reduction.step) && is_int_literal(reduction.factor)
+            && !__builtin_mul_overflow(static_cast<const AstInt*>(reduction.step)->value,
+                static_cast<const AstInt*>(reduction.factor)->value, &step)
+            && (!reduction.subtract || !__builtin_sub_overflow(0L, step, &step))) {
+            reduction.folded = true;
+            reduction.folded_step = step;
+        }
+        if (reduction.folded || reduction.uses.size() > 1)
+            reductions.push_back(std::move(reduction));
+    }
+    plan.reductions = std::move(reductions);
+}
+
+LoopPlan plan_loop(const AstWhile& loop, const std::function<NameKind(const std::string&)>& resolve,
+        const std::unordered_set<std::string>& integers, const std::unordered_map<const AstExpr*, size_t>& computed,
+        LoopPassStats* stats) {
+    LoopPlanner planner(loop, resolve, integers, computed, stats);
+    planner.run();
+    return std::move(planner.plan);
+}
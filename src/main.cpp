@@ -1,15 +1,37 @@
 #include "lib/lexer.hpp"
 #include "lib/ast.hpp"
-//#include "lib/parser.hpp"
-//#include "lib/interpreter.hpp"
+#include "lib/parser.hpp"
+#include "lib/compiler.hpp"
+#include "lib/loops.hpp"
+#include "lib/module.hpp"
+#include "lib/repl.hpp"
+#include "lib/interpreter.hpp"
+#include "lib/c_backend.hpp"
+#include "lib/feedback.hpp"
+#include "lib/snapshot.hpp"
+#include "lib/output.hpp"
+#include "lib/profiler.hpp"
+#include "lib/stats.hpp"
+#include "lib/error.hpp"
 
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
 
-std::string read_file(char* path) {
+std::string read_file(const char* path) {
     std::ifstream file(path);
 
+    if (!file.is_open())
+        fail("MAIN", "CANNOT_OPEN_FILE", std::string("path = '") + path + "'");
+
     std::stringstream buf;
 
     buf << file.rdbuf();
@@ -19,25 +41,339 @@ std::string read_file(char* path) {
     return buf.str();
 }
 
-int main(int argc, char* argv[]) {
-    /*
-    if (argc < 2)
+// runs a command and returns its combined output followed by its exit status
+std::string run_command(const std::string& command) {
+    FILE* pipe = popen((command + " 2>&1").c_str(), "r");
+
+    if (pipe == nullptr)
+        fail("MAIN", "CANNOT_RUN");
+
+    std::string output;
+    char buf[4096];
+    size_t size;
+    while ((size = fread(buf, 1, sizeof(buf), pipe)) > 0)
+        output.append(buf, size);
+
+    int status = pclose(pipe);
+
+    return output + "\nstatus = " + std::to_string(WIFEXITED(status) ? WEXITSTATUS(status) : -1) + "\n";
+}
+
+// runs every program through the interpreter without caching and through the
+// jit with every function compiled and every pure one cached on its first
+// call, and reports where they disagree
+int compare_engines(const std::vector<const char*>& paths) {
+    char self[4096];
+    ssize_t size = readlink("/proc/self/exe", self, sizeof(self) - 1);
+
+    if (size < 0) {
+        std::cerr << "ERROR::MAIN::CANNOT_FIND_SELF\n";
+        return 1;
+    }
+    self[size] = '\0';
+
+    int failures = 0;
+
+    for (const char* path : paths) {
+        std::string command = std::string("'") + self + "' ";
+        std::string interpreted = run_command(command + "--no-jit --memo-threshold=0 '" + path + "'");
+        std::string compiled = run_command(command + "--jit --jit-threshold=1 --memo-threshold=1 '" + path + "'");
+
+        if (interpreted == compiled) {
+            out() << "OK " << path << "\n";
+        } else {
+            failures++;
+            out() << "MISMATCH " << path << "\n";
+            out() << "--- interpreter\n" << interpreted << "--- jit\n" << compiled;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
+
+// translates the program to C and builds it against the runtime with cc
+int build_native(const AstProgram& ast, const std::string& output) {
+    const char* runtime = std::getenv("BASK_RUNTIME_DIR");
+    if (runtime == nullptr)
+        runtime = BASK_RUNTIME_DIR;
+
+    // nothing is written when the program uses what the runtime lacks
+    std::ostringstream c;
+    emit_c(ast, c);
+
+    std::string c_path = output + ".c";
+    std::ofstream file(c_path);
+    file << c.str();
+    file.close();
+
+    std::string command = std::string("cc -O2 -I'") + runtime + "' '" + c_path + "' '"
+        + runtime + "/bask_runtime.c' '" + runtime + "/bask_format.c' -o '" + output + "'";
+
+    return std::system(command.c_str()) == 0 ? 0 : 1;
+}
+
+// runs the program, sampling it into the folded stacks at profile_output
+// and recording what it does into the profile at feedback_output unless
+// those are empty, and timing it into stats unless that is nullptr, all
+// reported even when the program fails
+int run_program(const Program& program, const InterpreterOptions& options, const std::string& profile_output,
+        const std::string& feedback_output, Stats* stats) {
+    std::unique_ptr<Profiler> profiler;
+    if (!profile_output.empty())
+        profiler.reset(new Profiler());
+
+    Interpreter interpreter(program, options);
+    std::unique_ptr<ProfileRecorder> recorder;
+    if (!feedback_output.empty()) {
+        recorder.reset(new ProfileRecorder(program));
+        interpreter.record(recorder.get());
+    }
+
+    auto report = [&]() {
+        if (profiler)
+            profiler->finish(profile_output);
+        if (recorder)
+            recorder->profile().write(feedback_output);
+        if (stats != nullptr) {
+            stats->execution = interpreter.execution_stats();
+            out().flush();
+            Output err(2);
+            stats->print(err);
+        }
+    };
+
+    int code;
+    try {
+        PhaseTimer init(stats, "init");
+        interpreter.initialize();
+        init.stop();
+
+        PhaseTimer running(stats, "run");
+        code = interpreter.run();
+        running.stop();
+    } catch (...) {
+        report();
+        throw;
+    }
+    report();
+
+    return code;
+}
+
+// the N of a --name=N option, a decimal count
+size_t count_option(const char* option) {
+    const char* text = std::strchr(option, '=') + 1;
+    char* end;
+    errno = 0;
+    unsigned long long value = std::strtoull(text, &end, 10);
+    if (!std::isdigit(static_cast<unsigned char>(*text)) || *end != '\0' || errno == ERANGE)
+        fail("MAIN", "INVALID_OPTION", "option = '" + std::string(option) + "'");
+    return value;
+}
+
+// the S of a --name=S option, seconds that may have a fraction
+double seconds_option(const char* option) {
+    const char* text = std::strchr(option, '=') + 1;
+    char* end;
+    double value = std::strtod(text, &end);
+    if (*text == '\0' || *end != '\0' || !(value >= 0) || value == HUGE_VAL)
+        fail("MAIN", "INVALID_OPTION", "option = '" + std::string(option) + "'");
+    return value;
+}
+
+// optimizes program with the profile at path before it runs
+void use_profile(Program& program, const std::string& path, Stats* stats) {
+    PhaseTimer optimizing(stats, "optimize");
+    ProfileUse use = apply_profile(program, Profile::read(path, program));
+    optimizing.stop();
+
+    if (stats != nullptr) {
+        stats->profiled_functions = use.matched;
+        stats->stale_profiles = use.stale;
+        stats->inlined_calls = use.inlined;
+        stats->precompiled_functions = use.precompiled;
+    }
+}
+
+int run_main(int argc, char* argv[]) {
+    std::vector<const char*> paths;
+    bool print_token_list = false;
+    bool print_ast = false;
+    bool compare = false;
+    bool print_c = false;
+    std::string native_output;
+    std::string snapshot_output;
+    std::string snapshot_input;
+    std::string profile_output;
+    std::string feedback_output;
+    std::string feedback_input;
+    std::string module_cache;
+    bool print_stats = false;
+    InterpreterOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--tokens") == 0)
+            print_token_list = true;
+        else if (std::strcmp(argv[i], "--ast") == 0)
+            print_ast = true;
+        else if (std::strncmp(argv[i], "--stack-size=", 13) == 0)
+            options.stack_size = count_option(argv[i]);
+        else if (std::strcmp(argv[i], "--jit") == 0)
+            options.jit = true;
+        else if (std::strcmp(argv[i], "--no-jit") == 0)
+            options.jit = false;
+        else if (std::strncmp(argv[i], "--jit-threshold=", 16) == 0)
+            options.jit_threshold = count_option(argv[i]);
+        else if (std::strncmp(argv[i], "--memo-threshold=", 17) == 0)
+            options.memo_threshold = count_option(argv[i]);
+        else if (std::strncmp(argv[i], "--fuel=", 7) == 0)
+            options.limits.fuel = count_option(argv[i]);
+        else if (std::strncmp(argv[i], "--time-limit=", 13) == 0)
+            options.limits.seconds = seconds_option(argv[i]);
+        else if (std::strncmp(argv[i], "--heap-limit=", 13) == 0)
+            options.limits.heap_bytes = count_option(argv[i]);
+        else if (std::strncmp(argv[i], "--threads=", 10) == 0)
+            options.threads = count_option(argv[i]);
+        else if (std::strcmp(argv[i], "--compare-engines") == 0)
+            compare = true;
+        else if (std::strcmp(argv[i], "--emit-c") == 0)
+            print_c = true;
+        else if (std::strncmp(argv[i], "--native=", 9) == 0)
+            native_output = argv[i] + 9;
+        else if (std::strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc)
+            snapshot_output = argv[++i];
+        else if (std::strcmp(argv[i], "--from-snapshot") == 0 && i + 1 < argc)
+            snapshot_input = argv[++i];
+        else if (std::strncmp(argv[i], "--profile=", 10) == 0)
+            profile_output = argv[i] + 10;
+        else if (std::strncmp(argv[i], "--profile-out=", 14) == 0)
+            feedback_output = argv[i] + 14;
+        else if (std::strncmp(argv[i], "--profile-in=", 13) == 0)
+            feedback_input = argv[i] + 13;
+        else if (std::strcmp(argv[i], "--stats") == 0)
+            print_stats = true;
+        else if (std::strncmp(argv[i], "--module-cache=", 15) == 0)
+            module_cache = argv[i] + 15;
+        else
+            paths.push_back(argv[i]);
+    }
+
+    if (compare)
+        return compare_engines(paths);
+
+    // a recording has to see every call and branch of the program as it was
+    // written, not what the JIT or an earlier profile made of it
+    if (!feedback_output.empty()) {
+        options.jit = false;
+        if (!feedback_input.empty()) {
+            std::cerr << "WARNING::MAIN::PROFILE_IN_IGNORED_WHEN_RECORDING\n";
+            feedback_input.clear();
+        }
+    }
+
+    Stats stats;
+    Stats* phases = print_stats ? &stats : nullptr;
+
+    if (!snapshot_input.empty() && paths.empty()) {
+        PhaseTimer load(phases, "load");
+        Program program = read_snapshot(snapshot_input);
+        load.stop();
+        if (!feedback_input.empty())
+            use_profile(program, feedback_input, phases);
+        return run_program(program, options, profile_output, feedback_output, phases);
+    }
+
+    if (paths.empty() && !print_token_list && !print_ast && !print_c && native_output.empty()
+            && snapshot_output.empty())
+        return repl(options);
+
+    if (paths.size() != 1) {
+        std::cerr << "usage: bask [--stack-size=N] [--jit | --no-jit] [--jit-threshold=N] [--memo-threshold=N]\n";
+        std::cerr << "            [--threads=N]  (a session on stdin)\n";
+        std::cerr << "       bask [--tokens] [--ast] [--stack-size=N] [--jit | --no-jit] [--jit-threshold=N]\n";
+        std::cerr << "            [--memo-threshold=N] [--threads=N] [--fuel=N] [--time-limit=S] [--heap-limit=BYTES]\n";
+        std::cerr << "            [--profile=out.folded] [--profile-out=p.prof | --profile-in=p.prof] [--stats]\n";
+        std::cerr << "            [--module-cache=dir] file.bsk\n";
+        std::cerr << "       bask --emit-c file.bsk > file.c\n";
+        std::cerr << "       bask --native=executable file.bsk\n";
+        std::cerr << "       bask --compare-engines file.bsk...\n";
+        std::cerr << "       bask --snapshot image file.bsk\n";
+        std::cerr << "       bask [options] --from-snapshot image\n";
         return 1;
+    }
+
+    if (options.jit && !BASK_JIT_SUPPORTED)
+        std::cerr << "WARNING::MAIN::JIT_NOT_SUPPORTED\n";
 
-    std::string source = read_file(argv[1]);
+    std::string source = read_file(paths.at(0));
 
+    PhaseTimer lex(phases, "lex");
     std::vector<Token> tokens = tokenize(source);
+    lex.stop();
+
+    if (print_token_list)
+        print_tokens(tokens);
+
+    PhaseTimer parsing(phases, "parse");
+    AstProgram ast = parse(tokens);
+    parsing.stop();
+
+    if (print_ast) {
+        ast.print();
+        out() << "\n";
+    }
 
-    print_tokens(tokens);
+    bool imports = false;
+    for (const auto& declaration : ast.code)
+        imports = imports || declaration->get_type() == AstType::IMPORT;
 
-    */
+    // modules compile side by side, their loop passes stay part of compile
+    PhaseTimer compiling(phases, "compile");
+    ModuleLoader loader(module_cache, options.threads);
+    LoopPassStats loop_passes;
+    Program program = imports ? loader.load(paths.at(0)) : compile(ast, default_natives(), &loop_passes);
+    compiling.stop();
+    if (phases != nullptr && !imports)
+        phases->split_last({loop_passes.licm, loop_passes.strength});
 
-    //std::vector<std::unique_ptr<AstStatement>> ast_tree = parse(tokens);
+    if (print_stats) {
+        stats.count_tokens(tokens);
+        stats.count_nodes(ast);
+        stats.modules_compiled = loader.compiled;
+        stats.modules_cached = loader.cached;
+    }
 
-    //run(ast_tree);
+    if (print_c) {
+        std::ostringstream c;
+        emit_c(ast, c);
+        out() << c.str();
+        return 0;
+    }
 
-    
+    if (!native_output.empty())
+        return build_native(ast, native_output);
 
-    return 0;
+    if (!feedback_input.empty())
+        use_profile(program, feedback_input, phases);
 
-}
\ No newline at end of file
+    if (!snapshot_output.empty()) {
+        Interpreter interpreter(program, options);
+        interpreter.initialize();
+        write_snapshot(snapshot_output, program, interpreter.global_values());
+        return 0;
+    }
+
+    return run_program(program, options, profile_output, feedback_output, phases);
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        return run_main(argc, argv);
+    } catch (const ScriptExit& exit) {
+        return exit.code;
+    } catch (const BaskError& error) {
+        out().flush();
+        std::cerr << error.what();
+        return 1;
+    }
+}
@@ -0,0 +1,337 @@
+#include "lib/map.hpp"
+#include "lib/stats.hpp"
+#include "lib/limits.hpp"
+#include "lib/error.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// A control byte is EMPTY, DELETED or, for a full slot, the low 7 bits of
+// its key's hash, so the sign bit alone tells full from free. The rest of
+// the hash picks the group of 16 slots a probe starts at, and probes move
+// on group by group in growing steps until a group has an EMPTY slot.
+
+const signed char EMPTY = -128;
+const signed char DELETED = -2;
+const size_t GROUP_SIZE = 16;
+
+// HASHING
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// eight bytes at a time
+static uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed ^ (size * 0x9E3779B97F4A7C15ULL);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        hash = (hash ^ mix(word)) * 0x9E3779B97F4A7C15ULL;
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + i, size - i);
+        hash = (hash ^ mix(word)) * 0x9E3779B97F4A7C15ULL;
+    }
+
+    return mix(hash);
+}
+
+bool is_hashable(const Value& value) {
+    return value.type != ValueTypes::ARRAY && value.type != ValueTypes::MAP;
+}
+
+size_t hash_value(const Value& value) {
+    // seeded with the type, so 1 and 1.0 land apart
+    uint64_t seed = static_cast<uint64_t>(value.type) << 56;
+
+    switch (value.type) {
+        case ValueTypes::_NULL:
+            return mix(seed);
+        case ValueTypes::INT:
+            return mix(seed ^ static_cast<uint64_t>(value.int_value));
+        case ValueTypes::FLOAT: {
+            uint64_t bits;
+            std::memcpy(&bits, &value.float_value, sizeof(bits));
+            return mix(seed ^ bits);
+        }
+        case ValueTypes::STRING: {
+            if (value.is_small_string())
+                return hash_bytes(value.small_data(), value.small_size, seed);
+            StringObject* object = value.string_value;
+            if (object->hash == 0) {
+                size_t hash = hash_bytes(string_data(value), object->size, seed);
+                // 0 means not computed yet
+                object->hash = hash == 0 ? 1 : hash;
+            }
+            return object->hash;
+        }
+        case ValueTypes::BIG_INT:
+            return hash_bytes(value.big_value->limbs(), value.big_value->size * sizeof(uint32_t),
+                seed ^ value.big_value->negative);
+        case ValueTypes::FUNC:
+            return mix(seed ^ value.func_value);
+        case ValueTypes::NATIVE_FUNC:
+            return mix(seed ^ reinterpret_cast<uintptr_t>(value.native_value));
+        default:
+            fail("BUILTINS", "UNHASHABLE_KEY");
+    }
+}
+
+bool keys_equal(const Value& a, const Value& b) {
+    if (a.type != b.type)
+        return false;
+
+    switch (a.type) {
+        case ValueTypes::_NULL:
+            return true;
+        case ValueTypes::INT:
+            return a.int_value == b.int_value;
+        case ValueTypes::FLOAT:
+            return std::memcmp(&a.float_value, &b.float_value, sizeof(double)) == 0;
+        case ValueTypes::STRING: {
+            size_t size = string_size(a);
+            if (size != string_size(b))
+                return false;
+            if (!a.is_small_string() && !b.is_small_string()) {
+                if (a.string_value == b.string_value)
+                    return true;
+                // both were hashed on the way here
+                if (a.string_value->hash != b.string_value->hash)
+                    return false;
+            }
+            return std::memcmp(string_data(a), string_data(b), size) == 0;
+        }
+        case ValueTypes::BIG_INT:
+            return a.big_value->negative == b.big_value->negative && a.big_value->size == b.big_value->size
+                && std::memcmp(a.big_value->limbs(), b.big_value->limbs(), a.big_value->size * sizeof(uint32_t)) == 0;
+        case ValueTypes::FUNC:
+            return a.func_value == b.func_value;
+        case ValueTypes::NATIVE_FUNC:
+            return a.native_value == b.native_value;
+        default:
+            return false;
+    }
+}
+
+// GROUPS
+
+// bit i set for every control byte i of the group equal to byte
+static unsigned match(const signed char* group, signed char byte) {
+#if defined(__SSE2__)
+    __m128i control = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8(byte))));
+#else
+    unsigned bits = 0;
+    for (size_t i = 0; i < GROUP_SIZE; i++)
+        bits |= static_cast<unsigned>(group[i] == byte) << i;
+    return bits;
+#endif
+}
+
+// bit i set for every EMPTY or DELETED byte, the ones with the sign bit
+static unsigned match_free(const signed char* group) {
+#if defined(__SSE2__)
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#else
+    unsigned bits = 0;
+    for (size_t i = 0; i < GROUP_SIZE; i++)
+        bits |= static_cast<unsigned>(group[i] < 0) << i;
+    return bits;
+#endif
+}
+
+static signed char control_byte(size_t hash) {
+    return static_cast<signed char>(hash & 0x7F);
+}
+
+static size_t first_group(const MapObject* map, size_t hash) {
+    return (hash >> 7) & (map->capacity / GROUP_SIZE - 1);
+}
+
+// slot of key, or capacity when it is not there
+static size_t find_slot(const MapObject* map, const Value& key, size_t hash) {
+    if (map->capacity == 0)
+        return 0;
+
+    size_t mask = map->capacity / GROUP_SIZE - 1;
+    size_t group = first_group(map, hash);
+    signed char byte = control_byte(hash);
+
+    // the steps grow by one group each time, which visits every group of a
+    // power of two table
+    for (size_t step = 1; ; step++) {
+        const signed char* control = map->control + group * GROUP_SIZE;
+        for (unsigned bits = match(control, byte); bits != 0; bits &= bits - 1) {
+            size_t slot = group * GROUP_SIZE + static_cast<size_t>(__builtin_ctz(bits));
+            if (keys_equal(map->entries[slot].key, key))
+                return slot;
+        }
+        if (match(control, EMPTY) != 0)
+            return map->capacity;
+        group = (group + step) & mask;
+    }
+}
+
+// the first EMPTY or DELETED slot on the probe sequence of hash
+static size_t free_slot(const MapObject* map, size_t hash) {
+    size_t mask = map->capacity / GROUP_SIZE - 1;
+    size_t group = first_group(map, hash);
+
+    for (size_t step = 1; ; step++) {
+        unsigned bits = match_free(map->control + group * GROUP_SIZE);
+        if (bits != 0)
+            return group * GROUP_SIZE + static_cast<size_t>(__builtin_ctz(bits));
+        group = (group + step) & mask;
+    }
+}
+
+// TABLE
+
+static void allocate_table(MapObject* map, size_t capacity) {
+    size_t bytes = capacity * (sizeof(MapEntry) + 1);
+    heap_allocated(bytes);
+    char* memory = static_cast<char*>(std::malloc(bytes));
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    BASK_COUNT(count_allocation(bytes));
+
+    map->capacity = capacity;
+    map->tombstones = 0;
+    map->entries = reinterpret_cast<MapEntry*>(memory);
+    map->control = reinterpret_cast<signed char*>(memory + capacity * sizeof(MapEntry));
+    for (size_t i = 0; i < capacity; i++)
+        new (&map->entries[i]) MapEntry();
+    std::memset(map->control, EMPTY, capacity);
+}
+
+static void free_table(MapEntry* entries, size_t capacity) {
+    for (size_t i = 0; i < capacity; i++)
+        entries[i].~MapEntry();
+    heap_freed(capacity * (sizeof(MapEntry) + 1));
+    std::free(entries);
+}
+
+// room for at least count entries below the 7/8 load limit
+static size_t capacity_for(size_t count) {
+    size_t capacity = GROUP_SIZE;
+    while (capacity / 8 * 7 < count)
+        capacity *= 2;
+    return capacity;
+}
+
+static void rehash(MapObject* map, size_t capacity) {
+    MapEntry* old_entries = map->entries;
+    signed char* old_control = map->control;
+    size_t old_capacity = map->capacity;
+
+    allocate_table(map, capacity);
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_control[i] < 0)
+            continue;
+        size_t hash = hash_value(old_entries[i].key);
+        size_t slot = free_slot(map, hash);
+        map->control[slot] = control_byte(hash);
+        map->entries[slot].key = std::move(old_entries[i].key);
+        map->entries[slot].value = std::move(old_entries[i].value);
+    }
+
+    if (old_capacity != 0)
+        free_table(old_entries, old_capacity);
+}
+
+Value new_map(size_t reserve) {
+    heap_allocated(sizeof(MapObject));
+    MapObject* object = static_cast<MapObject*>(std::malloc(sizeof(MapObject)));
+    if (object == nullptr)
+        throw std::bad_alloc();
+    BASK_COUNT(count_allocation(sizeof(MapObject)));
+    object->refs = 1;
+    object->type = ObjectTypes::MAP;
+    object->immortal = false;
+    object->frozen = false;
+    object->size = 0;
+    object->tombstones = 0;
+    object->capacity = 0;
+    object->control = nullptr;
+    object->entries = nullptr;
+    if (reserve != 0)
+        allocate_table(object, capacity_for(reserve));
+    return Value::map(object);
+}
+
+const Value* map_find(const MapObject* map, const Value& key) {
+    if (!is_hashable(key))
+        fail("BUILTINS", "UNHASHABLE_KEY");
+    size_t slot = find_slot(map, key, hash_value(key));
+    return slot < map->capacity ? &map->entries[slot].value : nullptr;
+}
+
+void map_set(MapObject* map, const Value& key, const Value& value) {
+    if (!is_hashable(key))
+        fail("BUILTINS", "UNHASHABLE_KEY");
+    size_t hash = hash_value(key);
+
+    size_t slot = find_slot(map, key, hash);
+    if (slot < map->capacity) {
+        map->entries[slot].value = value;
+        return;
+    }
+
+    // grows when full of entries, just sweeps out tombstones otherwise
+    if (map->capacity == 0 || map->size + map->tombstones + 1 > map->capacity / 8 * 7)
+        rehash(map, capacity_for(map->size + 1 > map->capacity / 16 * 7 ? 2 * (map->size + 1) : map->size + 1));
+
+    slot = free_slot(map, hash);
+    if (map->control[slot] == DELETED)
+        map->tombstones--;
+    map->control[slot] = control_byte(hash);
+    map->entries[slot].key = key;
+    map->entries[slot].value = value;
+    map->size++;
+}
+
+bool map_remove(MapObject* map, const Value& key) {
+    if (!is_hashable(key))
+        fail("BUILTINS", "UNHASHABLE_KEY");
+    size_t slot = find_slot(map, key, hash_value(key));
+    if (slot >= map->capacity)
+        return false;
+
+    map->control[slot] = DELETED;
+    map->entries[slot].key = Value();
+    map->entries[slot].value = Value();
+    map->size--;
+    map->tombstones++;
+    return true;
+}
+
+Value copy_map(const MapObject* map, Value (*copy)(const Value&)) {
+    Value result = new_map(map->size);
+    map_for_each(map, [&result, copy](const Value& key, const Value& value) {
+        map_set(result.map_value, copy(key), copy(value));
+    });
+    return result;
+}
+
+void destroy_map(MapObject* map) {
+    if (map->capacity != 0)
+        free_table(map->entries, map->capacity);
+    heap_freed(sizeof(MapObject));
+    std::free(map);
+}
@@ -0,0 +1,61 @@
+#include "lib/memo.hpp"
+#include "lib/map.hpp"
+
+const Value* MemoTable::find(size_t hash, const Value* args, size_t count) {
+    lookups++;
+    if (slots.empty())
+        return nullptr;
+
+    const MemoEntry& entry = slots[hash % MEMO_SLOTS];
+    if (!entry.ready || entry.hash != hash || entry.args.size() != count)
+        return nullptr;
+    for (size_t i = 0; i < count; i++)
+        if (!keys_equal(entry.args[i], args[i]))
+            return nullptr;
+
+    hits++;
+    return &entry.result;
+}
+
+size_t MemoTable::reserve(size_t hash, const Value* args, size_t count) {
+    if (slots.empty())
+        slots.resize(MEMO_SLOTS);
+
+    MemoEntry& entry = slots[hash % MEMO_SLOTS];
+    entry.hash = hash;
+    entry.generation++;
+    entry.args.assign(args, args + count);
+    entry.result = Value();
+    entry.ready = false;
+    return entry.generation;
+}
+
+void MemoTable::store(size_t hash, size_t generation, const Value& result) {
+    if (slots.empty())
+        return;
+
+    MemoEntry& entry = slots[hash % MEMO_SLOTS];
+    if (entry.generation != generation || !memoizable(result))
+        return;
+    entry.result = result;
+    entry.ready = true;
+}
+
+void MemoTable::abandon() {
+    abandoned = true;
+    std::vector<MemoEntry>().swap(slots);
+}
+
+size_t memo_key(const Value* args, size_t count) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ count;
+    for (size_t i = 0; i < count; i++) {
+        if (!is_hashable(args[i]))
+            return 0;
+        hash = (hash ^ hash_value(args[i])) * 0x100000001b3ULL;
+    }
+    return hash != 0 ? static_cast<size_t>(hash) : 1;
+}
+
+bool memoizable(const Value& result) {
+    return is_hashable(result);
+}
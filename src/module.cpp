@@ -0,0 +1,474 @@
+#include "lib/module.hpp"
+#include "lib/lexer.hpp"
+#include "lib/parser.hpp"
+#include "lib/snapshot.hpp"
+#include "lib/bigint.hpp"
+#include "lib/error.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <climits>
+#include <sys/stat.h>
+#include <unistd.h>
+
+uint64_t content_hash(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = 0xCBF29CE484222325ULL ^ seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// POOL
+
+// Runs jobs on a fixed set of threads, jobs may push more jobs.
+class WorkPool {
+private:
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::deque<std::function<void()>> jobs;
+    size_t busy;
+    bool stopping;
+    std::vector<std::thread> workers;
+
+    void work() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            std::function<void()> job = std::move(jobs.front());
+            jobs.pop_front();
+            busy++;
+            guard.unlock();
+            job();
+            guard.lock();
+            if (--busy == 0 && jobs.empty())
+                idle.notify_all();
+        }
+    }
+public:
+    WorkPool(size_t threads) : busy(0), stopping(false) {
+        for (size_t i = 0; i < threads; i++)
+            workers.emplace_back(&WorkPool::work, this);
+    }
+
+    ~WorkPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    // job may not throw
+    void push(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            jobs.push_back(std::move(job));
+        }
+        wake.notify_one();
+    }
+
+    // until no job is queued or running
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock);
+        idle.wait(guard, [this]() { return busy == 0 && jobs.empty(); });
+    }
+};
+
+// GRAPH
+
+class ModuleNode {
+public:
+    // canonical, nodes are found by it
+    std::string path;
+    std::string source;
+    std::vector<Token> tokens;
+    // nodes this one imports, in source order
+    std::vector<size_t> imports;
+    std::vector<size_t> importers;
+    // imports not compiled yet
+    size_t pending;
+    uint64_t key;
+    std::shared_ptr<const CompiledModule> compiled;
+    // what went wrong reading, parsing or compiling it
+    std::exception_ptr error;
+
+    ModuleNode(std::string path) : path(std::move(path)), pending(0), key(0) {}
+};
+
+// the canonical form of path, or path itself when there is no such file
+static std::string canonical(const std::string& path) {
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved) == nullptr)
+        return path;
+    return resolved;
+}
+
+// import paths are relative to the directory of the importing file
+static std::string resolve(const std::string& importer, const std::string& path) {
+    if (!path.empty() && path[0] == '/')
+        return canonical(path);
+    size_t slash = importer.rfind('/');
+    return canonical(slash == std::string::npos ? path : importer.substr(0, slash + 1) + path);
+}
+
+static std::string read_source(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open())
+        fail("MODULE", "CANNOT_OPEN_FILE", "path = '" + path + "'");
+    std::stringstream buf;
+    buf << file.rdbuf();
+    return buf.str();
+}
+
+// the error of an imported module, saying which one it was
+static std::exception_ptr in_module(const std::string& path) {
+    try {
+        throw;
+    } catch (const BaskError& error) {
+        return std::make_exception_ptr(BaskError(error.what() + ("module = '" + path + "'\n")));
+    } catch (...) {
+        return std::current_exception();
+    }
+}
+
+// LINKING
+
+// a copy of a literal the program owns, so it outlives the cached module
+static Value adopt_literal(const Value& value, Program& program) {
+    if (value.type == ValueTypes::STRING && !value.is_small_string()) {
+        StringObject* object = new_string_object(string_data(value), string_size(value));
+        object->hash = value.string_value->hash;
+        object->immortal = true;
+        program.objects.push_back(object);
+        return Value::string(object);
+    }
+    if (value.type == ValueTypes::BIG_INT) {
+        Value copy = big_int(value.big_value->negative, value.big_value->limbs(), value.big_value->size);
+        copy.big_value->immortal = true;
+        copy.counted = false;
+        program.objects.push_back(copy.big_value);
+        return copy;
+    }
+    return value;
+}
+
+// one program from modules listed imports first, main comes from the last
+static Program link(const std::vector<const ModuleNode*>& order, const std::deque<ModuleNode>& nodes) {
+    const CompiledModule& root = *order.back()->compiled;
+    if (root.program.main < 0)
+        fail("COMPILER", "NO_MAIN", "name = 'main'");
+
+    Program program;
+    for (size_t i = 0; i < root.natives; i++)
+        program.globals.push_back(root.program.globals[i]);
+
+    // the root declares the first globals, so finding one by name prefers it
+    std::vector<const ModuleNode*> layout(1, order.back());
+    layout.insert(layout.end(), order.begin(), order.end() - 1);
+
+    std::unordered_map<const ModuleNode*, size_t> global_base;
+    std::unordered_map<const ModuleNode*, size_t> function_base;
+    program.functions.emplace_back("<init>");
+    for (const ModuleNode* node : layout) {
+        const CompiledModule& module = *node->compiled;
+        if (module.natives != root.natives || module.natives + module.declared > module.program.globals.size())
+            fail("SNAPSHOT", "CORRUPT_IMAGE", "module = '" + node->path + "'");
+        global_base[node] = program.globals.size();
+        function_base[node] = program.functions.size() - 1;
+        for (size_t i = module.natives; i < module.natives + module.declared; i++)
+            program.globals.push_back(module.program.globals[i]);
+        for (size_t i = 1; i < module.program.functions.size(); i++)
+            program.functions.push_back(module.program.functions[i]);
+    }
+
+    // module globals to program globals, imports first so externs resolve
+    std::unordered_map<const ModuleNode*, std::vector<size_t>> global_map;
+    for (const ModuleNode* node : order) {
+        const CompiledModule& module = *node->compiled;
+        std::vector<size_t>& map = global_map[node];
+        for (size_t i = 0; i < module.natives; i++)
+            map.push_back(i);
+        for (size_t i = 0; i < module.declared; i++)
+            map.push_back(global_base[node] + i);
+        for (const auto& external : module.externs) {
+            if (external.first >= node->imports.size())
+                fail("SNAPSHOT", "CORRUPT_IMAGE", "module = '" + node->path + "'");
+            const ModuleNode* import = &nodes[node->imports[external.first]];
+            const std::vector<size_t>& import_map = global_map[import];
+            if (external.second < root.natives || external.second >= root.natives + import->compiled->declared)
+                fail("SNAPSHOT", "CORRUPT_IMAGE", "module = '" + node->path + "'");
+            map.push_back(import_map[external.second]);
+        }
+        if (map.size() != module.program.globals.size())
+            fail("SNAPSHOT", "CORRUPT_IMAGE", "module = '" + node->path + "'");
+
+        size_t base = global_base[node];
+        for (size_t i = 0; i < module.declared; i++) {
+            Value& value = program.globals[base + i].value;
+            if (value.type == ValueTypes::FUNC)
+                value = Value::function(function_base[node] + value.func_value);
+        }
+    }
+
+    Function& init = program.functions[0];
+    init.entries.push_back(0);
+    for (const ModuleNode* node : order) {
+        const CompiledModule& module = *node->compiled;
+        const std::vector<size_t>& map = global_map[node];
+        size_t constant_base = program.constants.size();
+        for (const Value& constant : module.program.constants)
+            program.constants.push_back(adopt_literal(constant, program));
+
+        auto relocate = [&](Instruction& instruction) {
+            switch (instruction.op) {
+                case OpCode::PUSH_CONST:
+                    instruction.arg += constant_base;
+                    break;
+                case OpCode::GET_GLOBAL:
+                case OpCode::SET_GLOBAL:
+                case OpCode::CALL_NATIVE:
+                    instruction.arg = map.at(instruction.arg);
+                    break;
+                default:
+                    break;
+            }
+        };
+
+        size_t first = function_base[node] + 1;
+        for (size_t i = first; i < first + module.program.functions.size() - 1; i++)
+            for (Instruction& instruction : program.functions[i].code)
+                relocate(instruction);
+
+        // the initializers run one after the other, without the PUSH_NULL
+        // and RETURN ending each
+        const Function& module_init = module.program.functions.at(0);
+        size_t start = init.code.size();
+        init.code.insert(init.code.end(), module_init.code.begin(), module_init.code.end() - 2);
+        for (size_t i = start; i < init.code.size(); i++) {
+            relocate(init.code[i]);
+            // jumps in initializers, from && and ||, move with them
+            switch (init.code[i].op) {
+                case OpCode::JUMP:
+                case OpCode::JUMP_IF_FALSE:
+                case OpCode::JUMP_IF_TRUE:
+                    init.code[i].arg += start;
+                    break;
+                default:
+                    break;
+            }
+        }
+        for (const auto& line : module_init.lines)
+            if (line.first < module_init.code.size() - 2)
+                init.lines.emplace_back(start + line.first, line.second);
+        init.max_stack = std::max(init.max_stack, module_init.max_stack);
+    }
+    init.code.emplace_back(OpCode::PUSH_NULL);
+    init.code.emplace_back(OpCode::RETURN);
+    init.max_stack = std::max<size_t>(init.max_stack, 1);
+
+    program.main = function_base[order.back()] + root.program.main;
+    return program;
+}
+
+// LOADING
+
+ModuleLoader::ModuleLoader(std::string cache_dir, size_t threads, const NativeTable& natives)
+: natives(natives), cache_dir(std::move(cache_dir)), threads(threads), compiled(0), cached(0) {
+    if (this->threads == 0)
+        this->threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+static std::string cache_path(const std::string& dir, uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.bskm", static_cast<unsigned long long>(key));
+    return dir + name;
+}
+
+std::shared_ptr<const CompiledModule> ModuleLoader::find(uint64_t key) {
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        auto module = cache.find(key);
+        if (module != cache.end())
+            return module->second;
+    }
+    if (cache_dir.empty() || access(cache_path(cache_dir, key).c_str(), R_OK) != 0)
+        return nullptr;
+
+    std::shared_ptr<const CompiledModule> module;
+    try {
+        module = std::make_shared<CompiledModule>(read_module_image(cache_path(cache_dir, key), natives));
+    } catch (const BaskError&) {
+        // written by another build or cut short, compiled again
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> guard(cache_lock);
+    cache[key] = module;
+    return module;
+}
+
+void ModuleLoader::store(uint64_t key, const std::shared_ptr<const CompiledModule>& module) {
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        cache[key] = module;
+    }
+    if (cache_dir.empty())
+        return;
+
+    // renamed into place, so no other run ever reads half of it
+    std::string path = cache_path(cache_dir, key);
+    std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+    write_module_image(temporary, *module);
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        fail("MODULE", "CANNOT_WRITE_CACHE", "path = '" + path + "'");
+    }
+}
+
+Program ModuleLoader::load(const std::string& path) {
+    compiled = 0;
+    cached = 0;
+    if (!cache_dir.empty())
+        mkdir(cache_dir.c_str(), 0777);
+
+    // a deque so nodes stay put while scans add more
+    std::deque<ModuleNode> graph;
+    std::unordered_map<std::string, size_t> index;
+    std::mutex graph_lock;
+    WorkPool pool(threads);
+
+    // reads and lexes a module, adding what it imports
+    std::function<void(size_t)> scan = [&](size_t id) {
+        ModuleNode* node;
+        {
+            std::lock_guard<std::mutex> guard(graph_lock);
+            node = &graph[id];
+        }
+        std::vector<std::string> paths;
+        try {
+            node->source = read_source(node->path);
+            node->tokens = tokenize(node->source);
+            // import is a keyword, the parser finds each of these again
+            for (size_t i = 0; i + 1 < node->tokens.size(); i++)
+                if (node->tokens[i].type == TokenType::IMPORT && node->tokens[i + 1].type == TokenType::STRING)
+                    paths.push_back(resolve(node->path, node->tokens[i + 1].value));
+        } catch (...) {
+            node->error = id == 0 ? std::current_exception() : in_module(node->path);
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(graph_lock);
+        for (const std::string& import : paths) {
+            auto found = index.find(import);
+            size_t import_id;
+            if (found != index.end()) {
+                import_id = found->second;
+            } else {
+                import_id = graph.size();
+                index[import] = import_id;
+                graph.emplace_back(import);
+                pool.push([&scan, import_id]() { scan(import_id); });
+            }
+            node->imports.push_back(import_id);
+        }
+    };
+
+    std::string root = canonical(path);
+    index[root] = 0;
+    graph.emplace_back(root);
+    pool.push([&scan]() { scan(0); });
+    pool.wait();
+
+    // imports first, the root last
+    std::vector<const ModuleNode*> order;
+    std::vector<int> state(graph.size(), 0);
+    std::function<void(size_t)> visit = [&](size_t id) {
+        if (state[id] == 2)
+            return;
+        if (state[id] == 1)
+            fail("MODULE", "IMPORT_CYCLE", "path = '" + graph[id].path + "'");
+        if (graph[id].error)
+            std::rethrow_exception(graph[id].error);
+        state[id] = 1;
+        for (size_t import : graph[id].imports)
+            visit(import);
+        state[id] = 2;
+        order.push_back(&graph[id]);
+    };
+    visit(0);
+
+    // images name natives but call them by position
+    uint64_t seed = 0;
+    for (const Native& native : natives)
+        seed = content_hash(native.name.c_str(), native.name.size() + 1, seed);
+
+    for (const ModuleNode* node : order) {
+        size_t id = index.at(node->path);
+        ModuleNode& module = graph[id];
+        module.key = content_hash(module.source.data(), module.source.size(), seed);
+        for (size_t import : module.imports) {
+            module.key = content_hash(&graph[import].key, sizeof(uint64_t), module.key);
+            graph[import].importers.push_back(id);
+        }
+        module.pending = module.imports.size();
+    }
+
+    // compiles a module whose imports are, then the importers that waited
+    // only for it
+    std::function<void(size_t)> build = [&](size_t id) {
+        ModuleNode& node = graph[id];
+        bool found = true;
+        try {
+            node.compiled = find(node.key);
+            if (!node.compiled) {
+                found = false;
+                AstProgram ast = parse(node.tokens);
+                std::vector<const CompiledModule*> imports;
+                for (size_t import : node.imports)
+                    imports.push_back(graph[import].compiled.get());
+                node.compiled = std::make_shared<const CompiledModule>(compile_module(ast, imports, natives));
+                store(node.key, node.compiled);
+            }
+        } catch (...) {
+            node.error = id == 0 ? std::current_exception() : in_module(node.path);
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(graph_lock);
+        if (found)
+            cached++;
+        else
+            compiled++;
+        for (size_t importer : node.importers)
+            if (--graph[importer].pending == 0)
+                pool.push([&build, importer]() { build(importer); });
+    };
+
+    for (const ModuleNode* node : order)
+        if (node->imports.empty())
+            pool.push([&build, &index, node]() { build(index.at(node->path)); });
+    pool.wait();
+
+    // an error stops the modules importing it, the first one in order is
+    // the one reported
+    for (const ModuleNode* node : order)
+        if (node->error)
+            std::rethrow_exception(node->error);
+
+    return link(order, graph);
+}
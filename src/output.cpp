@@ -0,0 +1,77 @@
+#include "lib/output.hpp"
+#include "runtime/bask_format.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+Output::Output(int fd) : fd(fd), used(0) {}
+
+Output::~Output() {
+    flush();
+}
+
+void Output::write(const char* data, size_t size) {
+    if (size > OUTPUT_BUFFER_SIZE - used) {
+        flush();
+        // too big to be worth copying
+        if (size >= OUTPUT_BUFFER_SIZE) {
+            while (size > 0) {
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0 && errno == EINTR)
+                    continue;
+                if (written <= 0)
+                    return;
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+            return;
+        }
+    }
+
+    std::memcpy(buffer + used, data, size);
+    used += size;
+}
+
+void Output::write_int(long value) {
+    if (OUTPUT_BUFFER_SIZE - used < BASK_NUMBER_BUFFER)
+        flush();
+    used += bask_format_int(value, buffer + used);
+}
+
+void Output::write_double(double value) {
+    if (OUTPUT_BUFFER_SIZE - used < BASK_NUMBER_BUFFER)
+        flush();
+    used += bask_format_double(value, buffer + used);
+}
+
+void Output::flush() {
+    size_t done = 0;
+
+    while (done < used) {
+        ssize_t written = ::write(fd, buffer + done, used - done);
+        if (written < 0 && errno == EINTR)
+            continue;
+        // nowhere left to report it, the output is dropped
+        if (written <= 0)
+            break;
+        done += static_cast<size_t>(written);
+    }
+
+    used = 0;
+}
+
+Output& Output::operator<<(const char* value) {
+    write(value, std::strlen(value));
+    return *this;
+}
+
+Output& Output::operator<<(const std::string& value) {
+    write(value.data(), value.size());
+    return *this;
+}
+
+Output& out() {
+    static Output output(STDOUT_FILENO);
+    return output;
+}
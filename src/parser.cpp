@@ -1,10 +1,13 @@
 #include "lib/parser.hpp"
+#include "lib/error.hpp"
+
+#include <climits>
 
 Parser::Parser(std::vector<Token>& tokens)
-: tokens(tokens), current(tokens.at(0)), index(0) {}
+: tokens(tokens), current(&tokens.at(0)), index(0) {}
 
 void Parser::advance() {
-    current = tokens.at(++index);
+    current = &tokens.at(++index);
 }
 
 Token& Parser::next_token() {
@@ -12,16 +15,366 @@ Token& Parser::next_token() {
 }
 
 void Parser::check(TokenType type) {
-    if (current.type != type)
-        exit(1);
+    if (current->type != type) {
+        fail("PARSER", "UNEXPECTED_TOKEN", "expected = " + std::to_string(static_cast<unsigned short>(type))
+            + ", got = " + std::to_string(static_cast<unsigned short>(current->type)));
+    }
+}
+
+// EXPRESSIONS
+
+std::unique_ptr<AstExpr> Parser::parse_factor() {
+    std::unique_ptr<AstExpr> value;
+
+    switch (current->type) {
+        case TokenType::_NULL:
+            advance();
+            value = std::make_unique<AstNull>();
+            break;
+        case TokenType::INT: {
+            // longer than any long, or as long but bigger
+            const std::string& digits = current->value;
+            const std::string max = std::to_string(LONG_MAX);
+            if (digits.size() > max.size() || (digits.size() == max.size() && digits > max))
+                value = std::make_unique<AstInt>(0, digits);
+            else
+                value = std::make_unique<AstInt>(std::stol(digits));
+            advance();
+            break;
+        }
+        case TokenType::FLOAT:
+            value = std::make_unique<AstFloat>(std::stod(current->value));
+            advance();
+            break;
+        case TokenType::STRING:
+            value = std::make_unique<AstString>(current->value);
+            advance();
+            break;
+        case TokenType::ID:
+            value = std::make_unique<AstName>(current->value);
+            advance();
+            break;
+        case TokenType::PLUS:
+            advance();
+            return std::make_unique<AstUnaryOp>(UnaryOpType::PLUS_SIGN, parse_factor());
+        case TokenType::MINUS:
+            advance();
+            return std::make_unique<AstUnaryOp>(UnaryOpType::MINUS_SIGN, parse_factor());
+        case TokenType::AWAIT:
+            advance();
+            return std::make_unique<AstUnaryOp>(UnaryOpType::AWAIT, parse_factor());
+        case TokenType::NOT:
+            advance();
+            return std::make_unique<AstUnaryOp>(UnaryOpType::NOT, parse_factor());
+        case TokenType::LPAREN:
+            advance();
+            value = parse_expr();
+            check(TokenType::RPAREN);
+            advance();
+            break;
+        case TokenType::LCURLY:
+            value = parse_map();
+            break;
+        default:
+            fail("PARSER", "EXPECTED_EXPRESSION");
+    }
+
+    while (current->type == TokenType::LPAREN) {
+        advance();
+
+        std::vector<std::unique_ptr<AstExpr>> args;
+
+        if (current->type != TokenType::RPAREN)
+            while (true) {
+                args.push_back(parse_expr());
+
+                if (current->type == TokenType::RPAREN)
+                    break;
+
+                check(TokenType::COMA);
+                advance();
+            }
+
+        advance();
+
+        value = std::make_unique<AstFuncCall>(std::move(value), std::move(args));
+    }
+
+    return value;
+}
+
+std::unique_ptr<AstExpr> Parser::parse_map() {
+    advance();
+
+    std::vector<std::pair<std::unique_ptr<AstExpr>, std::unique_ptr<AstExpr>>> entries;
+
+    if (current->type != TokenType::RCURLY)
+        while (true) {
+            std::unique_ptr<AstExpr> key = parse_expr();
+            check(TokenType::COLON);
+            advance();
+            entries.emplace_back(std::move(key), parse_expr());
+
+            if (current->type == TokenType::RCURLY)
+                break;
+
+            check(TokenType::COMA);
+            advance();
+        }
+
+    advance();
+
+    return std::make_unique<AstMap>(std::move(entries));
+}
+
+std::unique_ptr<AstExpr> Parser::parse_term() {
+    std::unique_ptr<AstExpr> left = parse_factor();
+
+    while (current->type == TokenType::MULTIPLY || current->type == TokenType::DIVIDE) {
+        BinaryOpType type = (current->type == TokenType::MULTIPLY) ? BinaryOpType::MULT : BinaryOpType::DIV;
+        advance();
+        left = std::make_unique<AstBinaryOp>(type, std::move(left), parse_factor());
+    }
+
+    return left;
+}
+
+std::unique_ptr<AstExpr> Parser::parse_sum() {
+    std::unique_ptr<AstExpr> left = parse_term();
+
+    while (current->type == TokenType::PLUS || current->type == TokenType::MINUS) {
+        BinaryOpType type = (current->type == TokenType::PLUS) ? BinaryOpType::ADD : BinaryOpType::SUB;
+        advance();
+        left = std::make_unique<AstBinaryOp>(type, std::move(left), parse_term());
+    }
+
+    return left;
+}
+
+std::unique_ptr<AstExpr> Parser::parse_comparison() {
+    std::unique_ptr<AstExpr> left = parse_sum();
+
+    ComparisonType type;
+    switch (current->type) {
+        case TokenType::DOUBLE_EQUAL:
+            type = ComparisonType::EQUAL;
+            break;
+        case TokenType::NOT_EQUAL:
+            type = ComparisonType::NOT_EQUAL;
+            break;
+        case TokenType::LESS:
+            type = ComparisonType::LESS;
+            break;
+        case TokenType::LESS_EQUAL:
+            type = ComparisonType::LESS_EQUAL;
+            break;
+        case TokenType::GREATER:
+            type = ComparisonType::GREATER;
+            break;
+        case TokenType::GREATER_EQUAL:
+            type = ComparisonType::GREATER_EQUAL;
+            break;
+        default:
+            return left;
+    }
+    advance();
+
+    return std::make_unique<AstComparison>(type, std::move(left), parse_sum());
+}
+
+std::unique_ptr<AstExpr> Parser::parse_conjunction() {
+    std::unique_ptr<AstExpr> left = parse_comparison();
+
+    while (current->type == TokenType::AND) {
+        advance();
+        left = std::make_unique<AstLogicalOp>(LogicalOpType::AND, std::move(left), parse_comparison());
+    }
+
+    return left;
+}
+
+std::unique_ptr<AstExpr> Parser::parse_expr() {
+    std::unique_ptr<AstExpr> left = parse_conjunction();
+
+    while (current->type == TokenType::OR) {
+        advance();
+        left = std::make_unique<AstLogicalOp>(LogicalOpType::OR, std::move(left), parse_conjunction());
+    }
+
+    return left;
+}
+
+// STATEMENTS
+
+std::unique_ptr<AstStatement> Parser::parse_const_decl() {
+    advance();
+    check(TokenType::ID);
+    std::string name = current->value;
+
+    advance();
+    check(TokenType::EQUAL);
+    advance();
+
+    std::unique_ptr<AstExpr> value = parse_expr();
+
+    check(TokenType::SEMI);
+    advance();
+
+    return std::make_unique<AstConstDecl>(std::move(name), std::move(value));
+}
+
+std::unique_ptr<AstStatement> Parser::parse_var_decl() {
+    advance();
+    check(TokenType::ID);
+    std::string name = current->value;
+
+    advance();
+    check(TokenType::EQUAL);
+    advance();
+
+    std::unique_ptr<AstExpr> value = std::make_unique<AstNull>();
+
+    if (current->type != TokenType::SEMI) {
+        value = parse_expr();
+        check(TokenType::SEMI);
+    }
+    advance();
+
+    return std::make_unique<AstVarDecl>(std::move(name), std::move(value));
+}
+
+std::unique_ptr<AstStatement> Parser::parse_var_set() {
+    std::string name = current->value;
+
+    advance();
+    check(TokenType::EQUAL);
+    advance();
+
+    std::unique_ptr<AstExpr> value = parse_expr();
+
+    check(TokenType::SEMI);
+    advance();
+
+    return std::make_unique<AstVarSet>(std::move(name), std::move(value));
+}
+
+std::unique_ptr<AstStatement> Parser::parse_return() {
+    advance();
+
+    std::unique_ptr<AstExpr> value = std::make_unique<AstNull>();
+
+    if (current->type != TokenType::SEMI) {
+        value = parse_expr();
+        check(TokenType::SEMI);
+    }
+    advance();
+
+    return std::make_unique<AstReturn>(std::move(value));
 }
 
-// DO STATEMENTS BRUH
+std::vector<std::unique_ptr<AstStatement>> Parser::parse_block() {
+    check(TokenType::LCURLY);
+    advance();
+
+    std::vector<std::unique_ptr<AstStatement>> code;
+
+    while (current->type != TokenType::RCURLY)
+        code.push_back(parse_statement());
+
+    advance();
+
+    return code;
+}
+
+std::unique_ptr<AstExpr> Parser::parse_condition() {
+    check(TokenType::LPAREN);
+    advance();
+
+    std::unique_ptr<AstExpr> condition = parse_expr();
+
+    check(TokenType::RPAREN);
+    advance();
+
+    return condition;
+}
+
+std::unique_ptr<AstStatement> Parser::parse_if() {
+    advance();
+
+    std::unique_ptr<AstExpr> condition = parse_condition();
+    std::vector<std::unique_ptr<AstStatement>> code = parse_block();
+    std::vector<std::unique_ptr<AstStatement>> else_code;
+
+    if (current->type == TokenType::ELSE) {
+        advance();
+        if (current->type == TokenType::IF) {
+            int line = current->line;
+            else_code.push_back(parse_if());
+            else_code.back()->line = line;
+        } else {
+            else_code = parse_block();
+        }
+    }
+
+    return std::make_unique<AstIf>(std::move(condition), std::move(code), std::move(else_code));
+}
+
+std::unique_ptr<AstStatement> Parser::parse_while() {
+    advance();
+
+    std::unique_ptr<AstExpr> condition = parse_condition();
+
+    return std::make_unique<AstWhile>(std::move(condition), parse_block());
+}
+
+std::unique_ptr<AstStatement> Parser::parse_statement() {
+    int line = current->line;
+    std::unique_ptr<AstStatement> statement;
+
+    switch (current->type) {
+        case TokenType::CONST:
+            statement = parse_const_decl();
+            break;
+        case TokenType::VAR:
+            statement = parse_var_decl();
+            break;
+        case TokenType::RETURN:
+            statement = parse_return();
+            break;
+        case TokenType::IF:
+            statement = parse_if();
+            break;
+        case TokenType::WHILE:
+            statement = parse_while();
+            break;
+        case TokenType::ID:
+            if (next_token().type == TokenType::EQUAL) {
+                statement = parse_var_set();
+                break;
+            }
+            // any other name starts an expression statement
+            // fall through
+        default: {
+            std::unique_ptr<AstExpr> expr = parse_expr();
+
+            check(TokenType::SEMI);
+            advance();
+
+            statement = std::make_unique<AstNoReturnExpr>(std::move(expr));
+        }
+    }
+
+    statement->line = line;
+
+    return statement;
+}
+
+// DECLARATIONS
 
 std::unique_ptr<AstDeclaration> Parser::parse_global_const_decl() {
     advance();
     check(TokenType::ID);
-    std::string name = current.value;
+    std::string name = current->value;
 
     advance();
     check(TokenType::EQUAL);
@@ -32,13 +385,13 @@ std::unique_ptr<AstDeclaration> Parser::parse_global_const_decl() {
     check(TokenType::SEMI);
     advance();
 
-    return std::make_unique<AstGlobalVarDecl>(std::move(name), std::move(value));
+    return std::make_unique<AstGlobalConstDecl>(std::move(name), std::move(value));
 }
 
 std::unique_ptr<AstDeclaration> Parser::parse_global_var_decl() {
     advance();
     check(TokenType::ID);
-    std::string name = current.value;
+    std::string name = current->value;
 
     advance();
     check(TokenType::EQUAL);
@@ -46,7 +399,7 @@ std::unique_ptr<AstDeclaration> Parser::parse_global_var_decl() {
 
     std::unique_ptr<AstExpr> value = std::make_unique<AstNull>();
 
-    if (current.type != TokenType::SEMI) {
+    if (current->type != TokenType::SEMI) {
         value = parse_expr();
         check(TokenType::SEMI);
     }
@@ -56,9 +409,15 @@ std::unique_ptr<AstDeclaration> Parser::parse_global_var_decl() {
 }
 
 std::unique_ptr<AstDeclaration> Parser::parse_func_decl() {
+    bool is_async = current->type == TokenType::ASYNC;
+    if (is_async) {
+        advance();
+        check(TokenType::FUNC);
+    }
+
     advance();
     check(TokenType::ID);
-    std::string name = current.value;
+    std::string name = current->value;
 
     advance();
     check(TokenType::LPAREN);
@@ -68,23 +427,23 @@ std::unique_ptr<AstDeclaration> Parser::parse_func_decl() {
     std::vector<std::unique_ptr<AstVarDecl>> required_args;
     std::vector<std::unique_ptr<AstVarDecl>> optional_args;
 
-    if (current.type != TokenType::RPAREN)
+    if (current->type != TokenType::RPAREN)
         while (true) {
             check(TokenType::ID);
 
-            std::string name = current.value;
+            std::string name = current->value;
 
             advance();
 
             std::unique_ptr<AstExpr> value = std::make_unique<AstNull>();
 
-            if (current.type == TokenType::EQUAL) {
+            if (current->type == TokenType::EQUAL) {
                 optional = true;
                 advance();
                 value = parse_expr();
             } else {
                 if (optional)
-                    exit(1);
+                    fail("PARSER", "REQUIRED_ARG_AFTER_OPTIONAL");
             }
 
             if (optional) {
@@ -93,7 +452,7 @@ std::unique_ptr<AstDeclaration> Parser::parse_func_decl() {
                 required_args.push_back(std::make_unique<AstVarDecl>(std::move(name), std::move(value)));
             }
 
-            if (current.type == TokenType::RPAREN)
+            if (current->type == TokenType::RPAREN)
                 break;
             
             check(TokenType::COMA);
@@ -102,42 +461,91 @@ std::unique_ptr<AstDeclaration> Parser::parse_func_decl() {
     
     advance();
 
-    check(TokenType::LCURLY);
+    std::vector<std::unique_ptr<AstStatement>> code = parse_block();
+
+    return std::make_unique<AstFuncDecl>(std::move(name), std::move(required_args), std::move(optional_args), std::move(code),
+        is_async);
+}
+
+std::unique_ptr<AstDeclaration> Parser::parse_annotated() {
+    advance();
+    check(TokenType::ID);
+    if (current->value != "memo")
+        fail("PARSER", "UNKNOWN_ANNOTATION", "name = '" + current->value + "'");
+
     advance();
+    if (current->type != TokenType::FUNC && current->type != TokenType::ASYNC)
+        fail("PARSER", "EXPECTED_FUNC_DECL");
 
-    std::vector<std::unique_ptr<AstStatement>> code;
+    std::unique_ptr<AstDeclaration> declaration = parse_func_decl();
+    static_cast<AstFuncDecl*>(declaration.get())->memo = true;
+    return declaration;
+}
 
-    while (current.type != TokenType::RCURLY) {
-        code.push_back(parse_statement());
-    }
+std::unique_ptr<AstDeclaration> Parser::parse_import() {
+    advance();
+    check(TokenType::STRING);
+    std::string path = current->value;
 
+    advance();
+    check(TokenType::SEMI);
     advance();
 
-    return std::make_unique<AstFuncDecl>(std::move(name), std::move(required_args), std::move(optional_args), std::move(code));
+    return std::make_unique<AstImport>(std::move(path));
 }
 
 std::unique_ptr<AstDeclaration> Parser::parse_declaration() {
-    switch (current.type) {
+    int line = current->line;
+    std::unique_ptr<AstDeclaration> declaration;
+
+    switch (current->type) {
         case TokenType::CONST:
-            return parse_global_const_decl();
+            declaration = parse_global_const_decl();
+            break;
         case TokenType::VAR:
-            return parse_global_var_decl();
+            declaration = parse_global_var_decl();
+            break;
         case TokenType::FUNC:
-            return parse_func_decl();
+        case TokenType::ASYNC:
+            declaration = parse_func_decl();
+            break;
+        case TokenType::IMPORT:
+            declaration = parse_import();
+            break;
+        case TokenType::AT:
+            declaration = parse_annotated();
+            break;
         default:
-            exit(1);
+            fail("PARSER", "EXPECTED_DECLARATION");
     }
+
+    declaration->line = line;
+
+    return declaration;
 }
 
 AstProgram Parser::parse() {
     std::vector<std::unique_ptr<AstDeclaration>> declarations;
 
-    while (current.type != TokenType::END)
+    while (current->type != TokenType::END)
         declarations.push_back(parse_declaration());
 
     return AstProgram(std::move(declarations));
 }
 
+std::vector<std::unique_ptr<AstStatement>> Parser::parse_statements() {
+    std::vector<std::unique_ptr<AstStatement>> statements;
+
+    while (current->type != TokenType::END)
+        statements.push_back(parse_statement());
+
+    return statements;
+}
+
 AstProgram parse(std::vector<Token>& tokens) {
     return Parser(tokens).parse();
+}
+
+std::vector<std::unique_ptr<AstStatement>> parse_statements(std::vector<Token>& tokens) {
+    return Parser(tokens).parse_statements();
 }
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "lib/profiler.hpp"
+#include "lib/output.hpp"
+#include "lib/error.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <unordered_set>
+#include <vector>
+
+std::atomic<long> profile_ticks(0);
+
+static Profiler* active_profiler = nullptr;
+
+// CPU time timers only fire on scheduler ticks, expirations in between come
+// in one signal as overruns
+static void on_tick(int, siginfo_t* info, void*) {
+    profile_ticks.fetch_add(1 + info->si_overrun, std::memory_order_relaxed);
+}
+
+static void set_timer(timer_t timer, long interval) {
+    itimerspec spec;
+    spec.it_interval.tv_sec = interval / 1000000;
+    spec.it_interval.tv_nsec = interval % 1000000 * 1000;
+    spec.it_value = spec.it_interval;
+    timer_settime(timer, 0, &spec, nullptr);
+}
+
+// name of the function in a "name:line" frame
+static std::string function_of(const std::string& frame) {
+    return frame.substr(0, frame.rfind(':'));
+}
+
+Profiler::Profiler(long interval) : samples(0), interval(interval) {
+    if (active_profiler != nullptr)
+        fail("PROFILER", "ALREADY_RUNNING");
+    active_profiler = this;
+    profile_ticks = 0;
+
+    struct sigaction action = {};
+    action.sa_sigaction = on_tick;
+    // epoll_wait and friends still see EINTR, they already retry
+    action.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &previous);
+
+    sigevent event = {};
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGPROF;
+    if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &timer) != 0) {
+        sigaction(SIGPROF, &previous, nullptr);
+        active_profiler = nullptr;
+        fail("PROFILER", "CANNOT_CREATE_TIMER");
+    }
+
+    set_timer(timer, interval);
+}
+
+Profiler::~Profiler() {
+    timer_delete(timer);
+    sigaction(SIGPROF, &previous, nullptr);
+    profile_ticks = 0;
+    active_profiler = nullptr;
+}
+
+void Profiler::record(const std::string& stack, size_t weight) {
+    std::lock_guard<std::mutex> guard(lock);
+    stacks[stack] += weight;
+    samples += weight;
+}
+
+void Profiler::finish(const std::string& path) {
+    set_timer(timer, 0);
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::vector<std::pair<std::string, size_t>> sorted(stacks.begin(), stacks.end());
+    std::sort(sorted.begin(), sorted.end());
+
+    std::ofstream file(path);
+    if (!file.is_open())
+        fail("PROFILER", "CANNOT_WRITE_PROFILE", "path = '" + path + "'");
+    for (const auto& stack : sorted)
+        file << stack.first << ' ' << stack.second << '\n';
+    file.close();
+
+    // self counts the function at the top of each stack, total every
+    // function in it once, however deep it recurses
+    std::unordered_map<std::string, std::pair<size_t, size_t>> functions;
+    for (const auto& stack : sorted) {
+        std::unordered_set<std::string> seen;
+        size_t start = 0;
+        std::string function;
+        while (true) {
+            size_t end = stack.first.find(';', start);
+            function = function_of(stack.first.substr(start, end - start));
+            if (seen.insert(function).second)
+                functions[function].second += stack.second;
+            if (end == std::string::npos)
+                break;
+            start = end + 1;
+        }
+        functions[function].first += stack.second;
+    }
+
+    std::vector<std::pair<std::string, std::pair<size_t, size_t>>> summary(functions.begin(), functions.end());
+    std::sort(summary.begin(), summary.end(), [](const std::pair<std::string, std::pair<size_t, size_t>>& a,
+            const std::pair<std::string, std::pair<size_t, size_t>>& b) {
+        if (a.second.first != b.second.first)
+            return a.second.first > b.second.first;
+        if (a.second.second != b.second.second)
+            return a.second.second > b.second.second;
+        return a.first < b.first;
+    });
+
+    Output err(2);
+    err << "profile: " << static_cast<long>(samples) << " samples every " << interval << " us, written to "
+        << path << "\n";
+    err << "   self   total  function\n";
+    for (const auto& function : summary) {
+        char percent[32];
+        double total = samples == 0 ? 1 : static_cast<double>(samples);
+        std::snprintf(percent, sizeof(percent), "%6.1f%% %6.1f%%  ", 100.0 * function.second.first / total,
+            100.0 * function.second.second / total);
+        err << percent << function.first << "\n";
+    }
+}
+
+Profiler* Profiler::active() {
+    return active_profiler;
+}
@@ -0,0 +1,168 @@
+#include "lib/purity.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+class PurityChecker {
+private:
+    const std::unordered_map<std::string, const AstFuncDecl*>& candidates;
+    const std::function<GlobalKind(const std::string&)>& global;
+    // names in scope, blocks drop theirs at the end
+    std::vector<std::string> locals;
+
+    bool is_local(const std::string& name) const {
+        return std::find(locals.begin(), locals.end(), name) != locals.end();
+    }
+
+    bool callable(const AstExpr* callee) const {
+        if (callee->get_type() != AstType::NAME)
+            return false;
+        const std::string& name = static_cast<const AstName*>(callee)->value;
+        // a local may hold any func
+        if (is_local(name))
+            return false;
+        return candidates.count(name) != 0 || global(name) == GlobalKind::PURE_FUNCTION;
+    }
+
+    bool readable(const std::string& name) const {
+        return is_local(name) || candidates.count(name) != 0 || global(name) != GlobalKind::OTHER;
+    }
+
+    bool expr(const AstExpr* node) {
+        switch (node->get_type()) {
+            case AstType::NAME:
+                return readable(static_cast<const AstName*>(node)->value);
+            case AstType::UNARY_OP:
+                if (static_cast<const AstUnaryOp*>(node)->type == UnaryOpType::AWAIT)
+                    return false;
+                break;
+            case AstType::FUNC_CALL:
+                if (!callable(static_cast<const AstFuncCall*>(node)->name.get()))
+                    return false;
+                break;
+            default:
+                break;
+        }
+
+        bool result = true;
+        visit_operands(node, [&](const AstExpr* operand) { result = result && expr(operand); });
+        return result;
+    }
+
+    bool block(const std::vector<std::unique_ptr<AstStatement>>& code) {
+        size_t outer = locals.size();
+        bool result = true;
+        for (const auto& statement : code)
+            if (!(result = this->statement(statement.get())))
+                break;
+        locals.resize(outer);
+        return result;
+    }
+
+    bool statement(const AstStatement* node) {
+        switch (node->get_type()) {
+            case AstType::CONST_DECL: {
+                const AstConstDecl* decl = static_cast<const AstConstDecl*>(node);
+                bool result = expr(decl->value.get());
+                locals.push_back(decl->name);
+                return result;
+            }
+            case AstType::VAR_DECL: {
+                const AstVarDecl* decl = static_cast<const AstVarDecl*>(node);
+                bool result = expr(decl->value.get());
+                locals.push_back(decl->name);
+                return result;
+            }
+            case AstType::VAR_SET: {
+                const AstVarSet* set = static_cast<const AstVarSet*>(node);
+                return is_local(set->name) && expr(set->value.get());
+            }
+            case AstType::RETURN:
+                return expr(static_cast<const AstReturn*>(node)->value.get());
+            case AstType::NO_RETURN_EXPR:
+                return expr(static_cast<const AstNoReturnExpr*>(node)->expr.get());
+            case AstType::IF: {
+                const AstIf* branch = static_cast<const AstIf*>(node);
+                return expr(branch->condition.get()) && block(branch->code) && block(branch->else_code);
+            }
+            case AstType::WHILE: {
+                const AstWhile* loop = static_cast<const AstWhile*>(node);
+                return expr(loop->condition.get()) && block(loop->code);
+            }
+            default:
+                return false;
+        }
+    }
+public:
+    PurityChecker(const std::unordered_map<std::string, const AstFuncDecl*>& candidates,
+        const std::function<GlobalKind(const std::string&)>& global)
+    : candidates(candidates), global(global) {}
+
+    bool pure(const AstFuncDecl* func) {
+        if (func->is_async)
+            return false;
+
+        locals.clear();
+        for (const auto& arg : func->required_args)
+            locals.push_back(arg->name);
+        // an optional argument is only visible to the defaults after it
+        for (const auto& arg : func->optional_args) {
+            if (!expr(arg->value.get()))
+                return false;
+            locals.push_back(arg->name);
+        }
+        return block(func->code);
+    }
+};
+
+std::unordered_set<const AstFuncDecl*> pure_functions(const std::vector<const AstFuncDecl*>& funcs,
+        const std::function<GlobalKind(const std::string&)>& global) {
+    std::unordered_map<std::string, const AstFuncDecl*> candidates;
+    for (const AstFuncDecl* func : funcs)
+        candidates[func->name] = func;
+
+    // every func found impure takes its callers along, until none is left
+    PurityChecker checker(candidates, global);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto func = candidates.begin(); func != candidates.end();) {
+            if (checker.pure(func->second)) {
+                ++func;
+            } else {
+                func = candidates.erase(func);
+                changed = true;
+            }
+        }
+    }
+
+    std::unordered_set<const AstFuncDecl*> result;
+    for (const auto& func : candidates)
+        result.insert(func.second);
+    return result;
+}
+
+bool immutable_value(const AstExpr* expr) {
+    switch (expr->get_type()) {
+        case AstType::_NULL:
+        case AstType::INT:
+        case AstType::FLOAT:
+        case AstType::STRING:
+            return true;
+        case AstType::UNARY_OP:
+            if (static_cast<const AstUnaryOp*>(expr)->type == UnaryOpType::AWAIT)
+                return false;
+            break;
+        case AstType::BINARY_OP:
+        case AstType::COMPARISON:
+        case AstType::LOGICAL_OP:
+            break;
+        default:
+            // names could be anything and calls return anything
+            return false;
+    }
+
+    bool result = true;
+    visit_operands(expr, [&](const AstExpr* operand) { result = result && immutable_value(operand); });
+    return result;
+}
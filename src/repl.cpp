@@ -0,0 +1,122 @@
+#include "lib/repl.hpp"
+#include "lib/lexer.hpp"
+#include "lib/parser.hpp"
+#include "lib/output.hpp"
+#include "lib/error.hpp"
+
+#include <iostream>
+#include <unistd.h>
+
+Session::Session(const InterpreterOptions& options, const NativeTable& natives)
+: compiler(natives), interpreter(compiler.target(), options) {}
+
+static bool is_declaration(const std::vector<Token>& tokens) {
+    switch (tokens.front().type) {
+        case TokenType::CONST:
+        case TokenType::VAR:
+        case TokenType::FUNC:
+        case TokenType::ASYNC:
+        case TokenType::IMPORT:
+        case TokenType::AT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// parse(tokens), or parse of tokens with a ; added when only that fails
+template <typename Parse>
+static auto parse_input(std::vector<Token>& tokens, Parse parse) -> decltype(parse(tokens)) {
+    try {
+        return parse(tokens);
+    } catch (const BaskError&) {
+        if (tokens.size() < 2 || tokens[tokens.size() - 2].type == TokenType::SEMI)
+            throw;
+        tokens.insert(tokens.end() - 1, Token(TokenType::SEMI, "", tokens.back().line));
+        try {
+            return parse(tokens);
+        } catch (const BaskError&) {
+        }
+        throw;
+    }
+}
+
+Value Session::evaluate(const std::string& input) {
+    std::vector<Token> tokens = tokenize(input);
+    if (tokens.front().type == TokenType::END)
+        return Value();
+
+    if (is_declaration(tokens)) {
+        AstProgram ast = parse_input(tokens, [](std::vector<Token>& tokens) { return parse(tokens); });
+        interpreter.update(compiler.add_declarations(ast));
+        interpreter.call(Value::function(compiler.input_function()), nullptr, 0);
+        interpreter.settle();
+        return Value();
+    }
+
+    auto statements = parse_input(tokens, [](std::vector<Token>& tokens) { return parse_statements(tokens); });
+    compiler.add_statements(statements);
+    Value result = interpreter.call(Value::function(compiler.input_function()), nullptr, 0);
+    interpreter.settle();
+    return result;
+}
+
+// how many more brackets input opens than it closes
+static long open_brackets(const std::string& input) {
+    long open = 0;
+    try {
+        for (const Token& token : tokenize(input)) {
+            if (token.type == TokenType::LPAREN || token.type == TokenType::LCURLY)
+                open++;
+            else if (token.type == TokenType::RPAREN || token.type == TokenType::RCURLY)
+                open--;
+        }
+    } catch (const BaskError&) {
+        // evaluate reports it
+        return 0;
+    }
+    return open;
+}
+
+int repl(const InterpreterOptions& options) {
+    Session session(options);
+    bool interactive = isatty(0);
+    std::string input;
+    std::string line;
+
+    while (true) {
+        if (interactive) {
+            out() << (input.empty() ? "> " : "... ");
+            out().flush();
+        }
+        // what is still open when the input ends is run as it is
+        bool end = !std::getline(std::cin, line);
+        if (end && input.empty())
+            break;
+
+        if (!end) {
+            input += line + "\n";
+            if (open_brackets(input) > 0)
+                continue;
+        }
+
+        try {
+            Value result = session.evaluate(input);
+            if (result.type != ValueTypes::_NULL) {
+                print_value(out(), result);
+                out() << "\n";
+            }
+        } catch (const BaskError& error) {
+            out().flush();
+            std::cerr << error.what();
+        }
+        out().flush();
+        input.clear();
+        if (end)
+            break;
+    }
+
+    if (interactive)
+        out() << "\n";
+    return 0;
+}
@@ -0,0 +1,358 @@
+#include "bask_format.h"
+
+#include <stdint.h>
+#include <string.h>
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+size_t bask_format_int(long value, char* buffer) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+    unsigned long rest = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+    size_t size;
+
+    while (rest >= 100) {
+        unsigned long pair = (rest % 100) * 2;
+        rest /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+    if (rest >= 10) {
+        *--p = digit_pairs[rest * 2 + 1];
+        *--p = digit_pairs[rest * 2];
+    } else {
+        *--p = (char)('0' + rest);
+    }
+    if (value < 0)
+        *--p = '-';
+
+    size = (size_t)(end - p);
+    memcpy(buffer, p, size);
+    buffer[size] = '\0';
+    return size;
+}
+
+/* GRISU2
+ * Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+ * with Integers". Digits always read back exactly and are the shortest for
+ * all but a tiny fraction of doubles. */
+
+typedef struct {
+    uint64_t f;
+    int e;
+} diy_fp;
+
+#define SIGNIFICAND_BITS 52
+#define HIDDEN_BIT ((uint64_t)1 << SIGNIFICAND_BITS)
+#define SIGNIFICAND_MASK (HIDDEN_BIT - 1)
+
+/* normalized 10^k for k = -348, -340, ..., 340 */
+static const diy_fp cached_powers[] = {
+    {0xFA8FD5A0081C0288ULL, -1220},
+    {0xBAAEE17FA23EBF76ULL, -1193},
+    {0x8B16FB203055AC76ULL, -1166},
+    {0xCF42894A5DCE35EAULL, -1140},
+    {0x9A6BB0AA55653B2DULL, -1113},
+    {0xE61ACF033D1A45DFULL, -1087},
+    {0xAB70FE17C79AC6CAULL, -1060},
+    {0xFF77B1FCBEBCDC4FULL, -1034},
+    {0xBE5691EF416BD60CULL, -1007},
+    {0x8DD01FAD907FFC3CULL, -980},
+    {0xD3515C2831559A83ULL, -954},
+    {0x9D71AC8FADA6C9B5ULL, -927},
+    {0xEA9C227723EE8BCBULL, -901},
+    {0xAECC49914078536DULL, -874},
+    {0x823C12795DB6CE57ULL, -847},
+    {0xC21094364DFB5637ULL, -821},
+    {0x9096EA6F3848984FULL, -794},
+    {0xD77485CB25823AC7ULL, -768},
+    {0xA086CFCD97BF97F4ULL, -741},
+    {0xEF340A98172AACE5ULL, -715},
+    {0xB23867FB2A35B28EULL, -688},
+    {0x84C8D4DFD2C63F3BULL, -661},
+    {0xC5DD44271AD3CDBAULL, -635},
+    {0x936B9FCEBB25C996ULL, -608},
+    {0xDBAC6C247D62A584ULL, -582},
+    {0xA3AB66580D5FDAF6ULL, -555},
+    {0xF3E2F893DEC3F126ULL, -529},
+    {0xB5B5ADA8AAFF80B8ULL, -502},
+    {0x87625F056C7C4A8BULL, -475},
+    {0xC9BCFF6034C13053ULL, -449},
+    {0x964E858C91BA2655ULL, -422},
+    {0xDFF9772470297EBDULL, -396},
+    {0xA6DFBD9FB8E5B88FULL, -369},
+    {0xF8A95FCF88747D94ULL, -343},
+    {0xB94470938FA89BCFULL, -316},
+    {0x8A08F0F8BF0F156BULL, -289},
+    {0xCDB02555653131B6ULL, -263},
+    {0x993FE2C6D07B7FACULL, -236},
+    {0xE45C10C42A2B3B06ULL, -210},
+    {0xAA242499697392D3ULL, -183},
+    {0xFD87B5F28300CA0EULL, -157},
+    {0xBCE5086492111AEBULL, -130},
+    {0x8CBCCC096F5088CCULL, -103},
+    {0xD1B71758E219652CULL, -77},
+    {0x9C40000000000000ULL, -50},
+    {0xE8D4A51000000000ULL, -24},
+    {0xAD78EBC5AC620000ULL, 3},
+    {0x813F3978F8940984ULL, 30},
+    {0xC097CE7BC90715B3ULL, 56},
+    {0x8F7E32CE7BEA5C70ULL, 83},
+    {0xD5D238A4ABE98068ULL, 109},
+    {0x9F4F2726179A2245ULL, 136},
+    {0xED63A231D4C4FB27ULL, 162},
+    {0xB0DE65388CC8ADA8ULL, 189},
+    {0x83C7088E1AAB65DBULL, 216},
+    {0xC45D1DF942711D9AULL, 242},
+    {0x924D692CA61BE758ULL, 269},
+    {0xDA01EE641A708DEAULL, 295},
+    {0xA26DA3999AEF774AULL, 322},
+    {0xF209787BB47D6B85ULL, 348},
+    {0xB454E4A179DD1877ULL, 375},
+    {0x865B86925B9BC5C2ULL, 402},
+    {0xC83553C5C8965D3DULL, 428},
+    {0x952AB45CFA97A0B3ULL, 455},
+    {0xDE469FBD99A05FE3ULL, 481},
+    {0xA59BC234DB398C25ULL, 508},
+    {0xF6C69A72A3989F5CULL, 534},
+    {0xB7DCBF5354E9BECEULL, 561},
+    {0x88FCF317F22241E2ULL, 588},
+    {0xCC20CE9BD35C78A5ULL, 614},
+    {0x98165AF37B2153DFULL, 641},
+    {0xE2A0B5DC971F303AULL, 667},
+    {0xA8D9D1535CE3B396ULL, 694},
+    {0xFB9B7CD9A4A7443CULL, 720},
+    {0xBB764C4CA7A44410ULL, 747},
+    {0x8BAB8EEFB6409C1AULL, 774},
+    {0xD01FEF10A657842CULL, 800},
+    {0x9B10A4E5E9913129ULL, 827},
+    {0xE7109BFBA19C0C9DULL, 853},
+    {0xAC2820D9623BF429ULL, 880},
+    {0x80444B5E7AA7CF85ULL, 907},
+    {0xBF21E44003ACDD2DULL, 933},
+    {0x8E679C2F5E44FF8FULL, 960},
+    {0xD433179D9C8CB841ULL, 986},
+    {0x9E19DB92B4E31BA9ULL, 1013},
+    {0xEB96BF6EBADF77D9ULL, 1039},
+    {0xAF87023B9BF0EE6BULL, 1066}
+};
+
+static diy_fp make_fp(uint64_t f, int e) {
+    diy_fp result;
+    result.f = f;
+    result.e = e;
+    return result;
+}
+
+static diy_fp multiply(diy_fp x, diy_fp y) {
+    const uint64_t mask = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & mask, c = y.f >> 32, d = y.f & mask;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t mid = (bd >> 32) + (ad & mask) + (bc & mask);
+    /* rounds to nearest */
+    mid += (uint64_t)1 << 31;
+    return make_fp(ac + (ad >> 32) + (bc >> 32) + (mid >> 32), x.e + y.e + 64);
+}
+
+static diy_fp normalize(diy_fp x) {
+    while (!(x.f & ((uint64_t)1 << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+static diy_fp cached_power(int e, int* k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    unsigned index;
+
+    if (dk - ik > 0.0)
+        ik++;
+    index = (unsigned)((ik >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+    return cached_powers[index];
+}
+
+static void round_weed(char* buffer, int size, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa
+        && (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buffer[size - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static const uint32_t pow10_32[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static int count_digits(uint32_t n) {
+    int digits = 1;
+    while (digits < 10 && n >= pow10_32[digits])
+        digits++;
+    return digits;
+}
+
+static int generate_digits(diy_fp w, diy_fp mp, uint64_t delta, char* buffer, int* k) {
+    diy_fp one = make_fp((uint64_t)1 << -mp.e, mp.e);
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = count_digits(p1);
+    int size = 0;
+
+    while (kappa > 0) {
+        uint32_t divisor = pow10_32[kappa - 1];
+        uint32_t digit = p1 / divisor;
+        uint64_t rest;
+
+        p1 %= divisor;
+        if (digit != 0 || size != 0)
+            buffer[size++] = (char)('0' + digit);
+        kappa--;
+
+        rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            round_weed(buffer, size, delta, rest, (uint64_t)pow10_32[kappa] << -one.e, wp_w);
+            return size;
+        }
+    }
+
+    while (1) {
+        char digit;
+
+        p2 *= 10;
+        delta *= 10;
+        digit = (char)(p2 >> -one.e);
+        if (digit != 0 || size != 0)
+            buffer[size++] = (char)('0' + digit);
+        p2 &= one.f - 1;
+        kappa--;
+
+        if (p2 < delta) {
+            *k += kappa;
+            round_weed(buffer, size, delta, p2, one.f, -kappa < 10 ? wp_w * pow10_32[-kappa] : 0);
+            return size;
+        }
+    }
+}
+
+/* digits of a positive finite value, which is digits * 10^k */
+static int grisu2(double value, char* buffer, int* k) {
+    uint64_t bits, significand;
+    int biased_exponent;
+    diy_fp v, plus, minus, c_mk, w, wp, wm;
+
+    memcpy(&bits, &value, sizeof(bits));
+    significand = bits & SIGNIFICAND_MASK;
+    biased_exponent = (int)((bits >> SIGNIFICAND_BITS) & 0x7FF);
+    if (biased_exponent != 0)
+        v = make_fp(significand + HIDDEN_BIT, biased_exponent - 1075);
+    else
+        v = make_fp(significand, -1074);
+
+    /* the boundaries halfway to the neighbouring doubles */
+    plus = make_fp((v.f << 1) + 1, v.e - 1);
+    while (!(plus.f & (HIDDEN_BIT << 1))) {
+        plus.f <<= 1;
+        plus.e--;
+    }
+    plus.f <<= 64 - SIGNIFICAND_BITS - 2;
+    plus.e -= 64 - SIGNIFICAND_BITS - 2;
+
+    if (v.f == HIDDEN_BIT)
+        minus = make_fp((v.f << 2) - 1, v.e - 2);
+    else
+        minus = make_fp((v.f << 1) - 1, v.e - 1);
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    c_mk = cached_power(plus.e, k);
+    w = multiply(normalize(v), c_mk);
+    wp = multiply(plus, c_mk);
+    wm = multiply(minus, c_mk);
+    wm.f++;
+    wp.f--;
+
+    return generate_digits(w, wp, wp.f - wm.f, buffer, k);
+}
+
+/* plain notation from 1e-5 up to 1e17, like %.17g but without padding */
+static size_t layout(const char* digits, int size, int k, char* buffer) {
+    int exponent = size + k - 1;
+    size_t at = 0;
+    int i;
+
+    if (exponent >= -5 && exponent < 17) {
+        if (k >= 0) {
+            memcpy(buffer, digits, (size_t)size);
+            at = (size_t)size;
+            for (i = 0; i < k; i++)
+                buffer[at++] = '0';
+        } else if (size + k > 0) {
+            memcpy(buffer, digits, (size_t)(size + k));
+            at = (size_t)(size + k);
+            buffer[at++] = '.';
+            memcpy(buffer + at, digits + size + k, (size_t)-k);
+            at += (size_t)-k;
+        } else {
+            buffer[at++] = '0';
+            buffer[at++] = '.';
+            for (i = 0; i < -(size + k); i++)
+                buffer[at++] = '0';
+            memcpy(buffer + at, digits, (size_t)size);
+            at += (size_t)size;
+        }
+        return at;
+    }
+
+    buffer[at++] = digits[0];
+    if (size > 1) {
+        buffer[at++] = '.';
+        memcpy(buffer + at, digits + 1, (size_t)(size - 1));
+        at += (size_t)(size - 1);
+    }
+    buffer[at++] = 'e';
+    buffer[at++] = exponent < 0 ? '-' : '+';
+    if (exponent < 0)
+        exponent = -exponent;
+    if (exponent >= 100)
+        buffer[at++] = (char)('0' + exponent / 100);
+    buffer[at++] = digit_pairs[(exponent % 100) * 2];
+    buffer[at++] = digit_pairs[(exponent % 100) * 2 + 1];
+    return at;
+}
+
+size_t bask_format_double(double value, char* buffer) {
+    char digits[24];
+    size_t at = 0;
+    int size, k;
+
+    if (value != value) {
+        memcpy(buffer, "nan", 4);
+        return 3;
+    }
+
+    if (value < 0 || (value == 0 && 1 / value < 0)) {
+        buffer[at++] = '-';
+        value = -value;
+    }
+
+    if (value == 0) {
+        buffer[at++] = '0';
+    } else if (value > 1.7976931348623157e308) {
+        memcpy(buffer + at, "inf", 3);
+        at += 3;
+    } else {
+        size = grisu2(value, digits, &k);
+        at += layout(digits, size, k, buffer + at);
+    }
+
+    buffer[at] = '\0';
+    return at;
+}
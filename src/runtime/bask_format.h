@@ -0,0 +1,25 @@
+#ifndef BASK_FORMAT_H
+#define BASK_FORMAT_H
+
+/* Number formatting shared by the interpreter and compiled programs, so
+ * both print the same text for the same value. */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* enough for any long or double with its sign */
+#define BASK_NUMBER_BUFFER 32
+
+size_t bask_format_int(long value, char* buffer);
+
+/* shortest digits that read back as the same double, Grisu2 */
+size_t bask_format_double(double value, char* buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
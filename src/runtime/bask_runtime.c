@@ -0,0 +1,229 @@
+#include "bask_runtime.h"
+#include "bask_format.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BASK_STACK_BYTES (4 << 20)
+
+uintptr_t bask_stack_limit = 0;
+
+void bask_error(const char* error) {
+    fflush(stdout);
+    fprintf(stderr, "ERROR::INTERPRETER::%s\n", error);
+    exit(1);
+}
+
+void bask_init_stack(void) {
+    char probe;
+    bask_stack_limit = (uintptr_t)&probe - BASK_STACK_BYTES;
+}
+
+bask_value bask_call(bask_value callee, const bask_value* args, size_t count) {
+    const bask_function* fn;
+
+    if (callee.type != BASK_FUNC)
+        bask_error("NOT_CALLABLE");
+
+    fn = callee.as.fn;
+    if (fn->optional != BASK_VARIADIC && (count < fn->required || count > fn->required + fn->optional))
+        bask_error("WRONG_ARGUMENT_COUNT");
+
+    return fn->code(args, count);
+}
+
+/* compiled programs are short lived batch jobs, results are never freed */
+bask_value bask_concat(bask_value left, bask_value right) {
+    size_t left_size = strlen(left.as.s);
+    size_t right_size = strlen(right.as.s);
+    char* result = malloc(left_size + right_size + 1);
+
+    if (result == NULL)
+        bask_error("OUT_OF_MEMORY");
+
+    memcpy(result, left.as.s, left_size);
+    memcpy(result + left_size, right.as.s, right_size + 1);
+
+    return bask_string(result);
+}
+
+bask_value bask_arithmetic_slow(int op, bask_value left, bask_value right) {
+    double a, b;
+
+    if (left.type == BASK_INT && right.type == BASK_INT) {
+        /* only overflow and integer division by zero end up here */
+        bask_error(op == BASK_DIV && right.as.i == 0 ? "DIVISION_BY_ZERO" : "INTEGER_OVERFLOW");
+    }
+
+    if (op == BASK_ADD && left.type == BASK_STRING && right.type == BASK_STRING)
+        return bask_concat(left, right);
+
+    if ((left.type != BASK_INT && left.type != BASK_FLOAT)
+        || (right.type != BASK_INT && right.type != BASK_FLOAT))
+        bask_error("TYPE_ERROR");
+
+    a = (left.type == BASK_INT) ? (double)left.as.i : left.as.f;
+    b = (right.type == BASK_INT) ? (double)right.as.i : right.as.f;
+
+    switch (op) {
+        case BASK_ADD:
+            return bask_float(a + b);
+        case BASK_SUB:
+            return bask_float(a - b);
+        case BASK_MULT:
+            return bask_float(a * b);
+        default:
+            return bask_float(a / b);
+    }
+}
+
+bask_value bask_compare_slow(int op, bask_value left, bask_value right) {
+    double a, b;
+
+    if ((left.type == BASK_INT || left.type == BASK_FLOAT) && (right.type == BASK_INT || right.type == BASK_FLOAT)) {
+        /* compared as IEEE does, so nan is unequal to everything */
+        a = (left.type == BASK_INT) ? (double)left.as.i : left.as.f;
+        b = (right.type == BASK_INT) ? (double)right.as.i : right.as.f;
+        switch (op) {
+            case BASK_EQUAL:
+                return bask_int(a == b);
+            case BASK_NOT_EQUAL:
+                return bask_int(a != b);
+            case BASK_LESS:
+                return bask_int(a < b);
+            case BASK_LESS_EQUAL:
+                return bask_int(a <= b);
+            case BASK_GREATER:
+                return bask_int(a > b);
+            default:
+                return bask_int(a >= b);
+        }
+    }
+
+    if (left.type == BASK_STRING && right.type == BASK_STRING)
+        return bask_int(bask_holds(op, strcmp(left.as.s, right.as.s)));
+
+    if (op != BASK_EQUAL && op != BASK_NOT_EQUAL)
+        bask_error("TYPE_ERROR");
+
+    if (left.type != right.type)
+        return bask_int(op == BASK_NOT_EQUAL);
+    /* null, or the same function */
+    return bask_int((left.type == BASK_NULL || left.as.fn == right.as.fn) == (op == BASK_EQUAL));
+}
+
+static void print_value(bask_value value) {
+    char number[BASK_NUMBER_BUFFER];
+
+    switch (value.type) {
+        case BASK_NULL:
+            fputs("null", stdout);
+            break;
+        case BASK_INT:
+            fwrite(number, 1, bask_format_int(value.as.i, number), stdout);
+            break;
+        case BASK_FLOAT:
+            fwrite(number, 1, bask_format_double(value.as.f, number), stdout);
+            break;
+        case BASK_STRING:
+            fputs(value.as.s, stdout);
+            break;
+        case BASK_FUNC:
+            fputs(value.as.fn->optional == BASK_VARIADIC ? "<native func>" : "<func>", stdout);
+            break;
+    }
+}
+
+static bask_value builtin_print(const bask_value* args, size_t count) {
+    size_t i;
+    for (i = 0; i < count; i++)
+        print_value(args[i]);
+    return bask_null();
+}
+
+static bask_value builtin_three(const bask_value* args, size_t count) {
+    (void)args;
+    (void)count;
+    return bask_int(3);
+}
+
+static bask_value builtin_exit(const bask_value* args, size_t count) {
+    if (count != 1 || args[0].type != BASK_INT) {
+        fflush(stdout);
+        fputs("ERROR::BUILTINS::EXIT_EXPECTS_INT\n", stderr);
+        exit(1);
+    }
+    exit((int)args[0].as.i);
+}
+
+/* compiled programs are single threaded, spawn runs the task right away and
+ * keeps its result until it is joined */
+typedef struct {
+    bask_value result;
+    int joined;
+} task_slot;
+
+static task_slot* tasks = NULL;
+static size_t task_count = 0;
+
+static bask_value builtin_spawn(const bask_value* args, size_t count) {
+    bask_value result;
+
+    if (count < 1)
+        bask_error("WRONG_ARGUMENT_COUNT");
+
+    result = bask_call(args[0], args + 1, count - 1);
+
+    tasks = realloc(tasks, (task_count + 1) * sizeof(task_slot));
+    if (tasks == NULL)
+        bask_error("OUT_OF_MEMORY");
+    tasks[task_count].result = result;
+    tasks[task_count].joined = 0;
+    task_count++;
+
+    return bask_int((long)task_count);
+}
+
+static bask_value builtin_join(const bask_value* args, size_t count) {
+    task_slot* task;
+
+    if (count != 1)
+        bask_error("WRONG_ARGUMENT_COUNT");
+    if (args[0].type != BASK_INT || args[0].as.i < 1 || (size_t)args[0].as.i > task_count
+        || tasks[args[0].as.i - 1].joined)
+        bask_error("UNKNOWN_TASK");
+
+    task = &tasks[args[0].as.i - 1];
+    task->joined = 1;
+
+    return task->result;
+}
+
+static bask_value builtin_parallel_map(const bask_value* args, size_t count) {
+    bask_value result = bask_null();
+    bask_value index;
+    long i;
+
+    if (count != 2)
+        bask_error("WRONG_ARGUMENT_COUNT");
+    if (args[1].type != BASK_INT) {
+        fflush(stdout);
+        fputs("ERROR::BUILTINS::ARGUMENT_TYPE\n", stderr);
+        exit(1);
+    }
+
+    for (i = 0; i < args[1].as.i; i++) {
+        index = bask_int(i);
+        result = (i == 0) ? bask_call(args[0], &index, 1) : bask_add(result, bask_call(args[0], &index, 1));
+    }
+
+    return result;
+}
+
+const bask_function bask_builtin_print = {"print", 0, BASK_VARIADIC, builtin_print};
+const bask_function bask_builtin_three = {"three", 0, BASK_VARIADIC, builtin_three};
+const bask_function bask_builtin_exit = {"exit", 0, BASK_VARIADIC, builtin_exit};
+const bask_function bask_builtin_spawn = {"spawn", 0, BASK_VARIADIC, builtin_spawn};
+const bask_function bask_builtin_join = {"join", 0, BASK_VARIADIC, builtin_join};
+const bask_function bask_builtin_parallel_map = {"parallel_map", 0, BASK_VARIADIC, builtin_parallel_map};
@@ -0,0 +1,193 @@
+#ifndef BASK_RUNTIME_H
+#define BASK_RUNTIME_H
+
+/* Runtime for programs translated by `bask --emit-c`. */
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    BASK_NULL,
+    BASK_INT,
+    BASK_FLOAT,
+    BASK_STRING,
+    BASK_FUNC,
+} bask_type;
+
+typedef struct bask_value bask_value;
+typedef struct bask_function bask_function;
+
+typedef bask_value (*bask_code)(const bask_value* args, size_t count);
+
+struct bask_value {
+    bask_type type;
+    union {
+        long i;
+        double f;
+        const char* s;
+        const bask_function* fn;
+    } as;
+};
+
+/* builtins accept any number of arguments and check them themselves */
+#define BASK_VARIADIC ((size_t)-1)
+
+struct bask_function {
+    const char* name;
+    size_t required;
+    size_t optional;
+    bask_code code;
+};
+
+extern const bask_function bask_builtin_print;
+extern const bask_function bask_builtin_three;
+extern const bask_function bask_builtin_exit;
+extern const bask_function bask_builtin_spawn;
+extern const bask_function bask_builtin_join;
+extern const bask_function bask_builtin_parallel_map;
+
+extern uintptr_t bask_stack_limit;
+
+void bask_error(const char* error);
+
+void bask_init_stack(void);
+
+bask_value bask_call(bask_value callee, const bask_value* args, size_t count);
+
+bask_value bask_concat(bask_value left, bask_value right);
+
+bask_value bask_arithmetic_slow(int op, bask_value left, bask_value right);
+
+bask_value bask_compare_slow(int op, bask_value left, bask_value right);
+
+static inline bask_value bask_null(void) {
+    bask_value value;
+    value.type = BASK_NULL;
+    value.as.i = 0;
+    return value;
+}
+
+static inline bask_value bask_int(long i) {
+    bask_value value;
+    value.type = BASK_INT;
+    value.as.i = i;
+    return value;
+}
+
+static inline bask_value bask_float(double f) {
+    bask_value value;
+    value.type = BASK_FLOAT;
+    value.as.f = f;
+    return value;
+}
+
+static inline bask_value bask_string(const char* s) {
+    bask_value value;
+    value.type = BASK_STRING;
+    value.as.s = s;
+    return value;
+}
+
+static inline bask_value bask_func(const bask_function* fn) {
+    bask_value value;
+    value.type = BASK_FUNC;
+    value.as.fn = fn;
+    return value;
+}
+
+#define BASK_CHECK_STACK() do { \
+        char bask_probe; \
+        if ((uintptr_t)&bask_probe < bask_stack_limit) \
+            bask_error("STACK_OVERFLOW"); \
+    } while (0)
+
+enum { BASK_ADD, BASK_SUB, BASK_MULT, BASK_DIV };
+
+/* there are no big ints here, an int that overflows is an error */
+static inline bask_value bask_add(bask_value left, bask_value right) {
+    long result;
+    if (left.type == BASK_INT && right.type == BASK_INT && !__builtin_add_overflow(left.as.i, right.as.i, &result))
+        return bask_int(result);
+    return bask_arithmetic_slow(BASK_ADD, left, right);
+}
+
+static inline bask_value bask_sub(bask_value left, bask_value right) {
+    long result;
+    if (left.type == BASK_INT && right.type == BASK_INT && !__builtin_sub_overflow(left.as.i, right.as.i, &result))
+        return bask_int(result);
+    return bask_arithmetic_slow(BASK_SUB, left, right);
+}
+
+static inline bask_value bask_mult(bask_value left, bask_value right) {
+    long result;
+    if (left.type == BASK_INT && right.type == BASK_INT && !__builtin_mul_overflow(left.as.i, right.as.i, &result))
+        return bask_int(result);
+    return bask_arithmetic_slow(BASK_MULT, left, right);
+}
+
+static inline bask_value bask_div(bask_value left, bask_value right) {
+    if (left.type == BASK_INT && right.type == BASK_INT && right.as.i != 0
+        && (right.as.i != -1 || left.as.i != LONG_MIN))
+        return bask_int(left.as.i / right.as.i);
+    return bask_arithmetic_slow(BASK_DIV, left, right);
+}
+
+static inline bask_value bask_pos(bask_value value) {
+    if (value.type != BASK_INT && value.type != BASK_FLOAT)
+        bask_error("TYPE_ERROR");
+    return value;
+}
+
+static inline bask_value bask_neg(bask_value value) {
+    if (value.type == BASK_INT) {
+        if (value.as.i == LONG_MIN)
+            bask_error("INTEGER_OVERFLOW");
+        return bask_int(-value.as.i);
+    }
+    if (value.type == BASK_FLOAT)
+        return bask_float(-value.as.f);
+    bask_error("TYPE_ERROR");
+    return value;
+}
+
+/* null, int 0 and float 0.0 are false */
+static inline int bask_truthy(bask_value value) {
+    switch (value.type) {
+        case BASK_NULL:
+            return 0;
+        case BASK_INT:
+            return value.as.i != 0;
+        case BASK_FLOAT:
+            return value.as.f != 0.0;
+        default:
+            return 1;
+    }
+}
+
+enum { BASK_EQUAL, BASK_NOT_EQUAL, BASK_LESS, BASK_LESS_EQUAL, BASK_GREATER, BASK_GREATER_EQUAL };
+
+static inline int bask_holds(int op, int order) {
+    switch (op) {
+        case BASK_EQUAL:
+            return order == 0;
+        case BASK_NOT_EQUAL:
+            return order != 0;
+        case BASK_LESS:
+            return order < 0;
+        case BASK_LESS_EQUAL:
+            return order <= 0;
+        case BASK_GREATER:
+            return order > 0;
+        default:
+            return order >= 0;
+    }
+}
+
+static inline bask_value bask_compare(int op, bask_value left, bask_value right) {
+    if (left.type == BASK_INT && right.type == BASK_INT)
+        return bask_int(bask_holds(op, (left.as.i > right.as.i) - (left.as.i < right.as.i)));
+    return bask_compare_slow(op, left, right);
+}
+
+#endif
@@ -0,0 +1,258 @@
+#include "lib/scheduler.hpp"
+#include "lib/interpreter.hpp"
+#include "lib/error.hpp"
+
+// parallel_map always splits into at most this many chunks, so how results
+// are grouped before adding does not depend on the number of threads
+const long PARALLEL_MAP_CHUNKS = 64;
+
+static thread_local const Scheduler* worker_scheduler = nullptr;
+static thread_local size_t worker_queue = 0;
+
+Scheduler::Scheduler(const Program& program, const std::vector<Value>& globals, const InterpreterOptions& options)
+: program(program), queued(0), stopping(false), next_handle(1) {
+    size_t count = options.threads;
+    if (count == 0)
+        count = std::thread::hardware_concurrency();
+    if (count == 0)
+        count = 1;
+
+    for (size_t i = 0; i < count; i++)
+        queues.emplace_back(new Queue());
+
+    // every queue gets its own interpreter and copies, strings are counted
+    // per thread, and the creating thread runs tasks on the one for queue 0
+    // rather than on its own globals
+    for (size_t i = 0; i < count; i++) {
+        std::unique_ptr<Interpreter> interpreter(new Interpreter(program, options));
+        for (size_t j = 0; j < globals.size(); j++) {
+            if (!program.globals[j].constant)
+                continue;
+            interpreter->globals[j] = isolate(globals[j]);
+            freeze(interpreter->globals[j]);
+        }
+        interpreter->initialized = true;
+        interpreter->task_depth = 1;
+        interpreter->scheduler = this;
+        interpreters.push_back(std::move(interpreter));
+    }
+
+    for (size_t i = 1; i < count; i++)
+        threads.emplace_back(&Scheduler::work, this, i);
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& thread : threads)
+        thread.join();
+}
+
+size_t Scheduler::own_queue() const {
+    return worker_scheduler == this ? worker_queue : 0;
+}
+
+void Scheduler::push(std::shared_ptr<Task> task) {
+    Queue& queue = *queues[own_queue()];
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+std::shared_ptr<Task> Scheduler::take() {
+    if (queued.load() == 0)
+        return nullptr;
+
+    size_t self = own_queue();
+    std::shared_ptr<Task> task;
+
+    {
+        Queue& queue = *queues[self];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+
+    for (size_t i = 1; task == nullptr && i < queues.size(); i++) {
+        Queue& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+
+    if (task != nullptr)
+        queued--;
+
+    return task;
+}
+
+void Scheduler::run_task(Interpreter& interpreter, Task& task) {
+    interpreter.task_depth++;
+
+    try {
+        Value result;
+        if (task.map) {
+            for (long i = task.begin; i < task.end; i++) {
+                Value index = Value::integer(i);
+                Value value = interpreter.call(task.callee, &index, 1);
+                result = (i == task.begin) ? value : arithmetic(OpCode::ADD, result, value);
+            }
+        } else {
+            result = interpreter.call(task.callee, task.args.data(), task.args.size());
+        }
+        task.result = isolate(result);
+    } catch (const ScriptExit& exit) {
+        task.state = TaskState::EXIT;
+        task.exit_code = exit.code;
+    } catch (const LimitError& error) {
+        task.state = TaskState::ERROR;
+        task.error = error.what();
+        task.limit = error.limit;
+    } catch (const BaskError& error) {
+        task.state = TaskState::ERROR;
+        task.error = error.what();
+    }
+
+    interpreter.task_depth--;
+    task.args.clear();
+
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        task.done = true;
+    }
+    wake.notify_all();
+}
+
+void Scheduler::wait_for(Task& task) {
+    Interpreter& interpreter = *interpreters[own_queue()];
+
+    while (!task.done) {
+        std::shared_ptr<Task> other = take();
+        if (other != nullptr) {
+            run_task(interpreter, *other);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idle_lock);
+        wake.wait(lock, [&]() { return task.done || queued.load() != 0; });
+    }
+}
+
+Value Scheduler::finish(Task& task) {
+    if (task.state == TaskState::EXIT)
+        throw ScriptExit(task.exit_code);
+    if (task.state == TaskState::ERROR && task.limit != Limit::NONE)
+        throw LimitError(task.limit, task.error);
+    if (task.state == TaskState::ERROR)
+        throw BaskError(task.error);
+
+    // moved out so only this thread ever counts the result
+    return std::move(task.result);
+}
+
+void Scheduler::work(size_t index) {
+    worker_scheduler = this;
+    worker_queue = index;
+    Interpreter& interpreter = *interpreters[index];
+
+    while (true) {
+        std::shared_ptr<Task> task = take();
+        if (task != nullptr) {
+            run_task(interpreter, *task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idle_lock);
+        wake.wait(lock, [&]() { return stopping || queued.load() != 0; });
+        if (stopping)
+            return;
+    }
+}
+
+long Scheduler::spawn(const Value& callee, const Value* args, size_t count) {
+    if (callee.type != ValueTypes::FUNC && callee.type != ValueTypes::NATIVE_FUNC)
+        fail("INTERPRETER", "NOT_CALLABLE");
+
+    std::shared_ptr<Task> task = std::make_shared<Task>();
+    task->callee = callee;
+    for (size_t i = 0; i < count; i++)
+        task->args.push_back(isolate(args[i]));
+
+    long handle;
+    {
+        std::lock_guard<std::mutex> guard(handles_lock);
+        handle = next_handle++;
+        handles[handle] = task;
+    }
+
+    push(std::move(task));
+
+    return handle;
+}
+
+Value Scheduler::join(long handle) {
+    std::shared_ptr<Task> task;
+    {
+        std::lock_guard<std::mutex> guard(handles_lock);
+        auto found = handles.find(handle);
+        if (found == handles.end())
+            fail("INTERPRETER", "UNKNOWN_TASK", "handle = " + std::to_string(handle));
+        task = std::move(found->second);
+        handles.erase(found);
+    }
+
+    wait_for(*task);
+
+    return finish(*task);
+}
+
+Value Scheduler::parallel_map(const Value& callee, long count) {
+    if (callee.type != ValueTypes::FUNC && callee.type != ValueTypes::NATIVE_FUNC)
+        fail("INTERPRETER", "NOT_CALLABLE");
+    if (count <= 0)
+        return Value();
+
+    long chunks = count < PARALLEL_MAP_CHUNKS ? count : PARALLEL_MAP_CHUNKS;
+    std::vector<std::shared_ptr<Task>> tasks;
+
+    for (long i = 0; i < chunks; i++) {
+        std::shared_ptr<Task> task = std::make_shared<Task>();
+        task->callee = callee;
+        task->map = true;
+        task->begin = count * i / chunks;
+        task->end = count * (i + 1) / chunks;
+        tasks.push_back(task);
+        push(std::move(task));
+    }
+
+    // every chunk finishes before any error is reported
+    for (auto& task : tasks)
+        wait_for(*task);
+
+    Value result;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        Value value = finish(*tasks[i]);
+        result = (i == 0) ? value : arithmetic(OpCode::ADD, result, value);
+    }
+
+    return result;
+}
+
+void Scheduler::add_stats(ExecutionStats& stats) const {
+    for (const auto& interpreter : interpreters)
+        stats.add(interpreter->execution_stats());
+}
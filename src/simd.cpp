@@ -0,0 +1,552 @@
+#include "lib/simd.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BASK_SIMD_X86 1
+#else
+#define BASK_SIMD_X86 0
+#endif
+
+// SCALAR
+
+// int kernels wrap like the vector instructions do instead of overflowing
+static long wrap_add(long a, long b) {
+    return static_cast<long>(static_cast<unsigned long>(a) + static_cast<unsigned long>(b));
+}
+
+static long wrap_sub(long a, long b) {
+    return static_cast<long>(static_cast<unsigned long>(a) - static_cast<unsigned long>(b));
+}
+
+static long wrap_mul(long a, long b) {
+    return static_cast<long>(static_cast<unsigned long>(a) * static_cast<unsigned long>(b));
+}
+
+static void add_floats_scalar(const double* a, const double* b, double* out, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        out[i] = a[i] + b[i];
+}
+
+static void sub_floats_scalar(const double* a, const double* b, double* out, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        out[i] = a[i] - b[i];
+}
+
+static void mul_floats_scalar(const double* a, const double* b, double* out, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        out[i] = a[i] * b[i];
+}
+
+static void div_floats_scalar(const double* a, const double* b, double* out, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        out[i] = a[i] / b[i];
+}
+
+// Float sums keep PARTIALS running sums, element i going into sum i % 8,
+// and add those up in one fixed order. Every kernel set does exactly these
+// additions, only more of them at once, so results never depend on which
+// one runs.
+const size_t PARTIALS = 8;
+
+// adds the elements from i on into partials, then partials together
+static double finish_sum(double* partials, const double* a, size_t i, size_t size) {
+    for (; i < size; i++)
+        partials[i % PARTIALS] += a[i];
+    double low = (partials[0] + partials[4]) + (partials[1] + partials[5]);
+    double high = (partials[2] + partials[6]) + (partials[3] + partials[7]);
+    return low + high;
+}
+
+static double finish_dot(double* partials, const double* a, const double* b, size_t i, size_t size) {
+    for (; i < size; i++)
+        partials[i % PARTIALS] += a[i] * b[i];
+    return finish_sum(partials, a, size, size);
+}
+
+static double sum_floats_scalar(const double* a, size_t size) {
+    double partials[PARTIALS] = {};
+    return finish_sum(partials, a, 0, size);
+}
+
+// written as the vector min and max compare, so NaNs come out the same way
+static double min_floats_scalar(const double* a, size_t size) {
+    double min = a[0];
+    for (size_t i = 1; i < size; i++)
+        min = a[i] < min ? a[i] : min;
+    return min;
+}
+
+static double max_floats_scalar(const double* a, size_t size) {
+    double max = a[0];
+    for (size_t i = 1; i < size; i++)
+        max = a[i] > max ? a[i] : max;
+    return max;
+}
+
+static double dot_floats_scalar(const double* a, const double* b, size_t size) {
+    double partials[PARTIALS] = {};
+    return finish_dot(partials, a, b, 0, size);
+}
+
+static void scaled_add_floats_scalar(const double* a, const double* b, double scale, double* out, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        out[i] = a[i] + scale * b[i];
+}
+
+static void add_ints_scalar(const long* a, const long* b, long* out, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        out[i] = wrap_add(a[i], b[i]);
+}
+
+static void sub_ints_scalar(const long* a, const long* b, long* out, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        out[i] = wrap_sub(a[i], b[i]);
+}
+
+static void mul_ints_scalar(const long* a, const long* b, long* out, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        out[i] = wrap_mul(a[i], b[i]);
+}
+
+static long sum_ints_scalar(const long* a, size_t size) {
+    long sum = 0;
+    for (size_t i = 0; i < size; i++)
+        sum = wrap_add(sum, a[i]);
+    return sum;
+}
+
+static long min_ints_scalar(const long* a, size_t size) {
+    long min = a[0];
+    for (size_t i = 1; i < size; i++)
+        min = a[i] < min ? a[i] : min;
+    return min;
+}
+
+static long max_ints_scalar(const long* a, size_t size) {
+    long max = a[0];
+    for (size_t i = 1; i < size; i++)
+        max = a[i] > max ? a[i] : max;
+    return max;
+}
+
+static long dot_ints_scalar(const long* a, const long* b, size_t size) {
+    long sum = 0;
+    for (size_t i = 0; i < size; i++)
+        sum = wrap_add(sum, wrap_mul(a[i], b[i]));
+    return sum;
+}
+
+static void scaled_add_ints_scalar(const long* a, const long* b, long scale, long* out, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        out[i] = wrap_add(a[i], wrap_mul(scale, b[i]));
+}
+
+static const ArrayKernels SCALAR_KERNELS = {
+    "scalar",
+    add_floats_scalar, sub_floats_scalar, mul_floats_scalar, div_floats_scalar,
+    sum_floats_scalar, min_floats_scalar, max_floats_scalar, dot_floats_scalar, scaled_add_floats_scalar,
+    add_ints_scalar, sub_ints_scalar, mul_ints_scalar,
+    sum_ints_scalar, min_ints_scalar, max_ints_scalar, dot_ints_scalar, scaled_add_ints_scalar,
+};
+
+#if BASK_SIMD_X86
+
+// SSE2, two lanes, always there on x86-64
+
+// the low 64 bits of a * b per lane, from 32 bit multiplies
+static inline __m128i mul_lanes_sse2(__m128i a, __m128i b) {
+    __m128i low = _mm_mul_epu32(a, b);
+    __m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b), _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+    return _mm_add_epi64(low, _mm_slli_epi64(cross, 32));
+}
+
+static void add_floats_sse2(const double* a, const double* b, double* out, size_t size) {
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2)
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    add_floats_scalar(a + i, b + i, out + i, size - i);
+}
+
+static void sub_floats_sse2(const double* a, const double* b, double* out, size_t size) {
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2)
+        _mm_storeu_pd(out + i, _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    sub_floats_scalar(a + i, b + i, out + i, size - i);
+}
+
+static void mul_floats_sse2(const double* a, const double* b, double* out, size_t size) {
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2)
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    mul_floats_scalar(a + i, b + i, out + i, size - i);
+}
+
+static void div_floats_sse2(const double* a, const double* b, double* out, size_t size) {
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2)
+        _mm_storeu_pd(out + i, _mm_div_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    div_floats_scalar(a + i, b + i, out + i, size - i);
+}
+
+// the partial sums two at a time
+static double sum_floats_sse2(const double* a, size_t size) {
+    __m128d sums[PARTIALS / 2];
+    for (__m128d& sum : sums)
+        sum = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + PARTIALS <= size; i += PARTIALS)
+        for (size_t j = 0; j < PARTIALS / 2; j++)
+            sums[j] = _mm_add_pd(sums[j], _mm_loadu_pd(a + i + 2 * j));
+    double partials[PARTIALS];
+    for (size_t j = 0; j < PARTIALS / 2; j++)
+        _mm_storeu_pd(partials + 2 * j, sums[j]);
+    return finish_sum(partials, a, i, size);
+}
+
+static double min_floats_sse2(const double* a, size_t size) {
+    __m128d min = _mm_set1_pd(a[0]);
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2)
+        min = _mm_min_pd(_mm_loadu_pd(a + i), min);
+    double lanes[2];
+    _mm_storeu_pd(lanes, min);
+    double result = min_floats_scalar(lanes, 2);
+    for (; i < size; i++)
+        result = a[i] < result ? a[i] : result;
+    return result;
+}
+
+static double max_floats_sse2(const double* a, size_t size) {
+    __m128d max = _mm_set1_pd(a[0]);
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2)
+        max = _mm_max_pd(_mm_loadu_pd(a + i), max);
+    double lanes[2];
+    _mm_storeu_pd(lanes, max);
+    double result = max_floats_scalar(lanes, 2);
+    for (; i < size; i++)
+        result = a[i] > result ? a[i] : result;
+    return result;
+}
+
+static double dot_floats_sse2(const double* a, const double* b, size_t size) {
+    __m128d sums[PARTIALS / 2];
+    for (__m128d& sum : sums)
+        sum = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + PARTIALS <= size; i += PARTIALS)
+        for (size_t j = 0; j < PARTIALS / 2; j++)
+            sums[j] = _mm_add_pd(sums[j], _mm_mul_pd(_mm_loadu_pd(a + i + 2 * j), _mm_loadu_pd(b + i + 2 * j)));
+    double partials[PARTIALS];
+    for (size_t j = 0; j < PARTIALS / 2; j++)
+        _mm_storeu_pd(partials + 2 * j, sums[j]);
+    return finish_dot(partials, a, b, i, size);
+}
+
+static void scaled_add_floats_sse2(const double* a, const double* b, double scale, double* out, size_t size) {
+    __m128d factor = _mm_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2)
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_mul_pd(factor, _mm_loadu_pd(b + i))));
+    scaled_add_floats_scalar(a + i, b + i, scale, out + i, size - i);
+}
+
+static void add_ints_sse2(const long* a, const long* b, long* out, size_t size) {
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi64(x, y));
+    }
+    add_ints_scalar(a + i, b + i, out + i, size - i);
+}
+
+static void sub_ints_sse2(const long* a, const long* b, long* out, size_t size) {
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_sub_epi64(x, y));
+    }
+    sub_ints_scalar(a + i, b + i, out + i, size - i);
+}
+
+static void mul_ints_sse2(const long* a, const long* b, long* out, size_t size) {
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), mul_lanes_sse2(x, y));
+    }
+    mul_ints_scalar(a + i, b + i, out + i, size - i);
+}
+
+static long sum_ints_sse2(const long* a, size_t size) {
+    __m128i sum = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2)
+        sum = _mm_add_epi64(sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+    long lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+    return wrap_add(wrap_add(lanes[0], lanes[1]), sum_ints_scalar(a + i, size - i));
+}
+
+static long dot_ints_sse2(const long* a, const long* b, size_t size) {
+    __m128i sum = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        sum = _mm_add_epi64(sum, mul_lanes_sse2(x, y));
+    }
+    long lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+    return wrap_add(wrap_add(lanes[0], lanes[1]), dot_ints_scalar(a + i, b + i, size - i));
+}
+
+static void scaled_add_ints_sse2(const long* a, const long* b, long scale, long* out, size_t size) {
+    __m128i factor = _mm_set1_epi64x(scale);
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi64(x, mul_lanes_sse2(factor, y)));
+    }
+    scaled_add_ints_scalar(a + i, b + i, scale, out + i, size - i);
+}
+
+// SSE2 has no 64 bit compare, min and max of ints stay scalar
+static const ArrayKernels SSE2_KERNELS = {
+    "sse2",
+    add_floats_sse2, sub_floats_sse2, mul_floats_sse2, div_floats_sse2,
+    sum_floats_sse2, min_floats_sse2, max_floats_sse2, dot_floats_sse2, scaled_add_floats_sse2,
+    add_ints_sse2, sub_ints_sse2, mul_ints_sse2,
+    sum_ints_sse2, min_ints_scalar, max_ints_scalar, dot_ints_sse2, scaled_add_ints_sse2,
+};
+
+// AVX2, four lanes, compiled for it here and only called once the CPU
+// says it has it
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i load_ints(const long* a) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+}
+
+AVX2 static inline void store_ints(long* out, __m256i value) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), value);
+}
+
+AVX2 static inline __m256i mul_lanes_avx2(__m256i a, __m256i b) {
+    __m256i low = _mm256_mul_epu32(a, b);
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+        _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+}
+
+AVX2 static long add_lanes(__m256i value) {
+    long lanes[4];
+    store_ints(lanes, value);
+    return wrap_add(wrap_add(lanes[0], lanes[1]), wrap_add(lanes[2], lanes[3]));
+}
+
+AVX2 static void add_floats_avx2(const double* a, const double* b, double* out, size_t size) {
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    add_floats_scalar(a + i, b + i, out + i, size - i);
+}
+
+AVX2 static void sub_floats_avx2(const double* a, const double* b, double* out, size_t size) {
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        _mm256_storeu_pd(out + i, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    sub_floats_scalar(a + i, b + i, out + i, size - i);
+}
+
+AVX2 static void mul_floats_avx2(const double* a, const double* b, double* out, size_t size) {
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    mul_floats_scalar(a + i, b + i, out + i, size - i);
+}
+
+AVX2 static void div_floats_avx2(const double* a, const double* b, double* out, size_t size) {
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        _mm256_storeu_pd(out + i, _mm256_div_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    div_floats_scalar(a + i, b + i, out + i, size - i);
+}
+
+// the partial sums four at a time, two adds in flight
+AVX2 static double sum_floats_avx2(const double* a, size_t size) {
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + PARTIALS <= size; i += PARTIALS) {
+        sum0 = _mm256_add_pd(sum0, _mm256_loadu_pd(a + i));
+        sum1 = _mm256_add_pd(sum1, _mm256_loadu_pd(a + i + 4));
+    }
+    double partials[PARTIALS];
+    _mm256_storeu_pd(partials, sum0);
+    _mm256_storeu_pd(partials + 4, sum1);
+    return finish_sum(partials, a, i, size);
+}
+
+AVX2 static double min_floats_avx2(const double* a, size_t size) {
+    __m256d min = _mm256_set1_pd(a[0]);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        min = _mm256_min_pd(_mm256_loadu_pd(a + i), min);
+    double lanes[4];
+    _mm256_storeu_pd(lanes, min);
+    double result = min_floats_scalar(lanes, 4);
+    for (; i < size; i++)
+        result = a[i] < result ? a[i] : result;
+    return result;
+}
+
+AVX2 static double max_floats_avx2(const double* a, size_t size) {
+    __m256d max = _mm256_set1_pd(a[0]);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        max = _mm256_max_pd(_mm256_loadu_pd(a + i), max);
+    double lanes[4];
+    _mm256_storeu_pd(lanes, max);
+    double result = max_floats_scalar(lanes, 4);
+    for (; i < size; i++)
+        result = a[i] > result ? a[i] : result;
+    return result;
+}
+
+AVX2 static double dot_floats_avx2(const double* a, const double* b, size_t size) {
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + PARTIALS <= size; i += PARTIALS) {
+        sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    double partials[PARTIALS];
+    _mm256_storeu_pd(partials, sum0);
+    _mm256_storeu_pd(partials + 4, sum1);
+    return finish_dot(partials, a, b, i, size);
+}
+
+AVX2 static void scaled_add_floats_avx2(const double* a, const double* b, double scale, double* out, size_t size) {
+    __m256d factor = _mm256_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_mul_pd(factor, _mm256_loadu_pd(b + i))));
+    scaled_add_floats_scalar(a + i, b + i, scale, out + i, size - i);
+}
+
+AVX2 static void add_ints_avx2(const long* a, const long* b, long* out, size_t size) {
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        store_ints(out + i, _mm256_add_epi64(load_ints(a + i), load_ints(b + i)));
+    add_ints_scalar(a + i, b + i, out + i, size - i);
+}
+
+AVX2 static void sub_ints_avx2(const long* a, const long* b, long* out, size_t size) {
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        store_ints(out + i, _mm256_sub_epi64(load_ints(a + i), load_ints(b + i)));
+    sub_ints_scalar(a + i, b + i, out + i, size - i);
+}
+
+AVX2 static void mul_ints_avx2(const long* a, const long* b, long* out, size_t size) {
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        store_ints(out + i, mul_lanes_avx2(load_ints(a + i), load_ints(b + i)));
+    mul_ints_scalar(a + i, b + i, out + i, size - i);
+}
+
+AVX2 static long sum_ints_avx2(const long* a, size_t size) {
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        sum = _mm256_add_epi64(sum, load_ints(a + i));
+    return wrap_add(add_lanes(sum), sum_ints_scalar(a + i, size - i));
+}
+
+AVX2 static long min_ints_avx2(const long* a, size_t size) {
+    __m256i min = _mm256_set1_epi64x(a[0]);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m256i x = load_ints(a + i);
+        min = _mm256_blendv_epi8(min, x, _mm256_cmpgt_epi64(min, x));
+    }
+    long lanes[4];
+    store_ints(lanes, min);
+    long result = min_ints_scalar(lanes, 4);
+    for (; i < size; i++)
+        result = a[i] < result ? a[i] : result;
+    return result;
+}
+
+AVX2 static long max_ints_avx2(const long* a, size_t size) {
+    __m256i max = _mm256_set1_epi64x(a[0]);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m256i x = load_ints(a + i);
+        max = _mm256_blendv_epi8(max, x, _mm256_cmpgt_epi64(x, max));
+    }
+    long lanes[4];
+    store_ints(lanes, max);
+    long result = max_ints_scalar(lanes, 4);
+    for (; i < size; i++)
+        result = a[i] > result ? a[i] : result;
+    return result;
+}
+
+AVX2 static long dot_ints_avx2(const long* a, const long* b, size_t size) {
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        sum = _mm256_add_epi64(sum, mul_lanes_avx2(load_ints(a + i), load_ints(b + i)));
+    return wrap_add(add_lanes(sum), dot_ints_scalar(a + i, b + i, size - i));
+}
+
+AVX2 static void scaled_add_ints_avx2(const long* a, const long* b, long scale, long* out, size_t size) {
+    __m256i factor = _mm256_set1_epi64x(scale);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        store_ints(out + i, _mm256_add_epi64(load_ints(a + i), mul_lanes_avx2(factor, load_ints(b + i))));
+    scaled_add_ints_scalar(a + i, b + i, scale, out + i, size - i);
+}
+
+static const ArrayKernels AVX2_KERNELS = {
+    "avx2",
+    add_floats_avx2, sub_floats_avx2, mul_floats_avx2, div_floats_avx2,
+    sum_floats_avx2, min_floats_avx2, max_floats_avx2, dot_floats_avx2, scaled_add_floats_avx2,
+    add_ints_avx2, sub_ints_avx2, mul_ints_avx2,
+    sum_ints_avx2, min_ints_avx2, max_ints_avx2, dot_ints_avx2, scaled_add_ints_avx2,
+};
+
+#endif
+
+static const ArrayKernels* select_kernels() {
+    // the kernel sets from the widest down, each allowed unless BASK_SIMD
+    // names a narrower one
+    const char* cap = std::getenv("BASK_SIMD");
+    bool allowed = cap == nullptr;
+
+#if BASK_SIMD_X86
+    __builtin_cpu_init();
+    allowed = allowed || std::strcmp(cap, "avx2") == 0;
+    if (allowed && __builtin_cpu_supports("avx2"))
+        return &AVX2_KERNELS;
+    allowed = allowed || std::strcmp(cap, "sse2") == 0;
+    if (allowed)
+        return &SSE2_KERNELS;
+#endif
+
+    return &SCALAR_KERNELS;
+}
+
+const ArrayKernels& array_kernels() {
+    static const ArrayKernels* kernels = select_kernels();
+    return *kernels;
+}
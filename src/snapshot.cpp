@@ -0,0 +1,537 @@
+#include "lib/snapshot.hpp"
+#include "lib/native.hpp"
+#include "lib/bigint.hpp"
+#include "lib/array.hpp"
+#include "lib/map.hpp"
+#include "lib/error.hpp"
+
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char SNAPSHOT_MAGIC[8] = {'B', 'A', 'S', 'K', 'I', 'M', 'G', '\0'};
+const char MODULE_MAGIC[8] = {'B', 'A', 'S', 'K', 'M', 'O', 'D', '\0'};
+// bumped whenever the layout below or the opcodes change
+const uint32_t SNAPSHOT_VERSION = 7;
+
+static_assert(std::is_trivially_copyable<Instruction>::value, "code is stored as raw instructions");
+
+// WRITING
+
+class ImageWriter {
+public:
+    std::string out;
+
+    void bytes(const void* data, size_t size) {
+        out.append(static_cast<const char*>(data), size);
+        // keeps every field 8 byte aligned in the mapping
+        out.append((8 - size % 8) % 8, '\0');
+    }
+
+    void u64(uint64_t value) {
+        bytes(&value, sizeof(value));
+    }
+
+    void string(const char* data, size_t size) {
+        u64(size);
+        bytes(data, size);
+    }
+
+    void string(const std::string& value) {
+        string(value.data(), value.size());
+    }
+
+    void value(const Value& value) {
+        u64(static_cast<uint64_t>(value.type));
+
+        switch (value.type) {
+            case ValueTypes::_NULL:
+                break;
+            case ValueTypes::INT:
+                u64(static_cast<uint64_t>(value.int_value));
+                break;
+            case ValueTypes::FLOAT:
+                bytes(&value.float_value, sizeof(value.float_value));
+                break;
+            case ValueTypes::STRING:
+                string(string_data(value), string_size(value));
+                break;
+            case ValueTypes::FUNC:
+                u64(value.func_value);
+                break;
+            case ValueTypes::NATIVE_FUNC:
+                string(value.native_value->name);
+                break;
+            case ValueTypes::BIG_INT:
+                u64(value.big_value->negative);
+                u64(value.big_value->size);
+                bytes(value.big_value->limbs(), value.big_value->size * sizeof(uint32_t));
+                break;
+            case ValueTypes::ARRAY:
+                u64(static_cast<uint64_t>(value.array_value->kind));
+                u64(value.array_value->size);
+                bytes(value.array_value->ints(), value.array_value->size * sizeof(double));
+                break;
+            case ValueTypes::MAP:
+                u64(value.map_value->size);
+                map_for_each(value.map_value, [this](const Value& key, const Value& value) {
+                    this->value(key);
+                    this->value(value);
+                });
+                break;
+        }
+    }
+
+    // constants, globals holding the given values, then functions
+    void program(const Program& program, const std::vector<Value>& globals) {
+        u64(program.constants.size());
+        for (const Value& constant : program.constants)
+            value(constant);
+
+        u64(program.globals.size());
+        for (size_t i = 0; i < program.globals.size(); i++) {
+            string(program.globals[i].name);
+            u64(program.globals[i].constant);
+            value(globals[i]);
+        }
+
+        u64(program.functions.size());
+        for (const Function& function : program.functions) {
+            string(function.name);
+            u64(function.required_args);
+            u64(function.optional_args);
+            u64(function.locals);
+            u64(function.max_stack);
+            u64(function.is_async);
+            u64(function.pure);
+            u64(function.memo);
+            u64(function.precompile);
+            u64(function.entries.size());
+            for (size_t entry : function.entries)
+                u64(entry);
+            u64(function.code.size());
+            bytes(function.code.data(), function.code.size() * sizeof(Instruction));
+            u64(function.lines.size());
+            for (const auto& line : function.lines) {
+                u64(line.first);
+                u64(static_cast<uint64_t>(line.second));
+            }
+        }
+    }
+
+    void save(const std::string& path) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+            fail("SNAPSHOT", "CANNOT_WRITE_IMAGE", "path = '" + path + "'");
+        file.write(out.data(), out.size());
+        if (!file)
+            fail("SNAPSHOT", "CANNOT_WRITE_IMAGE", "path = '" + path + "'");
+    }
+};
+
+void write_snapshot(const std::string& path, const Program& program, const std::vector<Value>& globals) {
+    ImageWriter image;
+
+    image.bytes(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    image.u64(SNAPSHOT_VERSION);
+    image.u64(static_cast<uint64_t>(program.main));
+    image.program(program, globals);
+    image.save(path);
+}
+
+void write_module_image(const std::string& path, const CompiledModule& module) {
+    ImageWriter image;
+
+    image.bytes(MODULE_MAGIC, sizeof(MODULE_MAGIC));
+    image.u64(SNAPSHOT_VERSION);
+    image.u64(static_cast<uint64_t>(module.program.main));
+    image.u64(module.natives);
+    image.u64(module.declared);
+    image.u64(module.externs.size());
+    for (const auto& external : module.externs) {
+        image.u64(external.first);
+        image.u64(external.second);
+    }
+
+    std::vector<Value> globals;
+    for (const Global& global : module.program.globals)
+        globals.push_back(global.value);
+    image.program(module.program, globals);
+    image.save(path);
+}
+
+// READING
+
+class ImageReader {
+private:
+    const char* data;
+    size_t size;
+    size_t offset;
+    Program& program;
+    std::unordered_map<std::string, const Native*> natives;
+public:
+    ImageReader(const char* data, size_t size, Program& program, const NativeTable& table)
+    : data(data), size(size), offset(0), program(program) {
+        for (const Native& native : table)
+            natives[native.name] = &native;
+    }
+
+    const char* bytes(size_t count) {
+        size_t padded = count + (8 - count % 8) % 8;
+        if (padded < count || padded > size - offset)
+            fail("SNAPSHOT", "CORRUPT_IMAGE");
+        const char* result = data + offset;
+        offset += padded;
+        return result;
+    }
+
+    uint64_t u64() {
+        uint64_t value;
+        std::memcpy(&value, bytes(sizeof(value)), sizeof(value));
+        return value;
+    }
+
+    std::string string() {
+        uint64_t length = u64();
+        return std::string(bytes(length), length);
+    }
+
+    Value value() {
+        switch (static_cast<ValueTypes>(u64())) {
+            case ValueTypes::_NULL:
+                return Value();
+            case ValueTypes::INT:
+                return Value::integer(static_cast<long>(u64()));
+            case ValueTypes::FLOAT: {
+                double value;
+                std::memcpy(&value, bytes(sizeof(value)), sizeof(value));
+                return Value::floating(value);
+            }
+            case ValueTypes::STRING: {
+                uint64_t length = u64();
+                const char* chars = bytes(length);
+                if (length <= SMALL_STRING_SIZE)
+                    return Value::string(chars, length);
+                // owned by the program like the literals of a compiled one
+                StringObject* object = new_string_object(chars, length);
+                object->immortal = true;
+                program.objects.push_back(object);
+                Value string = Value::string(object);
+                hash_value(string);
+                return string;
+            }
+            case ValueTypes::FUNC:
+                return Value::function(u64());
+            case ValueTypes::NATIVE_FUNC: {
+                std::string name = string();
+                auto native = natives.find(name);
+                if (native == natives.end())
+                    fail("SNAPSHOT", "UNKNOWN_NATIVE", "name = '" + name + "'");
+                return Value::native(native->second);
+            }
+            case ValueTypes::BIG_INT: {
+                bool negative = u64() != 0;
+                uint64_t size = u64();
+                if (size > this->size / sizeof(uint32_t))
+                    fail("SNAPSHOT", "CORRUPT_IMAGE");
+                std::vector<uint32_t> limbs(size);
+                std::memcpy(limbs.data(), bytes(size * sizeof(uint32_t)), size * sizeof(uint32_t));
+                Value value = big_int(negative, limbs.data(), limbs.size());
+                if (value.type == ValueTypes::BIG_INT) {
+                    value.big_value->immortal = true;
+                    value.counted = false;
+                    program.objects.push_back(value.big_value);
+                }
+                return value;
+            }
+            case ValueTypes::ARRAY: {
+                // arrays change in place, so they stay counted and every
+                // interpreter copies them out of the program
+                uint64_t kind = u64();
+                uint64_t size = u64();
+                if (kind > static_cast<uint64_t>(ArrayKinds::FLOAT) || size > this->size / sizeof(double))
+                    fail("SNAPSHOT", "CORRUPT_IMAGE");
+                Value value = new_array(static_cast<ArrayKinds>(kind), size);
+                std::memcpy(value.array_value->ints(), bytes(size * sizeof(double)), size * sizeof(double));
+                return value;
+            }
+            case ValueTypes::MAP: {
+                // counted and copied out like arrays, every entry takes at
+                // least two words
+                uint64_t count = u64();
+                if (count > this->size / 16)
+                    fail("SNAPSHOT", "CORRUPT_IMAGE");
+                Value map = new_map(count);
+                for (uint64_t i = 0; i < count; i++) {
+                    Value key = value();
+                    if (!is_hashable(key))
+                        fail("SNAPSHOT", "CORRUPT_IMAGE");
+                    map_set(map.map_value, key, value());
+                }
+                return map;
+            }
+        }
+        fail("SNAPSHOT", "CORRUPT_IMAGE");
+    }
+
+    // Every index an instruction holds must be one the program has and
+    // every path must keep the stack inside max_stack and end in a return,
+    // so the engines can trust the code as if they had compiled it.
+    void check_code(const Function& function) {
+        size_t code = function.code.size();
+        if (function.entries.size() != function.optional_args + 1
+                || function.required_args + function.optional_args > function.locals
+                || function.locals > function.max_stack || function.max_stack > UINT_MAX)
+            fail("SNAPSHOT", "CORRUPT_IMAGE");
+
+        // depth of the stack above the locals before each instruction, -1
+        // until some path reaches it
+        std::vector<long> depths(code, -1);
+        std::vector<size_t> pending;
+        auto reach = [&](size_t ip, long depth) {
+            if (ip >= code || (depths[ip] != -1 && depths[ip] != depth))
+                fail("SNAPSHOT", "CORRUPT_IMAGE");
+            if (depths[ip] == -1) {
+                depths[ip] = depth;
+                pending.push_back(ip);
+            }
+        };
+        for (size_t entry : function.entries)
+            reach(entry, 0);
+
+        long room = static_cast<long>(function.max_stack - function.locals);
+        while (!pending.empty()) {
+            size_t ip = pending.back();
+            pending.pop_back();
+            const Instruction& instruction = function.code[ip];
+            long arg = instruction.arg;
+            long depth = depths[ip];
+            long pops = 0;
+            long pushes = 0;
+            bool next = true;
+
+            switch (instruction.op) {
+                case OpCode::PUSH_CONST:
+                    if (arg < 0 || static_cast<size_t>(arg) >= program.constants.size())
+                        fail("SNAPSHOT", "CORRUPT_IMAGE");
+                    pushes = 1;
+                    break;
+                case OpCode::GET_LOCAL:
+                case OpCode::SET_LOCAL:
+                    if (arg < 0 || static_cast<size_t>(arg) >= function.locals)
+                        fail("SNAPSHOT", "CORRUPT_IMAGE");
+                    (instruction.op == OpCode::GET_LOCAL ? pushes : pops) = 1;
+                    break;
+                case OpCode::GET_GLOBAL:
+                case OpCode::SET_GLOBAL:
+                    if (arg < 0 || static_cast<size_t>(arg) >= program.globals.size())
+                        fail("SNAPSHOT", "CORRUPT_IMAGE");
+                    (instruction.op == OpCode::GET_GLOBAL ? pushes : pops) = 1;
+                    break;
+                case OpCode::CALL_NATIVE:
+                    if (arg < 0 || static_cast<size_t>(arg) >= program.globals.size())
+                        fail("SNAPSHOT", "CORRUPT_IMAGE");
+                    pops = instruction.count;
+                    pushes = 1;
+                    break;
+                case OpCode::CALL:
+                case OpCode::TAIL_CALL:
+                    if (arg < 0 || arg >= room)
+                        fail("SNAPSHOT", "CORRUPT_IMAGE");
+                    pops = arg + 1;
+                    pushes = 1;
+                    next = instruction.op == OpCode::CALL;
+                    break;
+                case OpCode::MAKE_MAP:
+                    if (arg < 0 || arg > room / 2)
+                        fail("SNAPSHOT", "CORRUPT_IMAGE");
+                    pops = 2 * arg;
+                    pushes = 1;
+                    break;
+                case OpCode::JUMP:
+                case OpCode::JUMP_IF_FALSE:
+                case OpCode::JUMP_IF_TRUE:
+                    if (arg < 0 || static_cast<size_t>(arg) >= code)
+                        fail("SNAPSHOT", "CORRUPT_IMAGE");
+                    pops = instruction.op == OpCode::JUMP ? 0 : 1;
+                    next = instruction.op != OpCode::JUMP;
+                    if (depth >= pops)
+                        reach(arg, depth - pops);
+                    break;
+                case OpCode::ADD_LOCAL:
+                    if (instruction.count >= function.locals)
+                        fail("SNAPSHOT", "CORRUPT_IMAGE");
+                    break;
+                case OpCode::PUSH_NULL:
+                case OpCode::PUSH_INT:
+                    pushes = 1;
+                    break;
+                case OpCode::POP:
+                case OpCode::ADD:
+                case OpCode::SUB:
+                case OpCode::MULT:
+                case OpCode::DIV:
+                case OpCode::EQUAL:
+                case OpCode::NOT_EQUAL:
+                case OpCode::LESS:
+                case OpCode::LESS_EQUAL:
+                case OpCode::GREATER:
+                case OpCode::GREATER_EQUAL:
+                    pops = instruction.op == OpCode::POP ? 1 : 2;
+                    pushes = instruction.op == OpCode::POP ? 0 : 1;
+                    break;
+                case OpCode::RETURN:
+                    pops = 1;
+                    next = false;
+                    break;
+                case OpCode::POS:
+                case OpCode::NEG:
+                case OpCode::AWAIT:
+                case OpCode::NOT:
+                    pops = 1;
+                    pushes = 1;
+                    break;
+                default:
+                    fail("SNAPSHOT", "CORRUPT_IMAGE");
+            }
+
+            if (depth < pops || depth - pops + pushes > room)
+                fail("SNAPSHOT", "CORRUPT_IMAGE");
+            if (next)
+                reach(ip + 1, depth - pops + pushes);
+        }
+    }
+
+    void program_body() {
+        uint64_t constants = u64();
+        for (uint64_t i = 0; i < constants; i++)
+            program.constants.push_back(value());
+
+        uint64_t globals = u64();
+        for (uint64_t i = 0; i < globals; i++) {
+            std::string name = string();
+            bool constant = u64() != 0;
+            program.globals.emplace_back(std::move(name), constant, value());
+        }
+
+        uint64_t functions = u64();
+        for (uint64_t i = 0; i < functions; i++) {
+            std::string name = string();
+            size_t required_args = u64();
+            size_t optional_args = u64();
+            program.functions.emplace_back(std::move(name), required_args, optional_args);
+
+            Function& function = program.functions.back();
+            function.locals = u64();
+            function.max_stack = u64();
+            function.is_async = u64() != 0;
+            function.pure = u64() != 0;
+            function.memo = u64() != 0;
+            function.precompile = u64() != 0;
+            uint64_t entries = u64();
+            for (uint64_t j = 0; j < entries; j++)
+                function.entries.push_back(u64());
+            uint64_t code = u64();
+            if (code == 0 || code > size / sizeof(Instruction))
+                fail("SNAPSHOT", "CORRUPT_IMAGE");
+            const char* instructions = bytes(code * sizeof(Instruction));
+            function.code.resize(code, Instruction(OpCode::RETURN));
+            std::memcpy(function.code.data(), instructions, code * sizeof(Instruction));
+            check_code(function);
+            uint64_t lines = u64();
+            for (uint64_t j = 0; j < lines; j++) {
+                size_t ip = u64();
+                function.lines.emplace_back(ip, static_cast<int>(u64()));
+            }
+        }
+
+        for (const Global& global : program.globals)
+            if (global.value.type == ValueTypes::FUNC && global.value.func_value >= program.functions.size())
+                fail("SNAPSHOT", "CORRUPT_IMAGE");
+    }
+
+    void read() {
+        if (std::memcmp(bytes(sizeof(SNAPSHOT_MAGIC)), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+            fail("SNAPSHOT", "NOT_AN_IMAGE");
+        if (u64() != SNAPSHOT_VERSION)
+            fail("SNAPSHOT", "WRONG_VERSION");
+        program.main = static_cast<long>(u64());
+        program_body();
+
+        if (program.main < 0 || static_cast<size_t>(program.main) >= program.functions.size())
+            fail("SNAPSHOT", "CORRUPT_IMAGE");
+        program.initialized = true;
+    }
+
+    void read_module(CompiledModule& module) {
+        if (std::memcmp(bytes(sizeof(MODULE_MAGIC)), MODULE_MAGIC, sizeof(MODULE_MAGIC)) != 0)
+            fail("SNAPSHOT", "NOT_AN_IMAGE");
+        if (u64() != SNAPSHOT_VERSION)
+            fail("SNAPSHOT", "WRONG_VERSION");
+        program.main = static_cast<long>(u64());
+        module.natives = u64();
+        module.declared = u64();
+        uint64_t externs = u64();
+        if (externs > size / 16)
+            fail("SNAPSHOT", "CORRUPT_IMAGE");
+        for (uint64_t i = 0; i < externs; i++) {
+            size_t import = u64();
+            module.externs.emplace_back(import, u64());
+        }
+        program_body();
+
+        if (program.main >= static_cast<long>(program.functions.size())
+                || module.natives + module.declared + externs != program.globals.size())
+            fail("SNAPSHOT", "CORRUPT_IMAGE");
+    }
+};
+
+// maps the file at path for read
+template <typename Read>
+static void read_image(const std::string& path, Read read) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        fail("SNAPSHOT", "CANNOT_OPEN_IMAGE", "path = '" + path + "'");
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        fail("SNAPSHOT", "NOT_AN_IMAGE");
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        fail("SNAPSHOT", "CANNOT_OPEN_IMAGE", "path = '" + path + "'");
+
+    try {
+        read(static_cast<const char*>(mapping), size);
+    } catch (...) {
+        munmap(mapping, size);
+        throw;
+    }
+    munmap(mapping, size);
+}
+
+Program read_snapshot(const std::string& path, const NativeTable& natives) {
+    Program program;
+    read_image(path, [&](const char* data, size_t size) {
+        ImageReader(data, size, program, natives).read();
+    });
+    return program;
+}
+
+CompiledModule read_module_image(const std::string& path, const NativeTable& natives) {
+    CompiledModule module;
+    read_image(path, [&](const char* data, size_t size) {
+        ImageReader(data, size, module.program, natives).read_module(module);
+    });
+    return module;
+}
@@ -0,0 +1,240 @@
+#include "lib/stats.hpp"
+
+#include <atomic>
+#include <cstdio>
+
+static std::atomic<size_t> allocated(0);
+
+size_t allocated_bytes() {
+    return allocated.load(std::memory_order_relaxed);
+}
+
+void count_allocation(size_t bytes) {
+    BASK_COUNT(allocated.fetch_add(bytes, std::memory_order_relaxed));
+    (void) bytes;
+}
+
+static const char* const TOKEN_TYPE_NAMES[TOKEN_TYPE_COUNT] = {
+    "END", "ID", "VAR", "CONST", "FUNC", "RETURN", "ASYNC", "AWAIT", "IMPORT", "IF", "ELSE", "WHILE", "NULL",
+    "INT", "FLOAT", "STRING", "EQUAL", "SEMI", "COMA", "PLUS", "MINUS", "MULTIPLY", "DIVIDE", "LPAREN", "RPAREN",
+    "LCURLY", "RCURLY", "COLON", "DOUBLE_EQUAL", "NOT_EQUAL", "LESS", "LESS_EQUAL", "GREATER", "GREATER_EQUAL",
+    "AND", "OR", "NOT", "AT",
+};
+
+static const char* const AST_TYPE_NAMES[AST_TYPE_COUNT] = {
+    "NULL", "INT", "FLOAT", "STRING", "NAME", "UNARY_OP", "BINARY_OP", "FUNC_CALL", "MAP", "COMPARISON",
+    "LOGICAL_OP", "CONST_DECL", "VAR_DECL", "VAR_SET", "RETURN", "NO_RETURN_EXPR", "IF", "WHILE",
+    "GLOBAL_CONST_DECL", "GLOBAL_VAR_DECL", "FUNC_DECL", "IMPORT",
+};
+
+static const char* const OP_CODE_NAMES[OP_CODE_COUNT] = {
+    "PUSH_NULL", "PUSH_INT", "PUSH_CONST", "GET_LOCAL", "SET_LOCAL", "GET_GLOBAL", "SET_GLOBAL", "POP",
+    "POS", "NEG", "ADD", "SUB", "MULT", "DIV", "CALL", "CALL_NATIVE", "TAIL_CALL", "RETURN", "AWAIT",
+    "MAKE_MAP", "EQUAL", "NOT_EQUAL", "LESS", "LESS_EQUAL", "GREATER", "GREATER_EQUAL", "NOT", "JUMP",
+    "JUMP_IF_FALSE", "JUMP_IF_TRUE", "ADD_LOCAL",
+};
+
+ExecutionStats::ExecutionStats()
+: ops(), calls(0), native_calls(0), peak_frames(0), peak_stack(0), jit_functions(0), jit_seconds(0),
+  memo_functions(0), memo_lookups(0), memo_hits(0) {}
+
+void ExecutionStats::add(const ExecutionStats& other) {
+    for (size_t i = 0; i < OP_CODE_COUNT; i++)
+        ops[i] += other.ops[i];
+    calls += other.calls;
+    native_calls += other.native_calls;
+    // the interpreters have stacks of their own, the deepest one is the peak
+    if (other.peak_frames > peak_frames)
+        peak_frames = other.peak_frames;
+    if (other.peak_stack > peak_stack)
+        peak_stack = other.peak_stack;
+    jit_functions += other.jit_functions;
+    jit_seconds += other.jit_seconds;
+    memo_functions += other.memo_functions;
+    memo_lookups += other.memo_lookups;
+    memo_hits += other.memo_hits;
+}
+
+Stats::Stats()
+: tokens(), nodes(), modules_compiled(0), modules_cached(0), profiled_functions(0), stale_profiles(0),
+  inlined_calls(0), precompiled_functions(0) {}
+
+void Stats::count_tokens(const std::vector<Token>& tokens) {
+    for (const Token& token : tokens)
+        this->tokens[static_cast<size_t>(token.type)]++;
+}
+
+static void count_node(size_t* nodes, const AstNode* node) {
+    nodes[static_cast<size_t>(node->get_type())]++;
+
+    switch (node->get_type()) {
+        case AstType::UNARY_OP:
+            return count_node(nodes, static_cast<const AstUnaryOp*>(node)->value.get());
+        case AstType::BINARY_OP: {
+            const AstBinaryOp* op = static_cast<const AstBinaryOp*>(node);
+            count_node(nodes, op->left.get());
+            return count_node(nodes, op->right.get());
+        }
+        case AstType::COMPARISON: {
+            const AstComparison* comparison = static_cast<const AstComparison*>(node);
+            count_node(nodes, comparison->left.get());
+            return count_node(nodes, comparison->right.get());
+        }
+        case AstType::LOGICAL_OP: {
+            const AstLogicalOp* op = static_cast<const AstLogicalOp*>(node);
+            count_node(nodes, op->left.get());
+            return count_node(nodes, op->right.get());
+        }
+        case AstType::FUNC_CALL: {
+            const AstFuncCall* call = static_cast<const AstFuncCall*>(node);
+            count_node(nodes, call->name.get());
+            for (const auto& arg : call->args)
+                count_node(nodes, arg.get());
+            return;
+        }
+        case AstType::MAP:
+            for (const auto& entry : static_cast<const AstMap*>(node)->entries) {
+                count_node(nodes, entry.first.get());
+                count_node(nodes, entry.second.get());
+            }
+            return;
+        case AstType::CONST_DECL:
+            return count_node(nodes, static_cast<const AstConstDecl*>(node)->value.get());
+        case AstType::VAR_DECL:
+            return count_node(nodes, static_cast<const AstVarDecl*>(node)->value.get());
+        case AstType::VAR_SET:
+            return count_node(nodes, static_cast<const AstVarSet*>(node)->value.get());
+        case AstType::RETURN:
+            return count_node(nodes, static_cast<const AstReturn*>(node)->value.get());
+        case AstType::NO_RETURN_EXPR:
+            return count_node(nodes, static_cast<const AstNoReturnExpr*>(node)->expr.get());
+        case AstType::IF: {
+            const AstIf* branch = static_cast<const AstIf*>(node);
+            count_node(nodes, branch->condition.get());
+            for (const auto& statement : branch->code)
+                count_node(nodes, statement.get());
+            for (const auto& statement : branch->else_code)
+                count_node(nodes, statement.get());
+            return;
+        }
+        case AstType::WHILE: {
+            const AstWhile* loop = static_cast<const AstWhile*>(node);
+            count_node(nodes, loop->condition.get());
+            for (const auto& statement : loop->code)
+                count_node(nodes, statement.get());
+            return;
+        }
+        case AstType::GLOBAL_CONST_DECL:
+            return count_node(nodes, static_cast<const AstGlobalConstDecl*>(node)->value.get());
+        case AstType::GLOBAL_VAR_DECL:
+            return count_node(nodes, static_cast<const AstGlobalVarDecl*>(node)->value.get());
+        case AstType::FUNC_DECL: {
+            const AstFuncDecl* func = static_cast<const AstFuncDecl*>(node);
+            for (const auto& arg : func->required_args)
+                count_node(nodes, arg.get());
+            for (const auto& arg : func->optional_args)
+                count_node(nodes, arg.get());
+            for (const auto& statement : func->code)
+                count_node(nodes, statement.get());
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+void Stats::count_nodes(const AstProgram& ast) {
+    for (const auto& declaration : ast.code)
+        count_node(nodes, declaration.get());
+}
+
+// "  NAME count" for every nonzero count
+static void print_counts(Output& output, const char* title, const size_t* counts, const char* const* names,
+        size_t size) {
+    output << title << "\n";
+    for (size_t i = 0; i < size; i++)
+        if (counts[i] != 0)
+            output << "  " << names[i] << " " << static_cast<long>(counts[i]) << "\n";
+}
+
+void Stats::print(Output& output) const {
+    output << "phase          ms      bytes\n";
+    for (const PhaseStats& phase : phases) {
+        char line[96];
+        std::snprintf(line, sizeof(line), "%-8s %8.3f %10zu\n", phase.name.c_str(), phase.seconds * 1000, phase.bytes);
+        output << line;
+    }
+    if (execution.jit_functions != 0) {
+        char line[96];
+        std::snprintf(line, sizeof(line), "%-8s %8.3f %10s  (%zu functions, part of run)\n", "jit",
+            execution.jit_seconds * 1000, "-", execution.jit_functions);
+        output << line;
+    }
+
+    if (execution.memo_lookups != 0) {
+        char line[96];
+        std::snprintf(line, sizeof(line), "memo %zu of %zu calls cached (%.1f%%) in %zu functions\n",
+            execution.memo_hits, execution.memo_lookups, 100.0 * execution.memo_hits / execution.memo_lookups,
+            execution.memo_functions);
+        output << line;
+    }
+
+    if (modules_compiled + modules_cached != 0)
+        output << "modules " << static_cast<long>(modules_compiled) << " compiled, "
+            << static_cast<long>(modules_cached) << " cached\n";
+
+    if (profiled_functions + stale_profiles != 0)
+        output << "profile " << static_cast<long>(profiled_functions) << " functions, "
+            << static_cast<long>(stale_profiles) << " stale, " << static_cast<long>(inlined_calls)
+            << " calls inlined, " << static_cast<long>(precompiled_functions) << " precompiled\n";
+
+    print_counts(output, "tokens", tokens, TOKEN_TYPE_NAMES, TOKEN_TYPE_COUNT);
+    print_counts(output, "nodes", nodes, AST_TYPE_NAMES, AST_TYPE_COUNT);
+#if BASK_STATS
+    print_counts(output, "ops", execution.ops, OP_CODE_NAMES, OP_CODE_COUNT);
+    output << "calls " << static_cast<long>(execution.calls) << "\n";
+    output << "native calls " << static_cast<long>(execution.native_calls) << "\n";
+    output << "peak frames " << static_cast<long>(execution.peak_frames) << "\n";
+    output << "peak stack " << static_cast<long>(execution.peak_stack) << "\n";
+#else
+    (void) OP_CODE_NAMES;
+    output << "execution counters were left out of this build\n";
+#endif
+}
+
+void Stats::split_last(const std::vector<PhaseStats>& parts) {
+    PhaseStats& whole = phases.back();
+    for (const PhaseStats& part : parts) {
+        whole.seconds -= part.seconds;
+        whole.bytes -= part.bytes;
+    }
+    phases.insert(phases.end(), parts.begin(), parts.end());
+}
+
+PhaseTimer::PhaseTimer(Stats* stats, std::string name)
+: stats(stats), name(std::move(name)), start(std::chrono::steady_clock::now()), start_bytes(allocated_bytes()) {}
+
+PhaseTimer::~PhaseTimer() {
+    stop();
+}
+
+void PhaseTimer::stop() {
+    if (stats == nullptr)
+        return;
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stats->phases.emplace_back(name, elapsed.count(), allocated_bytes() - start_bytes);
+    stats = nullptr;
+}
+
+PhaseSpan::PhaseSpan(PhaseStats* phase)
+: phase(phase), start(std::chrono::steady_clock::now()), start_bytes(allocated_bytes()) {}
+
+PhaseSpan::~PhaseSpan() {
+    if (phase == nullptr)
+        return;
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    phase->seconds += elapsed.count();
+    phase->bytes += allocated_bytes() - start_bytes;
+}
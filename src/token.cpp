@@ -1,24 +1,24 @@
 #include "lib/token.hpp"
+#include "lib/output.hpp"
 
-#include <iostream>
 #include <utility>
 
-Token::Token(TokenType type, std::string value)
-: type(type), value(std::move(value)) {}
+Token::Token(TokenType type, std::string value, int line)
+: type(type), value(std::move(value)), line(line) {}
 
 void Token::print() const {
-    std::cout << "(" << static_cast<unsigned short>(type);
+    out() << "(" << static_cast<unsigned short>(type);
     if (value != "")
-        std::cout << ", " << value;
-    std::cout << ")";
+        out() << ", " << value;
+    out() << ")";
 }
 
 void print_tokens(const std::vector<Token>& tokens) {
-    std::cout << "[";
+    out() << "[";
     for (size_t i = 0; i < tokens.size(); i++) {
         tokens.at(i).print();
         if (i != (tokens.size() - 1))
-            std::cout << ", ";
+            out() << ", ";
     }
-    std::cout << "]\n";
+    out() << "]\n";
 }
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "lib/value.hpp"
+#include "lib/output.hpp"
+#include "lib/stats.hpp"
+#include "lib/limits.hpp"
+#include "lib/bigint.hpp"
+#include "lib/array.hpp"
+#include "lib/map.hpp"
+#include "lib/error.hpp"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// shorter concatenations are copied, longer ones become rope nodes
+const size_t ROPE_MIN_SIZE = 256;
+// ropes make long strings cheap to build, but they have to fit in memory
+// once something flattens them
+const size_t MAX_STRING_SIZE = static_cast<size_t>(1) << 32;
+
+static StringObject* allocate_string(size_t size, bool flat) {
+    size_t bytes = sizeof(StringObject) + (flat ? size + 1 : 0);
+    StringObject* object = static_cast<StringObject*>(std::malloc(bytes));
+    if (object == nullptr)
+        fail("INTERPRETER", "STRING_TOO_LARGE", "size = " + std::to_string(size));
+    heap_allocated(bytes);
+    BASK_COUNT(count_allocation(bytes));
+    object->refs = 1;
+    object->type = ObjectTypes::STRING;
+    object->immortal = false;
+    object->frozen = false;
+    object->size = size;
+    object->left = nullptr;
+    object->right = nullptr;
+    object->hash = 0;
+    return object;
+}
+
+StringObject* new_string_object(const char* data, size_t size) {
+    StringObject* object = allocate_string(size, true);
+    std::memcpy(object->data(), data, size);
+    object->data()[size] = '\0';
+    return object;
+}
+
+// what the allocation of a string, array or big int took
+static size_t object_bytes(Object* object) {
+    switch (object->type) {
+        case ObjectTypes::STRING: {
+            StringObject* string = static_cast<StringObject*>(object);
+            return sizeof(StringObject) + (string->is_flat() ? string->size + 1 : 0);
+        }
+        case ObjectTypes::ARRAY:
+            return sizeof(ArrayObject) + static_cast<ArrayObject*>(object)->size * sizeof(double);
+        case ObjectTypes::BIG_INT:
+            return sizeof(BigIntObject) + static_cast<BigIntObject*>(object)->size * sizeof(uint32_t);
+        default:
+            return 0;
+    }
+}
+
+void destroy_object(Object* object) {
+    if (object->type == ObjectTypes::MAP)
+        return destroy_map(static_cast<MapObject*>(object));
+    if (object->type != ObjectTypes::STRING) {
+        heap_freed(object_bytes(object));
+        return std::free(object);
+    }
+
+    // ropes can be deep, so children are freed from a worklist
+    std::vector<Object*> pending(1, object);
+
+    while (!pending.empty()) {
+        Object* current = pending.back();
+        pending.pop_back();
+
+        StringObject* string = static_cast<StringObject*>(current);
+        for (StringObject* child : {string->left, string->right})
+            if (child != nullptr && !child->immortal && --child->refs == 0)
+                pending.push_back(child);
+
+        heap_freed(object_bytes(current));
+        std::free(current);
+    }
+}
+
+Value Value::string(const char* data, size_t size) {
+    if (size > SMALL_STRING_SIZE)
+        return Value::string(new_string_object(data, size));
+
+    Value result;
+    result.type = ValueTypes::STRING;
+    result.small_size = static_cast<unsigned char>(size);
+    std::memcpy(reinterpret_cast<char*>(&result) + 3, data, size);
+    return result;
+}
+
+size_t string_size(const Value& value) {
+    return value.is_small_string() ? value.small_size : value.string_value->size;
+}
+
+// calls write(data, size) for every piece of the string in order
+template <typename Write>
+static void for_each_piece(const Value& value, Write write) {
+    if (value.is_small_string())
+        return write(value.small_data(), value.small_size);
+
+    std::vector<StringObject*> pending(1, value.string_value);
+
+    while (!pending.empty()) {
+        StringObject* current = pending.back();
+        pending.pop_back();
+
+        if (current->is_flat()) {
+            write(current->data(), current->size);
+        } else if (current->right == nullptr) {
+            pending.push_back(current->left);
+        } else {
+            pending.push_back(current->right);
+            pending.push_back(current->left);
+        }
+    }
+}
+
+const char* string_data(const Value& value) {
+    if (value.is_small_string())
+        return value.small_data();
+
+    StringObject* object = value.string_value;
+
+    if (object->is_flat())
+        return object->data();
+    if (object->right == nullptr)
+        return object->left->data();
+
+    // the script picked the size like that of an array, the rope node
+    // already stands so refusing it here leaks nothing
+    heap_require(sizeof(StringObject) + object->size + 1);
+    StringObject* flat = allocate_string(object->size, true);
+    size_t offset = 0;
+    for_each_piece(value, [flat, &offset](const char* data, size_t size) {
+        std::memcpy(flat->data() + offset, data, size);
+        offset += size;
+    });
+    flat->data()[offset] = '\0';
+
+    release(object->left);
+    release(object->right);
+    object->left = flat;
+    object->right = nullptr;
+
+    return flat->data();
+}
+
+// a rope child has to be an object, small strings get one of their own
+static StringObject* as_object(const Value& value) {
+    if (value.is_small_string())
+        return new_string_object(value.small_data(), value.small_size);
+    retain(value.string_value);
+    return value.string_value;
+}
+
+Value isolate(const Value& value) {
+    if (!value.counted)
+        return value;
+
+    if (value.type == ValueTypes::BIG_INT)
+        return big_int(value.big_value->negative, value.big_value->limbs(), value.big_value->size);
+
+    if (value.type == ValueTypes::ARRAY)
+        return copy_array(value.array_value);
+
+    if (value.type == ValueTypes::MAP)
+        return copy_map(value.map_value, isolate);
+
+    return Value::string(string_data(value), string_size(value));
+}
+
+void freeze(const Value& value) {
+    if (value.type == ValueTypes::ARRAY)
+        value.array_value->frozen = true;
+
+    if (value.type == ValueTypes::MAP) {
+        value.map_value->frozen = true;
+        map_for_each(value.map_value, [](const Value&, const Value& inner) { freeze(inner); });
+    }
+}
+
+Value concat(const Value& left, const Value& right) {
+    // ropes never pass the cap and flat strings fit in memory, so the sum
+    // cannot wrap
+    size_t size = string_size(left) + string_size(right);
+    if (size > MAX_STRING_SIZE)
+        fail("INTERPRETER", "STRING_TOO_LARGE", "size = " + std::to_string(size));
+
+    if (size >= ROPE_MIN_SIZE) {
+        StringObject* node = allocate_string(size, false);
+        node->left = as_object(left);
+        node->right = as_object(right);
+        return Value::string(node);
+    }
+
+    char small[SMALL_STRING_SIZE];
+    StringObject* flat = nullptr;
+    char* out = small;
+    if (size > SMALL_STRING_SIZE) {
+        flat = allocate_string(size, true);
+        out = flat->data();
+        out[size] = '\0';
+    }
+
+    size_t offset = 0;
+    auto append = [out, &offset](const char* data, size_t size) {
+        std::memcpy(out + offset, data, size);
+        offset += size;
+    };
+    for_each_piece(left, append);
+    for_each_piece(right, append);
+
+    return flat != nullptr ? Value::string(flat) : Value::string(small, size);
+}
+
+void write_string(Output& out, const Value& value) {
+    for_each_piece(value, [&out](const char* data, size_t size) {
+        out.write(data, size);
+    });
+}
@@ -0,0 +1,106 @@
+#include "../src/lib/embed.hpp"
+#include "../src/lib/snapshot.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Contexts made from one loaded snapshot each see their own copy of the
+// globals it holds, whatever the others do to them. A file read that fails
+// only fails whoever awaits it, not the reads finishing along with it.
+//
+// usage: bask_embed_test image
+
+static int failures = 0;
+
+static void expect(const char* what, const RunResult& result, long expected) {
+    if (result.status != RunStatus::OK || result.value.type != ValueTypes::INT || result.value.int_value != expected) {
+        std::cerr << what << ": expected " << expected << ", got ";
+        if (result.status != RunStatus::OK)
+            std::cerr << "error " << result.error;
+        else if (result.value.type == ValueTypes::INT)
+            std::cerr << result.value.int_value;
+        else
+            std::cerr << "a value of type " << static_cast<int>(result.value.type);
+        std::cerr << "\n";
+        failures++;
+    }
+}
+
+const char* SOURCE =
+    "var counts = array_int(2);\n"
+    "var seen = {\"a\": 0};\n"
+    "func bump_array() {\n"
+    "    array_set(counts, 0, array_get(counts, 0) + 1);\n"
+    "    return array_get(counts, 0);\n"
+    "}\n"
+    "func bump_map() {\n"
+    "    map_set(seen, \"a\", map_get(seen, \"a\") + 1);\n"
+    "    map_set(seen, map_len(seen), 1);\n"
+    "    return map_get(seen, \"a\") * 100 + map_len(seen);\n"
+    "}\n"
+    "var good = 0;\n"
+    "async func read_both(ok, missing) {\n"
+    "    const bad = read_file_async(missing);\n"
+    "    good = read_file_async(ok);\n"
+    "    # long enough for both reads to finish in one poll\n"
+    "    var i = 0;\n"
+    "    while (i < 2000000) {\n"
+    "        i = i + 1;\n"
+    "    }\n"
+    "    return await bad;\n"
+    "}\n"
+    "async func read_good() {\n"
+    "    return await good;\n"
+    "}\n"
+    "func main() {\n"
+    "    return 0;\n"
+    "}\n";
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: bask_embed_test image\n";
+        return 2;
+    }
+    std::string image = argv[1];
+
+    Script compiled = Script::compile(SOURCE);
+    {
+        Interpreter interpreter(*compiled.program);
+        interpreter.initialize();
+        write_snapshot(image, *compiled.program, interpreter.global_values());
+    }
+
+    Script loaded = Script::load(image);
+    Context first(loaded);
+    Context second(loaded);
+
+    expect("first bump_array", first.call("bump_array"), 1);
+    expect("second bump_array", second.call("bump_array"), 1);
+    expect("first bump_array again", first.call("bump_array"), 2);
+    Context third(loaded);
+    expect("third bump_array", third.call("bump_array"), 1);
+
+    expect("first bump_map", first.call("bump_map"), 102);
+    expect("second bump_map", second.call("bump_map"), 102);
+    expect("first bump_map again", first.call("bump_map"), 203);
+    Context fourth(loaded);
+    expect("fourth bump_map", fourth.call("bump_map"), 102);
+
+    std::string missing = image + ".missing";
+    Value paths[] = {Value::string(argv[0], std::strlen(argv[0])), Value::string(missing.c_str(), missing.size())};
+    RunResult both = first.call("read_both", paths, 2);
+    if (both.status != RunStatus::ERROR || both.error.find("CANNOT_READ_FILE") == std::string::npos) {
+        std::cerr << "read_both: expected CANNOT_READ_FILE, got " << both.error << "\n";
+        failures++;
+    }
+    RunResult good = first.call("read_good");
+    if (good.status != RunStatus::OK || good.value.type != ValueTypes::STRING) {
+        std::cerr << "read_good: expected the file, got " << good.error << "\n";
+        failures++;
+    }
+
+    std::remove(image.c_str());
+    return failures == 0 ? 0 : 1;
+}